@@ -0,0 +1,231 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+/* Needed for posix_memalign() */
+#define _POSIX_C_SOURCE 200112L
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fecbufferpool.h"
+
+
+/*
+Each block starts with a header which points back to the pool; the buffer data
+follows the header. Blocks are allocated with 32-byte alignment (malloc only guarantees 16),
+and the header size keeps the data 32-byte aligned as well.
+While a block is in the free list, the trash stack link occupies the header instead.
+*/
+#define BLOCK_HEADER_SIZE 32
+#define BLOCK_ALIGNMENT 32
+
+
+typedef struct
+{
+	fec_buffer_pool *pool;
+}
+fec_buffer_pool_block_header;
+
+
+struct fec_buffer_pool_s
+{
+	guint block_size;
+
+	/* Free blocks; the trash stack link is stored in the block header */
+	GTrashStack *free_blocks;
+
+	/* One reference held by the owner, and one per block that is currently in use */
+	volatile gint refcount;
+
+	GMutex *mutex;
+
+	fec_buffer_pool_stats stats;
+};
+
+
+
+static guint8* fec_buffer_pool_allocate_block(fec_buffer_pool *pool);
+static void fec_buffer_pool_release_block(gpointer data);
+static void fec_buffer_pool_unref(fec_buffer_pool *pool);
+
+
+
+fec_buffer_pool* fec_buffer_pool_create(guint const block_size, guint const num_preallocated_blocks)
+{
+	guint i;
+	fec_buffer_pool *pool = malloc(sizeof(fec_buffer_pool));
+
+	pool->block_size = block_size;
+	pool->free_blocks = NULL;
+	pool->refcount = 1;
+	pool->mutex = g_mutex_new();
+	memset(&(pool->stats), 0, sizeof(fec_buffer_pool_stats));
+	pool->stats.block_size = block_size;
+
+	for (i = 0; i < num_preallocated_blocks; ++i)
+	{
+		guint8 *block = fec_buffer_pool_allocate_block(pool);
+		g_trash_stack_push(&(pool->free_blocks), block);
+		++pool->stats.num_free_blocks;
+	}
+
+	GST_DEBUG("Created buffer pool %p with %u preallocated blocks of %u bytes", pool, num_preallocated_blocks, block_size);
+
+	return pool;
+}
+
+
+void fec_buffer_pool_destroy(fec_buffer_pool *pool)
+{
+	/* Buffers still in flight keep the pool alive; it is freed once they are all released */
+	fec_buffer_pool_unref(pool);
+}
+
+
+static guint8* fec_buffer_pool_allocate_block(fec_buffer_pool *pool)
+{
+	void *block;
+	fec_buffer_pool_block_header *header;
+
+	if (posix_memalign(&block, BLOCK_ALIGNMENT, BLOCK_HEADER_SIZE + pool->block_size) != 0)
+		block = NULL;
+	assert(block != NULL);
+	header = (fec_buffer_pool_block_header*)block;
+	header->pool = pool;
+
+	++pool->stats.num_blocks;
+
+	return block;
+}
+
+
+static void fec_buffer_pool_unref(fec_buffer_pool *pool)
+{
+	if (!g_atomic_int_dec_and_test(&(pool->refcount)))
+		return;
+
+	/* Last reference is gone -> all blocks are in the free list */
+	assert(g_trash_stack_height(&(pool->free_blocks)) == pool->stats.num_blocks);
+
+	while (pool->free_blocks != NULL)
+		free(g_trash_stack_pop(&(pool->free_blocks)));
+
+	GST_DEBUG("Destroyed buffer pool %p", pool);
+
+	g_mutex_free(pool->mutex);
+	free(pool);
+}
+
+
+static void fec_buffer_pool_release_block(gpointer data)
+{
+	guint8 *block;
+	fec_buffer_pool *pool;
+
+	block = ((guint8*)data) - BLOCK_HEADER_SIZE;
+	pool = ((fec_buffer_pool_block_header*)block)->pool;
+
+	g_mutex_lock(pool->mutex);
+	g_trash_stack_push(&(pool->free_blocks), block);
+	++pool->stats.num_free_blocks;
+	g_mutex_unlock(pool->mutex);
+
+	fec_buffer_pool_unref(pool);
+}
+
+
+GstBuffer* fec_buffer_pool_acquire(fec_buffer_pool *pool, guint const size_in_bytes)
+{
+	guint8 *block;
+	GstBuffer *buffer;
+
+	g_mutex_lock(pool->mutex);
+
+	if (size_in_bytes > pool->block_size)
+	{
+		++pool->stats.num_oversized;
+		g_mutex_unlock(pool->mutex);
+		return NULL;
+	}
+
+	block = g_trash_stack_pop(&(pool->free_blocks));
+	if (block != NULL)
+	{
+		--pool->stats.num_free_blocks;
+		++pool->stats.num_hits;
+	}
+	else
+	{
+		block = fec_buffer_pool_allocate_block(pool);
+		++pool->stats.num_misses;
+		GST_DEBUG("Buffer pool %p is empty - allocated new block (%u blocks total)", pool, pool->stats.num_blocks);
+	}
+
+	g_mutex_unlock(pool->mutex);
+
+	/*
+	The header is overwritten by the trash stack link while the block is free,
+	so the pool pointer needs to be restored here
+	*/
+	((fec_buffer_pool_block_header*)block)->pool = pool;
+	g_atomic_int_inc(&(pool->refcount));
+
+	buffer = gst_buffer_new();
+	GST_BUFFER_MALLOCDATA(buffer) = block + BLOCK_HEADER_SIZE;
+	GST_BUFFER_FREE_FUNC(buffer) = fec_buffer_pool_release_block;
+	GST_BUFFER_DATA(buffer) = block + BLOCK_HEADER_SIZE;
+	GST_BUFFER_SIZE(buffer) = size_in_bytes;
+
+	return buffer;
+}
+
+
+guint fec_buffer_pool_get_block_size(fec_buffer_pool *pool)
+{
+	return pool->block_size;
+}
+
+
+void fec_buffer_pool_get_stats(fec_buffer_pool *pool, fec_buffer_pool_stats *stats)
+{
+	g_mutex_lock(pool->mutex);
+	*stats = pool->stats;
+	g_mutex_unlock(pool->mutex);
+}
+
+
+GstStructure* fec_buffer_pool_get_stats_structure(fec_buffer_pool *pool)
+{
+	fec_buffer_pool_stats stats;
+
+	fec_buffer_pool_get_stats(pool, &stats);
+
+	return gst_structure_new(
+		"pool-stats",
+		"block-size", G_TYPE_UINT, stats.block_size,
+		"blocks", G_TYPE_UINT, stats.num_blocks,
+		"free-blocks", G_TYPE_UINT, stats.num_free_blocks,
+		"hits", G_TYPE_UINT64, stats.num_hits,
+		"misses", G_TYPE_UINT64, stats.num_misses,
+		"oversized", G_TYPE_UINT64, stats.num_oversized,
+		NULL
+	);
+}
@@ -0,0 +1,67 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+#ifndef FECBUFFERPOOL_H
+#define FECBUFFERPOOL_H
+
+
+#include <gst/gst.h>
+
+
+/*
+Pool of fixed-size memory blocks for GstBuffers. Buffers acquired from the pool return their
+memory to it when their last reference is dropped (using the buffer's free function), so once
+the pool has grown to the number of buffers in flight, acquiring a buffer does not allocate
+any payload memory. The pool stays alive until the last of its buffers has been released.
+*/
+
+
+struct fec_buffer_pool_s;
+typedef struct fec_buffer_pool_s fec_buffer_pool;
+
+
+typedef struct
+{
+	guint block_size;
+	guint num_blocks;     /* number of blocks allocated so far */
+	guint num_free_blocks;
+	guint64 num_hits;     /* acquisitions served from the free list */
+	guint64 num_misses;   /* acquisitions that had to allocate a new block */
+	guint64 num_oversized; /* acquisitions that were larger than block_size (and failed) */
+}
+fec_buffer_pool_stats;
+
+
+fec_buffer_pool* fec_buffer_pool_create(guint const block_size, guint const num_preallocated_blocks);
+void fec_buffer_pool_destroy(fec_buffer_pool *pool);
+
+/* Returns NULL if size_in_bytes exceeds the block size; the caller must allocate the buffer by other means then */
+GstBuffer* fec_buffer_pool_acquire(fec_buffer_pool *pool, guint const size_in_bytes);
+
+guint fec_buffer_pool_get_block_size(fec_buffer_pool *pool);
+
+void fec_buffer_pool_get_stats(fec_buffer_pool *pool, fec_buffer_pool_stats *stats);
+GstStructure* fec_buffer_pool_get_stats_structure(fec_buffer_pool *pool);
+
+
+#endif
+
@@ -0,0 +1,494 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+#include <string.h>
+#include <openfec/lib_common/of_openfec_api.h>
+#include "feccore.h"
+
+
+#define FEC_CORE_READ16(data) ((uint16_t)((((uint16_t)((data)[0])) << 8) | (((uint16_t)((data)[1])) << 0)))
+#define FEC_CORE_READ24(data) ((((uint32_t)((data)[0])) << 16) | (((uint32_t)((data)[1])) << 8) | (((uint32_t)((data)[2])) << 0))
+#define FEC_CORE_READ32(data) ((((uint32_t)((data)[0])) << 24) | (((uint32_t)((data)[1])) << 16) | (((uint32_t)((data)[2])) << 8) | (((uint32_t)((data)[3])) << 0))
+
+
+/* Passed to the OpenFEC callback, which hands out the caller's memory for recovered packets */
+typedef struct
+{
+	uint8_t * const *recovered_packets;
+	unsigned int num_media_packets;
+}
+fec_core_decode_context;
+
+
+static int fec_core_initialized = 0;
+
+
+
+static void fec_core_write16(uint8_t *data, uint16_t const value)
+{
+	data[0] = (value >> 8) & 0xff;
+	data[1] = (value >> 0) & 0xff;
+}
+
+
+static void fec_core_write32(uint8_t *data, uint32_t const value)
+{
+	data[0] = (value >> 24) & 0xff;
+	data[1] = (value >> 16) & 0xff;
+	data[2] = (value >> 8) & 0xff;
+	data[3] = (value >> 0) & 0xff;
+}
+
+
+/*
+Returns the symbol of a media packet: the packet itself if it has the full symbol size, otherwise
+a zero-padded copy in the padding memory; returns NULL if the packet needs padding, but there is none
+*/
+static void* fec_core_get_media_symbol(struct iovec const *media_packet, unsigned int const index, size_t const symbol_size, uint8_t *padding)
+{
+	uint8_t *symbol;
+
+	if (media_packet->iov_len >= symbol_size)
+		return media_packet->iov_base;
+
+	if (padding == NULL)
+		return NULL;
+
+	symbol = padding + index * symbol_size;
+	memcpy(symbol, media_packet->iov_base, media_packet->iov_len);
+	memset(symbol + media_packet->iov_len, 0, symbol_size - media_packet->iov_len);
+
+	return symbol;
+}
+
+
+static fec_core_result fec_core_create_encoder_session(of_session_t **session, unsigned int const num_media_packets, unsigned int const num_fec_packets, size_t const symbol_size)
+{
+	of_rs_parameters_t of_params;
+
+	of_params.nb_source_symbols = num_media_packets;
+	of_params.nb_repair_symbols = num_fec_packets;
+	of_params.encoding_symbol_length = symbol_size;
+
+	if (of_create_codec_instance(session, OF_CODEC_REED_SOLOMON_GF_2_8_STABLE, OF_ENCODER, 0) != OF_STATUS_OK)
+		return FEC_CORE_ERROR_CODEC;
+
+	if (of_set_fec_parameters(*session, (of_parameters_t*)(&of_params)) != OF_STATUS_OK)
+	{
+		of_release_codec_instance(*session);
+		return FEC_CORE_ERROR_CODEC;
+	}
+
+	return FEC_CORE_OK;
+}
+
+
+fec_core_result fec_core_init(void)
+{
+	of_session_t *session;
+	fec_core_result result;
+
+	if (fec_core_initialized)
+		return FEC_CORE_OK;
+
+	/* Setting up the first RS session initializes the GF tables, which all later sessions share */
+	result = fec_core_create_encoder_session(&session, 1, 1, 1);
+	if (result != FEC_CORE_OK)
+		return result;
+	of_release_codec_instance(session);
+
+	fec_core_initialized = 1;
+	return FEC_CORE_OK;
+}
+
+
+fec_core_result fec_core_encoder_cache_prepare(fec_core_encoder_cache *cache, unsigned int const num_media_packets, unsigned int const num_fec_packets, size_t const symbol_size)
+{
+	of_session_t *session;
+	fec_core_result result;
+
+	/*
+	The repair symbols of the RS code do not depend on how many of them there are, so a session for
+	more repair symbols also serves blocks whose number of FEC packets was limited. Decoders rely on
+	the same property, since they always decode with the full number of repair symbols.
+	*/
+	if ((cache->session != NULL) && (cache->num_media_packets == num_media_packets) && (cache->num_fec_packets >= num_fec_packets) && (cache->symbol_size == symbol_size))
+		return FEC_CORE_OK;
+
+	if ((num_media_packets == 0) || (num_media_packets > FEC_CORE_MAX_MEDIA_PACKETS) || (num_fec_packets == 0) || ((num_media_packets + num_fec_packets) > FEC_CORE_MAX_SYMBOLS) || (symbol_size == 0) || (symbol_size > 0xffff))
+		return FEC_CORE_ERROR_INVALID_ARGUMENT;
+
+	result = fec_core_create_encoder_session(&session, num_media_packets, num_fec_packets, symbol_size);
+	if (result != FEC_CORE_OK)
+		return result;
+
+	fec_core_encoder_cache_clear(cache);
+	cache->session = session;
+	cache->num_media_packets = num_media_packets;
+	cache->num_fec_packets = num_fec_packets;
+	cache->symbol_size = symbol_size;
+
+	return FEC_CORE_OK;
+}
+
+
+void fec_core_encoder_cache_clear(fec_core_encoder_cache *cache)
+{
+	if (cache->session != NULL)
+		of_release_codec_instance(cache->session);
+
+	cache->session = NULL;
+	cache->num_media_packets = 0;
+	cache->num_fec_packets = 0;
+	cache->symbol_size = 0;
+}
+
+
+size_t fec_core_get_rtp_header_size(uint8_t const *packet, size_t const size)
+{
+	size_t header_size;
+
+	if ((size < FEC_CORE_RTP_HEADER_SIZE) || ((packet[0] >> 6) != 2))
+		return 0;
+
+	header_size = FEC_CORE_RTP_HEADER_SIZE + (packet[0] & 0x0f) * 4;
+
+	/* Header extension: 16 bit profile-defined field, 16 bit length in 32-bit words */
+	if (packet[0] & 0x10)
+	{
+		if (size < (header_size + 4))
+			return 0;
+		header_size += 4 + FEC_CORE_READ16(packet + header_size + 2) * 4;
+	}
+
+	return (header_size <= size) ? header_size : 0;
+}
+
+
+size_t fec_core_get_fec_packet_size(fec_core_encode_params const *params)
+{
+	size_t member_table_size = (params->member_ssrcs != NULL) ? (params->num_media_packets * FEC_CORE_JOINT_MEMBER_SIZE) : 0;
+	/* +1 to make room for the FEC packet index byte */
+	return FEC_CORE_RTP_HEADER_SIZE + FEC_CORE_FEC_HEADER_SIZE + 1 + member_table_size + params->symbol_size;
+}
+
+
+fec_core_result fec_core_encode(fec_core_encode_params const *params, struct iovec const *media_packets, uint8_t * const *fec_packets, uint8_t *padding)
+{
+	void *encoding_symbol_tab[FEC_CORE_MAX_SYMBOLS];
+	uint32_t mask;
+	size_t member_table_size;
+	unsigned int i, num_symbols;
+	int joint;
+
+	num_symbols = params->num_media_packets + params->num_fec_packets;
+	joint = (params->member_ssrcs != NULL) && (params->member_seqnums != NULL);
+
+	if ((params->num_media_packets == 0) || (params->num_media_packets > FEC_CORE_MAX_MEDIA_PACKETS) || (params->num_fec_packets == 0) || (num_symbols > FEC_CORE_MAX_SYMBOLS) || (params->symbol_size == 0) || (params->symbol_size > 0xffff))
+		return FEC_CORE_ERROR_INVALID_ARGUMENT;
+	if (params->xor_mode && (params->num_fec_packets != 1))
+		return FEC_CORE_ERROR_INVALID_ARGUMENT;
+
+	for (i = 0; i < params->num_media_packets; ++i)
+	{
+		if (media_packets[i].iov_len > params->symbol_size)
+			return FEC_CORE_ERROR_INVALID_ARGUMENT;
+	}
+
+	mask = (1ul << params->num_media_packets) - 1;
+	member_table_size = joint ? (params->num_media_packets * FEC_CORE_JOINT_MEMBER_SIZE) : 0;
+
+	for (i = 0; i < params->num_fec_packets; ++i)
+	{
+		uint8_t *fec_packet = fec_packets[i];
+		uint8_t *fec_data = fec_packet + FEC_CORE_RTP_HEADER_SIZE;
+
+		/* RTP header: version 2, no padding, no extension, no CSRCs, no marker */
+		fec_packet[0] = 0x80;
+		fec_packet[1] = params->payload_type & 0x7f;
+		fec_core_write16(fec_packet + 2, (params->fec_seqnum + i) & 0xffff);
+		fec_core_write32(fec_packet + 4, params->timestamp);
+		fec_core_write32(fec_packet + 8, params->ssrc);
+
+		/*  FEC header:
+		 *   0                   1                   2                   3
+		 *   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+		 *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+		 *  |      SN base                  |        length recovery        |
+		 *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+		 *  |E| PT recovery |                 mask                          |
+		 *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+		 *  |                          TS recovery                          |
+		 *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+		 */
+
+		fec_core_write16(fec_data + 0, params->snbase);
+		fec_core_write16(fec_data + 2, params->symbol_size);
+		/* E bit: the member table follows the index byte */
+		fec_data[4] = (params->pt_recovery & 0x7f) | (joint ? 0x80 : 0x00);
+		fec_data[5] = (mask >> 16) & 0xff;
+		fec_data[6] = (mask >> 8) & 0xff;
+		fec_data[7] = (mask >> 0) & 0xff;
+		fec_core_write32(fec_data + 8, params->timestamp);
+
+		fec_data[12] = params->xor_mode ? FEC_CORE_XOR_INDEX : i;
+
+		if (joint)
+		{
+			uint8_t *member = fec_data + FEC_CORE_FEC_HEADER_SIZE + 1;
+			unsigned int j;
+
+			for (j = 0; j < params->num_media_packets; ++j)
+			{
+				fec_core_write32(member, params->member_ssrcs[j]);
+				fec_core_write16(member + 4, params->member_seqnums[j]);
+				/* The length recovery field only gives the symbol size; the members of a joint block differ in size */
+				fec_core_write16(member + 6, media_packets[j].iov_len);
+				member += FEC_CORE_JOINT_MEMBER_SIZE;
+			}
+		}
+
+		/*
+		The payload OpenFEC shall write to lies beyond the FEC header (12 byte), the index byte,
+		and the member table (if any)
+		*/
+		encoding_symbol_tab[i + params->num_media_packets] = fec_data + FEC_CORE_FEC_HEADER_SIZE + 1 + member_table_size;
+	}
+
+	if (params->xor_mode)
+	{
+		uint8_t *parity = encoding_symbol_tab[params->num_media_packets];
+
+		/* Shorter packets are implicitly zero-padded, so only their actual bytes are XORed in */
+		memset(parity, 0, params->symbol_size);
+		for (i = 0; i < params->num_media_packets; ++i)
+		{
+			uint8_t const *data = media_packets[i].iov_base;
+			size_t j;
+
+			for (j = 0; j < media_packets[i].iov_len; ++j)
+				parity[j] ^= data[j];
+		}
+	}
+	else
+	{
+		of_session_t *session;
+		fec_core_result result;
+
+		for (i = 0; i < params->num_media_packets; ++i)
+		{
+			encoding_symbol_tab[i] = fec_core_get_media_symbol(&(media_packets[i]), i, params->symbol_size, padding);
+			if (encoding_symbol_tab[i] == NULL)
+				return FEC_CORE_ERROR_INVALID_ARGUMENT;
+		}
+
+		if (params->encoder_cache != NULL)
+		{
+			result = fec_core_encoder_cache_prepare(params->encoder_cache, params->num_media_packets, params->num_fec_packets, params->symbol_size);
+			session = params->encoder_cache->session;
+		}
+		else
+			result = fec_core_create_encoder_session(&session, params->num_media_packets, params->num_fec_packets, params->symbol_size);
+
+		if (result != FEC_CORE_OK)
+			return result;
+
+		/* A cached session may cover more repair symbols than this block has; only the first num_fec_packets are built */
+		for (i = 0; (result == FEC_CORE_OK) && (i < params->num_fec_packets); ++i)
+		{
+			if (of_build_repair_symbol(session, encoding_symbol_tab, i + params->num_media_packets) != OF_STATUS_OK)
+				result = FEC_CORE_ERROR_CODEC;
+		}
+
+		if (params->encoder_cache == NULL)
+			of_release_codec_instance(session);
+
+		return result;
+	}
+
+	return FEC_CORE_OK;
+}
+
+
+fec_core_result fec_core_parse_fec_packet(uint8_t const *packet, size_t const size, fec_core_fec_packet_info *info)
+{
+	size_t header_size, offset;
+	uint8_t const *fec_data;
+	uint32_t mask;
+
+	header_size = fec_core_get_rtp_header_size(packet, size);
+	if ((header_size == 0) || (size < (header_size + FEC_CORE_FEC_HEADER_SIZE + 1)))
+		return FEC_CORE_ERROR_INVALID_PACKET;
+
+	info->seqnum = FEC_CORE_READ16(packet + 2);
+	info->ssrc = FEC_CORE_READ32(packet + 8);
+
+	fec_data = packet + header_size;
+	info->snbase = FEC_CORE_READ16(fec_data + 0);
+	info->length_recovery = FEC_CORE_READ16(fec_data + 2);
+	info->extended = (fec_data[4] & 0x80) != 0;
+	info->pt_recovery = fec_data[4] & 0x7f;
+	info->mask = FEC_CORE_READ24(fec_data + 5);
+	info->ts_recovery = FEC_CORE_READ32(fec_data + 8);
+	info->index = fec_data[12];
+
+	/* The mask covers the media packets of the block, which are consecutive starting at snbase */
+	for (info->num_media_packets = 0, mask = info->mask; (mask & 1) != 0; mask >>= 1)
+		++info->num_media_packets;
+	if (mask != 0)
+		info->num_media_packets = 0;
+
+	offset = header_size + FEC_CORE_FEC_HEADER_SIZE + 1;
+	if (info->extended)
+	{
+		if (size < (offset + info->num_media_packets * FEC_CORE_JOINT_MEMBER_SIZE))
+			return FEC_CORE_ERROR_INVALID_PACKET;
+		info->member_table = packet + offset;
+		offset += info->num_media_packets * FEC_CORE_JOINT_MEMBER_SIZE;
+	}
+	else
+		info->member_table = NULL;
+
+	info->repair_symbol = packet + offset;
+	info->repair_symbol_size = size - offset;
+
+	return FEC_CORE_OK;
+}
+
+
+void fec_core_read_joint_member(uint8_t const *member_table, unsigned int const index, uint32_t *ssrc, uint16_t *seqnum, uint16_t *length)
+{
+	uint8_t const *member = member_table + index * FEC_CORE_JOINT_MEMBER_SIZE;
+	if (ssrc != NULL)
+		*ssrc = FEC_CORE_READ32(member + 0);
+	if (seqnum != NULL)
+		*seqnum = FEC_CORE_READ16(member + 4);
+	if (length != NULL)
+		*length = FEC_CORE_READ16(member + 6);
+}
+
+
+static void* fec_core_source_packet_cb(void *context, UINT32 size, UINT32 esi)
+{
+	fec_core_decode_context *decode_context = context;
+
+	size = size; /* shut up compiler warning about unused argument */
+
+	/* OpenFEC only calls this for the source symbols it recovers, which are the missing media packets */
+	return (esi < decode_context->num_media_packets) ? decode_context->recovered_packets[esi] : NULL;
+}
+
+
+fec_core_result fec_core_decode(fec_core_decode_params const *params, struct iovec const *media_packets, uint8_t const * const *repair_symbols, uint8_t * const *recovered_packets, uint8_t *padding)
+{
+	void *encoding_symbol_tab[FEC_CORE_MAX_SYMBOLS];
+	of_session_t *session;
+	of_rs_parameters_t of_params;
+	fec_core_decode_context decode_context;
+	fec_core_result result = FEC_CORE_OK;
+	unsigned int i, num_symbols;
+
+	num_symbols = params->num_media_packets + params->num_fec_packets;
+	if ((params->num_media_packets == 0) || (params->num_media_packets > FEC_CORE_MAX_MEDIA_PACKETS) || (num_symbols > FEC_CORE_MAX_SYMBOLS) || (params->symbol_size == 0))
+		return FEC_CORE_ERROR_INVALID_ARGUMENT;
+
+	for (i = 0; i < params->num_media_packets; ++i)
+	{
+		if (media_packets[i].iov_base == NULL)
+		{
+			if (recovered_packets[i] == NULL)
+				return FEC_CORE_ERROR_INVALID_ARGUMENT;
+			encoding_symbol_tab[i] = NULL;
+		}
+		else
+		{
+			/* Packets longer than the symbol size cannot have been encoded with it; only their start is used */
+			encoding_symbol_tab[i] = fec_core_get_media_symbol(&(media_packets[i]), i, params->symbol_size, padding);
+			if (encoding_symbol_tab[i] == NULL)
+				return FEC_CORE_ERROR_INVALID_ARGUMENT;
+		}
+	}
+
+	for (i = 0; i < params->num_fec_packets; ++i)
+		encoding_symbol_tab[i + params->num_media_packets] = (void *)(repair_symbols[i]);
+
+	decode_context.recovered_packets = recovered_packets;
+	decode_context.num_media_packets = params->num_media_packets;
+
+	of_params.nb_source_symbols = params->num_media_packets;
+	of_params.nb_repair_symbols = params->num_fec_packets;
+	of_params.encoding_symbol_length = params->symbol_size;
+
+	if (of_create_codec_instance(&session, OF_CODEC_REED_SOLOMON_GF_2_8_STABLE, OF_DECODER, 0) != OF_STATUS_OK)
+		return FEC_CORE_ERROR_CODEC;
+
+	if ((of_set_fec_parameters(session, (of_parameters_t*)(&of_params)) != OF_STATUS_OK) || (of_set_callback_functions(session, fec_core_source_packet_cb, NULL, &decode_context) != OF_STATUS_OK))
+		result = FEC_CORE_ERROR_CODEC;
+
+	for (i = 0; (result == FEC_CORE_OK) && (i < num_symbols); ++i)
+	{
+		if (encoding_symbol_tab[i] != NULL)
+			of_decode_with_new_symbol(session, encoding_symbol_tab[i], i);
+	}
+
+	if (result == FEC_CORE_OK)
+	{
+		if (!of_is_decoding_complete(session))
+			of_finish_decoding(session);
+		if (!of_is_decoding_complete(session))
+			result = FEC_CORE_ERROR_NOT_RECOVERED;
+	}
+
+	of_release_codec_instance(session);
+
+	return result;
+}
+
+
+fec_core_result fec_core_decode_xor(fec_core_decode_params const *params, struct iovec const *media_packets, uint8_t const *parity_symbol, uint8_t *recovered_packet)
+{
+	unsigned int i;
+
+	if ((params->num_media_packets == 0) || (params->num_media_packets > FEC_CORE_MAX_MEDIA_PACKETS) || (params->symbol_size == 0))
+		return FEC_CORE_ERROR_INVALID_ARGUMENT;
+
+	/* The parity covers the media packets zero-padded to the symbol size */
+	memcpy(recovered_packet, parity_symbol, params->symbol_size);
+
+	for (i = 0; i < params->num_media_packets; ++i)
+	{
+		uint8_t const *data = media_packets[i].iov_base;
+		size_t j, size;
+
+		if (data == NULL)
+			continue;
+
+		size = (media_packets[i].iov_len < params->symbol_size) ? media_packets[i].iov_len : params->symbol_size;
+		for (j = 0; j < size; ++j)
+			recovered_packet[j] ^= data[j];
+	}
+
+	return FEC_CORE_OK;
+}
@@ -0,0 +1,222 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+#ifndef FECCORE_H
+#define FECCORE_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+
+/*
+GStreamer-independent FEC core. This is the wire format and the codec math of the RTP FEC scheme,
+without any block bookkeeping: the caller collects the packets of a block, and passes them in as
+raw pointers (struct iovec for media packets, one packet per entry). All output goes to memory
+the caller provides, and the core neither allocates memory nor depends on GLib, so it can be
+embedded into packet forwarders that do not use GStreamer. The only allocations are the ones
+OpenFEC makes for its codec sessions. fec_core_init() must be called once before the core is used.
+
+fec_enc, fec_dec and fec_joint_dec are wrappers around this core that take care of the blocks,
+the GstBuffer handling, statistics and tracing.
+
+Media packets are protected as whole RTP packets, zero-padded to the symbol size (the size of the
+largest media packet of the block). Packets that are shorter than the symbol size are copied into
+padding memory (symbol_size bytes per media packet) given by the caller; if no packet of a block
+is shorter, the padding memory may be NULL.
+
+FEC packet layout:
+  RTP header (12 bytes, no CSRCs, no extension)
+  FEC header (12 bytes: snbase, length recovery, E bit + PT recovery, mask, TS recovery)
+  index byte (repair symbol index, or FEC_CORE_XOR_INDEX)
+  member table (joint blocks only: SSRC, seqnum and length per media packet, FEC_CORE_JOINT_MEMBER_SIZE bytes each)
+  repair symbol (symbol size bytes)
+*/
+
+
+#define FEC_CORE_RTP_HEADER_SIZE 12
+#define FEC_CORE_FEC_HEADER_SIZE 12
+
+/* The mask in the FEC header has 24 bits */
+#define FEC_CORE_MAX_MEDIA_PACKETS 24
+/* RS over GF(2^8) supports up to 255 symbols per block */
+#define FEC_CORE_MAX_SYMBOLS 255
+
+#define FEC_CORE_JOINT_MEMBER_SIZE 8
+#define FEC_CORE_XOR_INDEX 0xFF
+
+
+typedef enum
+{
+	FEC_CORE_OK = 0,
+	FEC_CORE_ERROR_INVALID_ARGUMENT,
+	FEC_CORE_ERROR_INVALID_PACKET,
+	FEC_CORE_ERROR_CODEC,
+	FEC_CORE_ERROR_NOT_RECOVERED
+}
+fec_core_result;
+
+
+/*
+Keeps an OpenFEC RS encoder session across blocks. Creating a session builds the RS generator matrix
+of the block geometry, which costs more than encoding a small block; blocks with the same number of
+media packets and the same symbol size (typical for constant-size packets like MPEG-TS over RTP)
+reuse the session instead. Zero-initialize the cache before its first use, and release it with
+fec_core_encoder_cache_clear(). A cache must not be used by several threads at the same time.
+*/
+typedef struct
+{
+	void *session;
+	unsigned int num_media_packets;
+	unsigned int num_fec_packets;
+	size_t symbol_size;
+}
+fec_core_encoder_cache;
+
+
+typedef struct
+{
+	unsigned int num_media_packets;
+	unsigned int num_fec_packets;
+	size_t symbol_size;
+
+	/* If not NULL, the RS encoder session is taken from (and kept in) this cache */
+	fec_core_encoder_cache *encoder_cache;
+
+	/* RTP header fields of the FEC packets; the FEC packets get consecutive seqnums, starting at fec_seqnum */
+	uint32_t ssrc;
+	uint32_t timestamp;
+	uint16_t fec_seqnum;
+	uint8_t payload_type;
+
+	/* FEC header fields */
+	uint16_t snbase;
+	uint8_t pt_recovery;
+
+	/* If nonzero, a single XOR parity packet is generated, and num_fec_packets must be 1 */
+	int xor_mode;
+
+	/* Joint blocks only (NULL otherwise): SSRC and seqnum of every media packet, in block order */
+	uint32_t const *member_ssrcs;
+	uint16_t const *member_seqnums;
+}
+fec_core_encode_params;
+
+
+typedef struct
+{
+	/* Number of media packets of the block, as given by the mask */
+	unsigned int num_media_packets;
+	/* Number of repair symbols the encoder generates per block */
+	unsigned int num_fec_packets;
+	size_t symbol_size;
+}
+fec_core_decode_params;
+
+
+/* The fields of a parsed FEC packet; the pointers point into the packet */
+typedef struct
+{
+	uint16_t seqnum;
+	uint32_t ssrc;
+
+	uint16_t snbase;
+	uint16_t length_recovery;
+	int extended;
+	uint8_t pt_recovery;
+	uint32_t mask;
+	uint32_t ts_recovery;
+	uint8_t index;
+
+	/* Number of media packets covered by the mask; 0 if the mask does not cover consecutive packets starting at snbase */
+	unsigned int num_media_packets;
+
+	/* Only set if extended is nonzero; num_media_packets entries */
+	uint8_t const *member_table;
+
+	uint8_t const *repair_symbol;
+	size_t repair_symbol_size;
+}
+fec_core_fec_packet_info;
+
+
+/*
+Initializes the process-wide codec state, which is the GF(2^8) tables of OpenFEC. OpenFEC sets them up
+without locking when the first codec session of the process is created, so otherwise the first block
+of the first stream pays for it, and two streaming threads getting there at the same time race.
+Call this once before any other thread uses the core; further calls do nothing.
+*/
+fec_core_result fec_core_init(void);
+
+/*
+Makes sure the cache holds an encoder session that can encode blocks with the given geometry and
+symbol size, and creates one if necessary. fec_core_encode() does this by itself; calling it in
+advance moves the session setup out of the first block.
+*/
+fec_core_result fec_core_encoder_cache_prepare(fec_core_encoder_cache *cache, unsigned int const num_media_packets, unsigned int const num_fec_packets, size_t const symbol_size);
+void fec_core_encoder_cache_clear(fec_core_encoder_cache *cache);
+
+/* Returns the size of the RTP header including CSRCs and extension, or 0 if the packet is no valid RTP packet */
+size_t fec_core_get_rtp_header_size(uint8_t const *packet, size_t const size);
+
+/* Returns the size in bytes of each FEC packet of a block encoded with the given parameters */
+size_t fec_core_get_fec_packet_size(fec_core_encode_params const *params);
+
+/*
+Generates the FEC packets of a block. media_packets has params->num_media_packets entries, none of them
+larger than params->symbol_size. fec_packets has params->num_fec_packets entries, each pointing to
+fec_core_get_fec_packet_size() bytes; the whole packets are written, including their RTP headers.
+*/
+fec_core_result fec_core_encode(fec_core_encode_params const *params, struct iovec const *media_packets, uint8_t * const *fec_packets, uint8_t *padding);
+
+/*
+Parses an FEC packet. Only the structure of the packet is checked; the caller decides whether the
+packet fits the block geometry it expects.
+*/
+fec_core_result fec_core_parse_fec_packet(uint8_t const *packet, size_t const size, fec_core_fec_packet_info *info);
+
+/* Reads the SSRC, seqnum and packet length of the member with the given block index from the member table of a joint FEC packet; any output may be NULL */
+void fec_core_read_joint_member(uint8_t const *member_table, unsigned int const index, uint32_t *ssrc, uint16_t *seqnum, uint16_t *length);
+
+/*
+Recovers the missing media packets of an RS block. media_packets has params->num_media_packets entries
+in block order, with iov_base NULL for missing packets; repair_symbols has params->num_fec_packets
+entries, indexed by the FEC packet index, with NULL for missing FEC packets. For every missing media
+packet, recovered_packets must point to params->symbol_size bytes, which receive the recovered packet
+(zero-padded to the symbol size); the other entries are ignored. Returns FEC_CORE_ERROR_NOT_RECOVERED
+if too few symbols are present; the recovered packets are undefined then.
+*/
+fec_core_result fec_core_decode(fec_core_decode_params const *params, struct iovec const *media_packets, uint8_t const * const *repair_symbols, uint8_t * const *recovered_packets, uint8_t *padding);
+
+/*
+Recovers the missing media packet of an XOR block, which must be the only missing one; parity_symbol
+and recovered_packet have params->symbol_size bytes. Entries with iov_base NULL in media_packets are skipped.
+*/
+fec_core_result fec_core_decode_xor(fec_core_decode_params const *params, struct iovec const *media_packets, uint8_t const *parity_symbol, uint8_t *recovered_packet);
+
+
+#endif
+
@@ -22,12 +22,40 @@
 
 #include <assert.h>
 #include <string.h>
-#include <openfec/lib_common/of_openfec_api.h>
 #include <gst/rtp/gstrtpbuffer.h>
+#include "fecenc.h"
 #include "fecdec.h"
+#include "feccore.h"
+#include "fectrace.h"
 
+/* Alignment of the symbols in the symbol arena; 32 byte is enough for AVX2 loads and stores */
+#define SYMBOL_ARENA_ALIGNMENT 32
 
-#define RTP_FEC_HEADER_SIZE 12
+#define ALIGN_SYMBOL_SIZE(size) (((size) + SYMBOL_ARENA_ALIGNMENT - 1) & ~((guint)(SYMBOL_ARENA_ALIGNMENT - 1)))
+#define ALIGN_SYMBOL_POINTER(ptr) ((guint8*)((((guintptr)(ptr)) + SYMBOL_ARENA_ALIGNMENT - 1) & ~((guintptr)(SYMBOL_ARENA_ALIGNMENT - 1))))
+
+/* Number of media packets kept by the decoder: the current block, and the one following it */
+#define FEC_DEC_MEDIA_WINDOW(dec) ((dec)->num_media_packets * 2)
+
+
+/*
+A media packet held by the decoder. The packet is either kept by reference (the default),
+or copied into the slot's symbol in the arena, in which case buffer is NULL.
+The link is embedded so that queueing a slot does not allocate anything.
+*/
+typedef struct
+{
+	GList link;
+	GstBuffer *buffer;
+	guint8 *data;
+	guint size;
+	guint16 seqnum;
+	guint8 *arena_symbol;
+	GstClockTime timestamp;
+	/* System time at which the packet arrived; only set if statistics are collected */
+	GstClockTime arrival_time;
+}
+fec_dec_media_slot;
 
 
 struct fec_dec_s
@@ -37,12 +65,62 @@ struct fec_dec_s
 
 	guint max_packet_size;
 
+	/*
+	Media packet slots. The media window spans two blocks, since the FEC packets of a block may
+	arrive while the media packets of the next one come in (for example with paced FEC packets);
+	there is one slot more than the window, since a packet is pushed into the queue before the
+	oldest one is purged.
+	*/
+	fec_dec_media_slot *media_slots;
+	fec_dec_media_slot **free_media_slots;
+	guint num_media_slots, num_free_media_slots;
+
+	/*
+	Symbol arena; one contiguous, aligned block of memory with one symbol per media slot.
+	It is allocated once and only grows if a packet larger than arena_symbol_size arrives.
+	arena_symbol_size is the aligned stride; max_symbol_size is the configured size it starts from.
+	*/
+	gboolean use_symbol_arena;
+	guint max_symbol_size;
+	guint arena_symbol_size;
+	guint8 *arena_memory;
+
+	/* Zero-padded copies of the referenced media packets that are shorter than the symbol size */
+	guint8 *padding;
+	guint padding_size;
+
 	create_buffer_function create_buffer;
 	void *create_buffer_data;
 
+	fec_dec_recover_filter_function recover_filter;
+	void *recover_filter_data;
+
+	fec_dec_unrecoverable_function unrecoverable;
+	void *unrecoverable_data;
+
+	/* first_fec_arrival_time is the system time at which the first FEC packet of the current block arrived */
+	fec_dec_stats *stats;
+	GstClockTime first_fec_arrival_time;
+
 	guint cur_snbase, blacklisted_snbase;
 	gboolean has_snbase;
 
+	/* Expected snbase of the block following the last finished one; blocks of one stream are consecutive */
+	guint next_snbase;
+	gboolean has_next_snbase;
+
+	/*
+	Media packets received for the block at next_snbase; the media packet window may already have dropped
+	them by the time this block turns out to be unrecoverable, so they are tracked separately
+	*/
+	guint32 next_block_received_mask;
+
+	/*
+	Number of media packets in the current block, as given by the mask of its FEC packets;
+	blocks may be smaller than num_media_packets (see fec_enc_push_keyframe_packet())
+	*/
+	guint block_num_media_packets;
+
 	GQueue *media_packets;
 	GQueue *fec_packets;
 	GQueue *recovered_packets;
@@ -62,7 +140,7 @@ static void fec_dec_cleanup(fec_dec *dec);
 static void fec_dec_check_state(fec_dec *dec);
 static gboolean fec_dec_all_media_packets_present(fec_dec *dec);
 static gboolean fec_dec_can_recover_packets(fec_dec *dec);
-static void fec_dec_recover_packets(fec_dec *dec);
+static fec_core_result fec_dec_recover_packets(fec_dec *dec);
 
 
 
@@ -73,15 +151,214 @@ static void custom_hash_table_add(GHashTable *hash_table, gpointer key)
 
 
 
+static void fec_dec_allocate_arena(fec_dec *dec, guint const symbol_size)
+{
+	guint8 *arena_memory, *arena;
+	guint i, stride;
+
+	stride = ALIGN_SYMBOL_SIZE(symbol_size);
+	arena_memory = malloc(stride * dec->num_media_slots + SYMBOL_ARENA_ALIGNMENT - 1);
+	arena = ALIGN_SYMBOL_POINTER(arena_memory);
+
+	/* Slots that are in use keep their contents; this only happens if the arena has to grow */
+	for (i = 0; i < dec->num_media_slots; ++i)
+	{
+		fec_dec_media_slot *slot = &(dec->media_slots[i]);
+		slot->arena_symbol = arena + i * stride;
+
+		if ((slot->data != NULL) && (slot->buffer == NULL))
+		{
+			memcpy(slot->arena_symbol, slot->data, slot->size);
+			slot->data = slot->arena_symbol;
+		}
+	}
+
+	free(dec->arena_memory);
+	dec->arena_memory = arena_memory;
+	dec->arena_symbol_size = stride;
+
+	GST_DEBUG("Allocated symbol arena with %u symbols of %u bytes", dec->num_media_slots, stride);
+}
+
+
+static void fec_dec_allocate_padding(fec_dec *dec, guint const padding_size)
+{
+	free(dec->padding);
+	dec->padding = malloc(padding_size);
+	dec->padding_size = padding_size;
+}
+
+
+static void fec_dec_allocate_media_slots(fec_dec *dec)
+{
+	guint i;
+
+	/* All slots must be free at this point; this is called only after a reset */
+	assert(dec->num_free_media_slots == dec->num_media_slots);
+
+	free(dec->media_slots);
+	free(dec->free_media_slots);
+	free(dec->arena_memory);
+	dec->arena_memory = NULL;
+
+	dec->num_media_slots = FEC_DEC_MEDIA_WINDOW(dec) + 1;
+	dec->media_slots = malloc(sizeof(fec_dec_media_slot) * dec->num_media_slots);
+	dec->free_media_slots = malloc(sizeof(fec_dec_media_slot*) * dec->num_media_slots);
+	memset(dec->media_slots, 0, sizeof(fec_dec_media_slot) * dec->num_media_slots);
+
+	for (i = 0; i < dec->num_media_slots; ++i)
+	{
+		dec->media_slots[i].link.data = &(dec->media_slots[i]);
+		dec->free_media_slots[i] = &(dec->media_slots[i]);
+	}
+	dec->num_free_media_slots = dec->num_media_slots;
+
+	/*
+	Without the arena, the core zero-pads shorter media packets in the padding memory, so it is
+	preallocated for the max symbol size, and the first recovery does not have to allocate it
+	*/
+	if (dec->use_symbol_arena)
+		fec_dec_allocate_arena(dec, dec->max_symbol_size);
+	else if ((dec->num_media_packets * dec->max_symbol_size) > dec->padding_size)
+		fec_dec_allocate_padding(dec, dec->num_media_packets * dec->max_symbol_size);
+}
+
+
+static fec_dec_media_slot* fec_dec_acquire_media_slot(fec_dec *dec, GstBuffer *packet, guint16 const seqnum)
+{
+	fec_dec_media_slot *slot;
+
+	assert(dec->num_free_media_slots > 0);
+	slot = dec->free_media_slots[--dec->num_free_media_slots];
+
+	slot->size = GST_BUFFER_SIZE(packet);
+	slot->seqnum = seqnum;
+	slot->timestamp = GST_BUFFER_TIMESTAMP(packet);
+	slot->arrival_time = (dec->stats != NULL) ? gst_util_get_timestamp() : GST_CLOCK_TIME_NONE;
+
+	if (dec->use_symbol_arena)
+	{
+		if (slot->size > dec->arena_symbol_size)
+		{
+			GST_DEBUG("Packet with %u bytes does not fit in the symbol arena - growing it", slot->size);
+			fec_dec_allocate_arena(dec, slot->size);
+		}
+
+		/*
+		Copy the packet once, and release the reference right away (by not taking one),
+		so the packet stays writable for downstream elements
+		*/
+		memcpy(slot->arena_symbol, GST_BUFFER_DATA(packet), slot->size);
+		slot->data = slot->arena_symbol;
+		slot->buffer = NULL;
+	}
+	else
+	{
+		slot->buffer = gst_buffer_ref(packet);
+		slot->data = GST_BUFFER_DATA(packet);
+	}
+
+	return slot;
+}
+
+
+static void fec_dec_release_media_slot(fec_dec *dec, fec_dec_media_slot *slot)
+{
+	if (slot->buffer != NULL)
+		gst_buffer_unref(slot->buffer);
+
+	slot->buffer = NULL;
+	slot->data = NULL;
+	dec->free_media_slots[dec->num_free_media_slots++] = slot;
+}
+
+
+static void fec_dec_push_media_slot(fec_dec *dec, GstBuffer *packet, guint16 const seqnum)
+{
+	fec_dec_media_slot *slot = fec_dec_acquire_media_slot(dec, packet, seqnum);
+	g_queue_push_tail_link(dec->media_packets, &(slot->link));
+}
+
+
+static void fec_dec_clear_media_slots(fec_dec *dec)
+{
+	while (!g_queue_is_empty(dec->media_packets))
+	{
+		GList *link = g_queue_pop_head_link(dec->media_packets);
+		fec_dec_release_media_slot(dec, link->data);
+	}
+	g_hash_table_remove_all(dec->media_packet_set);
+}
+
+
+/* Releases the media packets preceding the given seqnum; packets of later blocks stay in the window */
+static void fec_dec_release_media_slots_before(fec_dec *dec, guint16 const seqnum)
+{
+	GList *link;
+
+	for (link = g_queue_peek_head_link(dec->media_packets); link != NULL;)
+	{
+		fec_dec_media_slot *slot = link->data;
+		link = link->next;
+
+		if ((gint16)(slot->seqnum - seqnum) < 0)
+		{
+			g_hash_table_remove(dec->media_packet_set, GINT_TO_POINTER((guint32)(slot->seqnum)));
+			g_queue_unlink(dec->media_packets, &(slot->link));
+			fec_dec_release_media_slot(dec, slot);
+		}
+	}
+}
+
+
+static gboolean fec_dec_is_in_current_block(fec_dec *dec, guint16 const seqnum)
+{
+	return ((guint16)(seqnum - dec->cur_snbase)) < dec->block_num_media_packets;
+}
+
+
+static void fec_dec_mark_next_block_packet(fec_dec *dec, guint16 const seqnum)
+{
+	guint16 offset = seqnum - dec->next_snbase;
+	if (dec->has_next_snbase && (offset < 32))
+		dec->next_block_received_mask |= (1ul << offset);
+}
+
+
+/* Called whenever next_snbase changes; the packets of the new next block which are already present are marked */
+static void fec_dec_update_next_block_mask(fec_dec *dec)
+{
+	GList *link;
+
+	dec->next_block_received_mask = 0;
+	for (link = g_queue_peek_head_link(dec->media_packets); link != NULL; link = link->next)
+	{
+		fec_dec_media_slot *slot = link->data;
+		fec_dec_mark_next_block_packet(dec, slot->seqnum);
+	}
+}
+
+
+
 fec_dec* fec_dec_create(guint const num_media_packets, guint const num_fec_packets, create_buffer_function const create_buffer, void *create_buffer_data)
 {
 	fec_dec *dec = malloc(sizeof(fec_dec));
 
 	dec->num_media_packets = num_media_packets;
+	dec->block_num_media_packets = num_media_packets;
 	dec->num_fec_packets = num_fec_packets;
 	dec->max_packet_size = 0;
 	dec->create_buffer = create_buffer;
 	dec->create_buffer_data = create_buffer_data;
+	dec->recover_filter = NULL;
+	dec->recover_filter_data = NULL;
+	dec->unrecoverable = NULL;
+	dec->unrecoverable_data = NULL;
+	dec->stats = NULL;
+	dec->first_fec_arrival_time = GST_CLOCK_TIME_NONE;
+	dec->next_snbase = 0;
+	dec->has_next_snbase = FALSE;
+	dec->next_block_received_mask = 0;
 	dec->cur_snbase = 0;
 	dec->blacklisted_snbase = 0;
 	dec->has_snbase = FALSE;
@@ -94,6 +371,18 @@ fec_dec* fec_dec_create(guint const num_media_packets, guint const num_fec_packe
 	dec->num_received_media_packets = 0;
 	dec->num_received_fec_packets = 0;
 
+	dec->media_slots = NULL;
+	dec->free_media_slots = NULL;
+	dec->num_media_slots = 0;
+	dec->num_free_media_slots = 0;
+	dec->use_symbol_arena = FALSE;
+	dec->max_symbol_size = FEC_DEC_DEFAULT_MAX_SYMBOL_SIZE;
+	dec->arena_symbol_size = 0;
+	dec->arena_memory = NULL;
+	dec->padding = NULL;
+	dec->padding_size = 0;
+	fec_dec_allocate_media_slots(dec);
+
 	return dec;
 }
 
@@ -106,6 +395,10 @@ void fec_dec_destroy(fec_dec *dec)
 	g_queue_free(dec->recovered_packets);
 	g_hash_table_destroy(dec->media_packet_set);
 	g_hash_table_destroy(dec->fec_packet_set);
+	free(dec->media_slots);
+	free(dec->free_media_slots);
+	free(dec->arena_memory);
+	free(dec->padding);
 	free(dec);
 }
 
@@ -129,24 +422,35 @@ static void fec_dec_cleanup(fec_dec *dec)
 
 	Also, blacklisted_snbase is used to drop any FEC packets that may come up with the current snbase.
 	*/
+	if (dec->has_snbase)
+	{
+		FEC_PROBE3(dec_block_close, dec->cur_snbase, dec->num_received_media_packets, dec->num_received_fec_packets);
+		dec->next_snbase = (dec->cur_snbase + dec->block_num_media_packets) & 0xffff;
+		dec->has_next_snbase = TRUE;
+	}
 	dec->blacklisted_snbase = dec->cur_snbase;
-	dec->has_snbase = FALSE;
 	dec->received_media_packet_mask = 0;
 	dec->num_received_media_packets = 0;
 	dec->num_received_fec_packets = 0;
 	dec->max_packet_size = 0;
-	g_queue_foreach(dec->media_packets, fec_dec_clear_packet, NULL);
+	/* Media packets of the next block may have arrived already; they are kept for it */
+	if (dec->has_snbase)
+	{
+		fec_dec_release_media_slots_before(dec, dec->next_snbase);
+		fec_dec_update_next_block_mask(dec);
+	}
+	else
+		fec_dec_clear_media_slots(dec);
+	dec->has_snbase = FALSE;
 	g_queue_foreach(dec->fec_packets, fec_dec_clear_packet, NULL);
-	g_queue_clear(dec->media_packets);
 	g_queue_clear(dec->fec_packets);
-	g_hash_table_remove_all(dec->media_packet_set);
 	g_hash_table_remove_all(dec->fec_packet_set);
 }
 
 
 static gboolean fec_dec_all_media_packets_present(fec_dec *dec)
 {
-	return (dec->received_media_packet_mask == ((1ul << (dec->num_media_packets)) - 1));
+	return (dec->received_media_packet_mask == ((1ul << (dec->block_num_media_packets)) - 1));
 }
 
 
@@ -155,104 +459,197 @@ static gboolean fec_dec_can_recover_packets(fec_dec *dec)
 	/*
 	TODO: this should make an OpenFEC call; the line below assumes Reed-Solomon is used
 	*/
-	return (dec->num_received_media_packets > 0) && ((dec->num_received_media_packets + dec->num_received_fec_packets) >= dec->num_media_packets);
+	return (dec->num_received_media_packets > 0) && ((dec->num_received_media_packets + dec->num_received_fec_packets) >= dec->block_num_media_packets);
 }
 
 
-static void* fec_dec_source_packet_cb(void *context, UINT32 size, UINT32 esi)
+static fec_core_result fec_dec_recover_packets(fec_dec *dec)
 {
-	GstBuffer *packet;
-	fec_dec *dec;
-
-	esi = esi; /* shut up compiler warning about unused argument */
-	
-	dec = context;
-	packet = dec->create_buffer(size, dec->create_buffer_data);
-	g_queue_push_tail(dec->recovered_packets, packet);
+	fec_core_decode_params params;
+	fec_core_fec_packet_info info;
+	fec_core_result result;
+	struct iovec media_packets[FEC_CORE_MAX_MEDIA_PACKETS];
+	guint8 const *repair_symbols[FEC_CORE_MAX_SYMBOLS];
+	guint8 *recovered_data[FEC_CORE_MAX_MEDIA_PACKETS];
+	GstBuffer *recovered_packets[FEC_CORE_MAX_MEDIA_PACKETS];
+	guint8 const *parity_symbol;
+	guint i, padding_size, num_recovered_packets;
+	GList *link;
 
-	return GST_BUFFER_DATA(packet);
-}
+	assert(dec->has_snbase);
+	assert(dec->max_packet_size > 0);
 
+	FEC_PROBE3(dec_recover_start, dec->cur_snbase, dec->block_num_media_packets - dec->num_received_media_packets, dec->max_packet_size);
 
-static inline guint32 fec_dec_correct_seqnum(fec_dec *dec, guint16 const seqnum)
-{
-	guint32 corrected_seqnum = seqnum;
-	guint32 snbase = dec->cur_snbase;
-	guint32 snend = snbase + dec->num_media_packets;
+	/*
+	The symbol size is the encoder's, as stored in the length recovery field; the largest
+	received media packet is only a fallback, since the largest packet may be a missing one
+	*/
+	params.num_media_packets = dec->block_num_media_packets;
+	params.num_fec_packets = dec->num_fec_packets;
+	params.symbol_size = dec->max_packet_size;
+	{
+		GstBuffer *fec_packet = g_queue_peek_head(dec->fec_packets);
+		if (fec_core_parse_fec_packet(GST_BUFFER_DATA(fec_packet), GST_BUFFER_SIZE(fec_packet), &info) == FEC_CORE_OK)
+			params.symbol_size = MIN(MAX(info.length_recovery, dec->max_packet_size), info.repair_symbol_size);
+	}
 
-	if (snend > 65536)
+	/*
+	A block is protected either by RS repair symbols or by a single XOR parity packet;
+	the parity packet can recover exactly one missing media packet, which is what
+	fec_dec_can_recover_packets() guarantees at this point
+	*/
+	parity_symbol = NULL;
+	memset(repair_symbols, 0, sizeof(guint8 const *) * dec->num_fec_packets);
+	for (link = g_queue_peek_head_link(dec->fec_packets); link != NULL; link = link->next)
 	{
-		if (corrected_seqnum < snbase)
-			corrected_seqnum += 65536;
+		GstBuffer *packet = link->data;
+
+		if ((fec_core_parse_fec_packet(GST_BUFFER_DATA(packet), GST_BUFFER_SIZE(packet), &info) != FEC_CORE_OK) || (info.repair_symbol_size < params.symbol_size))
+			continue;
+
+		if (info.index == FEC_XOR_INDEX)
+			parity_symbol = info.repair_symbol;
+		else if (info.index < dec->num_fec_packets)
+			repair_symbols[info.index] = info.repair_symbol;
 	}
 
-	return corrected_seqnum;
-}
+	memset(media_packets, 0, sizeof(struct iovec) * dec->block_num_media_packets);
+	for (link = g_queue_peek_head_link(dec->media_packets); link != NULL; link = link->next)
+	{
+		fec_dec_media_slot *slot = link->data;
+		struct iovec *media_packet;
 
+		/* The window may also hold media packets of the next block */
+		if (!fec_dec_is_in_current_block(dec, slot->seqnum))
+			continue;
 
-static void fec_dec_recover_packets(fec_dec *dec)
-{
-	of_session_t *session;
-	of_rs_parameters_t params;
-	void **encoding_symbol_tab;
-	guint i;
-	GList *link;
+		media_packet = &(media_packets[(guint16)(slot->seqnum - dec->cur_snbase)]);
 
-	assert(dec->has_snbase);
-	assert(dec->max_packet_size > 0);
+		media_packet->iov_base = slot->data;
+		media_packet->iov_len = slot->size;
 
-	encoding_symbol_tab = malloc(sizeof(void*) * (dec->num_media_packets + dec->num_fec_packets));
-	memset(encoding_symbol_tab, 0, sizeof(void*) * (dec->num_media_packets + dec->num_fec_packets));
+		/* Symbols in the arena are zero-padded in place, so the core does not have to copy them */
+		if ((slot->buffer == NULL) && (slot->size < params.symbol_size) && (params.symbol_size <= dec->arena_symbol_size))
+		{
+			memset(slot->data + slot->size, 0, params.symbol_size - slot->size);
+			media_packet->iov_len = params.symbol_size;
+		}
+	}
 
-	for (link = g_queue_peek_head_link(dec->media_packets); link != NULL; link = link->next)
+	num_recovered_packets = 0;
+	for (i = 0; i < dec->block_num_media_packets; ++i)
 	{
-		GstBuffer *media_packet;
-		guint32 seqnum;
+		recovered_packets[i] = NULL;
+		recovered_data[i] = NULL;
+		if (media_packets[i].iov_base == NULL)
+		{
+			recovered_packets[i] = dec->create_buffer(params.symbol_size, dec->create_buffer_data);
+			recovered_data[i] = GST_BUFFER_DATA(recovered_packets[i]);
+			++num_recovered_packets;
+		}
+	}
 
-		media_packet = link->data;
-		seqnum = fec_dec_correct_seqnum(dec, gst_rtp_buffer_get_seq(media_packet));
+	if (num_recovered_packets == 0)
+		result = FEC_CORE_OK;
+	else if (parity_symbol != NULL)
+	{
+		for (i = 0; recovered_data[i] == NULL; ++i)
+			;
+		result = fec_core_decode_xor(&params, media_packets, parity_symbol, recovered_data[i]);
+	}
+	else
+	{
+		padding_size = dec->block_num_media_packets * params.symbol_size;
+		if (padding_size > dec->padding_size)
+			fec_dec_allocate_padding(dec, padding_size);
 
-		encoding_symbol_tab[seqnum - dec->cur_snbase] = GST_BUFFER_DATA(media_packet);
+		result = fec_core_decode(&params, media_packets, repair_symbols, recovered_data, dec->padding);
 	}
 
-	for (link = g_queue_peek_head_link(dec->fec_packets); link != NULL; link = link->next)
+	for (i = 0; i < dec->block_num_media_packets; ++i)
+	{
+		if (recovered_packets[i] == NULL)
+			continue;
+
+		if (result == FEC_CORE_OK)
+			g_queue_push_tail(dec->recovered_packets, recovered_packets[i]);
+		else
+			gst_buffer_unref(recovered_packets[i]);
+	}
+
+	if (result != FEC_CORE_OK)
 	{
-		GstBuffer *packet;
-		guint8 *fec_data;
-		guint8 esi;
+		GST_DEBUG("Recovering %u media packets failed: error %d", num_recovered_packets, (int)result);
+		num_recovered_packets = 0;
+	}
+
+	FEC_PROBE2(dec_recover_done, dec->cur_snbase, num_recovered_packets);
 
-		packet = link->data;
-		fec_data = GST_BUFFER_DATA(packet) + gst_rtp_buffer_get_header_len(packet);
-		esi = fec_data[12];
+	return result;
+}
+
+
+static GstClockTime fec_dec_get_block_timestamp(fec_dec *dec)
+{
+	GstClockTime block_timestamp = GST_CLOCK_TIME_NONE;
+	GList *link;
 
-		encoding_symbol_tab[esi + dec->num_media_packets] = fec_data + RTP_FEC_HEADER_SIZE + 1;
+	for (link = g_queue_peek_head_link(dec->media_packets); link != NULL; link = link->next)
+	{
+		fec_dec_media_slot *slot = link->data;
+		if (!fec_dec_is_in_current_block(dec, slot->seqnum))
+			continue;
+		if (GST_CLOCK_TIME_IS_VALID(slot->timestamp) && (!GST_CLOCK_TIME_IS_VALID(block_timestamp) || (slot->timestamp < block_timestamp)))
+			block_timestamp = slot->timestamp;
 	}
 
-	params.nb_source_symbols = dec->num_media_packets;
-	params.nb_repair_symbols = dec->num_fec_packets;
-	params.encoding_symbol_length = dec->max_packet_size;
+	return block_timestamp;
+}
+
+
+static void fec_dec_report_unrecoverable_packets(fec_dec *dec)
+{
+	guint i;
+
+	if (!dec->has_snbase || (dec->num_received_media_packets >= dec->block_num_media_packets))
+		return;
+
+	FEC_STATS_ADD(dec->stats, blocks_unrecoverable, 1);
+	FEC_PROBE2(dec_recover_failure, dec->cur_snbase, dec->block_num_media_packets - dec->num_received_media_packets);
 
-	of_create_codec_instance(&session, OF_CODEC_REED_SOLOMON_GF_2_8_STABLE, OF_DECODER, 0);
-	of_set_fec_parameters(session, (of_parameters_t*)(&params));
-	of_set_callback_functions(session, fec_dec_source_packet_cb, NULL, dec);
+	if (dec->unrecoverable == NULL)
+		return;
 
-#if 1
-	for (i = 0; i < dec->num_media_packets + dec->num_fec_packets; ++i)
+	for (i = 0; i < dec->block_num_media_packets; ++i)
 	{
-		if (encoding_symbol_tab[i] != 0)
-			of_decode_with_new_symbol(session, encoding_symbol_tab[i], i);
+		if ((dec->received_media_packet_mask & (1ul << i)) == 0)
+			dec->unrecoverable((dec->cur_snbase + i) & 0xffff, dec->unrecoverable_data);
 	}
-#else
-	of_set_available_symbols(session, encoding_symbol_tab);
-#endif
+}
+
+
+static GstClockTime fec_dec_get_block_arrival_time(fec_dec *dec)
+{
+	GstClockTime arrival_time = dec->first_fec_arrival_time;
+	GList *link;
 
-	if (!of_is_decoding_complete(session))
+	for (link = g_queue_peek_head_link(dec->media_packets); link != NULL; link = link->next)
 	{
-		of_finish_decoding(session);
+		fec_dec_media_slot *slot = link->data;
+		if (!fec_dec_is_in_current_block(dec, slot->seqnum))
+			continue;
+		if (GST_CLOCK_TIME_IS_VALID(slot->arrival_time) && (!GST_CLOCK_TIME_IS_VALID(arrival_time) || (slot->arrival_time < arrival_time)))
+			arrival_time = slot->arrival_time;
 	}
 
-	free(encoding_symbol_tab);
-	of_release_codec_instance(session);
+	return arrival_time;
+}
+
+
+static gboolean fec_dec_has_media_packet(fec_dec *dec, guint16 const seqnum)
+{
+	return g_hash_table_lookup_extended(dec->media_packet_set, GINT_TO_POINTER((guint32)seqnum), NULL, NULL);
 }
 
 
@@ -260,13 +657,55 @@ static void fec_dec_check_state(fec_dec *dec)
 {
 	if (fec_dec_all_media_packets_present(dec))
 	{
-		GST_DEBUG("All %u media packets received, no recovery operation necessary", dec->num_media_packets);
+		GST_DEBUG("All %u media packets received, no recovery operation necessary", dec->block_num_media_packets);
+		FEC_STATS_ADD(dec->stats, blocks_complete, 1);
 		fec_dec_cleanup(dec);
 	}
 	else if (fec_dec_can_recover_packets(dec))
 	{
-		GST_DEBUG("Recovering %u media packets", dec->num_media_packets - dec->num_received_media_packets);
-		fec_dec_recover_packets(dec);
+		guint num_missing_packets = dec->block_num_media_packets - dec->num_received_media_packets;
+
+		/* The block is finished either way; a skipped block must not be recovered by later FEC packets */
+		if ((dec->recover_filter != NULL) && !dec->recover_filter(fec_dec_get_block_timestamp(dec), num_missing_packets, dec->recover_filter_data))
+		{
+			GST_DEBUG("Skipping recovery of %u media packets", num_missing_packets);
+		}
+		else
+		{
+			fec_core_result result;
+
+			GST_DEBUG("Recovering %u media packets", num_missing_packets);
+
+			if (dec->stats != NULL)
+			{
+				GstClockTime start_time, end_time, arrival_time;
+				guint num_recovered_packets;
+
+				arrival_time = fec_dec_get_block_arrival_time(dec);
+				num_recovered_packets = g_queue_get_length(dec->recovered_packets);
+
+				start_time = gst_util_get_timestamp();
+				result = fec_dec_recover_packets(dec);
+				end_time = gst_util_get_timestamp();
+
+				fec_stats_histogram_add(&(dec->stats->decode_time), end_time - start_time);
+				if (result == FEC_CORE_OK)
+				{
+					FEC_STATS_ADD(dec->stats, blocks_recovered, 1);
+					FEC_STATS_ADD(dec->stats, packets_recovered, g_queue_get_length(dec->recovered_packets) - num_recovered_packets);
+					if (GST_CLOCK_TIME_IS_VALID(arrival_time))
+						fec_stats_histogram_add(&(dec->stats->recovery_delay), end_time - arrival_time);
+				}
+			}
+			else
+				result = fec_dec_recover_packets(dec);
+
+			/* A failed decode leaves the missing packets missing; they are reported like those of any other unrecoverable block */
+			if (result == FEC_CORE_OK)
+				FEC_PROBE2(dec_recover_success, dec->cur_snbase, num_missing_packets);
+			else
+				fec_dec_report_unrecoverable_packets(dec);
+		}
 		fec_dec_cleanup(dec);
 	}
 }
@@ -280,19 +719,55 @@ void fec_dec_push_media_packet(fec_dec *dec, GstBuffer *packet)
 	if (g_hash_table_lookup_extended(dec->media_packet_set, GINT_TO_POINTER(original_seqnum), NULL, NULL))
 	{
 		GST_DEBUG("Media packet with seqnum %u is already in queue - discarding duplicate", original_seqnum);
+		FEC_STATS_ADD(dec->stats, duplicates_dropped, 1);
+		return;
+	}
+
+	/*
+	Packets older than the current block (for example retransmissions of packets which could not be recovered)
+	are of no use to the decoder, and must not be mistaken for the start of a new block
+	*/
+	if ((dec->has_snbase && ((gint16)(original_seqnum - dec->cur_snbase) < 0)) || (!dec->has_snbase && dec->has_next_snbase && ((gint16)(original_seqnum - dec->next_snbase) < 0)))
+	{
+		GST_DEBUG("Media packet with seqnum %u predates the current block - not using it for decoding", original_seqnum);
 		return;
 	}
 
 	if (dec->has_snbase)
 	{
-		guint32 corrected_seqnum;
-		corrected_seqnum = fec_dec_correct_seqnum(dec, original_seqnum);
+		guint16 offset = original_seqnum - dec->cur_snbase;
 
 		GST_DEBUG("Pushing media packet with seqnum %u, current snbase is %u", original_seqnum, dec->cur_snbase);
 
-		if ((corrected_seqnum - (guint32)(dec->cur_snbase)) >= dec->num_media_packets)
+		if (offset < dec->block_num_media_packets)
+		{
+			fec_dec_push_media_slot(dec, packet, original_seqnum);
+			custom_hash_table_add(dec->media_packet_set, GINT_TO_POINTER(original_seqnum));
+			++dec->num_received_media_packets;
+			dec->received_media_packet_mask |= (1ul << offset);
+			dec->max_packet_size = MAX(dec->max_packet_size, GST_BUFFER_SIZE(packet));
+
+			fec_dec_check_state(dec);
+		}
+		else if ((offset < (dec->block_num_media_packets + dec->num_media_packets)) && (dec->num_received_fec_packets < dec->num_fec_packets))
+		{
+			/*
+			The packet belongs to the next block. FEC packets of the current block may still be on their way
+			(paced FEC packets are spread over the next block interval), so the current block stays open until
+			the media packets of the block after the next one, or the FEC packets of another block arrive.
+			*/
+			GST_DEBUG("Media packet with seqnum %u belongs to the next block - keeping block with snbase %u open", original_seqnum, dec->cur_snbase);
+			fec_dec_push_media_slot(dec, packet, original_seqnum);
+			custom_hash_table_add(dec->media_packet_set, GINT_TO_POINTER(original_seqnum));
+		}
+		else
 		{
 			GST_DEBUG("Distance between FEC packets and incoming media packets is too large - purging %u FEC packets and setting has_snbase to FALSE", dec->num_received_fec_packets);
+			FEC_PROBE3(dec_block_close, dec->cur_snbase, dec->num_received_media_packets, dec->num_received_fec_packets);
+
+			fec_dec_report_unrecoverable_packets(dec);
+			dec->next_snbase = (dec->cur_snbase + dec->block_num_media_packets) & 0xffff;
+			dec->has_next_snbase = TRUE;
 
 			dec->has_snbase = FALSE;
 			dec->blacklisted_snbase = dec->cur_snbase;
@@ -300,70 +775,85 @@ void fec_dec_push_media_packet(fec_dec *dec, GstBuffer *packet)
 			g_queue_clear(dec->fec_packets);
 			g_hash_table_remove_all(dec->fec_packet_set);
 			dec->num_received_fec_packets = 0;
+			dec->received_media_packet_mask = 0;
+			dec->num_received_media_packets = 0;
+			fec_dec_release_media_slots_before(dec, dec->next_snbase);
 
 			GST_DEBUG("Pushing media packet with seqnum %u, no current snbase set", original_seqnum);
-			g_queue_push_tail(dec->media_packets, gst_buffer_ref(packet));
+			fec_dec_push_media_slot(dec, packet, original_seqnum);
 			custom_hash_table_add(dec->media_packet_set, GINT_TO_POINTER(original_seqnum));
-			++dec->num_received_media_packets;
-		}
-		else if ((corrected_seqnum >= (guint32)(dec->cur_snbase)) && (corrected_seqnum <= ((guint32)(dec->cur_snbase) + ((guint32)(dec->num_media_packets)) - 1)))
-		{
-			g_queue_push_tail(dec->media_packets, gst_buffer_ref(packet));
-			custom_hash_table_add(dec->media_packet_set, GINT_TO_POINTER(original_seqnum));
-			++dec->num_received_media_packets;
-			dec->received_media_packet_mask |= (1ul << (corrected_seqnum - dec->cur_snbase));
-			dec->max_packet_size = MAX(dec->max_packet_size, GST_BUFFER_SIZE(packet));
-
-			fec_dec_check_state(dec);
-		}
-		else
-		{
-			GST_DEBUG("Received media packet with seqnum %u outside bounds [%u, %u] - pushing aborted", original_seqnum, dec->cur_snbase, dec->cur_snbase + dec->num_media_packets - 1);
+			fec_dec_update_next_block_mask(dec);
 		}
 	}
 	else
 	{
 		GST_DEBUG("Pushing media packet with seqnum %u, no current snbase set", original_seqnum);
-		g_queue_push_tail(dec->media_packets, gst_buffer_ref(packet));
+		fec_dec_push_media_slot(dec, packet, original_seqnum);
 		custom_hash_table_add(dec->media_packet_set, GINT_TO_POINTER(original_seqnum));
-		++dec->num_received_media_packets;
+		fec_dec_mark_next_block_packet(dec, original_seqnum);
 	}
 
-	if (dec->num_received_media_packets > dec->num_media_packets)
+	/* Without a current block, nothing limits the window, so the oldest packets are dropped */
+	if (g_queue_get_length(dec->media_packets) > FEC_DEC_MEDIA_WINDOW(dec))
 	{
-		guint i;
-
-		GST_DEBUG("Too many media packets in queue - deleting the %u oldest packets", dec->num_received_media_packets - dec->num_media_packets);
+		GST_DEBUG("Too many media packets in queue - deleting the %u oldest packets", g_queue_get_length(dec->media_packets) - FEC_DEC_MEDIA_WINDOW(dec));
 
-		for (i = dec->num_media_packets; i < dec->num_received_media_packets; ++i)
+		while (g_queue_get_length(dec->media_packets) > FEC_DEC_MEDIA_WINDOW(dec))
 		{
-			GstBuffer *media_packet;
-			guint16 seqnum;
+			fec_dec_media_slot *slot;
 
-			media_packet = g_queue_pop_head(dec->media_packets);
-			seqnum = gst_rtp_buffer_get_seq(packet);
-			g_hash_table_remove(dec->media_packet_set, GINT_TO_POINTER(seqnum));
+			slot = g_queue_pop_head_link(dec->media_packets)->data;
+			g_hash_table_remove(dec->media_packet_set, GINT_TO_POINTER((guint32)(slot->seqnum)));
 
-			gst_buffer_unref(media_packet);
+			fec_dec_release_media_slot(dec, slot);
 		}
-
-		dec->num_received_media_packets = dec->num_media_packets;
 	}
 }
 
 
 void fec_dec_push_fec_packet(fec_dec *dec, GstBuffer *packet)
 {
-	guint8 *fec_data;
+	fec_core_fec_packet_info info;
 	guint32 snbase;
 	guint16 seqnum;
+	guint block_num_media_packets;
 	GList *link;
 
-	fec_data = GST_BUFFER_DATA(packet) + gst_rtp_buffer_get_header_len(packet);
-	snbase = (((guint16)(fec_data[0])) << 8) | (((guint16)(fec_data[1])) << 0);
-	seqnum = gst_rtp_buffer_get_seq(packet);
+	if (fec_core_parse_fec_packet(GST_BUFFER_DATA(packet), GST_BUFFER_SIZE(packet), &info) != FEC_CORE_OK)
+	{
+		GST_DEBUG("Ignoring malformed FEC packet with %u bytes", GST_BUFFER_SIZE(packet));
+		return;
+	}
+
+	snbase = info.snbase;
+	seqnum = info.seqnum;
+
+	GST_DEBUG("Received FEC packet, snbase %u, index %u, seqnum %u", snbase, (guint)(info.index), seqnum);
+
+	if (info.extended)
+	{
+		GST_DEBUG("Ignoring FEC packet with E bit set - joint blocks are handled by fec_joint_dec");
+		return;
+	}
+
+	/*
+	With layered FEC, the sender may generate more repair symbols than this decoder is
+	configured for; those packets are unusable here, and their index would be out of bounds
+	*/
+	if ((info.index >= dec->num_fec_packets) && (info.index != FEC_XOR_INDEX))
+	{
+		GST_DEBUG("Ignoring FEC packet with index %u, since only %u FEC packets per block are expected", (guint)(info.index), dec->num_fec_packets);
+		return;
+	}
+
+	/* The mask covers the media packets of the block, which are consecutive starting at snbase */
+	block_num_media_packets = info.num_media_packets;
 
-	GST_DEBUG("Received FEC packet, snbase %u, index %u, seqnum %u", snbase, (guint)(fec_data[12]), seqnum);
+	if ((block_num_media_packets == 0) || (block_num_media_packets > dec->num_media_packets))
+	{
+		GST_DEBUG("Ignoring FEC packet with unsupported mask %06x (at most %u media packets per block are expected)", info.mask, dec->num_media_packets);
+		return;
+	}
 
 	if (snbase == dec->blacklisted_snbase)
 	{
@@ -374,20 +864,64 @@ void fec_dec_push_fec_packet(fec_dec *dec, GstBuffer *packet)
 	if (g_hash_table_lookup_extended(dec->fec_packet_set, GINT_TO_POINTER(seqnum), NULL, NULL))
 	{
 		GST_DEBUG("FEC packet with seqnum %u is already in queue - discarding duplicate", seqnum);
+		FEC_STATS_ADD(dec->stats, duplicates_dropped, 1);
 		return;
 	}
 
+	/* The previous block is given up on if it is still unfinished */
+	if (dec->has_snbase && (dec->cur_snbase != snbase))
+	{
+		fec_dec_report_unrecoverable_packets(dec);
+	}
+	else if (!dec->has_snbase && dec->has_next_snbase)
+	{
+		/*
+		If the FEC packets of a whole block were lost, this block starts after the expected one; the
+		expected block cannot be recovered anymore, so report its missing packets; the received ones are
+		taken from next_block_received_mask, since the media packet window may not cover this block anymore
+		*/
+		guint distance = (snbase - dec->next_snbase) & 0xffff;
+		if ((distance > 0) && (distance <= dec->num_media_packets))
+		{
+			guint i, num_lost_packets = 0;
+			for (i = 0; i < distance; ++i)
+			{
+				guint16 lost_seqnum = (dec->next_snbase + i) & 0xffff;
+				if (dec->next_block_received_mask & (1ul << i))
+					continue;
+				++num_lost_packets;
+				if (dec->unrecoverable != NULL)
+					dec->unrecoverable(lost_seqnum, dec->unrecoverable_data);
+			}
+			if (num_lost_packets > 0)
+			{
+				FEC_STATS_ADD(dec->stats, blocks_unrecoverable, 1);
+				FEC_PROBE2(dec_recover_failure, dec->next_snbase, num_lost_packets);
+			}
+		}
+	}
+
 	if (dec->cur_snbase != snbase)
 	{
 		GST_DEBUG("snbase changed from %u to %u - purging FEC queue (%u FEC packets and %u media packets present)", dec->cur_snbase, snbase, dec->num_received_fec_packets, dec->num_received_media_packets);
+		FEC_PROBE4(dec_snbase_purge, dec->cur_snbase, snbase, dec->num_received_fec_packets, dec->num_received_media_packets);
+		if (dec->has_snbase)
+			FEC_PROBE3(dec_block_close, dec->cur_snbase, dec->num_received_media_packets, dec->num_received_fec_packets);
 		g_queue_foreach(dec->fec_packets, fec_dec_clear_packet, NULL);
 		g_queue_clear(dec->fec_packets);
 		g_hash_table_remove_all(dec->fec_packet_set);
 		dec->num_received_fec_packets = 0;
 	}
 
+	if ((dec->stats != NULL) && (dec->num_received_fec_packets == 0))
+		dec->first_fec_arrival_time = gst_util_get_timestamp();
+
+	if (!dec->has_snbase || (dec->cur_snbase != snbase))
+		FEC_PROBE2(dec_block_open, snbase, block_num_media_packets);
+
 	dec->cur_snbase = snbase;
 	dec->has_snbase = TRUE;
+	dec->block_num_media_packets = block_num_media_packets;
 	dec->received_media_packet_mask = 0;
 	dec->num_received_media_packets = 0;
 	dec->max_packet_size = 0;
@@ -395,34 +929,18 @@ void fec_dec_push_fec_packet(fec_dec *dec, GstBuffer *packet)
 	custom_hash_table_add(dec->fec_packet_set, GINT_TO_POINTER(seqnum));
 	++dec->num_received_fec_packets;
 
-	for (link = g_queue_peek_head_link(dec->media_packets); link != NULL;)
+	/* Media packets older than the block are of no use anymore; those of later blocks stay in the window */
+	fec_dec_release_media_slots_before(dec, snbase);
+	for (link = g_queue_peek_head_link(dec->media_packets); link != NULL; link = link->next)
 	{
-		GstBuffer *media_packet;
-		guint32 corrected_seqnum;
-
-		media_packet = link->data;
-		seqnum = gst_rtp_buffer_get_seq(media_packet);
-		corrected_seqnum = fec_dec_correct_seqnum(dec, seqnum);
+		fec_dec_media_slot *slot = link->data;
 
-		if ((corrected_seqnum < snbase) || (corrected_seqnum > (snbase + dec->num_media_packets - 1)))
-		{
-			GList *old_link;
-
-			GST_DEBUG("Found media packet with seqnum %u outside bounds [%u, %u] - purging", seqnum, snbase, snbase + dec->num_media_packets - 1);
-			g_hash_table_remove(dec->media_packet_set, GINT_TO_POINTER(seqnum));
-			gst_buffer_unref(media_packet);
+		if (!fec_dec_is_in_current_block(dec, slot->seqnum))
+			continue;
 
-			old_link = link;
-			link = link->next;
-			g_queue_delete_link(dec->media_packets, old_link);
-		}
-		else
-		{
-			dec->max_packet_size = MAX(dec->max_packet_size, GST_BUFFER_SIZE(media_packet));
-			dec->received_media_packet_mask |= (1ul << (corrected_seqnum - dec->cur_snbase));
-			++dec->num_received_media_packets;
-			link = link->next;
-		}
+		dec->max_packet_size = MAX(dec->max_packet_size, slot->size);
+		dec->received_media_packet_mask |= (1ul << (guint16)(slot->seqnum - dec->cur_snbase));
+		++dec->num_received_media_packets;
 	}
 
 	fec_dec_check_state(dec);
@@ -452,6 +970,8 @@ void fec_dec_set_num_media_packets(fec_dec *dec, guint const num_media_packets)
 {
 	fec_dec_reset(dec);
 	dec->num_media_packets = num_media_packets;
+	dec->block_num_media_packets = num_media_packets;
+	fec_dec_allocate_media_slots(dec);
 }
 
 
@@ -474,9 +994,99 @@ guint fec_dec_get_num_fec_packets(fec_dec *dec)
 }
 
 
+void fec_dec_set_use_symbol_arena(fec_dec *dec, gboolean const use_symbol_arena)
+{
+	fec_dec_reset(dec);
+	dec->use_symbol_arena = use_symbol_arena;
+	fec_dec_allocate_media_slots(dec);
+}
+
+
+gboolean fec_dec_get_use_symbol_arena(fec_dec *dec)
+{
+	return dec->use_symbol_arena;
+}
+
+
+void fec_dec_set_max_symbol_size(fec_dec *dec, guint const max_symbol_size)
+{
+	fec_dec_reset(dec);
+	dec->max_symbol_size = max_symbol_size;
+	fec_dec_allocate_media_slots(dec);
+}
+
+
+guint fec_dec_get_max_symbol_size(fec_dec *dec)
+{
+	return dec->max_symbol_size;
+}
+
+
+void fec_dec_set_recover_filter(fec_dec *dec, fec_dec_recover_filter_function const filter, void *filter_data)
+{
+	dec->recover_filter = filter;
+	dec->recover_filter_data = filter_data;
+}
+
+
+void fec_dec_set_unrecoverable_function(fec_dec *dec, fec_dec_unrecoverable_function const unrecoverable, void *unrecoverable_data)
+{
+	dec->unrecoverable = unrecoverable;
+	dec->unrecoverable_data = unrecoverable_data;
+}
+
+
+gboolean fec_dec_can_recover_seqnum(fec_dec *dec, guint16 const seqnum)
+{
+	guint16 snbase, offset;
+	guint block_num_media_packets, num_missing_packets, i;
+
+	if (fec_dec_has_media_packet(dec, seqnum))
+		return FALSE;
+
+	if (dec->has_snbase)
+	{
+		snbase = dec->cur_snbase;
+		block_num_media_packets = dec->block_num_media_packets;
+	}
+	else if (dec->has_next_snbase)
+	{
+		/* The size of the next block is not known yet; assume a regular block */
+		snbase = dec->next_snbase;
+		block_num_media_packets = dec->num_media_packets;
+	}
+	else
+		return FALSE;
+
+	offset = seqnum - snbase;
+	if (offset >= block_num_media_packets)
+		return FALSE;
+
+	/* Only packets up to the requested one count; later packets of the block may still arrive */
+	num_missing_packets = 0;
+	for (i = 0; i <= offset; ++i)
+	{
+		if (dec->has_snbase ? fec_dec_has_media_packet(dec, (snbase + i) & 0xffff) : ((dec->next_block_received_mask & (1ul << i)) != 0))
+			continue;
+		++num_missing_packets;
+	}
+
+	return num_missing_packets <= dec->num_fec_packets;
+}
+
+
+void fec_dec_set_stats(fec_dec *dec, fec_dec_stats *stats)
+{
+	dec->stats = stats;
+}
+
+
 void fec_dec_reset(fec_dec *dec)
 {
 	fec_dec_cleanup(dec);
+	fec_dec_clear_media_slots(dec);
 	fec_dec_flush_recovered_packets(dec);
+	dec->has_next_snbase = FALSE;
+	dec->next_block_received_mask = 0;
 }
 
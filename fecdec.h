@@ -25,11 +25,24 @@
 
 
 #include <gst/gst.h>
+#include "fecstats.h"
 
 
 struct fec_dec_s;
 typedef struct fec_dec_s fec_dec;
 typedef GstBuffer* (*create_buffer_function)(guint const size_in_bytes, void *data);
+/*
+Called right before lost media packets are recovered, with the earliest timestamp of the media packets
+received for the block (GST_CLOCK_TIME_NONE if none of them has one) and the number of missing packets;
+returns FALSE to skip the recovery, for example because the recovered packets would arrive too late
+*/
+typedef gboolean (*fec_dec_recover_filter_function)(GstClockTime const block_timestamp, guint const num_missing_packets, void *data);
+/* Called once for each media packet of a block which was given up on without being recovered */
+typedef void (*fec_dec_unrecoverable_function)(guint16 const seqnum, void *data);
+
+
+/* Initial size of the symbols in the symbol arena; large enough for one packet at the common Ethernet MTU */
+#define FEC_DEC_DEFAULT_MAX_SYMBOL_SIZE 1500
 
 
 fec_dec* fec_dec_create(guint const num_media_packets, guint const num_fec_packets, create_buffer_function const create_buffer, void *create_buffer_data);
@@ -48,6 +61,31 @@ guint fec_dec_get_num_media_packets(fec_dec *dec);
 void fec_dec_set_num_fec_packets(fec_dec *dec, guint const num_fec_packets);
 guint fec_dec_get_num_fec_packets(fec_dec *dec);
 
+/*
+If enabled, media packets are copied into a preallocated, aligned symbol arena instead
+of being referenced; the max symbol size is the initial size of one arena symbol
+(without the arena, it sizes the preallocated memory for zero-padding shorter packets)
+*/
+void fec_dec_set_use_symbol_arena(fec_dec *dec, gboolean const use_symbol_arena);
+gboolean fec_dec_get_use_symbol_arena(fec_dec *dec);
+void fec_dec_set_max_symbol_size(fec_dec *dec, guint const max_symbol_size);
+guint fec_dec_get_max_symbol_size(fec_dec *dec);
+
+/* If filter is NULL (the default), all recoverable blocks are recovered */
+void fec_dec_set_recover_filter(fec_dec *dec, fec_dec_recover_filter_function const filter, void *filter_data);
+
+/* If unrecoverable is NULL (the default), lost packets are not reported */
+void fec_dec_set_unrecoverable_function(fec_dec *dec, fec_dec_unrecoverable_function const unrecoverable, void *unrecoverable_data);
+/*
+Returns TRUE if the media packet with the given seqnum is missing, but may still be recovered once the FEC
+packets of its block arrive; this is the case if it belongs to the current (or the next expected) block, and
+that block has no more missing packets than it has FEC packets
+*/
+gboolean fec_dec_can_recover_seqnum(fec_dec *dec, guint16 const seqnum);
+
+/* If stats is NULL (the default), no statistics are collected; the decoder does not take ownership of stats */
+void fec_dec_set_stats(fec_dec *dec, fec_dec_stats *stats);
+
 void fec_dec_reset(fec_dec *dec);
 
 
@@ -21,15 +21,11 @@
 
 
 #include <assert.h>
-#include <openfec/lib_common/of_openfec_api.h>
+#include <string.h>
 #include <gst/rtp/gstrtpbuffer.h>
 #include "fecenc.h"
-
-
-/* TODO: currently, this code assumes all incoming media packets are of same size */
-
-
-#define RTP_FEC_HEADER_SIZE 12
+#include "feccore.h"
+#include "fectrace.h"
 
 
 struct fec_enc_s
@@ -41,6 +37,32 @@ struct fec_enc_s
 	guint current_fec_seqnum;
 	guint max_packet_size;
 	guint cur_num_media_packets;
+	gboolean joint;
+	gboolean xor_mode;
+
+	/* Keyframe block geometry for unequal error protection; disabled if keyframe_num_media_packets is 0 */
+	guint keyframe_num_media_packets;
+	guint keyframe_num_fec_packets;
+	gboolean cur_block_is_keyframe;
+
+	fec_enc_create_buffer_function create_buffer;
+	void *create_buffer_data;
+
+	fec_enc_limit_function limit;
+	void *limit_data;
+
+	fec_enc_stats *stats;
+
+	/* Zero-padded copies of the media packets that are shorter than the symbol size */
+	guint8 *padding;
+	guint padding_size;
+	guint max_symbol_size;
+
+	/* RS encoder sessions of the last regular and the last keyframe block */
+	fec_core_encoder_cache encoder_caches[2];
+
+	/* Timestamps of the media packets which finished the last two blocks */
+	GstClockTime last_block_time, prev_block_time;
 
 	GQueue *media_packets;
 	GQueue *fec_packets;
@@ -49,10 +71,27 @@ struct fec_enc_s
 
 
 static void fec_enc_calculate_fec_packets(fec_enc *enc);
+static void fec_enc_finish_block(fec_enc *enc, GstClockTime const timestamp);
+static void fec_enc_add_media_packet(fec_enc *enc, GstBuffer *packet);
 static void fec_enc_clear_packet(gpointer data, gpointer user_data);
 
 
-fec_enc* fec_enc_create(guint const num_media_packets, guint const num_fec_packets, guint const payload_type, guint const seqnum_offset)
+static void fec_enc_allocate_padding(fec_enc *enc, guint const padding_size)
+{
+	free(enc->padding);
+	enc->padding = malloc(padding_size);
+	enc->padding_size = padding_size;
+}
+
+
+static GstBuffer* fec_enc_default_create_buffer(guint const size_in_bytes, void *data)
+{
+	data = data; /* shut up compiler warning about unused arguments */
+	return gst_buffer_new_and_alloc(size_in_bytes);
+}
+
+
+fec_enc* fec_enc_create(guint const num_media_packets, guint const num_fec_packets, guint const payload_type, guint const seqnum_offset, fec_enc_create_buffer_function const create_buffer, void *create_buffer_data)
 {
 	fec_enc *enc = malloc(sizeof(fec_enc));
 
@@ -65,6 +104,22 @@ fec_enc* fec_enc_create(guint const num_media_packets, guint const num_fec_packe
 	enc->fec_packets = g_queue_new();
 	enc->max_packet_size = 0;
 	enc->cur_num_media_packets = 0;
+	enc->joint = FALSE;
+	enc->keyframe_num_media_packets = 0;
+	enc->keyframe_num_fec_packets = 0;
+	enc->cur_block_is_keyframe = FALSE;
+	enc->create_buffer = (create_buffer != NULL) ? create_buffer : fec_enc_default_create_buffer;
+	enc->create_buffer_data = create_buffer_data;
+	enc->limit = NULL;
+	enc->limit_data = NULL;
+	enc->xor_mode = FALSE;
+	enc->stats = NULL;
+	enc->padding = NULL;
+	enc->padding_size = 0;
+	enc->max_symbol_size = 0;
+	memset(enc->encoder_caches, 0, sizeof(enc->encoder_caches));
+	enc->last_block_time = GST_CLOCK_TIME_NONE;
+	enc->prev_block_time = GST_CLOCK_TIME_NONE;
 
 	return enc;
 }
@@ -83,39 +138,95 @@ void fec_enc_destroy(fec_enc *enc)
 	fec_enc_reset(enc);
 	g_queue_free(enc->media_packets);
 	g_queue_free(enc->fec_packets);
+	free(enc->padding);
+	fec_core_encoder_cache_clear(&(enc->encoder_caches[0]));
+	fec_core_encoder_cache_clear(&(enc->encoder_caches[1]));
 	GST_DEBUG("Destroyed FEC encoder %p", enc);
 	free(enc);
 }
 
 
-void fec_enc_push_media_packet(fec_enc *enc, GstBuffer *packet)
+static void fec_enc_finish_block(fec_enc *enc, GstClockTime const timestamp)
 {
-	if (fec_enc_has_fec_packets(enc))
+	enc->prev_block_time = enc->last_block_time;
+	enc->last_block_time = timestamp;
+
+	fec_enc_calculate_fec_packets(enc);
+	FEC_PROBE3(enc_block_close, gst_rtp_buffer_get_seq(g_queue_peek_head(enc->media_packets)), enc->cur_num_media_packets, g_queue_get_length(enc->fec_packets));
+	enc->max_packet_size = 0;
+	while (!g_queue_is_empty(enc->media_packets))
 	{
-		GST_DEBUG("Not pushing media packet - FEC packets are still present in the FEC queue");
-		return;
+		GstBuffer *packet = g_queue_pop_head(enc->media_packets);
+		gst_buffer_unref(packet);
 	}
+	enc->cur_num_media_packets = 0;
+}
 
+
+static void fec_enc_add_media_packet(fec_enc *enc, GstBuffer *packet)
+{
 	if (!fec_enc_is_media_packet_list_full(enc))
 	{
+		if (enc->cur_num_media_packets == 0)
+			FEC_PROBE2(enc_block_open, gst_rtp_buffer_get_ssrc(packet), gst_rtp_buffer_get_seq(packet));
+
 		g_queue_push_tail(enc->media_packets, gst_buffer_ref(packet));
 		enc->max_packet_size = MAX(enc->max_packet_size, GST_BUFFER_SIZE(packet));
 		++enc->cur_num_media_packets;
-		GST_DEBUG("Pushed media packet to queue, which now contains %u packets", enc->cur_num_media_packets);
+		GST_DEBUG("Pushed %s packet to queue, which now contains %u packets", enc->cur_block_is_keyframe ? "keyframe" : "media", enc->cur_num_media_packets);
 	}
 
 	if (fec_enc_is_media_packet_list_full(enc))
 	{
 		GST_DEBUG("Media packet queue full, calculating FEC packets");
-		fec_enc_calculate_fec_packets(enc);
-		enc->max_packet_size = 0;
-		while (!g_queue_is_empty(enc->media_packets))
-		{
-			GstBuffer *packet = g_queue_pop_head(enc->media_packets);
-			gst_buffer_unref(packet);
-		}
-		enc->cur_num_media_packets = 0;
+		fec_enc_finish_block(enc, GST_BUFFER_TIMESTAMP(packet));
+	}
+}
+
+
+void fec_enc_push_media_packet(fec_enc *enc, GstBuffer *packet)
+{
+	if (fec_enc_has_fec_packets(enc))
+	{
+		GST_DEBUG("Not pushing media packet - FEC packets are still present in the FEC queue");
+		return;
 	}
+
+	/* A keyframe block ends with the first regular packet after it */
+	if (enc->cur_block_is_keyframe && (enc->cur_num_media_packets > 0))
+	{
+		GST_DEBUG("Keyframe ended - finishing keyframe block early with %u packets", enc->cur_num_media_packets);
+		fec_enc_finish_block(enc, GST_BUFFER_TIMESTAMP(packet));
+	}
+	enc->cur_block_is_keyframe = FALSE;
+
+	fec_enc_add_media_packet(enc, packet);
+}
+
+
+void fec_enc_push_keyframe_packet(fec_enc *enc, GstBuffer *packet)
+{
+	if (enc->keyframe_num_media_packets == 0)
+	{
+		fec_enc_push_media_packet(enc, packet);
+		return;
+	}
+
+	if (fec_enc_has_fec_packets(enc))
+	{
+		GST_DEBUG("Not pushing keyframe packet - FEC packets are still present in the FEC queue");
+		return;
+	}
+
+	/* Keyframe packets do not share blocks with regular packets, so they get the full keyframe protection */
+	if (!enc->cur_block_is_keyframe && (enc->cur_num_media_packets > 0))
+	{
+		GST_DEBUG("Keyframe started - finishing regular block early with %u packets", enc->cur_num_media_packets);
+		fec_enc_finish_block(enc, GST_BUFFER_TIMESTAMP(packet));
+	}
+	enc->cur_block_is_keyframe = TRUE;
+
+	fec_enc_add_media_packet(enc, packet);
 }
 
 
@@ -163,9 +274,93 @@ guint fec_enc_get_num_fec_packets(fec_enc *enc)
 }
 
 
+void fec_enc_set_joint(fec_enc *enc, gboolean const joint)
+{
+	fec_enc_reset(enc);
+	enc->joint = joint;
+}
+
+
+gboolean fec_enc_get_joint(fec_enc *enc)
+{
+	return enc->joint;
+}
+
+
+void fec_enc_set_keyframe_geometry(fec_enc *enc, guint const num_media_packets, guint const num_fec_packets)
+{
+	fec_enc_reset(enc);
+	enc->keyframe_num_media_packets = num_media_packets;
+	enc->keyframe_num_fec_packets = num_fec_packets;
+}
+
+
+guint fec_enc_get_keyframe_num_media_packets(fec_enc *enc)
+{
+	return enc->keyframe_num_media_packets;
+}
+
+
+guint fec_enc_get_keyframe_num_fec_packets(fec_enc *enc)
+{
+	return enc->keyframe_num_fec_packets;
+}
+
+
+void fec_enc_set_xor(fec_enc *enc, gboolean const xor_mode)
+{
+	enc->xor_mode = xor_mode;
+}
+
+
+gboolean fec_enc_get_xor(fec_enc *enc)
+{
+	return enc->xor_mode;
+}
+
+
+void fec_enc_set_max_symbol_size(fec_enc *enc, guint const max_symbol_size)
+{
+	guint padding_size;
+
+	enc->max_symbol_size = max_symbol_size;
+
+	padding_size = MAX(enc->num_media_packets, enc->keyframe_num_media_packets) * max_symbol_size;
+	if (padding_size > enc->padding_size)
+		fec_enc_allocate_padding(enc, padding_size);
+}
+
+
+guint fec_enc_get_max_symbol_size(fec_enc *enc)
+{
+	return enc->max_symbol_size;
+}
+
+
+void fec_enc_set_limit_function(fec_enc *enc, fec_enc_limit_function const limit, void *limit_data)
+{
+	enc->limit = limit;
+	enc->limit_data = limit_data;
+}
+
+
+void fec_enc_set_stats(fec_enc *enc, fec_enc_stats *stats)
+{
+	enc->stats = stats;
+}
+
+
 gboolean fec_enc_is_media_packet_list_full(fec_enc *enc)
 {
-	return enc->cur_num_media_packets >= enc->num_media_packets;
+	return enc->cur_num_media_packets >= (enc->cur_block_is_keyframe ? enc->keyframe_num_media_packets : enc->num_media_packets);
+}
+
+
+GstClockTime fec_enc_get_block_interval(fec_enc *enc)
+{
+	if (!GST_CLOCK_TIME_IS_VALID(enc->last_block_time) || !GST_CLOCK_TIME_IS_VALID(enc->prev_block_time) || (enc->last_block_time < enc->prev_block_time))
+		return GST_CLOCK_TIME_NONE;
+	return enc->last_block_time - enc->prev_block_time;
 }
 
 
@@ -183,6 +378,9 @@ void fec_enc_reset(fec_enc *enc)
 	g_queue_clear(enc->fec_packets);
 	enc->max_packet_size = 0;
 	enc->cur_num_media_packets = 0;
+	enc->cur_block_is_keyframe = FALSE;
+	enc->last_block_time = GST_CLOCK_TIME_NONE;
+	enc->prev_block_time = GST_CLOCK_TIME_NONE;
 }
 
 
@@ -191,116 +389,107 @@ void fec_enc_reset(fec_enc *enc)
 
 static void fec_enc_calculate_fec_packets(fec_enc *enc)
 {
-	of_session_t *session;
-	void **encoding_symbol_tab;
-	of_rs_parameters_t params;
-	guint32 timestamp;
-	guint32 ssrc;
-	guint16 snbase;
-	guint32 mask;
-	guint i;
-
-	assert(enc->num_media_packets == enc->cur_num_media_packets);
-
-	mask = (1ul << (enc->num_media_packets)) - 1;
-
-	params.nb_source_symbols = enc->num_media_packets;
-	params.nb_repair_symbols = enc->num_fec_packets;
-	params.encoding_symbol_length = enc->max_packet_size;
-
-	of_create_codec_instance(&session, OF_CODEC_REED_SOLOMON_GF_2_8_STABLE, OF_ENCODER, 0);
-	of_set_fec_parameters(session, (of_parameters_t*)(&params));
-
-	GST_DEBUG("Created OpenFEC session");
-
-	encoding_symbol_tab = malloc(sizeof(void*) * (enc->num_media_packets + enc->num_fec_packets));
+	fec_core_encode_params params;
+	fec_core_result result;
+	struct iovec media_packets[FEC_CORE_MAX_MEDIA_PACKETS];
+	guint32 member_ssrcs[FEC_CORE_MAX_MEDIA_PACKETS];
+	guint16 member_seqnums[FEC_CORE_MAX_MEDIA_PACKETS];
+	guint8 *fec_packet_data[FEC_CORE_MAX_SYMBOLS];
+	GstBuffer *fec_packets[FEC_CORE_MAX_SYMBOLS];
+	guint i, fec_packet_size, padding_size;
+	GstClockTime start_time;
+	GList *link;
+
+	/* Timing is only measured if somebody is interested in it */
+	start_time = (enc->stats != NULL) ? gst_util_get_timestamp() : GST_CLOCK_TIME_NONE;
+
+	/* Blocks may be finished early (see fec_enc_push_keyframe_packet()), so the block size is the number of queued packets */
+	memset(&params, 0, sizeof(params));
+	params.num_media_packets = enc->cur_num_media_packets;
+	params.num_fec_packets = enc->xor_mode ? 1 : (enc->cur_block_is_keyframe ? enc->keyframe_num_fec_packets : enc->num_fec_packets);
+	params.symbol_size = enc->max_packet_size;
+	params.xor_mode = enc->xor_mode;
+	params.encoder_cache = &(enc->encoder_caches[enc->cur_block_is_keyframe ? 1 : 0]);
+	assert((params.num_media_packets > 0) && (params.num_media_packets <= FEC_CORE_MAX_MEDIA_PACKETS));
+
+	FEC_PROBE3(enc_calculate_start, params.num_media_packets, params.num_fec_packets, enc->max_packet_size);
+
+	for (link = g_queue_peek_head_link(enc->media_packets), i = 0; link != NULL; link = link->next, ++i)
+	{
+		GstBuffer *packet = link->data;
+		media_packets[i].iov_base = GST_BUFFER_DATA(packet);
+		media_packets[i].iov_len = GST_BUFFER_SIZE(packet);
+		member_ssrcs[i] = gst_rtp_buffer_get_ssrc(packet);
+		member_seqnums[i] = gst_rtp_buffer_get_seq(packet);
+	}
 
+	if (enc->joint)
 	{
-		GstBuffer *first_packet = g_queue_peek_head_link(enc->media_packets)->data;
-		ssrc = gst_rtp_buffer_get_ssrc(first_packet);
-		timestamp = gst_rtp_buffer_get_timestamp(first_packet);
-		snbase = gst_rtp_buffer_get_seq(first_packet);
-		GST_DEBUG("Using SSRC %u, timestamp %u, snbase %u for FEC packets", ssrc, timestamp, snbase);
+		params.member_ssrcs = member_ssrcs;
+		params.member_seqnums = member_seqnums;
 	}
 
+	fec_packet_size = fec_core_get_fec_packet_size(&params);
+
+	if (enc->limit != NULL)
 	{
-		GList *link;
-		guint32 cnt = 0;
-		for (link = g_queue_peek_head_link(enc->media_packets); link != NULL; link = link->next)
+		guint allowed_num_fec_packets = enc->limit(params.num_fec_packets, fec_packet_size, enc->limit_data);
+		if (allowed_num_fec_packets < params.num_fec_packets)
+		{
+			GST_DEBUG("Limiting number of FEC packets for this block from %u to %u", params.num_fec_packets, allowed_num_fec_packets);
+			params.num_fec_packets = allowed_num_fec_packets;
+		}
+
+		if (params.num_fec_packets == 0)
 		{
-			GstBuffer *packet = link->data;
-			encoding_symbol_tab[cnt++] = GST_BUFFER_DATA(packet);
+			FEC_PROBE2(enc_calculate_done, member_seqnums[0], 0);
+			return;
 		}
 	}
 
-	for (i = 0; i < enc->num_fec_packets; ++i)
+	/* The RTP timestamp and SSRC of the FEC packets are the ones of the first media packet */
+	params.ssrc = member_ssrcs[0];
+	params.timestamp = gst_rtp_buffer_get_timestamp(g_queue_peek_head(enc->media_packets));
+	params.snbase = member_seqnums[0];
+	params.fec_seqnum = enc->current_fec_seqnum;
+	params.payload_type = enc->payload_type;
+	params.pt_recovery = enc->payload_type;
+	GST_DEBUG("Using SSRC %u, timestamp %u, snbase %u for FEC packets", params.ssrc, params.timestamp, params.snbase);
+
+	/* Shorter media packets are zero-padded to the symbol size in the padding memory, which is kept across blocks */
+	padding_size = params.num_media_packets * params.symbol_size;
+	if (padding_size > enc->padding_size)
+		fec_enc_allocate_padding(enc, padding_size);
+
+	for (i = 0; i < params.num_fec_packets; ++i)
 	{
-		GstBuffer *fec_packet;
-		guint8 *fec_data;
-
-		/* +1 to make room for the FEC packet index byte */
-		fec_packet = gst_rtp_buffer_new_allocate(RTP_FEC_HEADER_SIZE + 1 + enc->max_packet_size, 0, 0);
-
-		gst_rtp_buffer_set_version(fec_packet, GST_RTP_VERSION);
-		gst_rtp_buffer_set_ssrc(fec_packet, ssrc);
-		gst_rtp_buffer_set_seq(fec_packet, enc->current_fec_seqnum++);
-		gst_rtp_buffer_set_timestamp(fec_packet, timestamp);
-		gst_rtp_buffer_set_payload_type(fec_packet, enc->payload_type);
-
-		/*
-		The FEC data is placed directly after the RTP header, and includes the FEC header
-		and the payload
-		-> skip the RTP header
-		*/
-		fec_data = GST_BUFFER_DATA(fec_packet) + gst_rtp_buffer_get_header_len(fec_packet);
-
-		/*  FEC header:
-		 *   0                   1                   2                   3
-		 *   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
-		 *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-		 *  |      SN base                  |        length recovery        |
-		 *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-		 *  |E| PT recovery |                 mask                          |
-		 *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-		 *  |                          TS recovery                          |
-		 *  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-		 */
-
-		fec_data[0] = (snbase >> 8) & 0xff;
-		fec_data[1] = (snbase >> 0) & 0xff;
-
-		fec_data[2] = (enc->max_packet_size >> 8) & 0xff;
-		fec_data[3] = (enc->max_packet_size >> 0) & 0xff;
-
-		fec_data[4] = enc->payload_type & 0x7f;
-
-		fec_data[5] = (mask >> 16) & 0xff;
-		fec_data[6] = (mask >> 8) & 0xff;
-		fec_data[7] = (mask >> 0) & 0xff;
-
-		fec_data[8] = (timestamp >> 24) & 0xff;
-		fec_data[9] = (timestamp >> 16) & 0xff;
-		fec_data[10] = (timestamp >> 8) & 0xff;
-		fec_data[11] = (timestamp >> 0) & 0xff;
-
-		fec_data[12] = i;
-
-		g_queue_push_tail(enc->fec_packets, fec_packet);
-
-		/*
-		The payload OpenFEC shall write to lies beyond the FEC header (12 byte) and the index byte
-		*/
-		encoding_symbol_tab[i + enc->num_media_packets] = fec_data + RTP_FEC_HEADER_SIZE + 1;
+		fec_packets[i] = enc->create_buffer(fec_packet_size, enc->create_buffer_data);
+		fec_packet_data[i] = GST_BUFFER_DATA(fec_packets[i]);
 	}
 
-	for (i = 0; i < enc->num_fec_packets; ++i)
+	result = fec_core_encode(&params, media_packets, fec_packet_data, enc->padding);
+	if (result != FEC_CORE_OK)
 	{
-		of_build_repair_symbol(session, encoding_symbol_tab, i + enc->num_media_packets);
+		GST_ERROR("Could not calculate FEC packets: error %d", (int)result);
+		for (i = 0; i < params.num_fec_packets; ++i)
+			gst_buffer_unref(fec_packets[i]);
+		FEC_PROBE2(enc_calculate_done, params.snbase, 0);
+		return;
 	}
-	GST_DEBUG("Calculated FEC packets");
 
-	free(encoding_symbol_tab);
-	of_release_codec_instance(session);
+	for (i = 0; i < params.num_fec_packets; ++i)
+		g_queue_push_tail(enc->fec_packets, fec_packets[i]);
+	enc->current_fec_seqnum = (enc->current_fec_seqnum + params.num_fec_packets) & 0xffff;
 
-}
+	GST_DEBUG("Calculated %s", enc->xor_mode ? "XOR parity packet" : "FEC packets");
 
+	FEC_PROBE2(enc_calculate_done, params.snbase, params.num_fec_packets);
+
+	if (enc->stats != NULL)
+	{
+		FEC_STATS_ADD(enc->stats, blocks_encoded, 1);
+		FEC_STATS_ADD(enc->stats, fec_packets, params.num_fec_packets);
+		FEC_STATS_ADD(enc->stats, fec_bytes, (guint64)params.num_fec_packets * fec_packet_size);
+		fec_stats_histogram_add(&(enc->stats->encode_time), gst_util_get_timestamp() - start_time);
+	}
+}
@@ -25,13 +25,33 @@
 
 
 #include <gst/gst.h>
+#include "feccore.h"
+#include "fecstats.h"
 
 
 struct fec_enc_s;
 typedef struct fec_enc_s fec_enc;
+typedef GstBuffer* (*fec_enc_create_buffer_function)(guint const size_in_bytes, void *data);
+/*
+Called right before the FEC packets of a block are generated, with the number of FEC packets the block
+would get and the size of each of them in bytes; returns the number of FEC packets to actually generate.
+Returning fewer drops the repair symbols with the highest indices; returning 0 skips the block.
+*/
+typedef guint (*fec_enc_limit_function)(guint const num_fec_packets, guint const fec_packet_size, void *data);
+
+
+/* Size of one member table entry in joint FEC packets: SSRC (32 bit), seqnum (16 bit) and length (16 bit) of a media packet */
+#define FEC_JOINT_MEMBER_SIZE FEC_CORE_JOINT_MEMBER_SIZE
 
+/* Index byte of XOR parity packets (see fec_enc_set_xor()); RS repair symbols never reach this index */
+#define FEC_XOR_INDEX FEC_CORE_XOR_INDEX
 
-fec_enc* fec_enc_create(guint const num_media_packets, guint const num_fec_packets, guint const payload_type, guint const seqnum_offset);
+
+/*
+create_buffer is called for every FEC packet; the returned buffer's contents may be uninitialized.
+If create_buffer is NULL, FEC packets are allocated with gst_buffer_new_and_alloc().
+*/
+fec_enc* fec_enc_create(guint const num_media_packets, guint const num_fec_packets, guint const payload_type, guint const seqnum_offset, fec_enc_create_buffer_function const create_buffer, void *create_buffer_data);
 void fec_enc_destroy(fec_enc *enc);
 
 void fec_enc_push_media_packet(fec_enc *enc, GstBuffer *packet);
@@ -46,6 +66,55 @@ guint fec_enc_get_num_media_packets(fec_enc *enc);
 void fec_enc_set_num_fec_packets(fec_enc *enc, guint const num_fec_packets);
 guint fec_enc_get_num_fec_packets(fec_enc *enc);
 
+/*
+In joint mode, a block may contain media packets of several streams. The FEC packets then have
+the E bit of the FEC header set, and the index byte is followed by a member table with one entry
+(SSRC, seqnum, length) per media packet of the block, in block order. The repair payload follows the table.
+*/
+void fec_enc_set_joint(fec_enc *enc, gboolean const joint);
+gboolean fec_enc_get_joint(fec_enc *enc);
+
+/*
+Unequal error protection: if a keyframe geometry is set (num_media_packets > 0), packets pushed with
+fec_enc_push_keyframe_packet() go into blocks of their own with that geometry, typically with fewer
+media packets and more FEC packets than regular blocks. A block is finished early when the packet
+type changes; the mask in the FEC header tells the decoder the actual number of media packets.
+*/
+void fec_enc_push_keyframe_packet(fec_enc *enc, GstBuffer *packet);
+void fec_enc_set_keyframe_geometry(fec_enc *enc, guint const num_media_packets, guint const num_fec_packets);
+guint fec_enc_get_keyframe_num_media_packets(fec_enc *enc);
+guint fec_enc_get_keyframe_num_fec_packets(fec_enc *enc);
+
+/*
+In XOR mode, each block gets a single parity packet instead of RS repair symbols. Its payload is the
+XOR of all media packets of the block (zero-padded to the symbol length), and its index byte is
+FEC_XOR_INDEX. This is much cheaper to compute, but can recover only one lost packet per block.
+Switching takes effect with the next block. Not supported in joint mode.
+*/
+void fec_enc_set_xor(fec_enc *enc, gboolean const xor_mode);
+gboolean fec_enc_get_xor(fec_enc *enc);
+
+/*
+Preallocates the padding memory for blocks with media packets of up to max_symbol_size bytes, so the
+first blocks do not allocate it while streaming; larger packets still work, but grow the memory. Set
+it after the block geometry, since it is sized for the current one. RS encoder sessions are kept
+across blocks anyway, and reused as long as the geometry and the symbol size stay the same.
+*/
+void fec_enc_set_max_symbol_size(fec_enc *enc, guint const max_symbol_size);
+guint fec_enc_get_max_symbol_size(fec_enc *enc);
+
+/* If limit is NULL (the default), all blocks get their full number of FEC packets */
+void fec_enc_set_limit_function(fec_enc *enc, fec_enc_limit_function const limit, void *limit_data);
+
+/* If stats is NULL (the default), no statistics are collected; the encoder does not take ownership of stats */
+void fec_enc_set_stats(fec_enc *enc, fec_enc_stats *stats);
+
+/*
+Returns the time between the last two finished blocks, as given by the timestamps of the media packets which
+finished them, or GST_CLOCK_TIME_NONE if fewer than two blocks with timestamps were finished since the last reset
+*/
+GstClockTime fec_enc_get_block_interval(fec_enc *enc);
+
 gboolean fec_enc_is_media_packet_list_full(fec_enc *enc);
 gboolean fec_enc_has_fec_packets(fec_enc *enc);
 
@@ -0,0 +1,142 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+#include <string.h>
+#include "fecimpair.h"
+
+
+
+void fec_impair_init(fec_impair *impair, guint32 const seed)
+{
+	memset(&(impair->settings), 0, sizeof(fec_impair_settings));
+	impair->settings.loss_model = FEC_IMPAIR_LOSS_MODEL_NONE;
+	impair->settings.burst_length = 1;
+	impair->rand = g_rand_new_with_seed(seed);
+	fec_impair_reset(impair, seed);
+}
+
+
+void fec_impair_cleanup(fec_impair *impair)
+{
+	g_rand_free(impair->rand);
+	impair->rand = NULL;
+}
+
+
+void fec_impair_reset(fec_impair *impair, guint32 const seed)
+{
+	g_rand_set_seed(impair->rand, seed);
+	impair->bad_state = FALSE;
+	impair->remaining_burst = 0;
+	impair->num_packets = 0;
+	impair->num_dropped = 0;
+	impair->num_duplicated = 0;
+	impair->num_reordered = 0;
+}
+
+
+static gboolean fec_impair_chance(fec_impair *impair, gdouble const probability)
+{
+	/* Not drawing a number for disabled impairments keeps the sequences of the other ones unchanged */
+	if (probability <= 0.0)
+		return FALSE;
+	return g_rand_double(impair->rand) < probability;
+}
+
+
+static gboolean fec_impair_is_lost(fec_impair *impair)
+{
+	fec_impair_settings *settings = &(impair->settings);
+
+	switch (settings->loss_model)
+	{
+		case FEC_IMPAIR_LOSS_MODEL_BERNOULLI:
+			return fec_impair_chance(impair, settings->loss_probability);
+
+		case FEC_IMPAIR_LOSS_MODEL_GILBERT_ELLIOTT:
+			if (impair->bad_state)
+			{
+				if (fec_impair_chance(impair, settings->ge_r))
+					impair->bad_state = FALSE;
+			}
+			else
+			{
+				if (fec_impair_chance(impair, settings->ge_p))
+					impair->bad_state = TRUE;
+			}
+			return fec_impair_chance(impair, impair->bad_state ? settings->ge_loss_bad : settings->ge_loss_good);
+
+		case FEC_IMPAIR_LOSS_MODEL_BURST:
+		{
+			guint burst_length = MAX(settings->burst_length, 1);
+			gdouble p = settings->loss_probability;
+
+			if (impair->remaining_burst > 0)
+			{
+				--impair->remaining_burst;
+				return TRUE;
+			}
+			/*
+			Burst starts are only drawn outside of bursts; with a start probability s, a burst follows
+			on average (1 - s) / s received packets, and solving s * L / (1 - s + s * L) = p for s gives this
+			*/
+			if (fec_impair_chance(impair, p / (p + burst_length * (1.0 - p))))
+			{
+				impair->remaining_burst = burst_length - 1;
+				return TRUE;
+			}
+			return FALSE;
+		}
+
+		default:
+			return FALSE;
+	}
+}
+
+
+fec_impair_action fec_impair_process_packet(fec_impair *impair)
+{
+	++impair->num_packets;
+
+	if (fec_impair_is_lost(impair))
+	{
+		++impair->num_dropped;
+		return FEC_IMPAIR_ACTION_DROP;
+	}
+
+	if ((impair->settings.reorder_distance > 0) && fec_impair_chance(impair, impair->settings.reorder_probability))
+	{
+		++impair->num_reordered;
+		return FEC_IMPAIR_ACTION_DELAY;
+	}
+
+	if (fec_impair_chance(impair, impair->settings.duplicate_probability))
+	{
+		++impair->num_duplicated;
+		return FEC_IMPAIR_ACTION_DUPLICATE;
+	}
+
+	return FEC_IMPAIR_ACTION_PASS;
+}
@@ -0,0 +1,110 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+#ifndef FECIMPAIR_H
+#define FECIMPAIR_H
+
+
+#include <gst/gst.h>
+
+
+/*
+Deterministic network impairment for one packet stream, for evaluating FEC settings. Every packet
+is first subjected to the loss model; packets which are not lost may then be held back (reordered)
+or duplicated. All decisions come from a GRand seeded at reset time, so a stream with the same
+settings and seed is always impaired the same way.
+
+Loss models:
+- Bernoulli: every packet is lost with loss_probability
+- Gilbert-Elliott: a two-state Markov chain; the stream goes from the good to the bad state with
+  probability ge_p, and back with probability ge_r (both evaluated once per packet). Packets are
+  lost with ge_loss_good in the good state, and with ge_loss_bad in the bad state.
+- burst: bursts of burst_length consecutive packets are lost; outside of bursts, a burst starts with
+  probability p / (p + burst_length * (1 - p)), p being loss_probability, so the average loss rate is p
+*/
+
+
+typedef enum
+{
+	FEC_IMPAIR_LOSS_MODEL_NONE,
+	FEC_IMPAIR_LOSS_MODEL_BERNOULLI,
+	FEC_IMPAIR_LOSS_MODEL_GILBERT_ELLIOTT,
+	FEC_IMPAIR_LOSS_MODEL_BURST
+}
+fec_impair_loss_model;
+
+
+typedef enum
+{
+	FEC_IMPAIR_ACTION_PASS,
+	FEC_IMPAIR_ACTION_DROP,
+	/* The packet shall be sent twice */
+	FEC_IMPAIR_ACTION_DUPLICATE,
+	/* The packet shall be held back until reorder_distance later packets of the stream have passed */
+	FEC_IMPAIR_ACTION_DELAY
+}
+fec_impair_action;
+
+
+typedef struct
+{
+	fec_impair_loss_model loss_model;
+	gdouble loss_probability;
+	guint burst_length;
+	gdouble ge_p, ge_r, ge_loss_good, ge_loss_bad;
+
+	gdouble reorder_probability;
+	guint reorder_distance;
+	gdouble duplicate_probability;
+}
+fec_impair_settings;
+
+
+typedef struct
+{
+	fec_impair_settings settings;
+
+	GRand *rand;
+	gboolean bad_state;
+	guint remaining_burst;
+
+	guint64 num_packets, num_dropped, num_duplicated, num_reordered;
+}
+fec_impair;
+
+
+/* Settings are initialized to no impairment */
+void fec_impair_init(fec_impair *impair, guint32 const seed);
+void fec_impair_cleanup(fec_impair *impair);
+
+/* Restarts the random sequence and resets model state and counters; the settings are kept */
+void fec_impair_reset(fec_impair *impair, guint32 const seed);
+
+/* Decides what happens to the next packet of the stream */
+fec_impair_action fec_impair_process_packet(fec_impair *impair);
+
+
+#endif
+
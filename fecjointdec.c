@@ -0,0 +1,452 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include "fecenc.h"
+#include "fecjointdec.h"
+#include "feccore.h"
+
+
+/*
+Number of blocks worth of media packets kept in the history; the FEC packets of a block
+may arrive after media packets of the next block, especially with separate transports
+*/
+#define HISTORY_BLOCKS 4
+
+
+typedef struct
+{
+	GstBuffer *buffer; /* NULL if the entry is unused */
+	guint32 ssrc;
+	guint16 seqnum;
+}
+fec_joint_dec_history_entry;
+
+
+struct fec_joint_dec_s
+{
+	guint num_media_packets;
+	guint num_fec_packets;
+
+	create_buffer_function create_buffer;
+	void *create_buffer_data;
+
+	/* Ring buffer with the most recently received media packets of all streams */
+	fec_joint_dec_history_entry *history;
+	guint history_size, history_pos;
+
+	/* The current block is identified by the SSRC and seqnum of its first member */
+	gboolean has_block;
+	guint32 block_ssrc;
+	guint16 block_snbase;
+	guint8 *block_members;
+	guint symbol_length;
+	GQueue *fec_packets;
+
+	/* Zero-padded copies of the media packets that are shorter than the symbol length; kept across blocks */
+	guint8 *padding;
+	guint padding_size;
+
+	/* The last block that was completed or recovered; its FEC packets are not needed anymore */
+	gboolean has_finished_block;
+	guint32 finished_block_ssrc;
+	guint16 finished_block_snbase;
+
+	GQueue *recovered_packets;
+};
+
+
+
+static void fec_joint_dec_clear_packet(gpointer data, gpointer user_data)
+{
+	user_data = user_data; /* shut up compiler warning about unused arguments */
+	gst_buffer_unref(data);
+}
+
+
+static fec_joint_dec_history_entry* fec_joint_dec_find_in_history(fec_joint_dec *dec, guint32 const ssrc, guint16 const seqnum)
+{
+	guint i;
+
+	/* The history holds only a few blocks worth of packets, so a linear search is fine */
+	for (i = 0; i < dec->history_size; ++i)
+	{
+		fec_joint_dec_history_entry *entry = &(dec->history[i]);
+		if ((entry->buffer != NULL) && (entry->ssrc == ssrc) && (entry->seqnum == seqnum))
+			return entry;
+	}
+
+	return NULL;
+}
+
+
+static void fec_joint_dec_clear_history(fec_joint_dec *dec)
+{
+	guint i;
+
+	for (i = 0; i < dec->history_size; ++i)
+	{
+		if (dec->history[i].buffer != NULL)
+			gst_buffer_unref(dec->history[i].buffer);
+		dec->history[i].buffer = NULL;
+	}
+
+	dec->history_pos = 0;
+}
+
+
+static void fec_joint_dec_allocate(fec_joint_dec *dec)
+{
+	free(dec->history);
+	free(dec->block_members);
+
+	dec->history_size = dec->num_media_packets * HISTORY_BLOCKS;
+	dec->history = calloc(dec->history_size, sizeof(fec_joint_dec_history_entry));
+	dec->history_pos = 0;
+	dec->block_members = malloc(dec->num_media_packets * FEC_JOINT_MEMBER_SIZE);
+}
+
+
+static void fec_joint_dec_drop_block(fec_joint_dec *dec)
+{
+	g_queue_foreach(dec->fec_packets, fec_joint_dec_clear_packet, NULL);
+	g_queue_clear(dec->fec_packets);
+	dec->has_block = FALSE;
+}
+
+
+static void fec_joint_dec_finish_block(fec_joint_dec *dec)
+{
+	dec->has_finished_block = TRUE;
+	dec->finished_block_ssrc = dec->block_ssrc;
+	dec->finished_block_snbase = dec->block_snbase;
+	fec_joint_dec_drop_block(dec);
+}
+
+
+static void fec_joint_dec_recover_packets(fec_joint_dec *dec, fec_joint_dec_history_entry **members)
+{
+	fec_core_decode_params params;
+	fec_core_fec_packet_info info;
+	fec_core_result result;
+	struct iovec media_packets[FEC_CORE_MAX_MEDIA_PACKETS];
+	guint8 const *repair_symbols[FEC_CORE_MAX_SYMBOLS];
+	guint8 *recovered_data[FEC_CORE_MAX_MEDIA_PACKETS];
+	GstBuffer *recovered_packets[FEC_CORE_MAX_MEDIA_PACKETS];
+	guint i;
+	GList *link;
+
+	params.num_media_packets = dec->num_media_packets;
+	params.num_fec_packets = dec->num_fec_packets;
+	params.symbol_size = dec->symbol_length;
+
+	for (i = 0; i < dec->num_media_packets; ++i)
+	{
+		if (members[i] == NULL)
+		{
+			media_packets[i].iov_base = NULL;
+			media_packets[i].iov_len = 0;
+			recovered_packets[i] = dec->create_buffer(dec->symbol_length, dec->create_buffer_data);
+			recovered_data[i] = GST_BUFFER_DATA(recovered_packets[i]);
+		}
+		else
+		{
+			media_packets[i].iov_base = GST_BUFFER_DATA(members[i]->buffer);
+			media_packets[i].iov_len = GST_BUFFER_SIZE(members[i]->buffer);
+			recovered_packets[i] = NULL;
+			recovered_data[i] = NULL;
+		}
+	}
+
+	/* The member table precedes the repair symbol; the parser skips it */
+	memset(repair_symbols, 0, sizeof(guint8 const *) * dec->num_fec_packets);
+	for (link = g_queue_peek_head_link(dec->fec_packets); link != NULL; link = link->next)
+	{
+		GstBuffer *packet = link->data;
+		if ((fec_core_parse_fec_packet(GST_BUFFER_DATA(packet), GST_BUFFER_SIZE(packet), &info) == FEC_CORE_OK) && (info.index < dec->num_fec_packets))
+			repair_symbols[info.index] = info.repair_symbol;
+	}
+
+	/*
+	The streams of a joint block usually have very different packet sizes (audio vs. video),
+	so shorter media packets are copied and zero-padded to the symbol length
+	*/
+	if ((dec->num_media_packets * dec->symbol_length) > dec->padding_size)
+	{
+		free(dec->padding);
+		dec->padding_size = dec->num_media_packets * dec->symbol_length;
+		dec->padding = malloc(dec->padding_size);
+	}
+	result = fec_core_decode(&params, media_packets, repair_symbols, recovered_data, dec->padding);
+
+	for (i = 0; i < dec->num_media_packets; ++i)
+	{
+		guint16 length;
+
+		if (recovered_packets[i] == NULL)
+			continue;
+
+		/* The recovered symbol is zero-padded to the symbol length; the member table has the actual packet length */
+		fec_core_read_joint_member(dec->block_members, i, NULL, NULL, &length);
+
+		if ((result == FEC_CORE_OK) && (length <= dec->symbol_length))
+		{
+			GST_BUFFER_SIZE(recovered_packets[i]) = length;
+			g_queue_push_tail(dec->recovered_packets, recovered_packets[i]);
+		}
+		else
+			gst_buffer_unref(recovered_packets[i]);
+	}
+
+	if (result != FEC_CORE_OK)
+		GST_DEBUG("Recovering media packets of joint block failed: error %d", (int)result);
+}
+
+
+static void fec_joint_dec_check_state(fec_joint_dec *dec)
+{
+	fec_joint_dec_history_entry *members[FEC_CORE_MAX_MEDIA_PACKETS];
+	guint i, num_present;
+
+	if (!dec->has_block)
+		return;
+
+	assert(dec->num_media_packets <= FEC_CORE_MAX_MEDIA_PACKETS);
+	num_present = 0;
+
+	for (i = 0; i < dec->num_media_packets; ++i)
+	{
+		guint32 ssrc;
+		guint16 seqnum;
+
+		fec_core_read_joint_member(dec->block_members, i, &ssrc, &seqnum, NULL);
+		members[i] = fec_joint_dec_find_in_history(dec, ssrc, seqnum);
+		if (members[i] != NULL)
+			++num_present;
+	}
+
+	if (num_present == dec->num_media_packets)
+	{
+		GST_DEBUG("All %u media packets of joint block present, no recovery operation necessary", dec->num_media_packets);
+		fec_joint_dec_finish_block(dec);
+	}
+	else if ((num_present + g_queue_get_length(dec->fec_packets)) >= dec->num_media_packets)
+	{
+		GST_DEBUG("Recovering %u media packets of joint block", dec->num_media_packets - num_present);
+		fec_joint_dec_recover_packets(dec, members);
+		fec_joint_dec_finish_block(dec);
+	}
+}
+
+
+
+fec_joint_dec* fec_joint_dec_create(guint const num_media_packets, guint const num_fec_packets, create_buffer_function const create_buffer, void *create_buffer_data)
+{
+	fec_joint_dec *dec = malloc(sizeof(fec_joint_dec));
+
+	dec->num_media_packets = num_media_packets;
+	dec->num_fec_packets = num_fec_packets;
+	dec->create_buffer = create_buffer;
+	dec->create_buffer_data = create_buffer_data;
+	dec->history = NULL;
+	dec->block_members = NULL;
+	dec->has_block = FALSE;
+	dec->has_finished_block = FALSE;
+	dec->symbol_length = 0;
+	dec->padding = NULL;
+	dec->padding_size = 0;
+	dec->fec_packets = g_queue_new();
+	dec->recovered_packets = g_queue_new();
+
+	fec_joint_dec_allocate(dec);
+
+	return dec;
+}
+
+
+void fec_joint_dec_destroy(fec_joint_dec *dec)
+{
+	fec_joint_dec_reset(dec);
+	g_queue_free(dec->fec_packets);
+	g_queue_free(dec->recovered_packets);
+	free(dec->history);
+	free(dec->block_members);
+	free(dec->padding);
+	free(dec);
+}
+
+
+void fec_joint_dec_push_media_packet(fec_joint_dec *dec, GstBuffer *packet)
+{
+	fec_joint_dec_history_entry *entry;
+	guint32 ssrc;
+	guint16 seqnum;
+
+	ssrc = gst_rtp_buffer_get_ssrc(packet);
+	seqnum = gst_rtp_buffer_get_seq(packet);
+
+	if (fec_joint_dec_find_in_history(dec, ssrc, seqnum) != NULL)
+	{
+		GST_DEBUG("Media packet with SSRC %08x seqnum %u is already in history - discarding duplicate", ssrc, seqnum);
+		return;
+	}
+
+	/* Overwrite the oldest entry */
+	entry = &(dec->history[dec->history_pos]);
+	if (entry->buffer != NULL)
+		gst_buffer_unref(entry->buffer);
+	entry->buffer = gst_buffer_ref(packet);
+	entry->ssrc = ssrc;
+	entry->seqnum = seqnum;
+	dec->history_pos = (dec->history_pos + 1) % dec->history_size;
+
+	fec_joint_dec_check_state(dec);
+}
+
+
+void fec_joint_dec_push_fec_packet(fec_joint_dec *dec, GstBuffer *packet)
+{
+	fec_core_fec_packet_info info;
+	guint32 ssrc;
+	GList *link;
+
+	if (fec_core_parse_fec_packet(GST_BUFFER_DATA(packet), GST_BUFFER_SIZE(packet), &info) != FEC_CORE_OK)
+	{
+		GST_DEBUG("FEC packet too small for its headers - ignoring");
+		return;
+	}
+
+	if (!info.extended)
+	{
+		GST_DEBUG("Ignoring FEC packet without E bit - not a joint block");
+		return;
+	}
+
+	if ((info.num_media_packets != dec->num_media_packets) || (info.index >= dec->num_fec_packets))
+	{
+		GST_DEBUG("Joint FEC packet geometry (mask %06x, index %u) does not match the configured %u+%u - ignoring", info.mask, (guint)(info.index), dec->num_media_packets, dec->num_fec_packets);
+		return;
+	}
+
+	/* The block is identified by its first member; the encoder uses that member's seqnum as snbase */
+	fec_core_read_joint_member(info.member_table, 0, &ssrc, NULL, NULL);
+
+	GST_DEBUG("Received joint FEC packet, block SSRC %08x snbase %u, index %u", ssrc, info.snbase, (guint)(info.index));
+
+	if (dec->has_finished_block && (dec->finished_block_ssrc == ssrc) && (dec->finished_block_snbase == info.snbase))
+	{
+		GST_DEBUG("Ignoring FEC packet since its block is complete already");
+		return;
+	}
+
+	if (!dec->has_block || (dec->block_ssrc != ssrc) || (dec->block_snbase != info.snbase))
+	{
+		if (dec->has_block)
+			GST_DEBUG("Joint block changed - purging %u FEC packets", g_queue_get_length(dec->fec_packets));
+
+		fec_joint_dec_drop_block(dec);
+		dec->has_block = TRUE;
+		dec->block_ssrc = ssrc;
+		dec->block_snbase = info.snbase;
+		dec->symbol_length = info.length_recovery;
+		memcpy(dec->block_members, info.member_table, dec->num_media_packets * FEC_JOINT_MEMBER_SIZE);
+	}
+
+	/* The repair payload must cover the whole symbol */
+	if (info.repair_symbol_size < dec->symbol_length)
+	{
+		GST_DEBUG("Joint FEC packet payload is shorter than the symbol length %u - ignoring", dec->symbol_length);
+		return;
+	}
+
+	for (link = g_queue_peek_head_link(dec->fec_packets); link != NULL; link = link->next)
+	{
+		GstBuffer *queued_packet = link->data;
+		fec_core_fec_packet_info queued_info;
+
+		/* Queued packets were parsed successfully before, so this cannot fail */
+		fec_core_parse_fec_packet(GST_BUFFER_DATA(queued_packet), GST_BUFFER_SIZE(queued_packet), &queued_info);
+		if (queued_info.index == info.index)
+		{
+			GST_DEBUG("Joint FEC packet with index %u is already in queue - discarding duplicate", (guint)(info.index));
+			return;
+		}
+	}
+
+	g_queue_push_tail(dec->fec_packets, gst_buffer_ref(packet));
+
+	fec_joint_dec_check_state(dec);
+}
+
+
+gboolean fec_joint_dec_has_recovered_packets(fec_joint_dec *dec)
+{
+	return !g_queue_is_empty(dec->recovered_packets);
+}
+
+
+GstBuffer* fec_joint_dec_pop_recovered_packet(fec_joint_dec *dec)
+{
+	return g_queue_pop_head(dec->recovered_packets);
+}
+
+
+void fec_joint_dec_set_num_media_packets(fec_joint_dec *dec, guint const num_media_packets)
+{
+	fec_joint_dec_reset(dec);
+	dec->num_media_packets = num_media_packets;
+	fec_joint_dec_allocate(dec);
+}
+
+
+guint fec_joint_dec_get_num_media_packets(fec_joint_dec *dec)
+{
+	return dec->num_media_packets;
+}
+
+
+void fec_joint_dec_set_num_fec_packets(fec_joint_dec *dec, guint const num_fec_packets)
+{
+	fec_joint_dec_reset(dec);
+	dec->num_fec_packets = num_fec_packets;
+}
+
+
+guint fec_joint_dec_get_num_fec_packets(fec_joint_dec *dec)
+{
+	return dec->num_fec_packets;
+}
+
+
+void fec_joint_dec_reset(fec_joint_dec *dec)
+{
+	fec_joint_dec_drop_block(dec);
+	fec_joint_dec_clear_history(dec);
+	dec->has_finished_block = FALSE;
+	g_queue_foreach(dec->recovered_packets, fec_joint_dec_clear_packet, NULL);
+	g_queue_clear(dec->recovered_packets);
+}
+
+
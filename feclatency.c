@@ -0,0 +1,86 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+#include <gst/rtp/gstrtpbuffer.h>
+#include "feclatency.h"
+
+
+
+void fec_latency_estimator_reset(fec_latency_estimator *estimator)
+{
+	estimator->ssrc = 0;
+	estimator->has_ssrc = FALSE;
+	estimator->last_timestamp = GST_CLOCK_TIME_NONE;
+	estimator->packet_interval = 0;
+}
+
+
+void fec_latency_estimator_push_packet(fec_latency_estimator *estimator, GstBuffer *packet)
+{
+	GstClockTime timestamp;
+	guint32 ssrc;
+
+	timestamp = GST_BUFFER_TIMESTAMP(packet);
+	if (!GST_CLOCK_TIME_IS_VALID(timestamp))
+		return;
+
+	ssrc = gst_rtp_buffer_get_ssrc(packet);
+	if (!estimator->has_ssrc)
+	{
+		estimator->ssrc = ssrc;
+		estimator->has_ssrc = TRUE;
+	}
+	else if (ssrc != estimator->ssrc)
+		return;
+
+	if (GST_CLOCK_TIME_IS_VALID(estimator->last_timestamp) && (timestamp >= estimator->last_timestamp) && ((timestamp - estimator->last_timestamp) <= FEC_LATENCY_MAX_PACKET_INTERVAL))
+	{
+		GstClockTime interval = timestamp - estimator->last_timestamp;
+
+		/* The first nonzero difference initializes the average; zero differences alone say nothing about the rate */
+		if (estimator->packet_interval == 0)
+			estimator->packet_interval = interval;
+		else
+			estimator->packet_interval = (estimator->packet_interval * 15 + interval) / 16;
+	}
+
+	estimator->last_timestamp = timestamp;
+}
+
+
+GstClockTime fec_latency_estimator_get_block_duration(fec_latency_estimator *estimator, guint const num_media_packets)
+{
+	return estimator->packet_interval * num_media_packets;
+}
+
+
+gboolean fec_latency_has_changed(GstClockTime const reported_latency, GstClockTime const latency)
+{
+	GstClockTime difference;
+
+	if (!GST_CLOCK_TIME_IS_VALID(reported_latency))
+		return FALSE;
+
+	difference = (latency > reported_latency) ? (latency - reported_latency) : (reported_latency - latency);
+	return (difference * FEC_LATENCY_TOLERANCE_DIVISOR) > reported_latency;
+}
+
@@ -0,0 +1,66 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+#ifndef FECLATENCY_H
+#define FECLATENCY_H
+
+
+#include <gst/gst.h>
+
+
+/*
+Estimates the duration of FEC blocks from the timestamps of incoming media packets, for latency reporting.
+Block durations are per stream, so only the packets of the first stream seen (by SSRC) are measured.
+The packet interval is a moving average of the timestamp differences of consecutive packets; since the
+packets of one frame often share a timestamp, zero differences are part of the average. Differences above
+FEC_LATENCY_MAX_PACKET_INTERVAL (discontinuities) and negative ones (reordering) are ignored.
+*/
+
+
+#define FEC_LATENCY_MAX_PACKET_INTERVAL GST_SECOND
+
+/* A latency counts as changed if it differs from the last reported one by more than 1/FEC_LATENCY_TOLERANCE_DIVISOR */
+#define FEC_LATENCY_TOLERANCE_DIVISOR 4
+
+
+typedef struct
+{
+	guint32 ssrc;
+	gboolean has_ssrc;
+	GstClockTime last_timestamp;
+	GstClockTime packet_interval; /* 0 if not measured yet */
+}
+fec_latency_estimator;
+
+
+void fec_latency_estimator_reset(fec_latency_estimator *estimator);
+void fec_latency_estimator_push_packet(fec_latency_estimator *estimator, GstBuffer *packet);
+
+/* Returns 0 if no packet interval has been measured yet */
+GstClockTime fec_latency_estimator_get_block_duration(fec_latency_estimator *estimator, guint const num_media_packets);
+
+/* Returns TRUE if a latency was reported already (reported_latency is valid), and latency deviates too much from it */
+gboolean fec_latency_has_changed(GstClockTime const reported_latency, GstClockTime const latency);
+
+
+#endif
+
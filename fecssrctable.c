@@ -0,0 +1,255 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fecssrctable.h"
+
+
+/* Bundles rarely carry more than a handful of streams */
+#define INITIAL_CAPACITY_LOG2 3
+
+
+typedef struct
+{
+	guint32 ssrc;
+	gpointer value; /* NULL if the entry is unused */
+	guint64 last_use; /* value of use_counter at the last lookup hit or insert */
+}
+fec_ssrc_table_entry;
+
+
+struct fec_ssrc_table_s
+{
+	fec_ssrc_table_entry *entries;
+	guint capacity_log2;
+	guint size;
+
+	/* Index of the most recently found or inserted entry */
+	guint last_index;
+
+	/* Incremented with each lookup hit and insert */
+	guint64 use_counter;
+
+	fec_ssrc_table_destroy_function destroy_value;
+};
+
+
+
+static guint fec_ssrc_table_hash(fec_ssrc_table *table, guint32 const ssrc)
+{
+	/* Fibonacci hashing; SSRCs are random, but the multiplication guards against poorly chosen ones */
+	return (guint32)(ssrc * 2654435761u) >> (32 - table->capacity_log2);
+}
+
+
+static guint fec_ssrc_table_find_slot(fec_ssrc_table *table, guint32 const ssrc)
+{
+	guint mask = (1u << table->capacity_log2) - 1;
+	guint index = fec_ssrc_table_hash(table, ssrc);
+
+	/* Linear probing; terminates because the table is never more than half full */
+	while ((table->entries[index].value != NULL) && (table->entries[index].ssrc != ssrc))
+		index = (index + 1) & mask;
+
+	return index;
+}
+
+
+static void fec_ssrc_table_grow(fec_ssrc_table *table)
+{
+	fec_ssrc_table_entry *old_entries = table->entries;
+	guint i, old_capacity = 1u << table->capacity_log2;
+
+	++table->capacity_log2;
+	table->entries = calloc(1u << table->capacity_log2, sizeof(fec_ssrc_table_entry));
+
+	for (i = 0; i < old_capacity; ++i)
+	{
+		if (old_entries[i].value != NULL)
+			table->entries[fec_ssrc_table_find_slot(table, old_entries[i].ssrc)] = old_entries[i];
+	}
+
+	table->last_index = 0;
+	free(old_entries);
+}
+
+
+fec_ssrc_table* fec_ssrc_table_create(fec_ssrc_table_destroy_function const destroy_value)
+{
+	fec_ssrc_table *table = malloc(sizeof(fec_ssrc_table));
+
+	table->capacity_log2 = INITIAL_CAPACITY_LOG2;
+	table->entries = calloc(1u << table->capacity_log2, sizeof(fec_ssrc_table_entry));
+	table->size = 0;
+	table->last_index = 0;
+	table->use_counter = 0;
+	table->destroy_value = destroy_value;
+
+	return table;
+}
+
+
+void fec_ssrc_table_destroy(fec_ssrc_table *table)
+{
+	fec_ssrc_table_clear(table);
+	free(table->entries);
+	free(table);
+}
+
+
+gpointer fec_ssrc_table_lookup(fec_ssrc_table *table, guint32 const ssrc)
+{
+	guint index;
+
+	if ((table->entries[table->last_index].value != NULL) && (table->entries[table->last_index].ssrc == ssrc))
+	{
+		table->entries[table->last_index].last_use = ++table->use_counter;
+		return table->entries[table->last_index].value;
+	}
+
+	index = fec_ssrc_table_find_slot(table, ssrc);
+	if (table->entries[index].value == NULL)
+		return NULL;
+
+	table->last_index = index;
+	table->entries[index].last_use = ++table->use_counter;
+	return table->entries[index].value;
+}
+
+
+void fec_ssrc_table_insert(fec_ssrc_table *table, guint32 const ssrc, gpointer value)
+{
+	guint index;
+
+	assert(value != NULL);
+
+	/* Keep the load factor at or below 1/2, so probe sequences stay short */
+	if (((table->size + 1) * 2) > (1u << table->capacity_log2))
+		fec_ssrc_table_grow(table);
+
+	index = fec_ssrc_table_find_slot(table, ssrc);
+	if (table->entries[index].value != NULL)
+	{
+		if (table->destroy_value != NULL)
+			table->destroy_value(table->entries[index].value);
+	}
+	else
+		++table->size;
+
+	table->entries[index].ssrc = ssrc;
+	table->entries[index].value = value;
+	table->entries[index].last_use = ++table->use_counter;
+	table->last_index = index;
+}
+
+
+void fec_ssrc_table_remove(fec_ssrc_table *table, guint32 const ssrc)
+{
+	guint mask = (1u << table->capacity_log2) - 1;
+	guint index, next;
+
+	index = fec_ssrc_table_find_slot(table, ssrc);
+	if (table->entries[index].value == NULL)
+		return;
+
+	if (table->destroy_value != NULL)
+		table->destroy_value(table->entries[index].value);
+	table->entries[index].value = NULL;
+	--table->size;
+
+	/*
+	Backward shift deletion: entries following in the probe sequence are moved into the hole if their
+	home slot does not lie between the hole and their current slot, so lookups never stop early at the hole
+	*/
+	for (next = (index + 1) & mask; table->entries[next].value != NULL; next = (next + 1) & mask)
+	{
+		guint home = fec_ssrc_table_hash(table, table->entries[next].ssrc);
+		if (((next - home) & mask) >= ((next - index) & mask))
+		{
+			table->entries[index] = table->entries[next];
+			table->entries[next].value = NULL;
+			index = next;
+		}
+	}
+
+	table->last_index = 0;
+}
+
+
+gboolean fec_ssrc_table_remove_least_recently_used(fec_ssrc_table *table, guint const min_idle_uses, guint32 *removed_ssrc)
+{
+	guint i, capacity = 1u << table->capacity_log2;
+	fec_ssrc_table_entry *oldest = NULL;
+
+	for (i = 0; i < capacity; ++i)
+	{
+		if ((table->entries[i].value != NULL) && ((oldest == NULL) || (table->entries[i].last_use < oldest->last_use)))
+			oldest = &(table->entries[i]);
+	}
+
+	if ((oldest == NULL) || ((table->use_counter - oldest->last_use) < min_idle_uses))
+		return FALSE;
+
+	if (removed_ssrc != NULL)
+		*removed_ssrc = oldest->ssrc;
+	fec_ssrc_table_remove(table, oldest->ssrc);
+
+	return TRUE;
+}
+
+
+void fec_ssrc_table_foreach(fec_ssrc_table *table, fec_ssrc_table_foreach_function const func, gpointer user_data)
+{
+	guint i, capacity = 1u << table->capacity_log2;
+
+	for (i = 0; i < capacity; ++i)
+	{
+		if (table->entries[i].value != NULL)
+			func(table->entries[i].ssrc, table->entries[i].value, user_data);
+	}
+}
+
+
+guint fec_ssrc_table_get_size(fec_ssrc_table *table)
+{
+	return table->size;
+}
+
+
+void fec_ssrc_table_clear(fec_ssrc_table *table)
+{
+	guint i, capacity = 1u << table->capacity_log2;
+
+	for (i = 0; i < capacity; ++i)
+	{
+		if ((table->entries[i].value != NULL) && (table->destroy_value != NULL))
+			table->destroy_value(table->entries[i].value);
+	}
+
+	memset(table->entries, 0, capacity * sizeof(fec_ssrc_table_entry));
+	table->size = 0;
+	table->last_index = 0;
+}
+
+
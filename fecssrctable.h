@@ -0,0 +1,71 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+#ifndef FECSSRCTABLE_H
+#define FECSSRCTABLE_H
+
+
+#include <gst/gst.h>
+
+
+/*
+Compact table mapping RTP SSRCs to per-stream state (encoders, decoders). It uses open addressing
+in one flat array, and remembers the last hit, since consecutive packets usually belong to the
+same stream. Each lookup hit and insert counts as a use of the entry, which allows for replacing
+the least recently used stream once a table is full.
+*/
+
+
+struct fec_ssrc_table_s;
+typedef struct fec_ssrc_table_s fec_ssrc_table;
+
+typedef void (*fec_ssrc_table_destroy_function)(gpointer value);
+typedef void (*fec_ssrc_table_foreach_function)(guint32 const ssrc, gpointer value, gpointer user_data);
+
+
+/* destroy_value is called for each value when the table is cleared or destroyed; it may be NULL */
+fec_ssrc_table* fec_ssrc_table_create(fec_ssrc_table_destroy_function const destroy_value);
+void fec_ssrc_table_destroy(fec_ssrc_table *table);
+
+/* Returns NULL if there is no entry for the SSRC */
+gpointer fec_ssrc_table_lookup(fec_ssrc_table *table, guint32 const ssrc);
+/* value must not be NULL; an existing entry for the SSRC is replaced (and its value destroyed) */
+void fec_ssrc_table_insert(fec_ssrc_table *table, guint32 const ssrc, gpointer value);
+
+/* Removes the entry for the SSRC (and destroys its value) if there is one */
+void fec_ssrc_table_remove(fec_ssrc_table *table, guint32 const ssrc);
+/*
+Removes the least recently used entry, but only if no other lookup or insert used it during the last
+min_idle_uses uses of the table (so streams which are still active are not replaced); returns TRUE and
+stores the SSRC of the removed entry in removed_ssrc (which may be NULL) if an entry was removed
+*/
+gboolean fec_ssrc_table_remove_least_recently_used(fec_ssrc_table *table, guint const min_idle_uses, guint32 *removed_ssrc);
+
+void fec_ssrc_table_foreach(fec_ssrc_table *table, fec_ssrc_table_foreach_function const func, gpointer user_data);
+guint fec_ssrc_table_get_size(fec_ssrc_table *table);
+
+void fec_ssrc_table_clear(fec_ssrc_table *table);
+
+
+#endif
+
+
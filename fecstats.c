@@ -0,0 +1,116 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+#include <string.h>
+#include "fecstats.h"
+
+
+/* Reads a counter atomically; plain 64-bit reads may tear on 32-bit platforms */
+#define FEC_STATS_READ(counter) __sync_fetch_and_add(&(counter), (guint64)0)
+
+
+
+void fec_stats_histogram_add(fec_stats_histogram *histogram, GstClockTime const duration)
+{
+	guint64 microseconds;
+	guint bucket;
+
+	microseconds = duration / GST_USECOND;
+	for (bucket = 0; (microseconds != 0) && (bucket < (FEC_STATS_HISTOGRAM_SIZE - 1)); microseconds >>= 1)
+		++bucket;
+
+	__sync_fetch_and_add(&(histogram->buckets[bucket]), (guint64)1);
+}
+
+
+void fec_enc_stats_reset(fec_enc_stats *stats)
+{
+	memset(stats, 0, sizeof(fec_enc_stats));
+}
+
+
+void fec_dec_stats_reset(fec_dec_stats *stats)
+{
+	memset(stats, 0, sizeof(fec_dec_stats));
+}
+
+
+static void fec_stats_set_histogram(GstStructure *structure, gchar const *name, fec_stats_histogram *histogram)
+{
+	GValue array, bucket;
+	guint i;
+
+	/* GValues must be zeroed before g_value_init() */
+	memset(&array, 0, sizeof(GValue));
+	memset(&bucket, 0, sizeof(GValue));
+	g_value_init(&array, GST_TYPE_ARRAY);
+	g_value_init(&bucket, G_TYPE_UINT64);
+
+	for (i = 0; i < FEC_STATS_HISTOGRAM_SIZE; ++i)
+	{
+		g_value_set_uint64(&bucket, FEC_STATS_READ(histogram->buckets[i]));
+		gst_value_array_append_value(&array, &bucket);
+	}
+
+	gst_structure_set_value(structure, name, &array);
+
+	g_value_unset(&bucket);
+	g_value_unset(&array);
+}
+
+
+GstStructure* fec_enc_stats_get_structure(fec_enc_stats *stats)
+{
+	GstStructure *structure;
+
+	structure = gst_structure_new(
+		"fec-enc-stats",
+		"blocks-encoded", G_TYPE_UINT64, FEC_STATS_READ(stats->blocks_encoded),
+		"fec-packets", G_TYPE_UINT64, FEC_STATS_READ(stats->fec_packets),
+		"fec-bytes", G_TYPE_UINT64, FEC_STATS_READ(stats->fec_bytes),
+		NULL
+	);
+	fec_stats_set_histogram(structure, "encode-time-histogram", &(stats->encode_time));
+
+	return structure;
+}
+
+
+GstStructure* fec_dec_stats_get_structure(fec_dec_stats *stats)
+{
+	GstStructure *structure;
+
+	structure = gst_structure_new(
+		"fec-dec-stats",
+		"blocks-complete", G_TYPE_UINT64, FEC_STATS_READ(stats->blocks_complete),
+		"blocks-recovered", G_TYPE_UINT64, FEC_STATS_READ(stats->blocks_recovered),
+		"blocks-unrecoverable", G_TYPE_UINT64, FEC_STATS_READ(stats->blocks_unrecoverable),
+		"packets-recovered", G_TYPE_UINT64, FEC_STATS_READ(stats->packets_recovered),
+		"duplicates-dropped", G_TYPE_UINT64, FEC_STATS_READ(stats->duplicates_dropped),
+		NULL
+	);
+	fec_stats_set_histogram(structure, "decode-time-histogram", &(stats->decode_time));
+	fec_stats_set_histogram(structure, "recovery-delay-histogram", &(stats->recovery_delay));
+
+	return structure;
+}
+
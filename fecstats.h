@@ -0,0 +1,94 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+#ifndef FECSTATS_H
+#define FECSTATS_H
+
+
+#include <gst/gst.h>
+
+
+/*
+Statistics of FEC encoders and decoders. One set of statistics is typically shared by all encoders
+(or decoders) of an element; fec_enc_set_stats() and fec_dec_set_stats() attach it. The counters are
+updated with atomic operations, so neither the encoders and decoders nor the readers need a lock,
+and updating them costs next to nothing compared to debug logging.
+
+Durations are counted in histograms with power-of-two buckets: bucket 0 counts durations below
+1 microsecond, bucket i counts durations in [2^(i-1), 2^i) microseconds, and the last bucket
+also counts everything longer.
+*/
+
+
+#define FEC_STATS_HISTOGRAM_SIZE 24
+
+
+typedef struct
+{
+	guint64 buckets[FEC_STATS_HISTOGRAM_SIZE];
+}
+fec_stats_histogram;
+
+
+typedef struct
+{
+	guint64 blocks_encoded;
+	guint64 fec_packets;    /* FEC packets generated */
+	guint64 fec_bytes;      /* total size of the generated FEC packets, including their RTP headers */
+	fec_stats_histogram encode_time;
+}
+fec_enc_stats;
+
+
+typedef struct
+{
+	guint64 blocks_complete;      /* blocks whose media packets all arrived */
+	guint64 blocks_recovered;     /* blocks whose missing media packets were recovered */
+	guint64 blocks_unrecoverable; /* blocks which were given up on with media packets still missing */
+	guint64 packets_recovered;
+	guint64 duplicates_dropped;   /* media and FEC packets which arrived more than once */
+	fec_stats_histogram decode_time;
+	/* Time from the arrival of the first packet of a block until its missing packets are recovered */
+	fec_stats_histogram recovery_delay;
+}
+fec_dec_stats;
+
+
+/* Atomically adds value to a counter of a statistics structure; does nothing if stats is NULL */
+#define FEC_STATS_ADD(stats, counter, value) \
+	do { if ((stats) != NULL) __sync_fetch_and_add(&((stats)->counter), (guint64)(value)); } while (0)
+
+
+/* Atomically counts one duration in the histogram */
+void fec_stats_histogram_add(fec_stats_histogram *histogram, GstClockTime const duration);
+
+/* Not atomic; must not be called while encoders or decoders are using the statistics */
+void fec_enc_stats_reset(fec_enc_stats *stats);
+void fec_dec_stats_reset(fec_dec_stats *stats);
+
+/* The structures contain the counters as G_TYPE_UINT64 fields, and the histograms as GST_TYPE_ARRAY of G_TYPE_UINT64 */
+GstStructure* fec_enc_stats_get_structure(fec_enc_stats *stats);
+GstStructure* fec_dec_stats_get_structure(fec_dec_stats *stats);
+
+
+#endif
+
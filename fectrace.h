@@ -0,0 +1,79 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+#ifndef FECTRACE_H
+#define FECTRACE_H
+
+
+/*
+Static tracepoints (USDT) for the FEC encoder and decoder. If ENABLE_USDT is defined, the probes
+are emitted as SystemTap SDT notes under the provider name "gstrtpfec" and can be attached to with
+tools like perf, bpftrace or SystemTap, for example:
+
+  bpftrace -e 'usdt:./libgstrtpfec.so:gstrtpfec:dec_recover_done { @[arg1] = count(); }'
+
+A probe that nobody is attached to costs a single nop. If ENABLE_USDT is not defined, the probes
+compile to nothing, and their arguments are not evaluated.
+
+Encoder probes:
+  enc_block_open(ssrc, snbase)                           first media packet of a block was queued
+  enc_block_close(snbase, num_media_packets, num_fec_packets)
+  enc_calculate_start(num_media_packets, num_fec_packets, symbol_size)
+  enc_calculate_done(snbase, num_fec_packets)
+
+Decoder probes:
+  dec_block_open(snbase, num_media_packets)              first FEC packet of a block was received
+  dec_block_close(snbase, num_received_media_packets, num_received_fec_packets)
+  dec_recover_start(snbase, num_missing_packets, symbol_size)
+  dec_recover_done(snbase, num_recovered_packets)
+  dec_recover_success(snbase, num_recovered_packets)
+  dec_recover_failure(snbase, num_lost_packets)
+  dec_snbase_purge(old_snbase, new_snbase, num_purged_fec_packets, num_purged_media_packets)
+*/
+
+
+#ifdef ENABLE_USDT
+
+#include <sys/sdt.h>
+
+#define FEC_PROBE0(name) DTRACE_PROBE(gstrtpfec, name)
+#define FEC_PROBE1(name, a1) DTRACE_PROBE1(gstrtpfec, name, a1)
+#define FEC_PROBE2(name, a1, a2) DTRACE_PROBE2(gstrtpfec, name, a1, a2)
+#define FEC_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(gstrtpfec, name, a1, a2, a3)
+#define FEC_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(gstrtpfec, name, a1, a2, a3, a4)
+
+#else
+
+#define FEC_PROBE0(name) do { } while (0)
+#define FEC_PROBE1(name, a1) do { } while (0)
+#define FEC_PROBE2(name, a1, a2) do { } while (0)
+#define FEC_PROBE3(name, a1, a2, a3) do { } while (0)
+#define FEC_PROBE4(name, a1, a2, a3, a4) do { } while (0)
+
+#endif
+
+
+#endif
+
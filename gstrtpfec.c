@@ -21,6 +21,7 @@
 
 
 #include "gstrtpfec.h"
+#include "feccore.h"
 
 
 #define PACKAGE "package"
@@ -28,8 +29,18 @@
 
 static gboolean plugin_init(GstPlugin *plugin)
 {
+	/* Set up the shared codec tables now, instead of in the streaming thread of the first FEC block */
+	if (fec_core_init() != FEC_CORE_OK)
+	{
+		GST_ERROR("Could not initialize the FEC codec");
+		return FALSE;
+	}
+
 	if (!gst_element_register(plugin, "rtpfecenc", GST_RANK_NONE, gst_rtp_fec_enc_get_type())) return FALSE;
 	if (!gst_element_register(plugin, "rtpfecdec", GST_RANK_NONE, gst_rtp_fec_dec_get_type())) return FALSE;
+	if (!gst_element_register(plugin, "rtpfecudpsink", GST_RANK_NONE, gst_rtp_fec_udp_sink_get_type())) return FALSE;
+	if (!gst_element_register(plugin, "rtpfecudpsrc", GST_RANK_NONE, gst_rtp_fec_udp_src_get_type())) return FALSE;
+	if (!gst_element_register(plugin, "rtpfecimpair", GST_RANK_NONE, gst_rtp_fec_impair_get_type())) return FALSE;
 	return TRUE;
 }
 
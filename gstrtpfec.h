@@ -28,6 +28,9 @@
 
 #include "gstrtpfecenc.h"
 #include "gstrtpfecdec.h"
+#include "gstrtpfecudpsink.h"
+#include "gstrtpfecudpsrc.h"
+#include "gstrtpfecimpair.h"
 
 
 #endif
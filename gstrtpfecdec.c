@@ -21,7 +21,10 @@
 
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <gst/rtp/gstrtpbuffer.h>
+#include "feccore.h"
 #include "gstrtpfecdec.h"
 
 
@@ -52,27 +55,124 @@ enum
 {
 	PROP_0 = 0, /* GStreamer disallows properties with id 0 -> using dummy enum to prevent 0 */
 	PROP_NUM_MEDIA_PACKETS,
-	PROP_NUM_FEC_PACKETS
+	PROP_NUM_FEC_PACKETS,
+	PROP_USE_SYMBOL_ARENA,
+	PROP_MAX_PACKET_SIZE,
+	PROP_POOL_STATS,
+	PROP_PAYLOAD_TYPE,
+	PROP_MAX_SSRCS,
+	PROP_QOS,
+	PROP_SKIPPED_RECOVERIES,
+	PROP_DO_RETRANSMISSION,
+	PROP_RETRANSMISSION_REQUESTS,
+	PROP_SUPPRESSED_REQUESTS,
+	PROP_STATS,
+	PROP_STATS_INTERVAL,
+	PROP_FEC_DEADLINE
 };
 
 
 enum
 {
 	DEFAULT_NUM_MEDIA_PACKETS = 9,
-	DEFAULT_NUM_FEC_PACKETS = 3
+	DEFAULT_NUM_FEC_PACKETS = 3,
+	DEFAULT_USE_SYMBOL_ARENA = FALSE,
+	DEFAULT_MAX_PACKET_SIZE = FEC_DEC_DEFAULT_MAX_SYMBOL_SIZE,
+	DEFAULT_PT = -1,
+	DEFAULT_MAX_SSRCS = 16
 };
 
 
+#define DEFAULT_QOS FALSE
+#define DEFAULT_DO_RETRANSMISSION FALSE
+#define DEFAULT_STATS_INTERVAL 0
+#define DEFAULT_FEC_DEADLINE 0
+
+
+/*
+Once max-ssrcs streams are known, a new stream replaces the least recently seen one, but only if that one
+did not receive any packet during the last this many packets; SSRCs change when senders restart or collide
+*/
+#define SSRC_MIN_IDLE_PACKETS 1000
+
+
 
 /**** Function declarations ****/
 
-/* Handles incoming media and FEC packets, pushing them to the decoder and retrieving recoverd packets */
+/*
+Handles incoming media and FEC packets, pushing them to the decoder and retrieving recoverd packets;
+must be called with the mutex locked, which it releases before pushing anything into the src pad
+*/
+/* A recovered packet of a joint block, together with the src_%d pad it goes to */
+typedef struct
+{
+	GstPad *srcpad;
+	GstBuffer *packet;
+}
+joint_recovered_packet;
+
+
 static GstFlowReturn gst_rtp_fec_dec_handle_incoming_packet(GstRtpFECDec *rtp_fec_dec, GstBuffer *packet, packet_types const packet_type);
 
 /* This function is invoked when the sink pad receives data (media packets) */
 static GstFlowReturn gst_rtp_fec_dec_chain_media(GstPad *pad, GstBuffer *packet);
 /* This function is invoked when the fec pad receives data (fec packets) */
 static GstFlowReturn gst_rtp_fec_dec_chain_fec(GstPad *pad, GstBuffer *packet);
+/* This function is invoked when the sink pad receives caps */
+static gboolean gst_rtp_fec_dec_setcaps(GstPad *pad, GstCaps *caps);
+/* These functions are invoked when the sink and fec pads receive buffer lists (one packet per group) */
+static GstFlowReturn gst_rtp_fec_dec_chain_list_media(GstPad *pad, GstBufferList *list);
+static GstFlowReturn gst_rtp_fec_dec_chain_list_fec(GstPad *pad, GstBufferList *list);
+/* These functions are invoked when a sink_%d request pad receives media packets of a joint block stream */
+static GstFlowReturn gst_rtp_fec_dec_joint_chain(GstPad *pad, GstBuffer *packet);
+static GstFlowReturn gst_rtp_fec_dec_joint_chain_list(GstPad *pad, GstBufferList *list);
+/* This function is invoked when a sink_%d request pad receives caps */
+static gboolean gst_rtp_fec_dec_joint_setcaps(GstPad *pad, GstCaps *caps);
+
+/* Pushes all packets of a buffer list to the decoder; must be called with the mutex locked */
+static void gst_rtp_fec_dec_push_list_to_decoder(GstRtpFECDec *rtp_fec_dec, GstBufferList *list, packet_types const packet_type);
+/* Pushes a packet to the decoder of its SSRC, and queues the packets this recovered */
+static void gst_rtp_fec_dec_decode_packet(GstRtpFECDec *rtp_fec_dec, GstBuffer *packet, packet_types const packet_type);
+/* In mux mode, pushes all packets of a sink pad list to the decoder and returns a new list containing only the media packets */
+static GstBufferList* gst_rtp_fec_dec_demux_list_to_decoder(GstRtpFECDec *rtp_fec_dec, GstBufferList *list);
+/* Moves all recovered packets into a new buffer list, or returns NULL if there are none; must be called with the mutex locked */
+static GstBufferList* gst_rtp_fec_dec_take_recovered_packets(GstRtpFECDec *rtp_fec_dec);
+/*
+Pushes a list of recovered packets into the src pad (NULL lists are ignored); must be called without the mutex locked,
+since downstream elements may send events upstream from within the push (QoS events, for example), which take it
+*/
+static GstFlowReturn gst_rtp_fec_dec_push_recovered_packets(GstRtpFECDec *rtp_fec_dec, GstBufferList *recovered_packets);
+/* Pushes a media packet of a sink_%d pad to the joint decoder, and queues the packets this recovered */
+static void gst_rtp_fec_dec_joint_decode_packet(GstRtpFECDec *rtp_fec_dec, GstPad *pad, GstBuffer *packet);
+/*
+Moves recovered packets of joint blocks into a new queue of joint_recovered_packet entries, each paired with the
+src_%d pad of its stream, or returns NULL if there are none; must be called with the mutex locked
+*/
+static GQueue* gst_rtp_fec_dec_take_joint_recovered_packets(GstRtpFECDec *rtp_fec_dec);
+/*
+Pushes the entries taken by gst_rtp_fec_dec_take_joint_recovered_packets() into their pads and frees the queue
+(NULL queues are ignored); must be called without the mutex locked, since one blocking src_%d pad
+would otherwise stall all other pads of the element
+*/
+static GstFlowReturn gst_rtp_fec_dec_push_joint_recovered_packets(GstRtpFECDec *rtp_fec_dec, GQueue *recovered_packets);
+/* Frees a queue taken by gst_rtp_fec_dec_take_joint_recovered_packets() without pushing it (NULL queues are ignored) */
+static void gst_rtp_fec_dec_free_joint_recovered_packets(GQueue *recovered_packets);
+
+/* Called by the decoders for each media packet they give up on; queues a retransmission request; called with the mutex locked */
+static void gst_rtp_fec_dec_request_retransmission(guint16 const seqnum, void *data);
+/* Moves the pending retransmission requests into a new queue, or returns NULL if there are none; must be called with the mutex locked */
+static GQueue* gst_rtp_fec_dec_take_retransmission_requests(GstRtpFECDec *rtp_fec_dec);
+/* Sends retransmission requests upstream and frees the queue (NULL queues are ignored); must be called without the mutex locked */
+static void gst_rtp_fec_dec_send_retransmission_requests(GstRtpFECDec *rtp_fec_dec, GQueue *requests);
+/* Returns TRUE if a retransmission request coming from downstream asks for a packet which FEC may still recover */
+static gboolean gst_rtp_fec_dec_suppress_retransmission_request(GstRtpFECDec *rtp_fec_dec, GstEvent *event);
+
+/* Posts the statistics as an element message if the stats interval has passed; must be called without the mutex locked */
+static void gst_rtp_fec_dec_post_stats_message(GstRtpFECDec *rtp_fec_dec);
+
+/* Request pad handling; each sink_%d pad comes with a src_%d pad */
+static GstPad* gst_rtp_fec_dec_request_new_pad(GstElement *element, GstPadTemplate *templ, gchar const *name);
+static void gst_rtp_fec_dec_release_pad(GstElement *element, GstPad *pad);
 
 /* Property accessors */
 static void gst_rtp_fec_dec_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec);
@@ -80,6 +180,26 @@ static void gst_rtp_fec_dec_get_property(GObject *object, guint prop_id, GValue
 
 /* Called when a packet is about to be recovered and needs a buffer */
 static GstBuffer* gst_rtp_fec_dec_create_recovered_buffer(guint const size_in_bytes, void *data);
+/* Called when a packet of a joint block is about to be recovered; caps are set once its stream is known */
+static GstBuffer* gst_rtp_fec_dec_create_joint_recovered_buffer(guint const size_in_bytes, void *data);
+
+/* Called by the decoders before recovering packets; skips recoveries which would be too late; called with the mutex locked */
+static gboolean gst_rtp_fec_dec_filter_recovery(GstClockTime const block_timestamp, guint const num_missing_packets, void *data);
+
+/* These functions are invoked when the sink or src pad receive events; they track the segment, QoS, and latency */
+static gboolean gst_rtp_fec_dec_sink_event(GstPad *pad, GstEvent *event);
+static gboolean gst_rtp_fec_dec_src_event(GstPad *pad, GstEvent *event);
+/* Resets segment and QoS information (but not the latency, which stays valid across flushes); must be called with the mutex locked */
+static void gst_rtp_fec_dec_reset_qos(GstRtpFECDec *rtp_fec_dec);
+
+/* Answers latency queries on the src pad by adding the own latency to the upstream latency */
+static gboolean gst_rtp_fec_dec_src_query(GstPad *pad, GstQuery *query);
+/* Returns the current latency of the element; must be called with the mutex locked */
+static GstClockTime gst_rtp_fec_dec_get_own_latency(GstRtpFECDec *rtp_fec_dec);
+/* Checks if the latency has drifted from the reported one, and flags a latency message if so; must be called with the mutex locked */
+static void gst_rtp_fec_dec_update_latency(GstRtpFECDec *rtp_fec_dec);
+/* Posts a latency message if one has been flagged; must be called without the mutex locked */
+static void gst_rtp_fec_dec_post_latency_message(GstRtpFECDec *rtp_fec_dec);
 
 /* Called when the pipeline state changes */
 static GstStateChangeReturn gst_rtp_fec_dec_change_state(GstElement *element, GstStateChange transition);
@@ -111,6 +231,20 @@ static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
 	GST_STATIC_CAPS("application/x-rtp")
 );
 
+static GstStaticPadTemplate joint_sink_template = GST_STATIC_PAD_TEMPLATE(
+	"sink_%d",
+	GST_PAD_SINK,
+	GST_PAD_REQUEST,
+	GST_STATIC_CAPS("application/x-rtp")
+);
+
+static GstStaticPadTemplate joint_src_template = GST_STATIC_PAD_TEMPLATE(
+	"src_%d",
+	GST_PAD_SRC,
+	GST_PAD_SOMETIMES,
+	GST_STATIC_CAPS("application/x-rtp")
+);
+
 static GstStaticPadTemplate fec_template = GST_STATIC_PAD_TEMPLATE(
 	"fec",
 	GST_PAD_SINK,
@@ -143,6 +277,8 @@ static void gst_rtp_fec_dec_base_init(gpointer klass)
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&sink_template));
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&src_template));
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&fec_template));
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&joint_sink_template));
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&joint_src_template));
 }
 
 
@@ -159,6 +295,8 @@ static void gst_rtp_fec_dec_class_init(GstRtpFECDecClass *klass)
 	/* Set functions */
 	object_class->finalize = GST_DEBUG_FUNCPTR(gst_rtp_fec_dec_finalize);
 	element_class->change_state = GST_DEBUG_FUNCPTR(gst_rtp_fec_dec_change_state);
+	element_class->request_new_pad = GST_DEBUG_FUNCPTR(gst_rtp_fec_dec_request_new_pad);
+	element_class->release_pad = GST_DEBUG_FUNCPTR(gst_rtp_fec_dec_release_pad);
 	object_class->set_property = GST_DEBUG_FUNCPTR(gst_rtp_fec_dec_set_property);
 	object_class->get_property = GST_DEBUG_FUNCPTR(gst_rtp_fec_dec_get_property);
 
@@ -181,12 +319,232 @@ static void gst_rtp_fec_dec_class_init(GstRtpFECDecClass *klass)
 		g_param_spec_uint(
 			"num-fec-packets",
 			"Number of FEC packets",
-			"Number of forward error correction packets to expect",
-		        1, 24,
+			"Number of forward error correction packets to expect (with fec_%d layers, the sum of the subscribed layers; media and FEC packets together are limited to 255)",
+		        1, FEC_CORE_MAX_SYMBOLS - 1,
 			DEFAULT_NUM_FEC_PACKETS,
 			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
 		)
 	);
+	g_object_class_install_property(
+		object_class,
+		PROP_USE_SYMBOL_ARENA,
+		g_param_spec_boolean(
+			"use-symbol-arena",
+			"Use symbol arena",
+			"Copy media packets into a preallocated symbol arena instead of keeping references to them (keeps the packets writable downstream)",
+			DEFAULT_USE_SYMBOL_ARENA,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_MAX_PACKET_SIZE,
+		g_param_spec_uint(
+			"max-packet-size",
+			"Maximum packet size",
+			"Expected maximum size of media packets in bytes; used for preallocating the symbol arena and sizing the recovered packet buffer pool",
+		        1, 65535,
+			DEFAULT_MAX_PACKET_SIZE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_POOL_STATS,
+		g_param_spec_boxed(
+			"pool-stats",
+			"Buffer pool statistics",
+			"Statistics of the recovered packet buffer pool (NULL if the element is in the NULL state)",
+			GST_TYPE_STRUCTURE,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_PAYLOAD_TYPE,
+		g_param_spec_int(
+			"pt",
+			"PT",
+			"Payload type of FEC packets multiplexed into the sink pad (-1 = FEC packets arrive through the fec pad only)",
+		        -1, 127,
+			DEFAULT_PT,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_MAX_SSRCS,
+		g_param_spec_uint(
+			"max-ssrcs",
+			"Maximum number of SSRCs",
+			"Maximum number of streams (SSRCs) to decode with independent FEC blocks; new streams replace idle ones, otherwise their packets are passed through without recovery",
+		        1, 1024,
+			DEFAULT_MAX_SSRCS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_QOS,
+		g_param_spec_boolean(
+			"qos",
+			"QoS",
+			"Skip recoveries of packets which would arrive downstream too late, according to QoS events and the pipeline latency",
+			DEFAULT_QOS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_SKIPPED_RECOVERIES,
+		g_param_spec_uint64(
+			"skipped-recoveries",
+			"Skipped recoveries",
+			"Number of lost media packets which were not recovered because they would have been too late",
+		        0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_DO_RETRANSMISSION,
+		g_param_spec_boolean(
+			"do-retransmission",
+			"Do retransmission",
+			"Send retransmission requests upstream for lost media packets which FEC cannot recover, and drop requests from downstream for packets which FEC may still recover",
+			DEFAULT_DO_RETRANSMISSION,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_RETRANSMISSION_REQUESTS,
+		g_param_spec_uint64(
+			"retransmission-requests",
+			"Retransmission requests",
+			"Number of retransmission requests sent upstream for unrecoverable media packets",
+		        0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_SUPPRESSED_REQUESTS,
+		g_param_spec_uint64(
+			"suppressed-requests",
+			"Suppressed requests",
+			"Number of retransmission requests from downstream which were dropped because FEC may still recover the packet",
+		        0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_STATS,
+		g_param_spec_boxed(
+			"stats",
+			"Statistics",
+			"Decoder statistics: complete, recovered and unrecoverable blocks, recovered packets, dropped duplicates, and histograms of decode times and loss-to-recovery delays (power-of-two buckets in microseconds)",
+			GST_TYPE_STRUCTURE,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_STATS_INTERVAL,
+		g_param_spec_uint(
+			"stats-interval",
+			"Statistics interval",
+			"Interval in milliseconds between element messages with the statistics (0 = no messages)",
+		        0, G_MAXUINT,
+			DEFAULT_STATS_INTERVAL,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_FEC_DEADLINE,
+		g_param_spec_uint64(
+			"fec-deadline",
+			"FEC deadline",
+			"Maximum time in nanoseconds the FEC packets of a block may arrive after its last media packet (for example the max-pacing-delay of a pacing rtpfecenc); added to the reported latency",
+		        0, G_MAXUINT64,
+			DEFAULT_FEC_DEADLINE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+}
+
+
+static void gst_rtp_fec_dec_destroy_decoder(gpointer value)
+{
+	fec_dec_destroy(value);
+}
+
+
+/* Media and FEC packets of a block share the symbol space of the code; must be called with the mutex locked */
+static void gst_rtp_fec_dec_limit_num_fec_packets(GstRtpFECDec *rtp_fec_dec)
+{
+	if ((rtp_fec_dec->num_media_packets + rtp_fec_dec->num_fec_packets) > FEC_CORE_MAX_SYMBOLS)
+	{
+		GST_WARNING_OBJECT(rtp_fec_dec, "%u media and %u FEC packets exceed the maximum of %d symbols per block - limiting FEC packets to %u", rtp_fec_dec->num_media_packets, rtp_fec_dec->num_fec_packets, FEC_CORE_MAX_SYMBOLS, FEC_CORE_MAX_SYMBOLS - rtp_fec_dec->num_media_packets);
+		rtp_fec_dec->num_fec_packets = FEC_CORE_MAX_SYMBOLS - rtp_fec_dec->num_media_packets;
+	}
+}
+
+
+static void gst_rtp_fec_dec_configure_decoder(guint32 const ssrc, gpointer value, gpointer user_data)
+{
+	GstRtpFECDec *rtp_fec_dec = user_data;
+	fec_dec *dec = value;
+
+	/* All of these setters reset the decoder, so only call them if something actually changed */
+	if (fec_dec_get_num_media_packets(dec) != rtp_fec_dec->num_media_packets)
+		fec_dec_set_num_media_packets(dec, rtp_fec_dec->num_media_packets);
+	if (fec_dec_get_num_fec_packets(dec) != rtp_fec_dec->num_fec_packets)
+		fec_dec_set_num_fec_packets(dec, rtp_fec_dec->num_fec_packets);
+	if (fec_dec_get_use_symbol_arena(dec) != rtp_fec_dec->use_symbol_arena)
+		fec_dec_set_use_symbol_arena(dec, rtp_fec_dec->use_symbol_arena);
+	if (fec_dec_get_max_symbol_size(dec) != rtp_fec_dec->max_packet_size)
+		fec_dec_set_max_symbol_size(dec, rtp_fec_dec->max_packet_size);
+
+	GST_LOG_OBJECT(rtp_fec_dec, "configured decoder for SSRC %08x", ssrc);
+}
+
+
+static fec_dec* gst_rtp_fec_dec_get_decoder(GstRtpFECDec *rtp_fec_dec, guint32 const ssrc)
+{
+	fec_dec *dec;
+
+	dec = fec_ssrc_table_lookup(rtp_fec_dec->decoders, ssrc);
+	if (dec != NULL)
+		return dec;
+
+	while (fec_ssrc_table_get_size(rtp_fec_dec->decoders) >= rtp_fec_dec->max_ssrcs)
+	{
+		guint32 idle_ssrc;
+
+		if (!fec_ssrc_table_remove_least_recently_used(rtp_fec_dec->decoders, SSRC_MIN_IDLE_PACKETS, &idle_ssrc))
+		{
+			GST_LOG_OBJECT(rtp_fec_dec, "maximum number of SSRCs reached - not decoding stream with SSRC %08x", ssrc);
+			return NULL;
+		}
+
+		GST_DEBUG_OBJECT(rtp_fec_dec, "removed FEC decoder of idle stream with SSRC %08x to make room for SSRC %08x", idle_ssrc, ssrc);
+	}
+
+	dec = fec_dec_create(rtp_fec_dec->num_media_packets, rtp_fec_dec->num_fec_packets, gst_rtp_fec_dec_create_recovered_buffer, rtp_fec_dec);
+	fec_dec_set_recover_filter(dec, gst_rtp_fec_dec_filter_recovery, rtp_fec_dec);
+	fec_dec_set_unrecoverable_function(dec, gst_rtp_fec_dec_request_retransmission, rtp_fec_dec);
+	fec_dec_set_stats(dec, &(rtp_fec_dec->stats));
+	gst_rtp_fec_dec_configure_decoder(ssrc, dec, rtp_fec_dec);
+	fec_ssrc_table_insert(rtp_fec_dec->decoders, ssrc, dec);
+	GST_DEBUG_OBJECT(rtp_fec_dec, "created FEC decoder for SSRC %08x", ssrc);
+
+	return dec;
 }
 
 
@@ -206,6 +564,12 @@ static void gst_rtp_fec_dec_init(GstRtpFECDec *rtp_fec_dec, GstRtpFECDecClass *k
 	/* Set chain functions for sink and fec pads */
 	gst_pad_set_chain_function(rtp_fec_dec->sinkpad, gst_rtp_fec_dec_chain_media);
 	gst_pad_set_chain_function(rtp_fec_dec->fecpad, gst_rtp_fec_dec_chain_fec);
+	gst_pad_set_chain_list_function(rtp_fec_dec->sinkpad, gst_rtp_fec_dec_chain_list_media);
+	gst_pad_set_chain_list_function(rtp_fec_dec->fecpad, gst_rtp_fec_dec_chain_list_fec);
+	gst_pad_set_setcaps_function(rtp_fec_dec->sinkpad, gst_rtp_fec_dec_setcaps);
+	gst_pad_set_event_function(rtp_fec_dec->sinkpad, gst_rtp_fec_dec_sink_event);
+	gst_pad_set_event_function(rtp_fec_dec->srcpad, gst_rtp_fec_dec_src_event);
+	gst_pad_set_query_function(rtp_fec_dec->srcpad, gst_rtp_fec_dec_src_query);
 
 	/* Add the pads to the element */
 	gst_element_add_pad(element, rtp_fec_dec->sinkpad);
@@ -215,193 +579,1249 @@ static void gst_rtp_fec_dec_init(GstRtpFECDec *rtp_fec_dec, GstRtpFECDecClass *k
 	/* Initialize the mutex */
 	rtp_fec_dec->mutex = g_mutex_new();
 
-	/* Finally, create the FEC decoder */
-	rtp_fec_dec->dec = fec_dec_create(DEFAULT_NUM_MEDIA_PACKETS, DEFAULT_NUM_FEC_PACKETS, gst_rtp_fec_dec_create_recovered_buffer, rtp_fec_dec);
+	/* The buffer pool is created when switching to READY */
+	rtp_fec_dec->pool = NULL;
+
+	rtp_fec_dec->fec_payload_type = DEFAULT_PT;
+
+	rtp_fec_dec->num_media_packets = DEFAULT_NUM_MEDIA_PACKETS;
+	rtp_fec_dec->num_fec_packets = DEFAULT_NUM_FEC_PACKETS;
+	rtp_fec_dec->use_symbol_arena = DEFAULT_USE_SYMBOL_ARENA;
+	rtp_fec_dec->max_packet_size = DEFAULT_MAX_PACKET_SIZE;
+	rtp_fec_dec->max_ssrcs = DEFAULT_MAX_SSRCS;
+	rtp_fec_dec->recovered_packets = g_queue_new();
+
+	rtp_fec_dec->qos = DEFAULT_QOS;
+	rtp_fec_dec->skipped_recoveries = 0;
+	rtp_fec_dec->latency = 0;
+	gst_rtp_fec_dec_reset_qos(rtp_fec_dec);
+
+	rtp_fec_dec->do_retransmission = DEFAULT_DO_RETRANSMISSION;
+	rtp_fec_dec->pending_retransmission_requests = g_queue_new();
+	rtp_fec_dec->cur_ssrc = 0;
+	rtp_fec_dec->retransmission_requests = 0;
+	rtp_fec_dec->suppressed_requests = 0;
+
+	fec_dec_stats_reset(&(rtp_fec_dec->stats));
+	rtp_fec_dec->stats_interval = DEFAULT_STATS_INTERVAL * GST_MSECOND;
+	rtp_fec_dec->last_stats_time = GST_CLOCK_TIME_NONE;
+
+	fec_latency_estimator_reset(&(rtp_fec_dec->latency_estimator));
+	rtp_fec_dec->fec_deadline = DEFAULT_FEC_DEADLINE;
+	rtp_fec_dec->reported_latency = GST_CLOCK_TIME_NONE;
+	rtp_fec_dec->latency_changed = FALSE;
+
+	/* Finally, create the FEC decoder table; the decoders themselves are created on demand */
+	rtp_fec_dec->decoders = fec_ssrc_table_create(gst_rtp_fec_dec_destroy_decoder);
+
+	/* The src_%d pads are owned by the element, so the table must not destroy them */
+	rtp_fec_dec->joint_dec = fec_joint_dec_create(rtp_fec_dec->num_media_packets, rtp_fec_dec->num_fec_packets, gst_rtp_fec_dec_create_joint_recovered_buffer, rtp_fec_dec);
+	rtp_fec_dec->joint_src_pads = fec_ssrc_table_create(NULL);
+	rtp_fec_dec->joint_recovered_packets = g_queue_new();
+	rtp_fec_dec->num_joint_pads = 0;
+}
+
+
+static GstPad* gst_rtp_fec_dec_request_new_pad(GstElement *element, GstPadTemplate *templ, gchar const *name)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	GstPad *sinkpad, *srcpad;
+	guint pad_nr;
+	gchar *pad_name;
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(element);
+
+	if (templ != gst_element_class_get_pad_template(GST_ELEMENT_GET_CLASS(element), "sink_%d"))
+	{
+		GST_WARNING_OBJECT(rtp_fec_dec, "this is not our template");
+		return NULL;
+	}
+
+	GST_OBJECT_LOCK(rtp_fec_dec);
+	if ((name != NULL) && (strncmp(name, "sink_", 5) == 0))
+		pad_nr = strtoul(name + 5, NULL, 10);
+	else
+		pad_nr = rtp_fec_dec->num_joint_pads;
+	rtp_fec_dec->num_joint_pads = MAX(rtp_fec_dec->num_joint_pads, pad_nr + 1);
+	GST_OBJECT_UNLOCK(rtp_fec_dec);
+
+	pad_name = g_strdup_printf("sink_%u", pad_nr);
+	sinkpad = gst_pad_new_from_static_template(&joint_sink_template, pad_name);
+	g_free(pad_name);
+
+	pad_name = g_strdup_printf("src_%u", pad_nr);
+	srcpad = gst_pad_new_from_static_template(&joint_src_template, pad_name);
+	g_free(pad_name);
+
+	gst_pad_set_element_private(sinkpad, srcpad);
+
+	gst_pad_set_chain_function(sinkpad, gst_rtp_fec_dec_joint_chain);
+	gst_pad_set_chain_list_function(sinkpad, gst_rtp_fec_dec_joint_chain_list);
+	gst_pad_set_setcaps_function(sinkpad, gst_rtp_fec_dec_joint_setcaps);
+
+	gst_pad_set_active(srcpad, TRUE);
+	gst_element_add_pad(element, srcpad);
+	gst_element_add_pad(element, sinkpad);
+
+	GST_DEBUG_OBJECT(rtp_fec_dec, "added joint pads %s and %s", GST_PAD_NAME(sinkpad), GST_PAD_NAME(srcpad));
+
+	return sinkpad;
+}
+
+
+static void gst_rtp_fec_dec_release_pad(GstElement *element, GstPad *pad)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	GstPad *srcpad;
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(element);
+	srcpad = gst_pad_get_element_private(pad);
+
+	GST_DEBUG_OBJECT(rtp_fec_dec, "releasing joint pads %s and %s", GST_PAD_NAME(pad), GST_PAD_NAME(srcpad));
+
+	/*
+	The SSRC table has no way to remove single entries; the mappings of the
+	remaining pads are learned again from their next media packets
+	*/
+	g_mutex_lock(rtp_fec_dec->mutex);
+	fec_ssrc_table_clear(rtp_fec_dec->joint_src_pads);
+	g_mutex_unlock(rtp_fec_dec->mutex);
+
+	gst_pad_set_element_private(pad, NULL);
+	gst_element_remove_pad(element, srcpad);
+	gst_element_remove_pad(element, pad);
 }
 
 
 static GstFlowReturn gst_rtp_fec_dec_handle_incoming_packet(GstRtpFECDec *rtp_fec_dec, GstBuffer *packet, packet_types const packet_type)
 {
+	GstBufferList *recovered_packets;
+	GQueue *requests, *joint_recovered_packets;
+	GstFlowReturn ret, joint_ret;
+
+	gst_rtp_fec_dec_decode_packet(rtp_fec_dec, packet, packet_type);
+	joint_recovered_packets = gst_rtp_fec_dec_take_joint_recovered_packets(rtp_fec_dec);
+	recovered_packets = gst_rtp_fec_dec_take_recovered_packets(rtp_fec_dec);
+	requests = gst_rtp_fec_dec_take_retransmission_requests(rtp_fec_dec);
+
+	g_mutex_unlock(rtp_fec_dec->mutex);
+
+	/* Requests go out first; the sooner the sender gets them, the sooner the retransmissions arrive */
+	gst_rtp_fec_dec_send_retransmission_requests(rtp_fec_dec, requests);
+	joint_ret = gst_rtp_fec_dec_push_joint_recovered_packets(rtp_fec_dec, joint_recovered_packets);
+
 	switch (packet_type)
 	{
 		case BUFFER_TYPE_FEC:
-			fec_dec_push_fec_packet(rtp_fec_dec->dec, packet);
 			/*
 			fec_dec_push_fec_packet() refs the packet, and since the packet is not needed by
 			anybody else, unref it here
 			*/
 			gst_buffer_unref(packet);
+			ret = GST_FLOW_OK;
 			break;
 
 		case BUFFER_TYPE_MEDIA:
-		{
-			GstFlowReturn ret;
-			fec_dec_push_media_packet(rtp_fec_dec->dec, packet);
 			/*
 			unlike with the fec packet, the media packet is not unref'd here,
 			instead it is pushed downstream - another element might need it
+			(if the symbol arena is used, the decoder holds no reference to it anymore,
+			so it stays writable)
 			*/
 			ret = gst_pad_push(rtp_fec_dec->srcpad, packet);
-			if (ret != GST_FLOW_OK)
-				return ret;
-
 			break;
-		}
 
 		default:
 			assert(0);
+			ret = GST_FLOW_ERROR;
 	}
 
-	while (fec_dec_has_recovered_packets(rtp_fec_dec->dec))
+	if (ret != GST_FLOW_OK)
 	{
-		GstFlowReturn ret;
-		guint16 seqnum;
-		GstBuffer *recovered_packet;
-
-		recovered_packet = fec_dec_pop_recovered_packet(rtp_fec_dec->dec);
-		seqnum = gst_rtp_buffer_get_seq(recovered_packet);
-
-		GST_DEBUG_OBJECT(rtp_fec_dec, "pushing recovered RTP media packet, seqnum %u", seqnum);
-		ret = gst_pad_push(rtp_fec_dec->srcpad, recovered_packet);
-
-		if (ret != GST_FLOW_OK)
-		{
-			GST_ERROR_OBJECT(rtp_fec_dec, "Could not push RTP media packet, flushing remaining packets");
-			fec_dec_flush_recovered_packets(rtp_fec_dec->dec);
-			return ret;
-		}
+		if (recovered_packets != NULL)
+			gst_buffer_list_unref(recovered_packets);
+		return ret;
 	}
 
-	return GST_FLOW_OK;
+	ret = gst_rtp_fec_dec_push_recovered_packets(rtp_fec_dec, recovered_packets);
+	return (ret == GST_FLOW_OK) ? joint_ret : ret;
 }
 
 
-static GstFlowReturn gst_rtp_fec_dec_chain_media(GstPad *pad, GstBuffer *packet)
+static void gst_rtp_fec_dec_push_list_to_decoder(GstRtpFECDec *rtp_fec_dec, GstBufferList *list, packet_types const packet_type)
 {
-	GstRtpFECDec *rtp_fec_dec;
-	guint16 seqnum;
-	GstFlowReturn ret;
-
-	rtp_fec_dec = GST_RTP_FEC_DEC(gst_pad_get_parent(pad));
-	g_mutex_lock(rtp_fec_dec->mutex);
+	GstBufferListIterator *it;
 
-	seqnum = gst_rtp_buffer_get_seq(packet);
-	GST_DEBUG_OBJECT(rtp_fec_dec, "received RTP media packet, seqnum %u", seqnum);
+	it = gst_buffer_list_iterate(list);
+	while (gst_buffer_list_iterator_next_group(it))
+	{
+		GstBuffer *packet;
 
-	ret = gst_rtp_fec_dec_handle_incoming_packet(rtp_fec_dec, packet, BUFFER_TYPE_MEDIA);
+		/* The decoder needs each packet in one piece; only groups with several buffers are merged */
+		if (gst_buffer_list_iterator_n_buffers(it) == 1)
+			packet = gst_buffer_ref(gst_buffer_list_iterator_next(it));
+		else
+			packet = gst_buffer_list_iterator_merge_group(it);
 
-	g_mutex_unlock(rtp_fec_dec->mutex);
-	gst_object_unref(rtp_fec_dec);
+		if (packet == NULL)
+			continue;
 
-	return ret;
+		gst_rtp_fec_dec_decode_packet(rtp_fec_dec, packet, packet_type);
+		gst_buffer_unref(packet);
+	}
+	gst_buffer_list_iterator_free(it);
 }
 
 
-static GstFlowReturn gst_rtp_fec_dec_chain_fec(GstPad *pad, GstBuffer *packet)
+static void gst_rtp_fec_dec_decode_packet(GstRtpFECDec *rtp_fec_dec, GstBuffer *packet, packet_types const packet_type)
 {
-	GstRtpFECDec *rtp_fec_dec;
-	guint16 seqnum;
-	GstFlowReturn ret;
+	fec_dec *dec;
 
-	rtp_fec_dec = GST_RTP_FEC_DEC(gst_pad_get_parent(pad));
-	g_mutex_lock(rtp_fec_dec->mutex);
+	/* FEC packets of joint blocks have the E bit set in the FEC header */
+	if ((packet_type == BUFFER_TYPE_FEC) && (gst_rtp_buffer_get_payload_len(packet) > 4) && (((guint8 *)gst_rtp_buffer_get_payload(packet))[4] & 0x80))
+	{
+		fec_joint_dec_push_fec_packet(rtp_fec_dec->joint_dec, packet);
+		while (fec_joint_dec_has_recovered_packets(rtp_fec_dec->joint_dec))
+			g_queue_push_tail(rtp_fec_dec->joint_recovered_packets, fec_joint_dec_pop_recovered_packet(rtp_fec_dec->joint_dec));
+		return;
+	}
 
-	seqnum = gst_rtp_buffer_get_seq(packet);
-	GST_DEBUG_OBJECT(rtp_fec_dec, "received RTP FEC packet, seqnum %u", seqnum);
+	/* FEC packets carry the SSRC of the media stream they protect */
+	rtp_fec_dec->cur_ssrc = gst_rtp_buffer_get_ssrc(packet);
+	dec = gst_rtp_fec_dec_get_decoder(rtp_fec_dec, rtp_fec_dec->cur_ssrc);
+	if (dec == NULL)
+		return;
 
-	ret = gst_rtp_fec_dec_handle_incoming_packet(rtp_fec_dec, packet, BUFFER_TYPE_FEC);
+	if (packet_type == BUFFER_TYPE_FEC)
+	{
+		fec_dec_push_fec_packet(dec, packet);
+	}
+	else
+	{
+		/* Media packets mark how far the data flow has progressed; FEC packets carry no meaningful timestamps */
+		if (GST_BUFFER_TIMESTAMP_IS_VALID(packet))
+		{
+			gint64 running_time = gst_segment_to_running_time(&(rtp_fec_dec->segment), GST_FORMAT_TIME, GST_BUFFER_TIMESTAMP(packet));
+			if (running_time >= 0)
+				rtp_fec_dec->last_running_time = running_time;
+		}
 
-	g_mutex_unlock(rtp_fec_dec->mutex);
-	gst_object_unref(rtp_fec_dec);
+		fec_latency_estimator_push_packet(&(rtp_fec_dec->latency_estimator), packet);
+		gst_rtp_fec_dec_update_latency(rtp_fec_dec);
 
-	return ret;
+		fec_dec_push_media_packet(dec, packet);
+	}
+
+	while (fec_dec_has_recovered_packets(dec))
+		g_queue_push_tail(rtp_fec_dec->recovered_packets, fec_dec_pop_recovered_packet(dec));
 }
 
 
-static void gst_rtp_fec_dec_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec)
+static GstBufferList* gst_rtp_fec_dec_demux_list_to_decoder(GstRtpFECDec *rtp_fec_dec, GstBufferList *list)
 {
-	GstRtpFECDec *rtp_fec_dec;
+	GstBufferList *media_packets;
+	GstBufferListIterator *it, *media_it;
 
-	GST_OBJECT_LOCK(object);
-
-	rtp_fec_dec = GST_RTP_FEC_DEC(object);
+	media_packets = gst_buffer_list_new();
+	media_it = gst_buffer_list_iterate(media_packets);
 
-	switch (prop_id)
+	it = gst_buffer_list_iterate(list);
+	while (gst_buffer_list_iterator_next_group(it))
 	{
-		case PROP_NUM_MEDIA_PACKETS:
+		GstBuffer *packet;
+
+		if (gst_buffer_list_iterator_n_buffers(it) == 1)
+			packet = gst_buffer_ref(gst_buffer_list_iterator_next(it));
+		else
+			packet = gst_buffer_list_iterator_merge_group(it);
+
+		if (packet == NULL)
+			continue;
+
+		if (gst_rtp_buffer_get_payload_type(packet) == rtp_fec_dec->fec_payload_type)
 		{
-			guint num_media_packets = g_value_get_uint(value);
-			GST_DEBUG_OBJECT(rtp_fec_dec, "Set number of media packets to %u", num_media_packets);
-			g_mutex_lock(rtp_fec_dec->mutex);
-			fec_dec_set_num_media_packets(rtp_fec_dec->dec, num_media_packets);
-			g_mutex_unlock(rtp_fec_dec->mutex);
-			break;
+			gst_rtp_fec_dec_decode_packet(rtp_fec_dec, packet, BUFFER_TYPE_FEC);
+			gst_buffer_unref(packet);
 		}
-		case PROP_NUM_FEC_PACKETS:
+		else
 		{
-			guint num_fec_packets = g_value_get_uint(value);
-			GST_DEBUG_OBJECT(rtp_fec_dec, "Set number of FEC packets to %u", num_fec_packets);
-			g_mutex_lock(rtp_fec_dec->mutex);
-			fec_dec_set_num_fec_packets(rtp_fec_dec->dec, num_fec_packets);
-			g_mutex_unlock(rtp_fec_dec->mutex);
-			break;
+			gst_rtp_fec_dec_decode_packet(rtp_fec_dec, packet, BUFFER_TYPE_MEDIA);
+			/* The new list takes over the reference; one group per packet */
+			gst_buffer_list_iterator_add_group(media_it);
+			gst_buffer_list_iterator_add(media_it, packet);
 		}
-		default:
-			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
-			break;
 	}
+	gst_buffer_list_iterator_free(it);
+	gst_buffer_list_iterator_free(media_it);
 
-	GST_OBJECT_UNLOCK(object);
+	gst_buffer_list_unref(list);
+
+	return media_packets;
 }
 
 
-static void gst_rtp_fec_dec_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+static void gst_rtp_fec_dec_joint_decode_packet(GstRtpFECDec *rtp_fec_dec, GstPad *pad, GstBuffer *packet)
 {
-	GstRtpFECDec *rtp_fec_dec;
-
-	GST_OBJECT_LOCK(object);
-
-	rtp_fec_dec = GST_RTP_FEC_DEC(object);
+	guint32 ssrc;
 
-	switch (prop_id)
+	/* Learn which src_%d pad recovered packets of this stream belong to */
+	ssrc = gst_rtp_buffer_get_ssrc(packet);
+	if (fec_ssrc_table_lookup(rtp_fec_dec->joint_src_pads, ssrc) != gst_pad_get_element_private(pad))
 	{
-		case PROP_NUM_MEDIA_PACKETS:
-			g_value_set_uint(value, fec_dec_get_num_media_packets(rtp_fec_dec->dec));
-			break;
-		case PROP_NUM_FEC_PACKETS:
-			g_value_set_uint(value, fec_dec_get_num_fec_packets(rtp_fec_dec->dec));
-			break;
-		default:
-			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
-			break;
+		GST_DEBUG_OBJECT(rtp_fec_dec, "routing recovered packets with SSRC %08x to %s", ssrc, GST_PAD_NAME(gst_pad_get_element_private(pad)));
+		fec_ssrc_table_insert(rtp_fec_dec->joint_src_pads, ssrc, gst_pad_get_element_private(pad));
 	}
 
-	GST_OBJECT_UNLOCK(object);
+	fec_joint_dec_push_media_packet(rtp_fec_dec->joint_dec, packet);
+	while (fec_joint_dec_has_recovered_packets(rtp_fec_dec->joint_dec))
+		g_queue_push_tail(rtp_fec_dec->joint_recovered_packets, fec_joint_dec_pop_recovered_packet(rtp_fec_dec->joint_dec));
 }
 
 
-static GstBuffer* gst_rtp_fec_dec_create_recovered_buffer(guint const size_in_bytes, void *data)
+static GQueue* gst_rtp_fec_dec_take_joint_recovered_packets(GstRtpFECDec *rtp_fec_dec)
 {
-	GstRtpFECDec *rtp_fec_dec;
-	GstBuffer *buffer;
-	GstFlowReturn ret;
-	
-	rtp_fec_dec = (GstRtpFECDec*)data;
-
-	ret = gst_pad_alloc_buffer(rtp_fec_dec->srcpad, 0, size_in_bytes, GST_PAD_CAPS(rtp_fec_dec->srcpad), &buffer);
-	if (ret != GST_FLOW_OK)
-	{
-		buffer = gst_buffer_new_and_alloc(size_in_bytes);
-		gst_buffer_set_caps(buffer, GST_PAD_CAPS(rtp_fec_dec->srcpad));
-		GST_DEBUG_OBJECT(rtp_fec_dec, "Created new buffer with %u bytes for recovered packet using gst_buffer_new_and_alloc()", size_in_bytes);
-	}
-	else
-	{
-		GST_DEBUG_OBJECT(rtp_fec_dec, "Created new buffer with %u bytes for recovered packet", size_in_bytes);
-	}
+	GQueue *recovered_packets;
 
-	return buffer;
-}
+	if (g_queue_is_empty(rtp_fec_dec->joint_recovered_packets))
+		return NULL;
+
+	recovered_packets = g_queue_new();
+
+	/* The SSRC table is protected by the mutex, so the pads are looked up here; the refs keep released pads alive until the push */
+	while (!g_queue_is_empty(rtp_fec_dec->joint_recovered_packets))
+	{
+		joint_recovered_packet *entry;
+		GstBuffer *recovered_packet;
+		GstPad *srcpad;
+		guint32 ssrc;
+
+		recovered_packet = g_queue_pop_head(rtp_fec_dec->joint_recovered_packets);
+		ssrc = gst_rtp_buffer_get_ssrc(recovered_packet);
+
+		srcpad = fec_ssrc_table_lookup(rtp_fec_dec->joint_src_pads, ssrc);
+		if (srcpad == NULL)
+		{
+			GST_DEBUG_OBJECT(rtp_fec_dec, "recovered RTP media packet with unknown SSRC %08x - dropping", ssrc);
+			gst_buffer_unref(recovered_packet);
+			continue;
+		}
+
+		entry = g_slice_new(joint_recovered_packet);
+		entry->srcpad = gst_object_ref(srcpad);
+		entry->packet = recovered_packet;
+		g_queue_push_tail(recovered_packets, entry);
+	}
+
+	return recovered_packets;
+}
+
+
+static GstFlowReturn gst_rtp_fec_dec_push_joint_recovered_packets(GstRtpFECDec *rtp_fec_dec, GQueue *recovered_packets)
+{
+	GstFlowReturn ret = GST_FLOW_OK;
+
+	if (recovered_packets == NULL)
+		return GST_FLOW_OK;
+
+	/* Recoveries are rare, so the packets are pushed one by one instead of being grouped per pad */
+	while (!g_queue_is_empty(recovered_packets))
+	{
+		joint_recovered_packet *entry;
+		GstFlowReturn pad_ret;
+
+		entry = g_queue_pop_head(recovered_packets);
+
+		GST_DEBUG_OBJECT(rtp_fec_dec, "pushing recovered RTP media packet into %s, SSRC %08x seqnum %u", GST_PAD_NAME(entry->srcpad), gst_rtp_buffer_get_ssrc(entry->packet), gst_rtp_buffer_get_seq(entry->packet));
+
+		gst_buffer_set_caps(entry->packet, GST_PAD_CAPS(entry->srcpad));
+		pad_ret = gst_pad_push(entry->srcpad, entry->packet);
+		if (pad_ret != GST_FLOW_OK)
+		{
+			GST_ERROR_OBJECT(rtp_fec_dec, "Could not push recovered RTP media packet: %s", gst_flow_get_name(pad_ret));
+			ret = pad_ret;
+		}
+
+		gst_object_unref(entry->srcpad);
+		g_slice_free(joint_recovered_packet, entry);
+	}
+
+	g_queue_free(recovered_packets);
+
+	return ret;
+}
+
+
+static void gst_rtp_fec_dec_free_joint_recovered_packets(GQueue *recovered_packets)
+{
+	if (recovered_packets == NULL)
+		return;
+
+	while (!g_queue_is_empty(recovered_packets))
+	{
+		joint_recovered_packet *entry = g_queue_pop_head(recovered_packets);
+		gst_buffer_unref(entry->packet);
+		gst_object_unref(entry->srcpad);
+		g_slice_free(joint_recovered_packet, entry);
+	}
+
+	g_queue_free(recovered_packets);
+}
+
+
+static GstBufferList* gst_rtp_fec_dec_take_recovered_packets(GstRtpFECDec *rtp_fec_dec)
+{
+	GstBufferList *recovered_packets;
+	GstBufferListIterator *it;
+
+	if (g_queue_is_empty(rtp_fec_dec->recovered_packets))
+		return NULL;
+
+	recovered_packets = gst_buffer_list_new();
+	it = gst_buffer_list_iterate(recovered_packets);
+
+	while (!g_queue_is_empty(rtp_fec_dec->recovered_packets))
+	{
+		GstBuffer *recovered_packet;
+
+		recovered_packet = g_queue_pop_head(rtp_fec_dec->recovered_packets);
+		GST_DEBUG_OBJECT(rtp_fec_dec, "pushing recovered RTP media packet, seqnum %u", gst_rtp_buffer_get_seq(recovered_packet));
+
+		/* One group per packet */
+		gst_buffer_list_iterator_add_group(it);
+		gst_buffer_list_iterator_add(it, recovered_packet);
+	}
+
+	gst_buffer_list_iterator_free(it);
+
+	return recovered_packets;
+}
+
+
+static GstFlowReturn gst_rtp_fec_dec_push_recovered_packets(GstRtpFECDec *rtp_fec_dec, GstBufferList *recovered_packets)
+{
+	GstFlowReturn ret;
+
+	if (recovered_packets == NULL)
+		return GST_FLOW_OK;
+
+	ret = gst_pad_push_list(rtp_fec_dec->srcpad, recovered_packets);
+	if (ret != GST_FLOW_OK)
+		GST_ERROR_OBJECT(rtp_fec_dec, "Could not push recovered RTP media packets: %s", gst_flow_get_name(ret));
+
+	return ret;
+}
+
+
+static void gst_rtp_fec_dec_request_retransmission(guint16 const seqnum, void *data)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	GstStructure *structure;
+
+	rtp_fec_dec = (GstRtpFECDec*)data;
+
+	if (!rtp_fec_dec->do_retransmission)
+		return;
+
+	GST_DEBUG_OBJECT(rtp_fec_dec, "cannot recover media packet with seqnum %u of SSRC %08x - requesting retransmission", seqnum, rtp_fec_dec->cur_ssrc);
+
+	structure = gst_structure_new(
+		"GstRTPRetransmissionRequest",
+		"seqnum", G_TYPE_UINT, (guint)seqnum,
+		"ssrc", G_TYPE_UINT, (guint)(rtp_fec_dec->cur_ssrc),
+		NULL
+	);
+	g_queue_push_tail(rtp_fec_dec->pending_retransmission_requests, gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM, structure));
+	++rtp_fec_dec->retransmission_requests;
+}
+
+
+static GQueue* gst_rtp_fec_dec_take_retransmission_requests(GstRtpFECDec *rtp_fec_dec)
+{
+	GQueue *requests;
+
+	if (g_queue_is_empty(rtp_fec_dec->pending_retransmission_requests))
+		return NULL;
+
+	requests = rtp_fec_dec->pending_retransmission_requests;
+	rtp_fec_dec->pending_retransmission_requests = g_queue_new();
+
+	return requests;
+}
+
+
+static void gst_rtp_fec_dec_send_retransmission_requests(GstRtpFECDec *rtp_fec_dec, GQueue *requests)
+{
+	if (requests == NULL)
+		return;
+
+	while (!g_queue_is_empty(requests))
+		gst_pad_push_event(rtp_fec_dec->sinkpad, g_queue_pop_head(requests));
+
+	g_queue_free(requests);
+}
+
+
+static gboolean gst_rtp_fec_dec_suppress_retransmission_request(GstRtpFECDec *rtp_fec_dec, GstEvent *event)
+{
+	GstStructure const *structure;
+	guint seqnum, ssrc;
+	fec_dec *dec;
+	gboolean suppress;
+
+	structure = gst_event_get_structure(event);
+	if ((structure == NULL) || !gst_structure_has_name(structure, "GstRTPRetransmissionRequest"))
+		return FALSE;
+	if (!gst_structure_get_uint(structure, "seqnum", &seqnum) || !gst_structure_get_uint(structure, "ssrc", &ssrc))
+		return FALSE;
+
+	g_mutex_lock(rtp_fec_dec->mutex);
+
+	/* Streams without a decoder get no FEC protection, so their requests always pass */
+	suppress = FALSE;
+	if (rtp_fec_dec->do_retransmission)
+	{
+		dec = fec_ssrc_table_lookup(rtp_fec_dec->decoders, ssrc);
+		suppress = (dec != NULL) && fec_dec_can_recover_seqnum(dec, seqnum);
+		if (suppress)
+			++rtp_fec_dec->suppressed_requests;
+	}
+
+	g_mutex_unlock(rtp_fec_dec->mutex);
+
+	if (suppress)
+		GST_DEBUG_OBJECT(rtp_fec_dec, "media packet with seqnum %u of SSRC %08x may still be recovered - dropping retransmission request", seqnum, ssrc);
+
+	return suppress;
+}
+
+
+static void gst_rtp_fec_dec_post_stats_message(GstRtpFECDec *rtp_fec_dec)
+{
+	GstStructure *structure;
+	GstClockTime now;
+	gboolean due;
+
+	/* Cheap check first, so disabled messages cost nothing */
+	if (rtp_fec_dec->stats_interval == 0)
+		return;
+
+	now = gst_util_get_timestamp();
+
+	GST_OBJECT_LOCK(rtp_fec_dec);
+	due = (rtp_fec_dec->stats_interval > 0) && (!GST_CLOCK_TIME_IS_VALID(rtp_fec_dec->last_stats_time) || ((now - rtp_fec_dec->last_stats_time) >= rtp_fec_dec->stats_interval));
+	if (due)
+		rtp_fec_dec->last_stats_time = now;
+	GST_OBJECT_UNLOCK(rtp_fec_dec);
+
+	if (!due)
+		return;
+
+	structure = fec_dec_stats_get_structure(&(rtp_fec_dec->stats));
+	gst_structure_set_name(structure, "GstRtpFECDecStats");
+	gst_element_post_message(GST_ELEMENT(rtp_fec_dec), gst_message_new_element(GST_OBJECT(rtp_fec_dec), structure));
+}
+
+
+static GstFlowReturn gst_rtp_fec_dec_chain_media(GstPad *pad, GstBuffer *packet)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	guint16 seqnum;
+	GstFlowReturn ret;
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(gst_pad_get_parent(pad));
+	g_mutex_lock(rtp_fec_dec->mutex);
+
+	seqnum = gst_rtp_buffer_get_seq(packet);
+
+	/* In mux mode, FEC packets arrive on the sink pad as well and are told apart by their payload type */
+	if ((rtp_fec_dec->fec_payload_type >= 0) && (gst_rtp_buffer_get_payload_type(packet) == rtp_fec_dec->fec_payload_type))
+	{
+		GST_DEBUG_OBJECT(rtp_fec_dec, "received multiplexed RTP FEC packet, seqnum %u", seqnum);
+		ret = gst_rtp_fec_dec_handle_incoming_packet(rtp_fec_dec, packet, BUFFER_TYPE_FEC);
+	}
+	else
+	{
+		GST_DEBUG_OBJECT(rtp_fec_dec, "received RTP media packet, seqnum %u", seqnum);
+		ret = gst_rtp_fec_dec_handle_incoming_packet(rtp_fec_dec, packet, BUFFER_TYPE_MEDIA);
+	}
+
+	gst_rtp_fec_dec_post_stats_message(rtp_fec_dec);
+	gst_rtp_fec_dec_post_latency_message(rtp_fec_dec);
+	gst_object_unref(rtp_fec_dec);
+
+	return ret;
+}
+
+
+static GstFlowReturn gst_rtp_fec_dec_chain_fec(GstPad *pad, GstBuffer *packet)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	guint16 seqnum;
+	GstFlowReturn ret;
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(gst_pad_get_parent(pad));
+	g_mutex_lock(rtp_fec_dec->mutex);
+
+	seqnum = gst_rtp_buffer_get_seq(packet);
+	GST_DEBUG_OBJECT(rtp_fec_dec, "received RTP FEC packet, seqnum %u", seqnum);
+
+	ret = gst_rtp_fec_dec_handle_incoming_packet(rtp_fec_dec, packet, BUFFER_TYPE_FEC);
+
+	gst_rtp_fec_dec_post_stats_message(rtp_fec_dec);
+	gst_rtp_fec_dec_post_latency_message(rtp_fec_dec);
+	gst_object_unref(rtp_fec_dec);
+
+	return ret;
+}
+
+
+static GstFlowReturn gst_rtp_fec_dec_chain_list_media(GstPad *pad, GstBufferList *list)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	GstBufferList *recovered_packets;
+	GQueue *requests, *joint_recovered_packets;
+	GstFlowReturn ret, joint_ret;
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(gst_pad_get_parent(pad));
+	g_mutex_lock(rtp_fec_dec->mutex);
+
+	GST_DEBUG_OBJECT(rtp_fec_dec, "received list with %u RTP media packets", gst_buffer_list_n_groups(list));
+
+	/* The whole list goes through the decoder under one lock acquisition */
+	if (rtp_fec_dec->fec_payload_type >= 0)
+		list = gst_rtp_fec_dec_demux_list_to_decoder(rtp_fec_dec, list);
+	else
+		gst_rtp_fec_dec_push_list_to_decoder(rtp_fec_dec, list, BUFFER_TYPE_MEDIA);
+
+	joint_recovered_packets = gst_rtp_fec_dec_take_joint_recovered_packets(rtp_fec_dec);
+	recovered_packets = gst_rtp_fec_dec_take_recovered_packets(rtp_fec_dec);
+	requests = gst_rtp_fec_dec_take_retransmission_requests(rtp_fec_dec);
+	g_mutex_unlock(rtp_fec_dec->mutex);
+
+	gst_rtp_fec_dec_send_retransmission_requests(rtp_fec_dec, requests);
+	joint_ret = gst_rtp_fec_dec_push_joint_recovered_packets(rtp_fec_dec, joint_recovered_packets);
+
+	/* As with single packets, the media packets are passed on downstream, still as one list */
+	ret = gst_pad_push_list(rtp_fec_dec->srcpad, list);
+	if (ret == GST_FLOW_OK)
+	{
+		ret = gst_rtp_fec_dec_push_recovered_packets(rtp_fec_dec, recovered_packets);
+		if (ret == GST_FLOW_OK)
+			ret = joint_ret;
+	}
+	else if (recovered_packets != NULL)
+		gst_buffer_list_unref(recovered_packets);
+
+	gst_rtp_fec_dec_post_stats_message(rtp_fec_dec);
+	gst_rtp_fec_dec_post_latency_message(rtp_fec_dec);
+	gst_object_unref(rtp_fec_dec);
+
+	return ret;
+}
+
+
+static GstFlowReturn gst_rtp_fec_dec_chain_list_fec(GstPad *pad, GstBufferList *list)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	GstBufferList *recovered_packets;
+	GQueue *requests, *joint_recovered_packets;
+	GstFlowReturn ret, joint_ret;
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(gst_pad_get_parent(pad));
+	g_mutex_lock(rtp_fec_dec->mutex);
+
+	GST_DEBUG_OBJECT(rtp_fec_dec, "received list with %u RTP FEC packets", gst_buffer_list_n_groups(list));
+
+	gst_rtp_fec_dec_push_list_to_decoder(rtp_fec_dec, list, BUFFER_TYPE_FEC);
+	/* The decoder refs the FEC packets it needs, so the list itself can go */
+	gst_buffer_list_unref(list);
+
+	joint_recovered_packets = gst_rtp_fec_dec_take_joint_recovered_packets(rtp_fec_dec);
+	recovered_packets = gst_rtp_fec_dec_take_recovered_packets(rtp_fec_dec);
+	requests = gst_rtp_fec_dec_take_retransmission_requests(rtp_fec_dec);
+	g_mutex_unlock(rtp_fec_dec->mutex);
+
+	gst_rtp_fec_dec_send_retransmission_requests(rtp_fec_dec, requests);
+	joint_ret = gst_rtp_fec_dec_push_joint_recovered_packets(rtp_fec_dec, joint_recovered_packets);
+
+	ret = gst_rtp_fec_dec_push_recovered_packets(rtp_fec_dec, recovered_packets);
+	if (ret == GST_FLOW_OK)
+		ret = joint_ret;
+
+	gst_rtp_fec_dec_post_stats_message(rtp_fec_dec);
+	gst_rtp_fec_dec_post_latency_message(rtp_fec_dec);
+	gst_object_unref(rtp_fec_dec);
+
+	return ret;
+}
+
+
+static GstFlowReturn gst_rtp_fec_dec_joint_chain(GstPad *pad, GstBuffer *packet)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	GQueue *recovered_packets;
+	GstFlowReturn ret;
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(gst_pad_get_parent(pad));
+	g_mutex_lock(rtp_fec_dec->mutex);
+
+	GST_DEBUG_OBJECT(rtp_fec_dec, "received RTP media packet on %s, seqnum %u", GST_PAD_NAME(pad), gst_rtp_buffer_get_seq(packet));
+
+	gst_rtp_fec_dec_joint_decode_packet(rtp_fec_dec, pad, packet);
+	recovered_packets = gst_rtp_fec_dec_take_joint_recovered_packets(rtp_fec_dec);
+	g_mutex_unlock(rtp_fec_dec->mutex);
+
+	/* The media packet is passed on downstream; the history of the joint decoder keeps a reference */
+	ret = gst_pad_push(gst_pad_get_element_private(pad), packet);
+	if (ret == GST_FLOW_OK)
+		ret = gst_rtp_fec_dec_push_joint_recovered_packets(rtp_fec_dec, recovered_packets);
+	else
+		gst_rtp_fec_dec_free_joint_recovered_packets(recovered_packets);
+
+	gst_rtp_fec_dec_post_stats_message(rtp_fec_dec);
+	gst_rtp_fec_dec_post_latency_message(rtp_fec_dec);
+	gst_object_unref(rtp_fec_dec);
+
+	return ret;
+}
+
+
+static GstFlowReturn gst_rtp_fec_dec_joint_chain_list(GstPad *pad, GstBufferList *list)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	GstBufferListIterator *it;
+	GQueue *recovered_packets;
+	GstFlowReturn ret;
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(gst_pad_get_parent(pad));
+	g_mutex_lock(rtp_fec_dec->mutex);
+
+	GST_DEBUG_OBJECT(rtp_fec_dec, "received list with %u RTP media packets on %s", gst_buffer_list_n_groups(list), GST_PAD_NAME(pad));
+
+	it = gst_buffer_list_iterate(list);
+	while (gst_buffer_list_iterator_next_group(it))
+	{
+		GstBuffer *packet;
+
+		if (gst_buffer_list_iterator_n_buffers(it) == 1)
+			packet = gst_buffer_ref(gst_buffer_list_iterator_next(it));
+		else
+			packet = gst_buffer_list_iterator_merge_group(it);
+
+		if (packet == NULL)
+			continue;
+
+		gst_rtp_fec_dec_joint_decode_packet(rtp_fec_dec, pad, packet);
+		gst_buffer_unref(packet);
+	}
+	gst_buffer_list_iterator_free(it);
+
+	recovered_packets = gst_rtp_fec_dec_take_joint_recovered_packets(rtp_fec_dec);
+	g_mutex_unlock(rtp_fec_dec->mutex);
+
+	ret = gst_pad_push_list(gst_pad_get_element_private(pad), list);
+	if (ret == GST_FLOW_OK)
+		ret = gst_rtp_fec_dec_push_joint_recovered_packets(rtp_fec_dec, recovered_packets);
+	else
+		gst_rtp_fec_dec_free_joint_recovered_packets(recovered_packets);
+
+	gst_rtp_fec_dec_post_stats_message(rtp_fec_dec);
+	gst_rtp_fec_dec_post_latency_message(rtp_fec_dec);
+	gst_object_unref(rtp_fec_dec);
+
+	return ret;
+}
+
+
+static gboolean gst_rtp_fec_dec_setcaps(GstPad *pad, GstCaps *caps)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	GstStructure *structure;
+	guint ssrc;
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(gst_pad_get_parent(pad));
+
+	/* If the caps name the SSRC of the stream, its decoder is set up now instead of with its first packet */
+	structure = gst_caps_get_structure(caps, 0);
+	if (gst_structure_get_uint(structure, "ssrc", &ssrc))
+	{
+		g_mutex_lock(rtp_fec_dec->mutex);
+		gst_rtp_fec_dec_get_decoder(rtp_fec_dec, ssrc);
+		g_mutex_unlock(rtp_fec_dec->mutex);
+	}
+
+	gst_object_unref(rtp_fec_dec);
+
+	return TRUE;
+}
+
+
+static gboolean gst_rtp_fec_dec_joint_setcaps(GstPad *pad, GstCaps *caps)
+{
+	return gst_pad_set_caps(gst_pad_get_element_private(pad), caps);
+}
+
+
+static void gst_rtp_fec_dec_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec)
+{
+	GstRtpFECDec *rtp_fec_dec;
+
+	GST_OBJECT_LOCK(object);
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(object);
+
+	switch (prop_id)
+	{
+		case PROP_NUM_MEDIA_PACKETS:
+		{
+			guint num_media_packets = g_value_get_uint(value);
+			GST_DEBUG_OBJECT(rtp_fec_dec, "Set number of media packets to %u", num_media_packets);
+			g_mutex_lock(rtp_fec_dec->mutex);
+			rtp_fec_dec->num_media_packets = num_media_packets;
+			gst_rtp_fec_dec_limit_num_fec_packets(rtp_fec_dec);
+			fec_ssrc_table_foreach(rtp_fec_dec->decoders, gst_rtp_fec_dec_configure_decoder, rtp_fec_dec);
+			if (fec_joint_dec_get_num_media_packets(rtp_fec_dec->joint_dec) != num_media_packets)
+				fec_joint_dec_set_num_media_packets(rtp_fec_dec->joint_dec, num_media_packets);
+			if (fec_joint_dec_get_num_fec_packets(rtp_fec_dec->joint_dec) != rtp_fec_dec->num_fec_packets)
+				fec_joint_dec_set_num_fec_packets(rtp_fec_dec->joint_dec, rtp_fec_dec->num_fec_packets);
+			gst_rtp_fec_dec_update_latency(rtp_fec_dec);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		}
+		case PROP_NUM_FEC_PACKETS:
+		{
+			guint num_fec_packets = g_value_get_uint(value);
+			GST_DEBUG_OBJECT(rtp_fec_dec, "Set number of FEC packets to %u", num_fec_packets);
+			g_mutex_lock(rtp_fec_dec->mutex);
+			rtp_fec_dec->num_fec_packets = num_fec_packets;
+			gst_rtp_fec_dec_limit_num_fec_packets(rtp_fec_dec);
+			fec_ssrc_table_foreach(rtp_fec_dec->decoders, gst_rtp_fec_dec_configure_decoder, rtp_fec_dec);
+			if (fec_joint_dec_get_num_fec_packets(rtp_fec_dec->joint_dec) != rtp_fec_dec->num_fec_packets)
+				fec_joint_dec_set_num_fec_packets(rtp_fec_dec->joint_dec, rtp_fec_dec->num_fec_packets);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		}
+		case PROP_USE_SYMBOL_ARENA:
+		{
+			gboolean use_symbol_arena = g_value_get_boolean(value);
+			GST_DEBUG_OBJECT(rtp_fec_dec, "%s symbol arena", use_symbol_arena ? "Enable" : "Disable");
+			g_mutex_lock(rtp_fec_dec->mutex);
+			rtp_fec_dec->use_symbol_arena = use_symbol_arena;
+			fec_ssrc_table_foreach(rtp_fec_dec->decoders, gst_rtp_fec_dec_configure_decoder, rtp_fec_dec);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		}
+		case PROP_MAX_PACKET_SIZE:
+		{
+			guint max_packet_size = g_value_get_uint(value);
+			GST_DEBUG_OBJECT(rtp_fec_dec, "Set maximum packet size to %u", max_packet_size);
+			g_mutex_lock(rtp_fec_dec->mutex);
+			rtp_fec_dec->max_packet_size = max_packet_size;
+			fec_ssrc_table_foreach(rtp_fec_dec->decoders, gst_rtp_fec_dec_configure_decoder, rtp_fec_dec);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		}
+		case PROP_PAYLOAD_TYPE:
+		{
+			gint payload_type = g_value_get_int(value);
+			GST_DEBUG_OBJECT(rtp_fec_dec, "Set FEC payload type to %d", payload_type);
+			g_mutex_lock(rtp_fec_dec->mutex);
+			rtp_fec_dec->fec_payload_type = payload_type;
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		}
+		case PROP_MAX_SSRCS:
+			/* Existing streams keep their decoders; the limit applies to new streams */
+			g_mutex_lock(rtp_fec_dec->mutex);
+			rtp_fec_dec->max_ssrcs = g_value_get_uint(value);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		case PROP_QOS:
+			g_mutex_lock(rtp_fec_dec->mutex);
+			rtp_fec_dec->qos = g_value_get_boolean(value);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			GST_DEBUG_OBJECT(rtp_fec_dec, "%s QoS", rtp_fec_dec->qos ? "Enable" : "Disable");
+			break;
+		case PROP_DO_RETRANSMISSION:
+			g_mutex_lock(rtp_fec_dec->mutex);
+			rtp_fec_dec->do_retransmission = g_value_get_boolean(value);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			GST_DEBUG_OBJECT(rtp_fec_dec, "%s retransmission requests", rtp_fec_dec->do_retransmission ? "Enable" : "Disable");
+			break;
+		case PROP_STATS_INTERVAL:
+			/* Already protected by the object lock */
+			rtp_fec_dec->stats_interval = (GstClockTime)g_value_get_uint(value) * GST_MSECOND;
+			rtp_fec_dec->last_stats_time = GST_CLOCK_TIME_NONE;
+			break;
+		case PROP_FEC_DEADLINE:
+			g_mutex_lock(rtp_fec_dec->mutex);
+			rtp_fec_dec->fec_deadline = g_value_get_uint64(value);
+			gst_rtp_fec_dec_update_latency(rtp_fec_dec);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			GST_DEBUG_OBJECT(rtp_fec_dec, "Set FEC deadline to %" GST_TIME_FORMAT, GST_TIME_ARGS(rtp_fec_dec->fec_deadline));
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+
+	GST_OBJECT_UNLOCK(object);
+
+	/* Posting messages takes the object lock, so this must happen after unlocking it */
+	gst_rtp_fec_dec_post_latency_message(rtp_fec_dec);
+}
+
+
+static void gst_rtp_fec_dec_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+	GstRtpFECDec *rtp_fec_dec;
+
+	GST_OBJECT_LOCK(object);
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(object);
+
+	switch (prop_id)
+	{
+		case PROP_NUM_MEDIA_PACKETS:
+			g_value_set_uint(value, rtp_fec_dec->num_media_packets);
+			break;
+		case PROP_NUM_FEC_PACKETS:
+			g_value_set_uint(value, rtp_fec_dec->num_fec_packets);
+			break;
+		case PROP_USE_SYMBOL_ARENA:
+			g_value_set_boolean(value, rtp_fec_dec->use_symbol_arena);
+			break;
+		case PROP_MAX_PACKET_SIZE:
+			g_value_set_uint(value, rtp_fec_dec->max_packet_size);
+			break;
+		case PROP_POOL_STATS:
+			/* The pool is created and destroyed under the mutex, in the state changes between NULL and READY */
+			g_mutex_lock(rtp_fec_dec->mutex);
+			g_value_take_boxed(value, (rtp_fec_dec->pool != NULL) ? fec_buffer_pool_get_stats_structure(rtp_fec_dec->pool) : NULL);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		case PROP_PAYLOAD_TYPE:
+			g_value_set_int(value, rtp_fec_dec->fec_payload_type);
+			break;
+		case PROP_MAX_SSRCS:
+			g_value_set_uint(value, rtp_fec_dec->max_ssrcs);
+			break;
+		case PROP_QOS:
+			g_value_set_boolean(value, rtp_fec_dec->qos);
+			break;
+		case PROP_SKIPPED_RECOVERIES:
+			g_mutex_lock(rtp_fec_dec->mutex);
+			g_value_set_uint64(value, rtp_fec_dec->skipped_recoveries);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		case PROP_DO_RETRANSMISSION:
+			g_value_set_boolean(value, rtp_fec_dec->do_retransmission);
+			break;
+		case PROP_RETRANSMISSION_REQUESTS:
+			g_mutex_lock(rtp_fec_dec->mutex);
+			g_value_set_uint64(value, rtp_fec_dec->retransmission_requests);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		case PROP_SUPPRESSED_REQUESTS:
+			g_mutex_lock(rtp_fec_dec->mutex);
+			g_value_set_uint64(value, rtp_fec_dec->suppressed_requests);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		case PROP_STATS:
+			/* The counters are atomic, so the mutex is not needed */
+			g_value_take_boxed(value, fec_dec_stats_get_structure(&(rtp_fec_dec->stats)));
+			break;
+		case PROP_STATS_INTERVAL:
+			g_value_set_uint(value, (guint)(rtp_fec_dec->stats_interval / GST_MSECOND));
+			break;
+		case PROP_FEC_DEADLINE:
+			g_value_set_uint64(value, rtp_fec_dec->fec_deadline);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+static GstBuffer* gst_rtp_fec_dec_create_recovered_buffer(guint const size_in_bytes, void *data)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	GstBuffer *buffer;
+	GstFlowReturn ret;
+	
+	rtp_fec_dec = (GstRtpFECDec*)data;
+
+	if (rtp_fec_dec->pool != NULL)
+	{
+		buffer = fec_buffer_pool_acquire(rtp_fec_dec->pool, size_in_bytes);
+		if (buffer != NULL)
+		{
+			gst_buffer_set_caps(buffer, GST_PAD_CAPS(rtp_fec_dec->srcpad));
+			return buffer;
+		}
+
+		GST_DEBUG_OBJECT(rtp_fec_dec, "Recovered packet with %u bytes does not fit in the buffer pool", size_in_bytes);
+	}
+
+	ret = gst_pad_alloc_buffer(rtp_fec_dec->srcpad, 0, size_in_bytes, GST_PAD_CAPS(rtp_fec_dec->srcpad), &buffer);
+	if (ret != GST_FLOW_OK)
+	{
+		buffer = gst_buffer_new_and_alloc(size_in_bytes);
+		gst_buffer_set_caps(buffer, GST_PAD_CAPS(rtp_fec_dec->srcpad));
+		GST_DEBUG_OBJECT(rtp_fec_dec, "Created new buffer with %u bytes for recovered packet using gst_buffer_new_and_alloc()", size_in_bytes);
+	}
+	else
+	{
+		GST_DEBUG_OBJECT(rtp_fec_dec, "Created new buffer with %u bytes for recovered packet", size_in_bytes);
+	}
+
+	return buffer;
+}
+
+
+static GstBuffer* gst_rtp_fec_dec_create_joint_recovered_buffer(guint const size_in_bytes, void *data)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	GstBuffer *buffer;
+
+	rtp_fec_dec = (GstRtpFECDec*)data;
+
+	buffer = (rtp_fec_dec->pool != NULL) ? fec_buffer_pool_acquire(rtp_fec_dec->pool, size_in_bytes) : NULL;
+	if (buffer == NULL)
+	{
+		buffer = gst_buffer_new_and_alloc(size_in_bytes);
+		GST_DEBUG_OBJECT(rtp_fec_dec, "Created new buffer with %u bytes for recovered packet of joint block using gst_buffer_new_and_alloc()", size_in_bytes);
+	}
+
+	return buffer;
+}
+
+
+static gboolean gst_rtp_fec_dec_filter_recovery(GstClockTime const block_timestamp, guint const num_missing_packets, void *data)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	gint64 block_running_time;
+
+	rtp_fec_dec = (GstRtpFECDec*)data;
+
+	/* Without timing information, it is impossible to tell if the recovery is too late, so always recover */
+	if (!rtp_fec_dec->qos || !GST_CLOCK_TIME_IS_VALID(block_timestamp))
+		return TRUE;
+
+	block_running_time = gst_segment_to_running_time(&(rtp_fec_dec->segment), GST_FORMAT_TIME, block_timestamp);
+	if (block_running_time < 0)
+		return TRUE;
+
+	if (GST_CLOCK_TIME_IS_VALID(rtp_fec_dec->qos_earliest_time) && ((GstClockTime)block_running_time < rtp_fec_dec->qos_earliest_time))
+	{
+		GST_DEBUG_OBJECT(rtp_fec_dec, "block running time %" GST_TIME_FORMAT " is before the earliest time %" GST_TIME_FORMAT " - skipping recovery of %u packets", GST_TIME_ARGS(block_running_time), GST_TIME_ARGS(rtp_fec_dec->qos_earliest_time), num_missing_packets);
+		rtp_fec_dec->skipped_recoveries += num_missing_packets;
+		return FALSE;
+	}
+
+	if ((rtp_fec_dec->latency > 0) && GST_CLOCK_TIME_IS_VALID(rtp_fec_dec->last_running_time) && (rtp_fec_dec->last_running_time > ((GstClockTime)block_running_time + rtp_fec_dec->latency)))
+	{
+		GST_DEBUG_OBJECT(rtp_fec_dec, "block running time %" GST_TIME_FORMAT " lies more than the latency %" GST_TIME_FORMAT " behind the current running time %" GST_TIME_FORMAT " - skipping recovery of %u packets", GST_TIME_ARGS(block_running_time), GST_TIME_ARGS(rtp_fec_dec->latency), GST_TIME_ARGS(rtp_fec_dec->last_running_time), num_missing_packets);
+		rtp_fec_dec->skipped_recoveries += num_missing_packets;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+static gboolean gst_rtp_fec_dec_sink_event(GstPad *pad, GstEvent *event)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	gboolean ret;
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(gst_pad_get_parent(pad));
+
+	switch (GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_NEWSEGMENT:
+		{
+			gboolean update;
+			gdouble rate, applied_rate;
+			GstFormat format;
+			gint64 start, stop, position;
+
+			gst_event_parse_new_segment_full(event, &update, &rate, &applied_rate, &format, &start, &stop, &position);
+
+			/* Only TIME segments allow for running time calculations; with other formats, no recovery is ever skipped */
+			g_mutex_lock(rtp_fec_dec->mutex);
+			if (format == GST_FORMAT_TIME)
+				gst_segment_set_newsegment_full(&(rtp_fec_dec->segment), update, rate, applied_rate, format, start, stop, position);
+			else
+				gst_segment_init(&(rtp_fec_dec->segment), GST_FORMAT_UNDEFINED);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		}
+		case GST_EVENT_FLUSH_STOP:
+			g_mutex_lock(rtp_fec_dec->mutex);
+			gst_rtp_fec_dec_reset_qos(rtp_fec_dec);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		case GST_EVENT_EOS:
+			/* The streams ended, so their decoders must not take up any of the max-ssrcs slots anymore */
+			g_mutex_lock(rtp_fec_dec->mutex);
+			fec_ssrc_table_clear(rtp_fec_dec->decoders);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		default:
+			break;
+	}
+
+	ret = gst_pad_event_default(pad, event);
+
+	gst_object_unref(rtp_fec_dec);
+
+	return ret;
+}
+
+
+static gboolean gst_rtp_fec_dec_src_event(GstPad *pad, GstEvent *event)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	gboolean ret;
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(gst_pad_get_parent(pad));
+
+	switch (GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_QOS:
+		{
+			gdouble proportion;
+			GstClockTimeDiff diff;
+			GstClockTime timestamp;
+
+			/* Buffers with a running time before timestamp + diff would arrive too late downstream */
+			gst_event_parse_qos(event, &proportion, &diff, &timestamp);
+			g_mutex_lock(rtp_fec_dec->mutex);
+			if ((diff < 0) && ((GstClockTime)(-diff) > timestamp))
+				rtp_fec_dec->qos_earliest_time = 0;
+			else
+				rtp_fec_dec->qos_earliest_time = timestamp + diff;
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		}
+		case GST_EVENT_LATENCY:
+		{
+			GstClockTime latency;
+
+			gst_event_parse_latency(event, &latency);
+			GST_DEBUG_OBJECT(rtp_fec_dec, "pipeline latency is %" GST_TIME_FORMAT, GST_TIME_ARGS(latency));
+			g_mutex_lock(rtp_fec_dec->mutex);
+			rtp_fec_dec->latency = latency;
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		}
+		case GST_EVENT_CUSTOM_UPSTREAM:
+			if (gst_rtp_fec_dec_suppress_retransmission_request(rtp_fec_dec, event))
+			{
+				gst_event_unref(event);
+				gst_object_unref(rtp_fec_dec);
+				return TRUE;
+			}
+			break;
+		default:
+			break;
+	}
+
+	ret = gst_pad_event_default(pad, event);
+
+	gst_object_unref(rtp_fec_dec);
+
+	return ret;
+}
+
+
+static gboolean gst_rtp_fec_dec_src_query(GstPad *pad, GstQuery *query)
+{
+	GstRtpFECDec *rtp_fec_dec;
+	gboolean ret;
+
+	rtp_fec_dec = GST_RTP_FEC_DEC(gst_pad_get_parent(pad));
+
+	switch (GST_QUERY_TYPE(query))
+	{
+		case GST_QUERY_LATENCY:
+		{
+			gboolean live;
+			GstClockTime min_latency, max_latency, own_latency;
+
+			ret = gst_pad_peer_query(rtp_fec_dec->sinkpad, query);
+			if (!ret)
+				break;
+
+			gst_query_parse_latency(query, &live, &min_latency, &max_latency);
+
+			g_mutex_lock(rtp_fec_dec->mutex);
+			own_latency = gst_rtp_fec_dec_get_own_latency(rtp_fec_dec);
+			rtp_fec_dec->reported_latency = own_latency;
+			g_mutex_unlock(rtp_fec_dec->mutex);
+
+			/*
+			Media packets pass through right away, but recovered packets may be late by the own latency,
+			so downstream has to wait that long for them to be of any use
+			*/
+			min_latency += own_latency;
+			if (GST_CLOCK_TIME_IS_VALID(max_latency))
+				max_latency += own_latency;
+
+			GST_DEBUG_OBJECT(rtp_fec_dec, "own latency %" GST_TIME_FORMAT ", reporting min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT, GST_TIME_ARGS(own_latency), GST_TIME_ARGS(min_latency), GST_TIME_ARGS(max_latency));
+
+			gst_query_set_latency(query, live, min_latency, max_latency);
+			break;
+		}
+		default:
+			ret = gst_pad_query_default(pad, query);
+			break;
+	}
+
+	gst_object_unref(rtp_fec_dec);
+
+	return ret;
+}
+
+
+static GstClockTime gst_rtp_fec_dec_get_own_latency(GstRtpFECDec *rtp_fec_dec)
+{
+	return fec_latency_estimator_get_block_duration(&(rtp_fec_dec->latency_estimator), rtp_fec_dec->num_media_packets) + rtp_fec_dec->fec_deadline;
+}
+
+
+static void gst_rtp_fec_dec_update_latency(GstRtpFECDec *rtp_fec_dec)
+{
+	GstClockTime latency = gst_rtp_fec_dec_get_own_latency(rtp_fec_dec);
+
+	if (!fec_latency_has_changed(rtp_fec_dec->reported_latency, latency))
+		return;
+
+	GST_DEBUG_OBJECT(rtp_fec_dec, "latency changed from %" GST_TIME_FORMAT " to %" GST_TIME_FORMAT, GST_TIME_ARGS(rtp_fec_dec->reported_latency), GST_TIME_ARGS(latency));
+
+	/* The pipeline re-queries the latency after the message, which updates reported_latency again */
+	rtp_fec_dec->reported_latency = latency;
+	g_atomic_int_set(&(rtp_fec_dec->latency_changed), TRUE);
+}
+
+
+static void gst_rtp_fec_dec_post_latency_message(GstRtpFECDec *rtp_fec_dec)
+{
+	if (g_atomic_int_compare_and_exchange(&(rtp_fec_dec->latency_changed), TRUE, FALSE))
+		gst_element_post_message(GST_ELEMENT(rtp_fec_dec), gst_message_new_latency(GST_OBJECT(rtp_fec_dec)));
+}
+
+
+static void gst_rtp_fec_dec_reset_qos(GstRtpFECDec *rtp_fec_dec)
+{
+	gst_segment_init(&(rtp_fec_dec->segment), GST_FORMAT_TIME);
+	rtp_fec_dec->qos_earliest_time = GST_CLOCK_TIME_NONE;
+	rtp_fec_dec->last_running_time = GST_CLOCK_TIME_NONE;
+}
 
 
 static GstStateChangeReturn gst_rtp_fec_dec_change_state(GstElement *element, GstStateChange transition)
@@ -410,6 +1830,19 @@ static GstStateChangeReturn gst_rtp_fec_dec_change_state(GstElement *element, Gs
 	GstRtpFECDec *rtp_fec_dec;
 	
 	rtp_fec_dec = GST_RTP_FEC_DEC(element);
+
+	switch (transition)
+	{
+		case GST_STATE_CHANGE_NULL_TO_READY:
+			/* Preallocate enough recovered packets for two blocks */
+			g_mutex_lock(rtp_fec_dec->mutex);
+			rtp_fec_dec->pool = fec_buffer_pool_create(rtp_fec_dec->max_packet_size, rtp_fec_dec->num_fec_packets * 2);
+			g_mutex_unlock(rtp_fec_dec->mutex);
+			break;
+		default:
+			break;
+	}
+
 	ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
 
 	switch (transition)
@@ -418,10 +1851,31 @@ static GstStateChangeReturn gst_rtp_fec_dec_change_state(GstElement *element, Gs
 			break;
 		case GST_STATE_CHANGE_PAUSED_TO_READY:
 			g_mutex_lock(rtp_fec_dec->mutex);
-			fec_dec_reset(rtp_fec_dec->dec);
+			/* The next session may carry different streams, so drop all decoders */
+			fec_ssrc_table_clear(rtp_fec_dec->decoders);
+			while (!g_queue_is_empty(rtp_fec_dec->recovered_packets))
+				gst_buffer_unref(g_queue_pop_head(rtp_fec_dec->recovered_packets));
+			fec_joint_dec_reset(rtp_fec_dec->joint_dec);
+			fec_ssrc_table_clear(rtp_fec_dec->joint_src_pads);
+			while (!g_queue_is_empty(rtp_fec_dec->joint_recovered_packets))
+				gst_buffer_unref(g_queue_pop_head(rtp_fec_dec->joint_recovered_packets));
+			gst_rtp_fec_dec_reset_qos(rtp_fec_dec);
+			while (!g_queue_is_empty(rtp_fec_dec->pending_retransmission_requests))
+				gst_event_unref(g_queue_pop_head(rtp_fec_dec->pending_retransmission_requests));
+			/* No decoder is running anymore, so the statistics can be reset for the next session */
+			fec_dec_stats_reset(&(rtp_fec_dec->stats));
+			fec_latency_estimator_reset(&(rtp_fec_dec->latency_estimator));
+			rtp_fec_dec->reported_latency = GST_CLOCK_TIME_NONE;
 			g_mutex_unlock(rtp_fec_dec->mutex);
+			GST_OBJECT_LOCK(rtp_fec_dec);
+			rtp_fec_dec->last_stats_time = GST_CLOCK_TIME_NONE;
+			GST_OBJECT_UNLOCK(rtp_fec_dec);
 			break;
 		case GST_STATE_CHANGE_READY_TO_NULL:
+			g_mutex_lock(rtp_fec_dec->mutex);
+			fec_buffer_pool_destroy(rtp_fec_dec->pool);
+			rtp_fec_dec->pool = NULL;
+			g_mutex_unlock(rtp_fec_dec->mutex);
 			break;
 		default:
 			break;
@@ -435,7 +1889,14 @@ static void gst_rtp_fec_dec_finalize(GObject *object)
 {
 	GstRtpFECDec *rtp_fec_dec = GST_RTP_FEC_DEC(object);
 	g_mutex_free(rtp_fec_dec->mutex);
-	fec_dec_destroy(rtp_fec_dec->dec);
+	fec_ssrc_table_destroy(rtp_fec_dec->decoders);
+	g_queue_free(rtp_fec_dec->recovered_packets);
+	fec_joint_dec_destroy(rtp_fec_dec->joint_dec);
+	fec_ssrc_table_destroy(rtp_fec_dec->joint_src_pads);
+	g_queue_free(rtp_fec_dec->joint_recovered_packets);
+	while (!g_queue_is_empty(rtp_fec_dec->pending_retransmission_requests))
+		gst_event_unref(g_queue_pop_head(rtp_fec_dec->pending_retransmission_requests));
+	g_queue_free(rtp_fec_dec->pending_retransmission_requests);
 	GST_DEBUG_OBJECT(rtp_fec_dec, "Cleaned up FEC decoder");
 	G_OBJECT_CLASS(parent_class)->finalize(object);
 }
@@ -25,6 +25,11 @@
 
 #include <gst/gst.h>
 #include "fecdec.h"
+#include "fecstats.h"
+#include "feclatency.h"
+#include "fecjointdec.h"
+#include "fecbufferpool.h"
+#include "fecssrctable.h"
 
 
 G_BEGIN_DECLS
@@ -50,8 +55,78 @@ struct _GstRtpFECDec
 		*srcpad,
 		*fecpad;
 
-	/* Actual FEC decoder */
-	fec_dec *dec;
+	/* Actual FEC decoders, one per SSRC, created when the first packet of a stream arrives */
+	fec_ssrc_table *decoders;
+	guint max_ssrcs;
+
+	/* Settings for the decoders */
+	guint num_media_packets, num_fec_packets, max_packet_size;
+	gboolean use_symbol_arena;
+
+	/* Packets recovered by any of the decoders, waiting to be pushed downstream */
+	GQueue *recovered_packets;
+
+	/*
+	Decoder for joint blocks, whose FEC packets (with the E bit set) arrive through the fec pad.
+	The media packets of the protected streams arrive through sink_%d request pads, each paired
+	with a src_%d pad (stored in the sink pad's element_private field). joint_src_pads maps the
+	SSRCs seen on the sink_%d pads to their src_%d pads, so recovered packets can be routed back.
+	*/
+	fec_joint_dec *joint_dec;
+	fec_ssrc_table *joint_src_pads;
+	GQueue *joint_recovered_packets;
+	guint num_joint_pads;
+
+	/* Pool for recovered packets; exists between the READY and NULL states */
+	fec_buffer_pool *pool;
+
+	/*
+	Payload type of FEC packets multiplexed into the sink pad (mux mode);
+	-1 if FEC packets only arrive through the fec pad
+	*/
+	gint fec_payload_type;
+
+	/*
+	Decoder-side QoS: if enabled, recoveries are skipped if the recovered packets would be late anyway.
+	A block is late if its running time (derived from the timestamps of its media packets and the
+	segment of the sink pad) lies before qos_earliest_time, which downstream QoS events report, or
+	if the data flow has already moved on by more than the pipeline latency since the block
+	(last_running_time is the running time of the most recent media packet).
+	*/
+	gboolean qos;
+	GstSegment segment;
+	GstClockTime qos_earliest_time, latency, last_running_time;
+	guint64 skipped_recoveries;
+
+	/*
+	Latency of the element: recovered packets can be late by up to one block duration, plus fec_deadline,
+	the time the FEC packets of a block may trail its last media packet. latency_estimator measures the block
+	duration. reported_latency is the latency last reported in a latency query (GST_CLOCK_TIME_NONE if there
+	was none yet); if the latency drifts too far from it, latency_changed is set, and a latency message is
+	posted once the mutex is released.
+	*/
+	fec_latency_estimator latency_estimator;
+	GstClockTime fec_deadline, reported_latency;
+	volatile gint latency_changed;
+
+	/*
+	Statistics shared by all decoders; they are updated atomically by the decoders, and can be read
+	without locking. If stats_interval is nonzero, they are posted as element messages at least
+	stats_interval apart (measured in system time); last_stats_time is protected by the object lock.
+	*/
+	fec_dec_stats stats;
+	GstClockTime stats_interval, last_stats_time;
+
+	/*
+	Hybrid FEC and retransmission: if enabled, media packets which the decoders give up on are requested upstream
+	with GstRTPRetransmissionRequest events, and such requests coming from downstream are dropped if the packet
+	may still be recovered by FEC. Requests are queued in pending_retransmission_requests while the mutex is locked,
+	and sent once it is released. cur_ssrc is the SSRC of the stream whose packet is currently being decoded.
+	*/
+	gboolean do_retransmission;
+	GQueue *pending_retransmission_requests;
+	guint32 cur_ssrc;
+	guint64 retransmission_requests, suppressed_requests;
 
 	/*
 	Mutex used in the chain functions. The GstObject mutex cannot be used,
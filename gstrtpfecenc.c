@@ -20,6 +20,8 @@
 
 
 
+#include <stdlib.h>
+#include <string.h>
 #include <gst/rtp/gstrtpbuffer.h>
 #include "gstrtpfecenc.h"
 
@@ -46,29 +48,202 @@ enum
 	PROP_0 = 0, /* GStreamer disallows properties with id 0 -> using dummy enum to prevent 0 */
 	PROP_NUM_MEDIA_PACKETS,
 	PROP_NUM_FEC_PACKETS,
-	PROP_PAYLOAD_TYPE
+	PROP_PAYLOAD_TYPE,
+	PROP_MAX_PACKET_SIZE,
+	PROP_POOL_STATS,
+	PROP_MUX,
+	PROP_MAX_SSRCS,
+	PROP_UEP_MODE,
+	PROP_UEP_EXTENSION_ID,
+	PROP_KEYFRAME_MEDIA_PACKETS,
+	PROP_KEYFRAME_FEC_PACKETS,
+	PROP_PACING,
+	PROP_MAX_PACING_DELAY,
+	PROP_MAX_FEC_BITRATE,
+	PROP_FEC_BITRATE,
+	PROP_SKIPPED_REPAIRS,
+	PROP_QOS,
+	PROP_QOS_LEVEL,
+	PROP_RTX_HISTORY,
+	PROP_RETRANSMITTED_PACKETS,
+	PROP_STATS,
+	PROP_STATS_INTERVAL
+};
+
+
+enum
+{
+	PROP_LAYER_0 = 0,
+	PROP_LAYER_NUM_FEC_PACKETS
 };
 
 
 enum
 {
 	DEFAULT_NUM_MEDIA_PACKETS = 9,
-	DEFAULT_NUM_FEC_PACKETS = 3
+	DEFAULT_NUM_FEC_PACKETS = 3,
+	DEFAULT_MAX_PACKET_SIZE = 1500,
+	DEFAULT_MUX = FALSE,
+	DEFAULT_MAX_SSRCS = 16,
+	DEFAULT_LAYER_NUM_FEC_PACKETS = 1,
+	DEFAULT_UEP_EXTENSION_ID = 1,
+	DEFAULT_KEYFRAME_MEDIA_PACKETS = 4,
+	DEFAULT_KEYFRAME_FEC_PACKETS = 4,
+	DEFAULT_MAX_FEC_BITRATE = 0,
+	DEFAULT_RTX_HISTORY = 0,
+	DEFAULT_STATS_INTERVAL = 0
 };
 
 
+#define DEFAULT_UEP_MODE GST_RTP_FEC_ENC_UEP_MODE_NONE
+#define DEFAULT_PACING FALSE
+#define DEFAULT_MAX_PACING_DELAY (50 * GST_MSECOND)
+#define DEFAULT_QOS FALSE
+
+
+/*
+Maximum number of fec_%d layers; with at most 24 repair symbols per layer, this keeps
+all repair symbol indices of regular blocks within the 8-bit index byte and the RS(255) code length.
+fec_%d layers and UEP are mutually exclusive, so the additional repair symbols of keyframe blocks
+always directly follow the repair symbols of the fec pad
+*/
+#define MAX_FEC_LAYERS 8
+
+
+/*
+Once max-ssrcs streams are known, a new stream replaces the least recently seen one, but only if that one
+did not send any packet during the last this many packets; SSRCs change when senders restart or collide
+*/
+#define SSRC_MIN_IDLE_PACKETS 1000
+
+
+/*
+The token bucket holds at most this much of the FEC bitrate budget, which bounds the size of
+FEC bursts after idle periods; the measured FEC bitrate is updated once per measurement window
+*/
+#define FEC_BUCKET_DURATION (200 * GST_MSECOND)
+#define FEC_BITRATE_WINDOW GST_SECOND
+
+
+/*
+QoS thresholds: there is pressure if encoding takes more than 1/QOS_PRESSURE_DIVISOR of the
+block interval, and headroom if it takes less than 1/QOS_HEADROOM_DIVISOR of it. The level is
+lowered at most once per QOS_DEGRADE_INTERVAL, so a burst of late buffers does not drop all
+protection at once, and raised after QOS_RESTORE_INTERVAL of continuous headroom.
+*/
+#define QOS_PRESSURE_DIVISOR 10
+#define QOS_HEADROOM_DIVISOR 40
+#define QOS_DEGRADE_INTERVAL (100 * GST_MSECOND)
+#define QOS_RESTORE_INTERVAL GST_SECOND
+
+
+/* Size of the RTP header (without CSRCs) and the FEC header plus the index byte preceding the FEC payload */
+#define FEC_PACKET_OVERHEAD (12 + 12 + 1)
+
+
 
 /**** Function declarations ****/
 
 /* This function is invoked when the sink pad receives data */
 static GstFlowReturn gst_rtp_fec_enc_chain(GstPad *pad, GstBuffer *packet);
+/* This function is invoked when the sink pad receives a buffer list (one packet per group) */
+static GstFlowReturn gst_rtp_fec_enc_chain_list(GstPad *pad, GstBufferList *list);
+/* These functions are invoked when a sink_%d request pad receives data; the packets go to the joint encoder */
+static GstFlowReturn gst_rtp_fec_enc_joint_chain(GstPad *pad, GstBuffer *packet);
+static GstFlowReturn gst_rtp_fec_enc_joint_chain_list(GstPad *pad, GstBufferList *list);
+/* Returns TRUE if the packet belongs to a keyframe according to the UEP mode */
+static gboolean gst_rtp_fec_enc_is_keyframe_packet(GstRtpFECEnc *rtp_fec_enc, GstBuffer *packet);
+/*
+Appends an FEC packet as a group of its own; the list and the iterator are created with the first packet
+(the list must be NULL or the iterator must be at its end), since most media packets do not complete a block
+*/
+static void gst_rtp_fec_enc_append_fec_packet(GstBufferList **fec_packets, GstBufferListIterator **fec_it, GstBuffer *fec_packet);
+/* Pushes a media packet to the encoder of its SSRC, and appends any FEC packets this generated (see gst_rtp_fec_enc_append_fec_packet()) */
+static void gst_rtp_fec_enc_encode_packet(GstRtpFECEnc *rtp_fec_enc, GstBuffer *packet, GstBufferList **fec_packets, GstBufferListIterator **fec_it);
+/* Appends all FEC packets of the encoder with the caps of the given pad (see gst_rtp_fec_enc_append_fec_packet()) */
+static void gst_rtp_fec_enc_drain_encoder(GstRtpFECEnc *rtp_fec_enc, fec_enc *enc, GstPad *pad, GstBufferList **fec_packets, GstBufferListIterator **fec_it);
+/*
+Pushes the collected FEC packets (if any; fec_packets may be NULL) as one buffer list into the given pad (the FEC pad,
+or the src pad in mux mode); packets belonging to fec_%d layers are split off into one list per layer pad
+*/
+static GstFlowReturn gst_rtp_fec_enc_push_fec_packets(GstRtpFECEnc *rtp_fec_enc, GstPad *pad, GstBufferList *fec_packets);
+/*
+Moves all FEC packets of the encoder into the pacing queue, spread over the block interval of that encoder;
+must be called with the mutex locked
+*/
+static void gst_rtp_fec_enc_schedule_fec_packets(GstRtpFECEnc *rtp_fec_enc, fec_enc *enc, GstPad *pad, GstClockTime const now);
+/*
+Appends all paced packets which are due at the given time to the FEC packets (which may be NULL); without pacing
+(or without a valid time), all paced packets are due, and go before the given FEC packets; must be called with the mutex locked
+*/
+static GstBufferList* gst_rtp_fec_enc_pace_fec_packets(GstRtpFECEnc *rtp_fec_enc, GstBufferList *fec_packets, GstClockTime const now);
+/* Appends paced packets due at the given time (all of them if now is GST_CLOCK_TIME_NONE) to the list, which is created if necessary */
+static void gst_rtp_fec_enc_take_due_packets(GstRtpFECEnc *rtp_fec_enc, GstBufferList **due_packets, GstClockTime const now);
+/* Drops all paced packets; must be called with the mutex locked */
+static void gst_rtp_fec_enc_clear_paced_packets(GstRtpFECEnc *rtp_fec_enc);
 /* This function is invoked when the sink pad receives caps */
 static gboolean gst_rtp_fec_enc_setcaps(GstPad *pad, GstCaps *caps);
+/* This function is invoked when the sink pad receives events; flushes paced packets at EOS */
+static gboolean gst_rtp_fec_enc_sink_event(GstPad *pad, GstEvent *event);
+/* This function is invoked when a sink_%d request pad receives caps */
+static gboolean gst_rtp_fec_enc_joint_setcaps(GstPad *pad, GstCaps *caps);
+/* Derives the fec pad caps from media caps */
+static gboolean gst_rtp_fec_enc_set_fec_caps(GstRtpFECEnc *rtp_fec_enc, GstCaps *caps);
+
+/* Request pad handling; each sink_%d pad comes with a src_%d pad */
+static GstPad* gst_rtp_fec_enc_request_new_pad(GstElement *element, GstPadTemplate *templ, gchar const *name);
+static void gst_rtp_fec_enc_release_pad(GstElement *element, GstPad *pad);
+static GstPad* gst_rtp_fec_enc_request_joint_pads(GstRtpFECEnc *rtp_fec_enc, gchar const *name);
+static GstPad* gst_rtp_fec_enc_request_layer_pad(GstRtpFECEnc *rtp_fec_enc, GstPadTemplate *templ, gchar const *name);
+/* Recomputes the repair symbol ranges of the layers and reconfigures the encoders; must be called with the mutex locked */
+static void gst_rtp_fec_enc_update_layers(GstRtpFECEnc *rtp_fec_enc);
+/* Checks if a block geometry fits in the symbol space of the code, and logs a warning if not */
+static gboolean gst_rtp_fec_enc_check_geometry(GstRtpFECEnc *rtp_fec_enc, guint const num_media_packets, guint const total_num_fec_packets);
 
 /* Property accessors */
 static void gst_rtp_fec_enc_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec);
 static void gst_rtp_fec_enc_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
 
+/* Called when the encoder needs a buffer for a FEC packet */
+static GstBuffer* gst_rtp_fec_enc_create_fec_buffer(guint const size_in_bytes, void *data);
+/* Called by the encoders before generating the FEC packets of a block; applies the QoS level and enforces max-fec-bitrate; called with the mutex locked */
+static guint gst_rtp_fec_enc_limit_fec_packets(guint const requested_num_fec_packets, guint const fec_packet_size, void *data);
+/* Resets the token bucket and the FEC bitrate measurement; must be called with the mutex locked */
+static void gst_rtp_fec_enc_reset_bitrate_state(GstRtpFECEnc *rtp_fec_enc);
+
+/* This function is invoked when the src, fec, or src_%d pads receive events; handles QoS events */
+static gboolean gst_rtp_fec_enc_src_event(GstPad *pad, GstEvent *event);
+/* Finishes the encode time measurement of a block, if one was encoded; must be called with the mutex locked */
+static void gst_rtp_fec_enc_finish_qos_measurement(GstRtpFECEnc *rtp_fec_enc);
+/* Lowers or raises the QoS level according to the current measurements; must be called with the mutex locked */
+static void gst_rtp_fec_enc_update_qos_level(GstRtpFECEnc *rtp_fec_enc);
+/* Resets the QoS level and measurements; must be called with the mutex locked */
+static void gst_rtp_fec_enc_reset_qos_state(GstRtpFECEnc *rtp_fec_enc);
+/* Posts an element message about a QoS level change; must be called without the mutex locked */
+static void gst_rtp_fec_enc_post_qos_message(GstRtpFECEnc *rtp_fec_enc, GstRtpFECEncQoSLevel const old_level, GstRtpFECEncQoSLevel const new_level);
+
+/* Adds a media packet to the retransmission history, dropping the oldest ones; must be called with the mutex locked */
+static void gst_rtp_fec_enc_store_rtx_packet(GstRtpFECEnc *rtp_fec_enc, GstBuffer *packet);
+/* Drops the oldest packets from the retransmission history until at most max_num_packets remain; must be called with the mutex locked */
+static void gst_rtp_fec_enc_trim_rtx_packets(GstRtpFECEnc *rtp_fec_enc, guint const max_num_packets);
+/*
+Answers a retransmission request by pushing the requested packet into the src pad; returns FALSE if it is not in the
+history or could not be pushed, in which case the request is passed on upstream
+*/
+static gboolean gst_rtp_fec_enc_handle_retransmission_request(GstRtpFECEnc *rtp_fec_enc, GstEvent *event);
+
+/* Posts the statistics as an element message if the stats interval has passed; must be called without the mutex locked */
+static void gst_rtp_fec_enc_post_stats_message(GstRtpFECEnc *rtp_fec_enc);
+
+/* Answers latency queries on the fec pad, and on the src pad in mux mode, by adding the latency of the FEC stream */
+static gboolean gst_rtp_fec_enc_src_query(GstPad *pad, GstQuery *query);
+/* Returns the current latency of the FEC stream; must be called with the mutex locked */
+static GstClockTime gst_rtp_fec_enc_get_own_latency(GstRtpFECEnc *rtp_fec_enc);
+/* Checks if the latency has drifted from the reported one, and flags a latency message if so; must be called with the mutex locked */
+static void gst_rtp_fec_enc_update_latency(GstRtpFECEnc *rtp_fec_enc);
+/* Posts a latency message if one has been flagged; must be called without the mutex locked */
+static void gst_rtp_fec_enc_post_latency_message(GstRtpFECEnc *rtp_fec_enc);
+
 /* Called when the pipeline state changes */
 static GstStateChangeReturn gst_rtp_fec_enc_change_state(GstElement *element, GstStateChange transition);
 
@@ -82,6 +257,52 @@ static void gst_rtp_fec_enc_finalize(GObject *object);
 GST_BOILERPLATE(GstRtpFECEnc, gst_rtp_fec_enc, GstElement, GST_TYPE_ELEMENT)
 
 
+#define GST_TYPE_RTP_FEC_ENC_UEP_MODE (gst_rtp_fec_enc_uep_mode_get_type())
+static GType gst_rtp_fec_enc_uep_mode_get_type(void)
+{
+	static GType uep_mode_type = 0;
+
+	if (!uep_mode_type)
+	{
+		static GEnumValue const uep_mode_values[] =
+		{
+			{ GST_RTP_FEC_ENC_UEP_MODE_NONE, "All packets get the same protection", "none" },
+			{ GST_RTP_FEC_ENC_UEP_MODE_DELTA_UNIT, "Packets without the DELTA_UNIT buffer flag are keyframe packets", "delta-unit" },
+			{ GST_RTP_FEC_ENC_UEP_MODE_MARKER, "Packets with the RTP marker bit set are keyframe packets", "marker" },
+			{ GST_RTP_FEC_ENC_UEP_MODE_HEADER_EXTENSION, "Packets with a nonzero one-byte header extension element (uep-extension-id) are keyframe packets", "header-extension" },
+			{ 0, NULL, NULL }
+		};
+
+		uep_mode_type = g_enum_register_static("GstRtpFECEncUEPMode", uep_mode_values);
+	}
+
+	return uep_mode_type;
+}
+
+
+#define GST_TYPE_RTP_FEC_ENC_QOS_LEVEL (gst_rtp_fec_enc_qos_level_get_type())
+static GType gst_rtp_fec_enc_qos_level_get_type(void)
+{
+	static GType qos_level_type = 0;
+
+	if (!qos_level_type)
+	{
+		static GEnumValue const qos_level_values[] =
+		{
+			{ GST_RTP_FEC_ENC_QOS_LEVEL_FULL, "All configured FEC packets are generated", "full" },
+			{ GST_RTP_FEC_ENC_QOS_LEVEL_REDUCED, "Half of the configured FEC packets are generated", "reduced" },
+			{ GST_RTP_FEC_ENC_QOS_LEVEL_XOR, "One XOR parity packet is generated per block", "xor" },
+			{ GST_RTP_FEC_ENC_QOS_LEVEL_SKIP, "No FEC packets are generated", "skip" },
+			{ 0, NULL, NULL }
+		};
+
+		qos_level_type = g_enum_register_static("GstRtpFECEncQoSLevel", qos_level_values);
+	}
+
+	return qos_level_type;
+}
+
+
 
 /**** Pads ****/
 
@@ -99,21 +320,131 @@ static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
 	GST_STATIC_CAPS("application/x-rtp")
 );
 
+static GstStaticPadTemplate joint_sink_template = GST_STATIC_PAD_TEMPLATE(
+	"sink_%d",
+	GST_PAD_SINK,
+	GST_PAD_REQUEST,
+	GST_STATIC_CAPS("application/x-rtp")
+);
+
+static GstStaticPadTemplate joint_src_template = GST_STATIC_PAD_TEMPLATE(
+	"src_%d",
+	GST_PAD_SRC,
+	GST_PAD_SOMETIMES,
+	GST_STATIC_CAPS("application/x-rtp")
+);
+
+#define FEC_PAD_CAPS \
+	"application/x-rtp," \
+	"media = (string) { \"video\", \"audio\", \"application\" }, " \
+	"payload = (int) [ 96, 127 ], " \
+	"clock-rate = (int) [ 1, MAX ], " \
+	"encoding-name = (string) \"parityfec\""
+
 static GstStaticPadTemplate fec_template = GST_STATIC_PAD_TEMPLATE(
 	"fec",
 	GST_PAD_SRC,
 	GST_PAD_ALWAYS,
-	GST_STATIC_CAPS(
-		"application/x-rtp,"
-		"media = (string) { \"video\", \"audio\", \"application\" }, "
-		"payload = (int) [ 96, 127 ], "
-		"clock-rate = (int) [ 1, MAX ], "
-		"encoding-name = (string) \"parityfec\""
-	)
+	GST_STATIC_CAPS(FEC_PAD_CAPS)
+);
+
+static GstStaticPadTemplate fec_layer_template = GST_STATIC_PAD_TEMPLATE(
+	"fec_%d",
+	GST_PAD_SRC,
+	GST_PAD_REQUEST,
+	GST_STATIC_CAPS(FEC_PAD_CAPS)
 );
 
 
 
+/**** Layer pad ****/
+
+G_DEFINE_TYPE(GstRtpFECEncLayerPad, gst_rtp_fec_enc_layer_pad, GST_TYPE_PAD)
+
+
+static void gst_rtp_fec_enc_layer_pad_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec)
+{
+	GstRtpFECEncLayerPad *layer_pad;
+	GstElement *parent;
+
+	layer_pad = GST_RTP_FEC_ENC_LAYER_PAD(object);
+
+	switch (prop_id)
+	{
+		case PROP_LAYER_NUM_FEC_PACKETS:
+			/* The layer ranges are shared with the streaming thread, which reads them under the element mutex */
+			parent = gst_pad_get_parent_element(GST_PAD(layer_pad));
+			if (parent != NULL)
+			{
+				GstRtpFECEnc *rtp_fec_enc = GST_RTP_FEC_ENC(parent);
+				guint num_fec_packets = g_value_get_uint(value);
+				g_mutex_lock(rtp_fec_enc->mutex);
+				if (gst_rtp_fec_enc_check_geometry(rtp_fec_enc, rtp_fec_enc->num_media_packets, rtp_fec_enc->total_num_fec_packets - layer_pad->num_fec_packets + num_fec_packets))
+				{
+					layer_pad->num_fec_packets = num_fec_packets;
+					gst_rtp_fec_enc_update_layers(rtp_fec_enc);
+				}
+				g_mutex_unlock(rtp_fec_enc->mutex);
+				gst_object_unref(parent);
+			}
+			else
+				layer_pad->num_fec_packets = g_value_get_uint(value);
+			GST_DEBUG_OBJECT(layer_pad, "Set number of FEC packets to %u", layer_pad->num_fec_packets);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+
+static void gst_rtp_fec_enc_layer_pad_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+	GstRtpFECEncLayerPad *layer_pad = GST_RTP_FEC_ENC_LAYER_PAD(object);
+
+	switch (prop_id)
+	{
+		case PROP_LAYER_NUM_FEC_PACKETS:
+			g_value_set_uint(value, layer_pad->num_fec_packets);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+
+static void gst_rtp_fec_enc_layer_pad_class_init(GstRtpFECEncLayerPadClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+	object_class->set_property = GST_DEBUG_FUNCPTR(gst_rtp_fec_enc_layer_pad_set_property);
+	object_class->get_property = GST_DEBUG_FUNCPTR(gst_rtp_fec_enc_layer_pad_get_property);
+
+	g_object_class_install_property(
+		object_class,
+		PROP_LAYER_NUM_FEC_PACKETS,
+		g_param_spec_uint(
+			"num-fec-packets",
+			"Number of FEC packets",
+			"Number of forward error correction packets per block in this layer",
+		        1, 24,
+			DEFAULT_LAYER_NUM_FEC_PACKETS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+}
+
+
+static void gst_rtp_fec_enc_layer_pad_init(GstRtpFECEncLayerPad *layer_pad)
+{
+	layer_pad->layer_nr = 0;
+	layer_pad->num_fec_packets = DEFAULT_LAYER_NUM_FEC_PACKETS;
+	layer_pad->first_index = 0;
+}
+
+
+
 /**** Function definition ****/
 
 static void gst_rtp_fec_enc_base_init(gpointer klass)
@@ -131,6 +462,9 @@ static void gst_rtp_fec_enc_base_init(gpointer klass)
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&sink_template));
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&src_template));
 	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&fec_template));
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&joint_sink_template));
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&joint_src_template));
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&fec_layer_template));
 }
 
 
@@ -147,6 +481,8 @@ static void gst_rtp_fec_enc_class_init(GstRtpFECEncClass *klass)
 	/* Set functions */
 	object_class->finalize = GST_DEBUG_FUNCPTR(gst_rtp_fec_enc_finalize);
 	element_class->change_state = GST_DEBUG_FUNCPTR(gst_rtp_fec_enc_change_state);
+	element_class->request_new_pad = GST_DEBUG_FUNCPTR(gst_rtp_fec_enc_request_new_pad);
+	element_class->release_pad = GST_DEBUG_FUNCPTR(gst_rtp_fec_enc_release_pad);
 	object_class->set_property = GST_DEBUG_FUNCPTR(gst_rtp_fec_enc_set_property);
 	object_class->get_property = GST_DEBUG_FUNCPTR(gst_rtp_fec_enc_get_property);
 
@@ -187,6 +523,314 @@ static void gst_rtp_fec_enc_class_init(GstRtpFECEncClass *klass)
 			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
 		)
 	);
+	g_object_class_install_property(
+		object_class,
+		PROP_MAX_PACKET_SIZE,
+		g_param_spec_uint(
+			"max-packet-size",
+			"Maximum packet size",
+			"Expected maximum size of media packets in bytes; used for sizing the FEC packet buffer pool and preallocating the encoders' padding memory (takes effect in the READY state)",
+		        1, 65535,
+			DEFAULT_MAX_PACKET_SIZE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_POOL_STATS,
+		g_param_spec_boxed(
+			"pool-stats",
+			"Buffer pool statistics",
+			"Statistics of the FEC packet buffer pool (NULL if the element is in the NULL state)",
+			GST_TYPE_STRUCTURE,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_MUX,
+		g_param_spec_boolean(
+			"mux",
+			"Mux",
+			"Interleave FEC packets into the src pad (after the media packets of their block) instead of pushing them into the fec pad",
+			DEFAULT_MUX,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_MAX_SSRCS,
+		g_param_spec_uint(
+			"max-ssrcs",
+			"Maximum number of SSRCs",
+			"Maximum number of streams (SSRCs) to protect with independent FEC blocks; new streams replace idle ones, otherwise their packets are passed through unprotected",
+		        1, 1024,
+			DEFAULT_MAX_SSRCS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_UEP_MODE,
+		g_param_spec_enum(
+			"uep-mode",
+			"UEP mode",
+			"How keyframe packets are identified for unequal error protection; keyframe packets get blocks of their own with the keyframe block geometry (cannot be used together with fec_%d layers)",
+			GST_TYPE_RTP_FEC_ENC_UEP_MODE,
+			DEFAULT_UEP_MODE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_UEP_EXTENSION_ID,
+		g_param_spec_uint(
+			"uep-extension-id",
+			"UEP extension ID",
+			"ID of the one-byte RTP header extension element marking keyframe packets (uep-mode=header-extension)",
+		        1, 14,
+			DEFAULT_UEP_EXTENSION_ID,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_KEYFRAME_MEDIA_PACKETS,
+		g_param_spec_uint(
+			"keyframe-media-packets",
+			"Number of keyframe media packets",
+			"Number of media packets per block for keyframe packets (only used if uep-mode is not none)",
+		        1, 24,
+			DEFAULT_KEYFRAME_MEDIA_PACKETS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_KEYFRAME_FEC_PACKETS,
+		g_param_spec_uint(
+			"keyframe-fec-packets",
+			"Number of keyframe FEC packets",
+			"Number of forward error correction packets per keyframe block on the fec pad (only used if uep-mode is not none); receivers must expect at least this many FEC packets",
+		        1, 24,
+			DEFAULT_KEYFRAME_FEC_PACKETS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_PACING,
+		g_param_spec_boolean(
+			"pacing",
+			"Pacing",
+			"Timestamp FEC packets and spread them evenly over the following block interval instead of sending them in one burst",
+			DEFAULT_PACING,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_MAX_PACING_DELAY,
+		g_param_spec_uint64(
+			"max-pacing-delay",
+			"Maximum pacing delay",
+			"Maximum delay in nanoseconds added to FEC packets by pacing",
+		        0, G_MAXUINT64,
+			DEFAULT_MAX_PACING_DELAY,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_MAX_FEC_BITRATE,
+		g_param_spec_uint(
+			"max-fec-bitrate",
+			"Maximum FEC bitrate",
+			"Maximum bitrate in bits per second of all FEC packets together; blocks get fewer FEC packets or none at all if it is exceeded (0 = unlimited)",
+		        0, G_MAXUINT,
+			DEFAULT_MAX_FEC_BITRATE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_FEC_BITRATE,
+		g_param_spec_uint(
+			"fec-bitrate",
+			"FEC bitrate",
+			"Measured bitrate in bits per second of all generated FEC packets",
+		        0, G_MAXUINT,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_SKIPPED_REPAIRS,
+		g_param_spec_uint64(
+			"skipped-repairs",
+			"Skipped repairs",
+			"Number of FEC packets which were not generated because of max-fec-bitrate",
+		        0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_QOS,
+		g_param_spec_boolean(
+			"qos",
+			"QoS",
+			"Reduce FEC protection when encoding takes too long or downstream reports lateness, and restore it when there is headroom again",
+			DEFAULT_QOS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_QOS_LEVEL,
+		g_param_spec_enum(
+			"qos-level",
+			"QoS level",
+			"Current level of FEC protection as chosen by QoS",
+			GST_TYPE_RTP_FEC_ENC_QOS_LEVEL,
+			GST_RTP_FEC_ENC_QOS_LEVEL_FULL,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_RTX_HISTORY,
+		g_param_spec_uint(
+			"rtx-history",
+			"Retransmission history",
+			"Number of recent media packets kept for answering retransmission requests from downstream (0 = no retransmissions)",
+		        0, 65535,
+			DEFAULT_RTX_HISTORY,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_RETRANSMITTED_PACKETS,
+		g_param_spec_uint64(
+			"retransmitted-packets",
+			"Retransmitted packets",
+			"Number of media packets which were sent again in response to retransmission requests",
+		        0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_STATS,
+		g_param_spec_boxed(
+			"stats",
+			"Statistics",
+			"Encoder statistics: blocks encoded, FEC packets and bytes generated, and a histogram of block encode times (power-of-two buckets in microseconds)",
+			GST_TYPE_STRUCTURE,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_STATS_INTERVAL,
+		g_param_spec_uint(
+			"stats-interval",
+			"Statistics interval",
+			"Interval in milliseconds between element messages with the statistics (0 = no messages)",
+		        0, G_MAXUINT,
+			DEFAULT_STATS_INTERVAL,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+}
+
+
+static void gst_rtp_fec_enc_destroy_encoder(gpointer value)
+{
+	fec_enc_destroy(value);
+}
+
+
+static void gst_rtp_fec_enc_configure_encoder(guint32 const ssrc, gpointer value, gpointer user_data)
+{
+	GstRtpFECEnc *rtp_fec_enc = user_data;
+	fec_enc *enc = value;
+
+	/* Changing the block geometry resets the encoder, so only do so if it actually changed */
+	if (fec_enc_get_num_media_packets(enc) != rtp_fec_enc->num_media_packets)
+		fec_enc_set_num_media_packets(enc, rtp_fec_enc->num_media_packets);
+	if (fec_enc_get_num_fec_packets(enc) != rtp_fec_enc->total_num_fec_packets)
+		fec_enc_set_num_fec_packets(enc, rtp_fec_enc->total_num_fec_packets);
+	fec_enc_set_payload_type(enc, rtp_fec_enc->payload_type);
+
+	/* The joint decoder cannot handle XOR parity packets; at the XOR level, joint blocks get one RS repair symbol instead */
+	if (enc != rtp_fec_enc->joint_enc)
+		fec_enc_set_xor(enc, rtp_fec_enc->qos_level == GST_RTP_FEC_ENC_QOS_LEVEL_XOR);
+
+	/*
+	UEP is never enabled together with fec_%d layers (total_num_fec_packets then equals num_fec_packets),
+	so any additional repair symbols of keyframe blocks directly follow the ones of the fec pad, and a receiver
+	of the fec pad only needs num-fec-packets set to keyframe-fec-packets to use them
+	*/
+	{
+		guint keyframe_num_media_packets = (rtp_fec_enc->uep_mode != GST_RTP_FEC_ENC_UEP_MODE_NONE) ? rtp_fec_enc->keyframe_num_media_packets : 0;
+		guint keyframe_num_fec_packets = rtp_fec_enc->total_num_fec_packets;
+		if (rtp_fec_enc->keyframe_num_fec_packets > rtp_fec_enc->num_fec_packets)
+			keyframe_num_fec_packets += rtp_fec_enc->keyframe_num_fec_packets - rtp_fec_enc->num_fec_packets;
+
+		/* Otherwise, fec_core_encode() would fail, and keyframe blocks would go out without any protection */
+		if ((keyframe_num_media_packets + keyframe_num_fec_packets) > FEC_CORE_MAX_SYMBOLS)
+		{
+			GST_WARNING_OBJECT(rtp_fec_enc, "%u keyframe media and %u keyframe FEC packets exceed the maximum of %d symbols per block - limiting keyframe FEC packets to %u", keyframe_num_media_packets, keyframe_num_fec_packets, FEC_CORE_MAX_SYMBOLS, FEC_CORE_MAX_SYMBOLS - keyframe_num_media_packets);
+			keyframe_num_fec_packets = FEC_CORE_MAX_SYMBOLS - keyframe_num_media_packets;
+		}
+
+		if ((fec_enc_get_keyframe_num_media_packets(enc) != keyframe_num_media_packets) || (fec_enc_get_keyframe_num_fec_packets(enc) != keyframe_num_fec_packets))
+			fec_enc_set_keyframe_geometry(enc, keyframe_num_media_packets, keyframe_num_fec_packets);
+	}
+
+	/* Sized for the geometry set above, so the padding memory is not allocated with the first blocks */
+	fec_enc_set_max_symbol_size(enc, rtp_fec_enc->max_packet_size);
+
+	GST_LOG_OBJECT(rtp_fec_enc, "configured encoder for SSRC %08x", ssrc);
+}
+
+
+static fec_enc* gst_rtp_fec_enc_get_encoder(GstRtpFECEnc *rtp_fec_enc, guint32 const ssrc)
+{
+	fec_enc *enc;
+
+	enc = fec_ssrc_table_lookup(rtp_fec_enc->encoders, ssrc);
+	if (enc != NULL)
+		return enc;
+
+	while (fec_ssrc_table_get_size(rtp_fec_enc->encoders) >= rtp_fec_enc->max_ssrcs)
+	{
+		guint32 idle_ssrc;
+
+		if (!fec_ssrc_table_remove_least_recently_used(rtp_fec_enc->encoders, SSRC_MIN_IDLE_PACKETS, &idle_ssrc))
+		{
+			GST_LOG_OBJECT(rtp_fec_enc, "maximum number of SSRCs reached - not protecting stream with SSRC %08x", ssrc);
+			return NULL;
+		}
+
+		GST_DEBUG_OBJECT(rtp_fec_enc, "removed FEC encoder of idle stream with SSRC %08x to make room for SSRC %08x", idle_ssrc, ssrc);
+	}
+
+	/* Each stream gets its own FEC seqnum space */
+	/* TODO: make seqnum-offset a property */
+	enc = fec_enc_create(rtp_fec_enc->num_media_packets, rtp_fec_enc->total_num_fec_packets, rtp_fec_enc->payload_type, g_random_int_range(0, G_MAXUINT16), gst_rtp_fec_enc_create_fec_buffer, rtp_fec_enc);
+	fec_enc_set_limit_function(enc, gst_rtp_fec_enc_limit_fec_packets, rtp_fec_enc);
+	fec_enc_set_stats(enc, &(rtp_fec_enc->stats));
+	gst_rtp_fec_enc_configure_encoder(ssrc, enc, rtp_fec_enc);
+	fec_ssrc_table_insert(rtp_fec_enc->encoders, ssrc, enc);
+	GST_DEBUG_OBJECT(rtp_fec_enc, "created FEC encoder for SSRC %08x", ssrc);
+
+	return enc;
 }
 
 
@@ -205,49 +849,849 @@ static void gst_rtp_fec_enc_init(GstRtpFECEnc *rtp_fec_enc, GstRtpFECEncClass *k
 
 	/* Set chain and setcaps functions for the sink pad */
 	gst_pad_set_chain_function(rtp_fec_enc->sinkpad, gst_rtp_fec_enc_chain);
+	gst_pad_set_chain_list_function(rtp_fec_enc->sinkpad, gst_rtp_fec_enc_chain_list);
 	gst_pad_set_setcaps_function(rtp_fec_enc->sinkpad, gst_rtp_fec_enc_setcaps);
+	gst_pad_set_event_function(rtp_fec_enc->sinkpad, gst_rtp_fec_enc_sink_event);
+	gst_pad_set_event_function(rtp_fec_enc->srcpad, gst_rtp_fec_enc_src_event);
+	gst_pad_set_event_function(rtp_fec_enc->fecpad, gst_rtp_fec_enc_src_event);
+	gst_pad_set_query_function(rtp_fec_enc->srcpad, gst_rtp_fec_enc_src_query);
+	gst_pad_set_query_function(rtp_fec_enc->fecpad, gst_rtp_fec_enc_src_query);
 
 	/* Add the pads to the element */
 	gst_element_add_pad(element, rtp_fec_enc->sinkpad);
 	gst_element_add_pad(element, rtp_fec_enc->srcpad);
 	gst_element_add_pad(element, rtp_fec_enc->fecpad);
 
-	/* Finally, create the FEC encoder */
-	/* TODO: make seqnum-offset a property */
-	rtp_fec_enc->enc = fec_enc_create(DEFAULT_NUM_MEDIA_PACKETS, DEFAULT_NUM_FEC_PACKETS, DEFAULT_PT, g_random_int_range(0, G_MAXUINT16));
+	/* The buffer pool is created when switching to READY */
+	rtp_fec_enc->pool = NULL;
+	rtp_fec_enc->max_packet_size = DEFAULT_MAX_PACKET_SIZE;
+	rtp_fec_enc->mux = DEFAULT_MUX;
+	rtp_fec_enc->pacing = DEFAULT_PACING;
+	rtp_fec_enc->max_pacing_delay = DEFAULT_MAX_PACING_DELAY;
+	rtp_fec_enc->paced_packets = g_queue_new();
+
+	rtp_fec_enc->num_media_packets = DEFAULT_NUM_MEDIA_PACKETS;
+	rtp_fec_enc->num_fec_packets = DEFAULT_NUM_FEC_PACKETS;
+	rtp_fec_enc->total_num_fec_packets = DEFAULT_NUM_FEC_PACKETS;
+	rtp_fec_enc->layer_pads = NULL;
+	rtp_fec_enc->num_layer_pads = 0;
+	rtp_fec_enc->payload_type = DEFAULT_PT;
+	rtp_fec_enc->max_ssrcs = DEFAULT_MAX_SSRCS;
+	rtp_fec_enc->uep_mode = DEFAULT_UEP_MODE;
+	rtp_fec_enc->uep_extension_id = DEFAULT_UEP_EXTENSION_ID;
+	rtp_fec_enc->keyframe_num_media_packets = DEFAULT_KEYFRAME_MEDIA_PACKETS;
+	rtp_fec_enc->keyframe_num_fec_packets = DEFAULT_KEYFRAME_FEC_PACKETS;
+	rtp_fec_enc->max_fec_bitrate = DEFAULT_MAX_FEC_BITRATE;
+	rtp_fec_enc->skipped_repairs = 0;
+	gst_rtp_fec_enc_reset_bitrate_state(rtp_fec_enc);
+	rtp_fec_enc->qos = DEFAULT_QOS;
+	gst_rtp_fec_enc_reset_qos_state(rtp_fec_enc);
+	rtp_fec_enc->rtx_history = DEFAULT_RTX_HISTORY;
+	rtp_fec_enc->rtx_packets = g_queue_new();
+	rtp_fec_enc->retransmitted_packets = 0;
+	fec_enc_stats_reset(&(rtp_fec_enc->stats));
+	rtp_fec_enc->stats_interval = DEFAULT_STATS_INTERVAL * GST_MSECOND;
+	rtp_fec_enc->last_stats_time = GST_CLOCK_TIME_NONE;
+	fec_latency_estimator_reset(&(rtp_fec_enc->latency_estimator));
+	rtp_fec_enc->reported_latency = GST_CLOCK_TIME_NONE;
+	rtp_fec_enc->latency_changed = FALSE;
+
+	/* Initialize the mutex */
+	rtp_fec_enc->mutex = g_mutex_new();
+
+	/* Finally, create the FEC encoder table; the encoders themselves are created on demand */
+	rtp_fec_enc->encoders = fec_ssrc_table_create(gst_rtp_fec_enc_destroy_encoder);
+
+	/* The joint encoder is cheap while no request pads exist, so it is always present */
+	rtp_fec_enc->joint_enc = fec_enc_create(rtp_fec_enc->num_media_packets, rtp_fec_enc->total_num_fec_packets, rtp_fec_enc->payload_type, g_random_int_range(0, G_MAXUINT16), gst_rtp_fec_enc_create_fec_buffer, rtp_fec_enc);
+	fec_enc_set_joint(rtp_fec_enc->joint_enc, TRUE);
+	fec_enc_set_limit_function(rtp_fec_enc->joint_enc, gst_rtp_fec_enc_limit_fec_packets, rtp_fec_enc);
+	fec_enc_set_stats(rtp_fec_enc->joint_enc, &(rtp_fec_enc->stats));
+	rtp_fec_enc->num_joint_pads = 0;
 }
 
 
-static GstFlowReturn gst_rtp_fec_enc_chain(GstPad *pad, GstBuffer *packet)
+static GstPad* gst_rtp_fec_enc_request_new_pad(GstElement *element, GstPadTemplate *templ, gchar const *name)
 {
 	GstRtpFECEnc *rtp_fec_enc;
-	GstFlowReturn ret;
-	guint16 seqnum;
+	GstElementClass *klass;
 
-	rtp_fec_enc = GST_RTP_FEC_ENC(gst_pad_get_parent(pad));
+	rtp_fec_enc = GST_RTP_FEC_ENC(element);
+	klass = GST_ELEMENT_GET_CLASS(element);
 
-	seqnum = gst_rtp_buffer_get_seq(packet);
-	GST_DEBUG_OBJECT(rtp_fec_enc, "received RTP packet, seqnum %u", seqnum);
+	if (templ == gst_element_class_get_pad_template(klass, "sink_%d"))
+		return gst_rtp_fec_enc_request_joint_pads(rtp_fec_enc, name);
+	else if (templ == gst_element_class_get_pad_template(klass, "fec_%d"))
+		return gst_rtp_fec_enc_request_layer_pad(rtp_fec_enc, templ, name);
 
-	/* Push the media packet to the encoder */
-	fec_enc_push_media_packet(rtp_fec_enc->enc, packet);
+	GST_WARNING_OBJECT(rtp_fec_enc, "this is not our template");
+	return NULL;
+}
 
-	/*
-	If the encoder was able to generate FEC packets after the push call above,
-	push the packets into the FEC pad
-	*/
-	while (fec_enc_has_fec_packets(rtp_fec_enc->enc))
-	{
-		GstBuffer *fec_packet = fec_enc_pop_fec_packet(rtp_fec_enc->enc);
-		seqnum = gst_rtp_buffer_get_seq(fec_packet);
-		GST_DEBUG_OBJECT(rtp_fec_enc, "pushing FEC packet, seqnum %u", seqnum);
-		gst_buffer_set_caps(fec_packet, GST_PAD_CAPS(rtp_fec_enc->fecpad));
-		gst_pad_push(rtp_fec_enc->fecpad, fec_packet);
-		/*gst_buffer_unref(fec_packet);*/ /* TODO: can this be removed? */
-	}
 
-	/* Finally, push the media packet to the src pad */
-	ret = gst_pad_push(rtp_fec_enc->srcpad, packet);
+static GstPad* gst_rtp_fec_enc_request_joint_pads(GstRtpFECEnc *rtp_fec_enc, gchar const *name)
+{
+	GstElement *element;
+	GstPad *sinkpad, *srcpad;
+	guint pad_nr;
+	gchar *pad_name;
+
+	element = GST_ELEMENT(rtp_fec_enc);
+
+	GST_OBJECT_LOCK(rtp_fec_enc);
+	if ((name != NULL) && (strncmp(name, "sink_", 5) == 0))
+		pad_nr = strtoul(name + 5, NULL, 10);
+	else
+		pad_nr = rtp_fec_enc->num_joint_pads;
+	rtp_fec_enc->num_joint_pads = MAX(rtp_fec_enc->num_joint_pads, pad_nr + 1);
+	GST_OBJECT_UNLOCK(rtp_fec_enc);
+
+	pad_name = g_strdup_printf("sink_%u", pad_nr);
+	sinkpad = gst_pad_new_from_static_template(&joint_sink_template, pad_name);
+	g_free(pad_name);
+
+	pad_name = g_strdup_printf("src_%u", pad_nr);
+	srcpad = gst_pad_new_from_static_template(&joint_src_template, pad_name);
+	g_free(pad_name);
+
+	/* The sink pad chain functions look up their src pad through the private field */
+	gst_pad_set_element_private(sinkpad, srcpad);
+
+	gst_pad_set_chain_function(sinkpad, gst_rtp_fec_enc_joint_chain);
+	gst_pad_set_chain_list_function(sinkpad, gst_rtp_fec_enc_joint_chain_list);
+	gst_pad_set_setcaps_function(sinkpad, gst_rtp_fec_enc_joint_setcaps);
+	gst_pad_set_event_function(srcpad, gst_rtp_fec_enc_src_event);
+
+	gst_pad_set_active(srcpad, TRUE);
+	gst_element_add_pad(element, srcpad);
+	gst_element_add_pad(element, sinkpad);
+
+	GST_DEBUG_OBJECT(rtp_fec_enc, "added joint pads %s and %s", GST_PAD_NAME(sinkpad), GST_PAD_NAME(srcpad));
+
+	return sinkpad;
+}
+
+
+static gint gst_rtp_fec_enc_compare_layer_pads(gconstpointer a, gconstpointer b)
+{
+	guint layer_nr_a = GST_RTP_FEC_ENC_LAYER_PAD(a)->layer_nr;
+	guint layer_nr_b = GST_RTP_FEC_ENC_LAYER_PAD(b)->layer_nr;
+	return (layer_nr_a < layer_nr_b) ? -1 : ((layer_nr_a > layer_nr_b) ? 1 : 0);
+}
+
+
+static GstPad* gst_rtp_fec_enc_request_layer_pad(GstRtpFECEnc *rtp_fec_enc, GstPadTemplate *templ, gchar const *name)
+{
+	GstRtpFECEncLayerPad *layer_pad;
+	guint layer_nr;
+	gchar *pad_name;
+
+	g_mutex_lock(rtp_fec_enc->mutex);
+
+	if (g_list_length(rtp_fec_enc->layer_pads) >= MAX_FEC_LAYERS)
+	{
+		g_mutex_unlock(rtp_fec_enc->mutex);
+		GST_WARNING_OBJECT(rtp_fec_enc, "maximum number of %d FEC layers reached", MAX_FEC_LAYERS);
+		return NULL;
+	}
+
+	if (rtp_fec_enc->uep_mode != GST_RTP_FEC_ENC_UEP_MODE_NONE)
+	{
+		g_mutex_unlock(rtp_fec_enc->mutex);
+		GST_WARNING_OBJECT(rtp_fec_enc, "FEC layers cannot be used together with UEP");
+		return NULL;
+	}
+
+	if (!gst_rtp_fec_enc_check_geometry(rtp_fec_enc, rtp_fec_enc->num_media_packets, rtp_fec_enc->total_num_fec_packets + DEFAULT_LAYER_NUM_FEC_PACKETS))
+	{
+		g_mutex_unlock(rtp_fec_enc->mutex);
+		return NULL;
+	}
+
+	if ((name != NULL) && (strncmp(name, "fec_", 4) == 0))
+		layer_nr = strtoul(name + 4, NULL, 10);
+	else
+		layer_nr = rtp_fec_enc->num_layer_pads;
+	rtp_fec_enc->num_layer_pads = MAX(rtp_fec_enc->num_layer_pads, layer_nr + 1);
+
+	pad_name = g_strdup_printf("fec_%u", layer_nr);
+	layer_pad = g_object_new(
+		GST_TYPE_RTP_FEC_ENC_LAYER_PAD,
+		"name", pad_name,
+		"direction", GST_PAD_SRC,
+		"template", templ,
+		NULL
+	);
+	g_free(pad_name);
+	layer_pad->layer_nr = layer_nr;
+
+	/* Layers are ordered by pad number, so fec_0 always carries the lowest repair symbols of the layers */
+	rtp_fec_enc->layer_pads = g_list_insert_sorted(rtp_fec_enc->layer_pads, layer_pad, gst_rtp_fec_enc_compare_layer_pads);
+	gst_rtp_fec_enc_update_layers(rtp_fec_enc);
+
+	g_mutex_unlock(rtp_fec_enc->mutex);
+
+	/* If the fec pad already has caps, the new layer uses the same ones */
+	if (GST_PAD_CAPS(rtp_fec_enc->fecpad) != NULL)
+		gst_pad_set_caps(GST_PAD(layer_pad), GST_PAD_CAPS(rtp_fec_enc->fecpad));
+
+	gst_pad_set_active(GST_PAD(layer_pad), TRUE);
+	if (!gst_element_add_pad(GST_ELEMENT(rtp_fec_enc), GST_PAD(layer_pad)))
+	{
+		/* Most likely, a pad with the same name exists already; the layer must not stay in the list then */
+		GST_WARNING_OBJECT(rtp_fec_enc, "could not add FEC layer pad %s", GST_PAD_NAME(layer_pad));
+
+		g_mutex_lock(rtp_fec_enc->mutex);
+		rtp_fec_enc->layer_pads = g_list_remove(rtp_fec_enc->layer_pads, layer_pad);
+		gst_rtp_fec_enc_update_layers(rtp_fec_enc);
+		g_mutex_unlock(rtp_fec_enc->mutex);
+
+		gst_pad_set_active(GST_PAD(layer_pad), FALSE);
+		gst_object_unref(layer_pad);
+		return NULL;
+	}
+
+	GST_DEBUG_OBJECT(rtp_fec_enc, "added FEC layer pad %s", GST_PAD_NAME(layer_pad));
+
+	return GST_PAD(layer_pad);
+}
+
+
+static void gst_rtp_fec_enc_update_layers(GstRtpFECEnc *rtp_fec_enc)
+{
+	GList *link;
+	guint first_index;
+
+	first_index = rtp_fec_enc->num_fec_packets;
+	for (link = rtp_fec_enc->layer_pads; link != NULL; link = link->next)
+	{
+		GstRtpFECEncLayerPad *layer_pad = link->data;
+		layer_pad->first_index = first_index;
+		first_index += layer_pad->num_fec_packets;
+		GST_DEBUG_OBJECT(rtp_fec_enc, "FEC layer %s carries repair symbols [%u, %u)", GST_PAD_NAME(layer_pad), layer_pad->first_index, first_index);
+	}
+
+	rtp_fec_enc->total_num_fec_packets = first_index;
+
+	fec_ssrc_table_foreach(rtp_fec_enc->encoders, gst_rtp_fec_enc_configure_encoder, rtp_fec_enc);
+	gst_rtp_fec_enc_configure_encoder(0, rtp_fec_enc->joint_enc, rtp_fec_enc);
+}
+
+
+static gboolean gst_rtp_fec_enc_check_geometry(GstRtpFECEnc *rtp_fec_enc, guint const num_media_packets, guint const total_num_fec_packets)
+{
+	/* Receivers decode with the sum of the layers they subscribed to, so all layers together must form a valid RS block */
+	if ((num_media_packets + total_num_fec_packets) > FEC_CORE_MAX_SYMBOLS)
+	{
+		GST_WARNING_OBJECT(rtp_fec_enc, "%u media and %u FEC packets (fec pad and all FEC layers) exceed the maximum of %d symbols per block - rejecting change", num_media_packets, total_num_fec_packets, FEC_CORE_MAX_SYMBOLS);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+static void gst_rtp_fec_enc_release_pad(GstElement *element, GstPad *pad)
+{
+	GstRtpFECEnc *rtp_fec_enc;
+	GstPad *srcpad;
+
+	rtp_fec_enc = GST_RTP_FEC_ENC(element);
+
+	if (GST_IS_RTP_FEC_ENC_LAYER_PAD(pad))
+	{
+		GST_DEBUG_OBJECT(rtp_fec_enc, "releasing FEC layer pad %s", GST_PAD_NAME(pad));
+
+		g_mutex_lock(rtp_fec_enc->mutex);
+		rtp_fec_enc->layer_pads = g_list_remove(rtp_fec_enc->layer_pads, pad);
+		gst_rtp_fec_enc_update_layers(rtp_fec_enc);
+		g_mutex_unlock(rtp_fec_enc->mutex);
+
+		gst_element_remove_pad(element, pad);
+		return;
+	}
+
+	srcpad = gst_pad_get_element_private(pad);
+
+	GST_DEBUG_OBJECT(element, "releasing joint pads %s and %s", GST_PAD_NAME(pad), GST_PAD_NAME(srcpad));
+
+	gst_pad_set_element_private(pad, NULL);
+	gst_element_remove_pad(element, srcpad);
+	gst_element_remove_pad(element, pad);
+}
+
+
+static GstFlowReturn gst_rtp_fec_enc_chain(GstPad *pad, GstBuffer *packet)
+{
+	GstRtpFECEnc *rtp_fec_enc;
+	GstBufferList *fec_packets;
+	GstBufferListIterator *fec_it;
+	GstFlowReturn ret;
+	guint16 seqnum;
+	GstRtpFECEncQoSLevel old_qos_level, new_qos_level;
+
+	rtp_fec_enc = GST_RTP_FEC_ENC(gst_pad_get_parent(pad));
+
+	seqnum = gst_rtp_buffer_get_seq(packet);
+	GST_DEBUG_OBJECT(rtp_fec_enc, "received RTP packet, seqnum %u", seqnum);
+
+	/* Push the media packet to the encoder of its stream */
+	fec_packets = NULL;
+	fec_it = NULL;
+	g_mutex_lock(rtp_fec_enc->mutex);
+	old_qos_level = rtp_fec_enc->qos_level;
+	gst_rtp_fec_enc_encode_packet(rtp_fec_enc, packet, &fec_packets, &fec_it);
+	gst_rtp_fec_enc_store_rtx_packet(rtp_fec_enc, packet);
+	if (fec_it != NULL)
+		gst_buffer_list_iterator_free(fec_it);
+	fec_packets = gst_rtp_fec_enc_pace_fec_packets(rtp_fec_enc, fec_packets, GST_BUFFER_TIMESTAMP(packet));
+	new_qos_level = rtp_fec_enc->qos_level;
+	g_mutex_unlock(rtp_fec_enc->mutex);
+
+	gst_rtp_fec_enc_post_qos_message(rtp_fec_enc, old_qos_level, new_qos_level);
+	gst_rtp_fec_enc_post_stats_message(rtp_fec_enc);
+	gst_rtp_fec_enc_post_latency_message(rtp_fec_enc);
+
+	if (rtp_fec_enc->mux)
+	{
+		GstFlowReturn fec_ret;
+
+		/*
+		In mux mode, the FEC packets share the src pad with the media packets; send them
+		after the media packet which completed their block, so receivers see whole blocks
+		*/
+		ret = gst_pad_push(rtp_fec_enc->srcpad, packet);
+		fec_ret = gst_rtp_fec_enc_push_fec_packets(rtp_fec_enc, rtp_fec_enc->srcpad, fec_packets);
+		if (ret == GST_FLOW_OK)
+			ret = fec_ret;
+	}
+	else
+	{
+		/*
+		If the encoder was able to generate FEC packets after the push call above,
+		push the packets into the FEC pad
+		*/
+		gst_rtp_fec_enc_push_fec_packets(rtp_fec_enc, rtp_fec_enc->fecpad, fec_packets);
+
+		/* Finally, push the media packet to the src pad */
+		ret = gst_pad_push(rtp_fec_enc->srcpad, packet);
+	}
+
+	gst_object_unref(rtp_fec_enc);
+
+	return ret;
+}
+
+
+static GstFlowReturn gst_rtp_fec_enc_chain_list(GstPad *pad, GstBufferList *list)
+{
+	GstRtpFECEnc *rtp_fec_enc;
+	GstBufferList *fec_packets;
+	GstBufferListIterator *it, *fec_it;
+	GstFlowReturn ret;
+	GstClockTime now;
+	GstRtpFECEncQoSLevel old_qos_level, new_qos_level;
+
+	rtp_fec_enc = GST_RTP_FEC_ENC(gst_pad_get_parent(pad));
+
+	GST_DEBUG_OBJECT(rtp_fec_enc, "received list with %u RTP packets", gst_buffer_list_n_groups(list));
+
+	/* For pacing, the list counts as having arrived at the latest timestamp among its packets */
+	now = GST_CLOCK_TIME_NONE;
+
+	fec_packets = NULL;
+	fec_it = NULL;
+	g_mutex_lock(rtp_fec_enc->mutex);
+	old_qos_level = rtp_fec_enc->qos_level;
+
+	/* Push all media packets of the list to the encoders; FEC packets are collected right away, so a list may span several blocks */
+	it = gst_buffer_list_iterate(list);
+	while (gst_buffer_list_iterator_next_group(it))
+	{
+		GstBuffer *packet;
+
+		/* The encoder needs each packet in one piece; only groups with several buffers are merged */
+		if (gst_buffer_list_iterator_n_buffers(it) == 1)
+			packet = gst_buffer_ref(gst_buffer_list_iterator_next(it));
+		else
+			packet = gst_buffer_list_iterator_merge_group(it);
+
+		if (packet == NULL)
+			continue;
+
+		gst_rtp_fec_enc_encode_packet(rtp_fec_enc, packet, &fec_packets, &fec_it);
+		gst_rtp_fec_enc_store_rtx_packet(rtp_fec_enc, packet);
+		if (GST_BUFFER_TIMESTAMP_IS_VALID(packet))
+			now = GST_BUFFER_TIMESTAMP(packet);
+		gst_buffer_unref(packet);
+	}
+	gst_buffer_list_iterator_free(it);
+
+	if (fec_it != NULL)
+		gst_buffer_list_iterator_free(fec_it);
+	fec_packets = gst_rtp_fec_enc_pace_fec_packets(rtp_fec_enc, fec_packets, now);
+	new_qos_level = rtp_fec_enc->qos_level;
+	g_mutex_unlock(rtp_fec_enc->mutex);
+
+	gst_rtp_fec_enc_post_qos_message(rtp_fec_enc, old_qos_level, new_qos_level);
+	gst_rtp_fec_enc_post_stats_message(rtp_fec_enc);
+	gst_rtp_fec_enc_post_latency_message(rtp_fec_enc);
+
+	if (rtp_fec_enc->mux)
+	{
+		GstFlowReturn fec_ret;
+
+		/* In mux mode, the media packets go first, followed by the FEC packets as a second list */
+		ret = gst_pad_push_list(rtp_fec_enc->srcpad, list);
+		fec_ret = gst_rtp_fec_enc_push_fec_packets(rtp_fec_enc, rtp_fec_enc->srcpad, fec_packets);
+		if (ret == GST_FLOW_OK)
+			ret = fec_ret;
+	}
+	else
+	{
+		/* All FEC packets generated out of this list go out as one list */
+		gst_rtp_fec_enc_push_fec_packets(rtp_fec_enc, rtp_fec_enc->fecpad, fec_packets);
+
+		/* Finally, push the media packets to the src pad, still as one list */
+		ret = gst_pad_push_list(rtp_fec_enc->srcpad, list);
+	}
+
+	gst_object_unref(rtp_fec_enc);
+
+	return ret;
+}
+
+
+static GstFlowReturn gst_rtp_fec_enc_joint_chain(GstPad *pad, GstBuffer *packet)
+{
+	GstRtpFECEnc *rtp_fec_enc;
+	GstBufferList *fec_packets;
+	GstBufferListIterator *fec_it;
+	GstFlowReturn ret;
+	GstPad *srcpad;
+	GstRtpFECEncQoSLevel old_qos_level, new_qos_level;
+
+	rtp_fec_enc = GST_RTP_FEC_ENC(gst_pad_get_parent(pad));
+	srcpad = gst_pad_get_element_private(pad);
+
+	GST_DEBUG_OBJECT(rtp_fec_enc, "received RTP packet on %s, SSRC %08x seqnum %u", GST_PAD_NAME(pad), gst_rtp_buffer_get_ssrc(packet), gst_rtp_buffer_get_seq(packet));
+
+	fec_packets = NULL;
+	fec_it = NULL;
+	g_mutex_lock(rtp_fec_enc->mutex);
+	old_qos_level = rtp_fec_enc->qos_level;
+	rtp_fec_enc->cur_time = GST_BUFFER_TIMESTAMP(packet);
+	fec_enc_push_media_packet(rtp_fec_enc->joint_enc, packet);
+	gst_rtp_fec_enc_finish_qos_measurement(rtp_fec_enc);
+	gst_rtp_fec_enc_drain_encoder(rtp_fec_enc, rtp_fec_enc->joint_enc, rtp_fec_enc->fecpad, &fec_packets, &fec_it);
+	new_qos_level = rtp_fec_enc->qos_level;
+	g_mutex_unlock(rtp_fec_enc->mutex);
+	if (fec_it != NULL)
+		gst_buffer_list_iterator_free(fec_it);
+
+	gst_rtp_fec_enc_post_qos_message(rtp_fec_enc, old_qos_level, new_qos_level);
+	gst_rtp_fec_enc_post_stats_message(rtp_fec_enc);
+	gst_rtp_fec_enc_post_latency_message(rtp_fec_enc);
+
+	/*
+	Joint blocks span several streams, so their FEC packets cannot be muxed into any one
+	of the src_%d pads; they always go out through the fec pad
+	*/
+	gst_rtp_fec_enc_push_fec_packets(rtp_fec_enc, rtp_fec_enc->fecpad, fec_packets);
+
+	ret = gst_pad_push(srcpad, packet);
+
+	gst_object_unref(rtp_fec_enc);
+
+	return ret;
+}
+
+
+static GstFlowReturn gst_rtp_fec_enc_joint_chain_list(GstPad *pad, GstBufferList *list)
+{
+	GstRtpFECEnc *rtp_fec_enc;
+	GstBufferList *fec_packets;
+	GstBufferListIterator *it, *fec_it;
+	GstFlowReturn ret;
+	GstPad *srcpad;
+	GstRtpFECEncQoSLevel old_qos_level, new_qos_level;
+
+	rtp_fec_enc = GST_RTP_FEC_ENC(gst_pad_get_parent(pad));
+	srcpad = gst_pad_get_element_private(pad);
+
+	GST_DEBUG_OBJECT(rtp_fec_enc, "received list with %u RTP packets on %s", gst_buffer_list_n_groups(list), GST_PAD_NAME(pad));
+
+	fec_packets = NULL;
+	fec_it = NULL;
+	g_mutex_lock(rtp_fec_enc->mutex);
+	old_qos_level = rtp_fec_enc->qos_level;
+
+	it = gst_buffer_list_iterate(list);
+	while (gst_buffer_list_iterator_next_group(it))
+	{
+		GstBuffer *packet;
+
+		if (gst_buffer_list_iterator_n_buffers(it) == 1)
+			packet = gst_buffer_ref(gst_buffer_list_iterator_next(it));
+		else
+			packet = gst_buffer_list_iterator_merge_group(it);
+
+		if (packet == NULL)
+			continue;
+
+		rtp_fec_enc->cur_time = GST_BUFFER_TIMESTAMP(packet);
+		fec_enc_push_media_packet(rtp_fec_enc->joint_enc, packet);
+		gst_rtp_fec_enc_finish_qos_measurement(rtp_fec_enc);
+		gst_rtp_fec_enc_drain_encoder(rtp_fec_enc, rtp_fec_enc->joint_enc, rtp_fec_enc->fecpad, &fec_packets, &fec_it);
+		gst_buffer_unref(packet);
+	}
+	gst_buffer_list_iterator_free(it);
+
+	new_qos_level = rtp_fec_enc->qos_level;
+	g_mutex_unlock(rtp_fec_enc->mutex);
+	if (fec_it != NULL)
+		gst_buffer_list_iterator_free(fec_it);
+
+	gst_rtp_fec_enc_post_qos_message(rtp_fec_enc, old_qos_level, new_qos_level);
+	gst_rtp_fec_enc_post_stats_message(rtp_fec_enc);
+	gst_rtp_fec_enc_post_latency_message(rtp_fec_enc);
+
+	gst_rtp_fec_enc_push_fec_packets(rtp_fec_enc, rtp_fec_enc->fecpad, fec_packets);
+
+	ret = gst_pad_push_list(srcpad, list);
+
+	gst_object_unref(rtp_fec_enc);
+
+	return ret;
+}
+
+
+static gboolean gst_rtp_fec_enc_is_keyframe_packet(GstRtpFECEnc *rtp_fec_enc, GstBuffer *packet)
+{
+	switch (rtp_fec_enc->uep_mode)
+	{
+		case GST_RTP_FEC_ENC_UEP_MODE_DELTA_UNIT:
+			return !GST_BUFFER_FLAG_IS_SET(packet, GST_BUFFER_FLAG_DELTA_UNIT);
+		case GST_RTP_FEC_ENC_UEP_MODE_MARKER:
+			return gst_rtp_buffer_get_marker(packet);
+		case GST_RTP_FEC_ENC_UEP_MODE_HEADER_EXTENSION:
+		{
+			gpointer data;
+			guint size;
+
+			if (!gst_rtp_buffer_get_extension_onebyte_header(packet, rtp_fec_enc->uep_extension_id, 0, &data, &size))
+				return FALSE;
+
+			return (size > 0) && (((guint8 *)data)[0] != 0);
+		}
+		default:
+			return FALSE;
+	}
+}
+
+
+static void gst_rtp_fec_enc_encode_packet(GstRtpFECEnc *rtp_fec_enc, GstBuffer *packet, GstBufferList **fec_packets, GstBufferListIterator **fec_it)
+{
+	fec_enc *enc;
+
+	enc = gst_rtp_fec_enc_get_encoder(rtp_fec_enc, gst_rtp_buffer_get_ssrc(packet));
+	if (enc == NULL)
+		return;
+
+	/* The token bucket is refilled based on the timestamp of the packet which completes a block */
+	rtp_fec_enc->cur_time = GST_BUFFER_TIMESTAMP(packet);
+
+	fec_latency_estimator_push_packet(&(rtp_fec_enc->latency_estimator), packet);
+	gst_rtp_fec_enc_update_latency(rtp_fec_enc);
+
+	if (gst_rtp_fec_enc_is_keyframe_packet(rtp_fec_enc, packet))
+		fec_enc_push_keyframe_packet(enc, packet);
+	else
+		fec_enc_push_media_packet(enc, packet);
+	gst_rtp_fec_enc_finish_qos_measurement(rtp_fec_enc);
+
+	/* Each stream is paced by its own block interval, since the streams finish their blocks at different rates */
+	if (rtp_fec_enc->pacing && GST_BUFFER_TIMESTAMP_IS_VALID(packet))
+		gst_rtp_fec_enc_schedule_fec_packets(rtp_fec_enc, enc, rtp_fec_enc->mux ? rtp_fec_enc->srcpad : rtp_fec_enc->fecpad, GST_BUFFER_TIMESTAMP(packet));
+	else
+		gst_rtp_fec_enc_drain_encoder(rtp_fec_enc, enc, rtp_fec_enc->mux ? rtp_fec_enc->srcpad : rtp_fec_enc->fecpad, fec_packets, fec_it);
+}
+
+
+static void gst_rtp_fec_enc_append_fec_packet(GstBufferList **fec_packets, GstBufferListIterator **fec_it, GstBuffer *fec_packet)
+{
+	if (*fec_it == NULL)
+	{
+		if (*fec_packets == NULL)
+			*fec_packets = gst_buffer_list_new();
+		*fec_it = gst_buffer_list_iterate(*fec_packets);
+		while (gst_buffer_list_iterator_next_group(*fec_it))
+			;
+	}
+
+	/* One group per packet */
+	gst_buffer_list_iterator_add_group(*fec_it);
+	gst_buffer_list_iterator_add(*fec_it, fec_packet);
+}
+
+
+static void gst_rtp_fec_enc_drain_encoder(GstRtpFECEnc *rtp_fec_enc, fec_enc *enc, GstPad *pad, GstBufferList **fec_packets, GstBufferListIterator **fec_it)
+{
+	/* Drain the encoder right away; it does not accept new media packets while FEC packets are pending */
+	while (fec_enc_has_fec_packets(enc))
+	{
+		GstBuffer *fec_packet = fec_enc_pop_fec_packet(enc);
+		GST_DEBUG_OBJECT(rtp_fec_enc, "generated FEC packet, SSRC %08x seqnum %u", gst_rtp_buffer_get_ssrc(fec_packet), gst_rtp_buffer_get_seq(fec_packet));
+		gst_buffer_set_caps(fec_packet, GST_PAD_CAPS(pad));
+		gst_rtp_fec_enc_append_fec_packet(fec_packets, fec_it, fec_packet);
+	}
+}
+
+
+static GstFlowReturn gst_rtp_fec_enc_push_fec_packets(GstRtpFECEnc *rtp_fec_enc, GstPad *pad, GstBufferList *fec_packets)
+{
+	GstPad **pads;
+	GstBufferList **layer_lists;
+	GstBufferListIterator *it, **layer_its;
+	GList *link;
+	guint i, num_pads;
+	GstFlowReturn ret;
+
+	if (fec_packets == NULL)
+		return GST_FLOW_OK;
+
+	if (gst_buffer_list_n_groups(fec_packets) == 0)
+	{
+		gst_buffer_list_unref(fec_packets);
+		return GST_FLOW_OK;
+	}
+
+	g_mutex_lock(rtp_fec_enc->mutex);
+
+	if (rtp_fec_enc->layer_pads == NULL)
+	{
+		g_mutex_unlock(rtp_fec_enc->mutex);
+		return gst_pad_push_list(pad, fec_packets);
+	}
+
+	/* Entry 0 is the base layer (the given pad), followed by the fec_%d pads in layer order */
+	num_pads = 1 + g_list_length(rtp_fec_enc->layer_pads);
+	pads = g_new(GstPad*, num_pads);
+	layer_lists = g_new(GstBufferList*, num_pads);
+	layer_its = g_new(GstBufferListIterator*, num_pads);
+
+	pads[0] = gst_object_ref(pad);
+	for (i = 1, link = rtp_fec_enc->layer_pads; link != NULL; ++i, link = link->next)
+		pads[i] = gst_object_ref(link->data);
+
+	for (i = 0; i < num_pads; ++i)
+	{
+		layer_lists[i] = gst_buffer_list_new();
+		layer_its[i] = gst_buffer_list_iterate(layer_lists[i]);
+	}
+
+	/* The index byte following the FEC header identifies the repair symbol, and thus the layer */
+	it = gst_buffer_list_iterate(fec_packets);
+	while (gst_buffer_list_iterator_next_group(it))
+	{
+		GstBuffer *fec_packet;
+		guint index, layer;
+
+		if (gst_buffer_list_iterator_next(it) == NULL)
+			continue;
+		fec_packet = gst_buffer_list_iterator_steal(it);
+
+		index = ((guint8 *)gst_rtp_buffer_get_payload(fec_packet))[12];
+		layer = 0;
+		for (i = 1; i < num_pads; ++i)
+		{
+			GstRtpFECEncLayerPad *layer_pad = GST_RTP_FEC_ENC_LAYER_PAD(pads[i]);
+			if ((index >= layer_pad->first_index) && (index < (layer_pad->first_index + layer_pad->num_fec_packets)))
+			{
+				layer = i;
+				gst_buffer_set_caps(fec_packet, GST_PAD_CAPS(pads[i]));
+				break;
+			}
+		}
+
+		gst_buffer_list_iterator_add_group(layer_its[layer]);
+		gst_buffer_list_iterator_add(layer_its[layer], fec_packet);
+	}
+	gst_buffer_list_iterator_free(it);
+	gst_buffer_list_unref(fec_packets);
+
+	g_mutex_unlock(rtp_fec_enc->mutex);
+
+	/* Only the flow return of the base layer matters; layers may be unlinked like the fec pad */
+	ret = GST_FLOW_OK;
+	for (i = 0; i < num_pads; ++i)
+	{
+		GstFlowReturn layer_ret = GST_FLOW_OK;
+
+		gst_buffer_list_iterator_free(layer_its[i]);
+		if (gst_buffer_list_n_groups(layer_lists[i]) > 0)
+			layer_ret = gst_pad_push_list(pads[i], layer_lists[i]);
+		else
+			gst_buffer_list_unref(layer_lists[i]);
+
+		if (i == 0)
+			ret = layer_ret;
+
+		gst_object_unref(pads[i]);
+	}
+
+	g_free(pads);
+	g_free(layer_lists);
+	g_free(layer_its);
+
+	return ret;
+}
+
+
+static void gst_rtp_fec_enc_schedule_fec_packets(GstRtpFECEnc *rtp_fec_enc, fec_enc *enc, GstPad *pad, GstClockTime const now)
+{
+	GstClockTime interval;
+	GQueue fec_packets;
+	guint i, num_fec_packets;
+
+	if (!fec_enc_has_fec_packets(enc))
+		return;
+
+	/*
+	The FEC packets of this block are spread over the next block interval of this stream, which is
+	assumed to be as long as the one that just ended. The first block has no previous one, so its FEC
+	packets go out right away.
+	*/
+	interval = fec_enc_get_block_interval(enc);
+	interval = GST_CLOCK_TIME_IS_VALID(interval) ? MIN(interval, rtp_fec_enc->max_pacing_delay) : 0;
+
+	g_queue_init(&fec_packets);
+	while (fec_enc_has_fec_packets(enc))
+		g_queue_push_tail(&fec_packets, fec_enc_pop_fec_packet(enc));
+	num_fec_packets = g_queue_get_length(&fec_packets);
+
+	GST_LOG_OBJECT(rtp_fec_enc, "pacing %u FEC packets over %" G_GUINT64_FORMAT " ns", num_fec_packets, (guint64)interval);
+
+	for (i = 0; i < num_fec_packets; ++i)
+	{
+		GstBuffer *fec_packet = g_queue_pop_head(&fec_packets);
+		gst_buffer_set_caps(fec_packet, GST_PAD_CAPS(pad));
+		GST_BUFFER_TIMESTAMP(fec_packet) = now + interval * (i + 1) / (num_fec_packets + 1);
+		g_queue_push_tail(rtp_fec_enc->paced_packets, fec_packet);
+	}
+}
+
+
+static GstBufferList* gst_rtp_fec_enc_pace_fec_packets(GstRtpFECEnc *rtp_fec_enc, GstBufferList *fec_packets, GstClockTime const now)
+{
+	GstBufferList *due_packets;
+	GstBufferListIterator *it, *due_it;
+
+	if (g_queue_is_empty(rtp_fec_enc->paced_packets))
+		return fec_packets;
+
+	/* Without pacing (or without timestamps), paced packets still queued from before go out right away */
+	if (!rtp_fec_enc->pacing || !GST_CLOCK_TIME_IS_VALID(now))
+	{
+		due_packets = NULL;
+		gst_rtp_fec_enc_take_due_packets(rtp_fec_enc, &due_packets, GST_CLOCK_TIME_NONE);
+
+		if (fec_packets != NULL)
+		{
+			due_it = NULL;
+			it = gst_buffer_list_iterate(fec_packets);
+			while (gst_buffer_list_iterator_next_group(it))
+			{
+				if (gst_buffer_list_iterator_next(it) == NULL)
+					continue;
+				gst_rtp_fec_enc_append_fec_packet(&due_packets, &due_it, gst_buffer_list_iterator_steal(it));
+			}
+			gst_buffer_list_iterator_free(it);
+			if (due_it != NULL)
+				gst_buffer_list_iterator_free(due_it);
+			gst_buffer_list_unref(fec_packets);
+		}
+
+		return due_packets;
+	}
+
+	gst_rtp_fec_enc_take_due_packets(rtp_fec_enc, &fec_packets, now);
+
+	return fec_packets;
+}
+
+
+static void gst_rtp_fec_enc_take_due_packets(GstRtpFECEnc *rtp_fec_enc, GstBufferList **due_packets, GstClockTime const now)
+{
+	GstBufferListIterator *due_it;
+	GList *link;
+
+	due_it = NULL;
+
+	/*
+	With several streams, blocks complete at different times, so the queue is not
+	necessarily sorted by timestamp; it only holds a few blocks, so it is scanned entirely
+	*/
+	for (link = g_queue_peek_head_link(rtp_fec_enc->paced_packets); link != NULL;)
+	{
+		GList *next = link->next;
+		GstBuffer *fec_packet = link->data;
+
+		if (!GST_CLOCK_TIME_IS_VALID(now) || (GST_BUFFER_TIMESTAMP(fec_packet) <= now))
+		{
+			g_queue_delete_link(rtp_fec_enc->paced_packets, link);
+			gst_rtp_fec_enc_append_fec_packet(due_packets, &due_it, fec_packet);
+		}
+
+		link = next;
+	}
+
+	if (due_it != NULL)
+		gst_buffer_list_iterator_free(due_it);
+}
+
+
+static void gst_rtp_fec_enc_clear_paced_packets(GstRtpFECEnc *rtp_fec_enc)
+{
+	while (!g_queue_is_empty(rtp_fec_enc->paced_packets))
+		gst_buffer_unref(g_queue_pop_head(rtp_fec_enc->paced_packets));
+}
+
+
+static gboolean gst_rtp_fec_enc_sink_event(GstPad *pad, GstEvent *event)
+{
+	GstRtpFECEnc *rtp_fec_enc;
+	gboolean ret;
+
+	rtp_fec_enc = GST_RTP_FEC_ENC(gst_pad_get_parent(pad));
+
+	switch (GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_EOS:
+		{
+			GstBufferList *remaining_packets;
+
+			/* Paced FEC packets still waiting for their time must go out before the EOS */
+			remaining_packets = NULL;
+			g_mutex_lock(rtp_fec_enc->mutex);
+			gst_rtp_fec_enc_take_due_packets(rtp_fec_enc, &remaining_packets, GST_CLOCK_TIME_NONE);
+			/* The streams ended, so their encoders must not take up any of the max-ssrcs slots anymore */
+			fec_ssrc_table_clear(rtp_fec_enc->encoders);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+
+			gst_rtp_fec_enc_push_fec_packets(rtp_fec_enc, rtp_fec_enc->mux ? rtp_fec_enc->srcpad : rtp_fec_enc->fecpad, remaining_packets);
+			break;
+		}
+		case GST_EVENT_FLUSH_STOP:
+			g_mutex_lock(rtp_fec_enc->mutex);
+			gst_rtp_fec_enc_clear_paced_packets(rtp_fec_enc);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		default:
+			break;
+	}
+
+	ret = gst_pad_event_default(pad, event);
 
 	gst_object_unref(rtp_fec_enc);
 
@@ -255,22 +1699,70 @@ static GstFlowReturn gst_rtp_fec_enc_chain(GstPad *pad, GstBuffer *packet)
 }
 
 
-static gboolean gst_rtp_fec_enc_setcaps(GstPad *pad, GstCaps *caps)
+static gboolean gst_rtp_fec_enc_setcaps(GstPad *pad, GstCaps *caps)
+{
+	GstRtpFECEnc *rtp_fec_enc;
+	GstStructure *structure;
+	guint ssrc;
+	gboolean res;
+
+	/*
+	Here it is necessary to get the caps structure and copy some values to the FEC pad caps.
+	To do that, this function exists. It intercepts the srcpad setcaps call, copies the values
+	to the fec pad caps, and then sets the src pad caps.
+	*/
+
+	rtp_fec_enc = GST_RTP_FEC_ENC(gst_pad_get_parent(pad));
+
+	res = gst_rtp_fec_enc_set_fec_caps(rtp_fec_enc, caps);
+
+	/* If the caps name the SSRC of the stream, its encoder is set up now instead of with its first packet */
+	structure = gst_caps_get_structure(caps, 0);
+	if (res && gst_structure_get_uint(structure, "ssrc", &ssrc))
+	{
+		g_mutex_lock(rtp_fec_enc->mutex);
+		gst_rtp_fec_enc_get_encoder(rtp_fec_enc, ssrc);
+		g_mutex_unlock(rtp_fec_enc->mutex);
+	}
+
+	/* Finally, do the regular src pad setcaps */
+	if (res)
+		res = gst_pad_set_caps(rtp_fec_enc->srcpad, caps);
+
+	gst_object_unref(rtp_fec_enc);
+
+	return res;
+}
+
+
+static gboolean gst_rtp_fec_enc_joint_setcaps(GstPad *pad, GstCaps *caps)
 {
 	GstRtpFECEnc *rtp_fec_enc;
-	GstStructure *str;
-	gint clock_rate;
-	const gchar *media;
-	GstCaps *feccaps;
 	gboolean res;
 
+	rtp_fec_enc = GST_RTP_FEC_ENC(gst_pad_get_parent(pad));
+
 	/*
-	Here it is necessary to get the caps structure and copy some values to the FEC pad caps.
-	To do that, this function exists. It intercepts the srcpad setcaps call, copies the values
-	to the fec pad caps, and then sets the src pad caps.
+	The joint FEC stream protects several media streams; its caps are derived from
+	whichever stream got its caps last, since only clock-rate and media are copied
 	*/
+	res = gst_rtp_fec_enc_set_fec_caps(rtp_fec_enc, caps);
+	if (res)
+		res = gst_pad_set_caps(gst_pad_get_element_private(pad), caps);
 
-	rtp_fec_enc = GST_RTP_FEC_ENC(gst_pad_get_parent(pad));
+	gst_object_unref(rtp_fec_enc);
+
+	return res;
+}
+
+
+static gboolean gst_rtp_fec_enc_set_fec_caps(GstRtpFECEnc *rtp_fec_enc, GstCaps *caps)
+{
+	GstStructure *str;
+	gint clock_rate;
+	const gchar *media;
+	GstCaps *feccaps;
+	GList *link;
 
 	/* Retrieve the caps structure */
 	str = gst_caps_get_structure(caps, 0);
@@ -293,32 +1785,34 @@ static gboolean gst_rtp_fec_enc_setcaps(GstPad *pad, GstCaps *caps)
 	feccaps = gst_caps_new_simple(
 		"application/x-rtp",
 		"media", G_TYPE_STRING, media,
-		"payload", G_TYPE_INT, fec_enc_get_payload_type(rtp_fec_enc->enc), /* Use configured payload type for FEC packets */
+		"payload", G_TYPE_INT, rtp_fec_enc->payload_type, /* Use configured payload type for FEC packets */
 		"clock-rate", G_TYPE_INT, clock_rate,
 		"encoding-name", G_TYPE_STRING, "parityfec",
 		NULL
 	);
 	/* Set the fec pad caps */
 	gst_pad_set_caps(rtp_fec_enc->fecpad, feccaps);
+	/* The FEC layers carry the same kind of packets */
+	g_mutex_lock(rtp_fec_enc->mutex);
+	for (link = rtp_fec_enc->layer_pads; link != NULL; link = link->next)
+		gst_pad_set_caps(GST_PAD(link->data), feccaps);
+	g_mutex_unlock(rtp_fec_enc->mutex);
 	/* Since gst_pad_set_caps() increases the caps reference count, it needs to be decreased here */
 	gst_caps_unref(feccaps);
 
-	/* Finally, do the regular src pad setcaps */
-	res = gst_pad_set_caps(rtp_fec_enc->srcpad, caps);
-
-	gst_object_unref(rtp_fec_enc);
-
-	return res;
+	return TRUE;
 }
 
 
 static void gst_rtp_fec_enc_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec)
 {
 	GstRtpFECEnc *rtp_fec_enc;
+	GstRtpFECEncQoSLevel old_qos_level, new_qos_level;
 
 	GST_OBJECT_LOCK(object);
 
 	rtp_fec_enc = GST_RTP_FEC_ENC(object);
+	old_qos_level = new_qos_level = GST_RTP_FEC_ENC_QOS_LEVEL_FULL;
 
 	switch (prop_id)
 	{
@@ -326,29 +1820,150 @@ static void gst_rtp_fec_enc_set_property(GObject *object, guint prop_id, GValue
 		{
 			guint num_media_packets = g_value_get_uint(value);
 			GST_DEBUG_OBJECT(rtp_fec_enc, "Set number of media packets to %u", num_media_packets);
-			fec_enc_set_num_media_packets(rtp_fec_enc->enc, num_media_packets);
+			g_mutex_lock(rtp_fec_enc->mutex);
+			if (gst_rtp_fec_enc_check_geometry(rtp_fec_enc, num_media_packets, rtp_fec_enc->total_num_fec_packets))
+			{
+				rtp_fec_enc->num_media_packets = num_media_packets;
+				fec_ssrc_table_foreach(rtp_fec_enc->encoders, gst_rtp_fec_enc_configure_encoder, rtp_fec_enc);
+				gst_rtp_fec_enc_configure_encoder(0, rtp_fec_enc->joint_enc, rtp_fec_enc);
+				gst_rtp_fec_enc_update_latency(rtp_fec_enc);
+			}
+			g_mutex_unlock(rtp_fec_enc->mutex);
 			break;
 		}
 		case PROP_NUM_FEC_PACKETS:
 		{
 			guint num_fec_packets = g_value_get_uint(value);
 			GST_DEBUG_OBJECT(rtp_fec_enc, "Set number of FEC packets to %u", num_fec_packets);
-			fec_enc_set_num_fec_packets(rtp_fec_enc->enc, num_fec_packets);
+			g_mutex_lock(rtp_fec_enc->mutex);
+			if (gst_rtp_fec_enc_check_geometry(rtp_fec_enc, rtp_fec_enc->num_media_packets, rtp_fec_enc->total_num_fec_packets - rtp_fec_enc->num_fec_packets + num_fec_packets))
+			{
+				rtp_fec_enc->num_fec_packets = num_fec_packets;
+				/* The layers follow the repair symbols of the fec pad, so their ranges shift */
+				gst_rtp_fec_enc_update_layers(rtp_fec_enc);
+			}
+			g_mutex_unlock(rtp_fec_enc->mutex);
 			break;
 		}
 		case PROP_PAYLOAD_TYPE:
 		{
 			guint payload_type = g_value_get_uint(value);
 			GST_DEBUG_OBJECT(rtp_fec_enc, "Set FEC payload type to %u", payload_type);
-			fec_enc_set_payload_type(rtp_fec_enc->enc, payload_type);
+			g_mutex_lock(rtp_fec_enc->mutex);
+			rtp_fec_enc->payload_type = payload_type;
+			fec_ssrc_table_foreach(rtp_fec_enc->encoders, gst_rtp_fec_enc_configure_encoder, rtp_fec_enc);
+			gst_rtp_fec_enc_configure_encoder(0, rtp_fec_enc->joint_enc, rtp_fec_enc);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		}
+		case PROP_MAX_PACKET_SIZE:
+		{
+			guint max_packet_size = g_value_get_uint(value);
+			GST_DEBUG_OBJECT(rtp_fec_enc, "Set maximum packet size to %u", max_packet_size);
+			rtp_fec_enc->max_packet_size = max_packet_size;
+			break;
+		}
+		case PROP_MUX:
+			rtp_fec_enc->mux = g_value_get_boolean(value);
+			GST_DEBUG_OBJECT(rtp_fec_enc, "%s mux mode", rtp_fec_enc->mux ? "Enable" : "Disable");
+			break;
+		case PROP_PACING:
+			/* Packets still queued when pacing is disabled go out with the next FEC packets */
+			g_mutex_lock(rtp_fec_enc->mutex);
+			rtp_fec_enc->pacing = g_value_get_boolean(value);
+			gst_rtp_fec_enc_update_latency(rtp_fec_enc);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			GST_DEBUG_OBJECT(rtp_fec_enc, "%s pacing", rtp_fec_enc->pacing ? "Enable" : "Disable");
+			break;
+		case PROP_MAX_PACING_DELAY:
+			g_mutex_lock(rtp_fec_enc->mutex);
+			rtp_fec_enc->max_pacing_delay = g_value_get_uint64(value);
+			gst_rtp_fec_enc_update_latency(rtp_fec_enc);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		case PROP_MAX_SSRCS:
+			/* Existing streams keep their encoders; the limit applies to new streams */
+			g_mutex_lock(rtp_fec_enc->mutex);
+			rtp_fec_enc->max_ssrcs = g_value_get_uint(value);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		case PROP_UEP_MODE:
+		{
+			GstRtpFECEncUEPMode uep_mode = g_value_get_enum(value);
+			g_mutex_lock(rtp_fec_enc->mutex);
+			/* The additional keyframe repair symbols would otherwise collide with the repair symbols of the layers */
+			if ((uep_mode != GST_RTP_FEC_ENC_UEP_MODE_NONE) && (rtp_fec_enc->layer_pads != NULL))
+				GST_WARNING_OBJECT(rtp_fec_enc, "UEP cannot be used together with fec_%%d layers - not changing UEP mode");
+			else
+			{
+				rtp_fec_enc->uep_mode = uep_mode;
+				fec_ssrc_table_foreach(rtp_fec_enc->encoders, gst_rtp_fec_enc_configure_encoder, rtp_fec_enc);
+			}
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		}
+		case PROP_UEP_EXTENSION_ID:
+			g_mutex_lock(rtp_fec_enc->mutex);
+			rtp_fec_enc->uep_extension_id = g_value_get_uint(value);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		case PROP_KEYFRAME_MEDIA_PACKETS:
+			g_mutex_lock(rtp_fec_enc->mutex);
+			rtp_fec_enc->keyframe_num_media_packets = g_value_get_uint(value);
+			fec_ssrc_table_foreach(rtp_fec_enc->encoders, gst_rtp_fec_enc_configure_encoder, rtp_fec_enc);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		case PROP_KEYFRAME_FEC_PACKETS:
+			g_mutex_lock(rtp_fec_enc->mutex);
+			rtp_fec_enc->keyframe_num_fec_packets = g_value_get_uint(value);
+			fec_ssrc_table_foreach(rtp_fec_enc->encoders, gst_rtp_fec_enc_configure_encoder, rtp_fec_enc);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		case PROP_MAX_FEC_BITRATE:
+		{
+			guint max_fec_bitrate = g_value_get_uint(value);
+			GST_DEBUG_OBJECT(rtp_fec_enc, "Set maximum FEC bitrate to %u bit/s", max_fec_bitrate);
+			g_mutex_lock(rtp_fec_enc->mutex);
+			/* Start with a full bucket, so the new limit does not cause an initial gap in protection */
+			rtp_fec_enc->max_fec_bitrate = max_fec_bitrate;
+			rtp_fec_enc->fec_tokens = gst_util_uint64_scale(max_fec_bitrate / 8, FEC_BUCKET_DURATION, GST_SECOND);
+			rtp_fec_enc->last_refill_time = GST_CLOCK_TIME_NONE;
+			g_mutex_unlock(rtp_fec_enc->mutex);
 			break;
 		}
+		case PROP_QOS:
+			g_mutex_lock(rtp_fec_enc->mutex);
+			rtp_fec_enc->qos = g_value_get_boolean(value);
+			old_qos_level = rtp_fec_enc->qos_level;
+			/* Without QoS, full protection applies again */
+			if (!rtp_fec_enc->qos)
+				gst_rtp_fec_enc_reset_qos_state(rtp_fec_enc);
+			new_qos_level = rtp_fec_enc->qos_level;
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			GST_DEBUG_OBJECT(rtp_fec_enc, "%s QoS", rtp_fec_enc->qos ? "Enable" : "Disable");
+			break;
+		case PROP_RTX_HISTORY:
+			g_mutex_lock(rtp_fec_enc->mutex);
+			rtp_fec_enc->rtx_history = g_value_get_uint(value);
+			gst_rtp_fec_enc_trim_rtx_packets(rtp_fec_enc, rtp_fec_enc->rtx_history);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			GST_DEBUG_OBJECT(rtp_fec_enc, "Set retransmission history to %u packets", rtp_fec_enc->rtx_history);
+			break;
+		case PROP_STATS_INTERVAL:
+			/* Already protected by the object lock */
+			rtp_fec_enc->stats_interval = (GstClockTime)g_value_get_uint(value) * GST_MSECOND;
+			rtp_fec_enc->last_stats_time = GST_CLOCK_TIME_NONE;
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 			break;
 	}
 
 	GST_OBJECT_UNLOCK(object);
+
+	/* Disabling QoS may have restored full protection; the message is posted without locks held, since bus handlers may access properties */
+	gst_rtp_fec_enc_post_qos_message(rtp_fec_enc, old_qos_level, new_qos_level);
+	gst_rtp_fec_enc_post_latency_message(rtp_fec_enc);
 }
 
 
@@ -363,13 +1978,79 @@ static void gst_rtp_fec_enc_get_property(GObject *object, guint prop_id, GValue
 	switch (prop_id)
 	{
 		case PROP_NUM_MEDIA_PACKETS:
-			g_value_set_uint(value, fec_enc_get_num_media_packets(rtp_fec_enc->enc));
+			g_value_set_uint(value, rtp_fec_enc->num_media_packets);
 			break;
 		case PROP_NUM_FEC_PACKETS:
-			g_value_set_uint(value, fec_enc_get_num_fec_packets(rtp_fec_enc->enc));
+			g_value_set_uint(value, rtp_fec_enc->num_fec_packets);
 			break;
 		case PROP_PAYLOAD_TYPE:
-			g_value_set_uint(value, fec_enc_get_payload_type(rtp_fec_enc->enc));
+			g_value_set_uint(value, rtp_fec_enc->payload_type);
+			break;
+		case PROP_MAX_PACKET_SIZE:
+			g_value_set_uint(value, rtp_fec_enc->max_packet_size);
+			break;
+		case PROP_POOL_STATS:
+			g_value_take_boxed(value, (rtp_fec_enc->pool != NULL) ? fec_buffer_pool_get_stats_structure(rtp_fec_enc->pool) : NULL);
+			break;
+		case PROP_MUX:
+			g_value_set_boolean(value, rtp_fec_enc->mux);
+			break;
+		case PROP_PACING:
+			g_value_set_boolean(value, rtp_fec_enc->pacing);
+			break;
+		case PROP_MAX_PACING_DELAY:
+			g_value_set_uint64(value, rtp_fec_enc->max_pacing_delay);
+			break;
+		case PROP_MAX_SSRCS:
+			g_value_set_uint(value, rtp_fec_enc->max_ssrcs);
+			break;
+		case PROP_UEP_MODE:
+			g_value_set_enum(value, rtp_fec_enc->uep_mode);
+			break;
+		case PROP_UEP_EXTENSION_ID:
+			g_value_set_uint(value, rtp_fec_enc->uep_extension_id);
+			break;
+		case PROP_KEYFRAME_MEDIA_PACKETS:
+			g_value_set_uint(value, rtp_fec_enc->keyframe_num_media_packets);
+			break;
+		case PROP_KEYFRAME_FEC_PACKETS:
+			g_value_set_uint(value, rtp_fec_enc->keyframe_num_fec_packets);
+			break;
+		case PROP_MAX_FEC_BITRATE:
+			g_value_set_uint(value, rtp_fec_enc->max_fec_bitrate);
+			break;
+		case PROP_FEC_BITRATE:
+			g_mutex_lock(rtp_fec_enc->mutex);
+			g_value_set_uint(value, rtp_fec_enc->fec_bitrate);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		case PROP_SKIPPED_REPAIRS:
+			g_mutex_lock(rtp_fec_enc->mutex);
+			g_value_set_uint64(value, rtp_fec_enc->skipped_repairs);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		case PROP_QOS:
+			g_value_set_boolean(value, rtp_fec_enc->qos);
+			break;
+		case PROP_QOS_LEVEL:
+			g_mutex_lock(rtp_fec_enc->mutex);
+			g_value_set_enum(value, rtp_fec_enc->qos_level);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		case PROP_RTX_HISTORY:
+			g_value_set_uint(value, rtp_fec_enc->rtx_history);
+			break;
+		case PROP_RETRANSMITTED_PACKETS:
+			g_mutex_lock(rtp_fec_enc->mutex);
+			g_value_set_uint64(value, rtp_fec_enc->retransmitted_packets);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		case PROP_STATS:
+			/* The counters are atomic, so the mutex is not needed */
+			g_value_take_boxed(value, fec_enc_stats_get_structure(&(rtp_fec_enc->stats)));
+			break;
+		case PROP_STATS_INTERVAL:
+			g_value_set_uint(value, (guint)(rtp_fec_enc->stats_interval / GST_MSECOND));
 			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -380,12 +2061,463 @@ static void gst_rtp_fec_enc_get_property(GObject *object, guint prop_id, GValue
 }
 
 
+static GstBuffer* gst_rtp_fec_enc_create_fec_buffer(guint const size_in_bytes, void *data)
+{
+	GstRtpFECEnc *rtp_fec_enc;
+	GstBuffer *buffer;
+
+	rtp_fec_enc = (GstRtpFECEnc*)data;
+
+	buffer = (rtp_fec_enc->pool != NULL) ? fec_buffer_pool_acquire(rtp_fec_enc->pool, size_in_bytes) : NULL;
+	if (buffer == NULL)
+	{
+		buffer = gst_buffer_new_and_alloc(size_in_bytes);
+		GST_DEBUG_OBJECT(rtp_fec_enc, "Created new buffer with %u bytes for FEC packet using gst_buffer_new_and_alloc()", size_in_bytes);
+	}
+
+	return buffer;
+}
+
+
+static guint gst_rtp_fec_enc_limit_fec_packets(guint const requested_num_fec_packets, guint const fec_packet_size, void *data)
+{
+	GstRtpFECEnc *rtp_fec_enc;
+	GstClockTime now;
+	guint num_fec_packets, allowed_num_fec_packets;
+
+	rtp_fec_enc = (GstRtpFECEnc*)data;
+
+	/* Packets without timestamps are paced by the system clock */
+	now = GST_CLOCK_TIME_IS_VALID(rtp_fec_enc->cur_time) ? rtp_fec_enc->cur_time : gst_util_get_timestamp();
+
+	/* The encode time measurement covers everything from here until the encoder returns */
+	if (rtp_fec_enc->qos)
+	{
+		if (GST_CLOCK_TIME_IS_VALID(rtp_fec_enc->qos_last_block_time) && (now > rtp_fec_enc->qos_last_block_time))
+		{
+			GstClockTime interval = now - rtp_fec_enc->qos_last_block_time;
+			rtp_fec_enc->qos_block_interval = (rtp_fec_enc->qos_block_interval == 0) ? interval : ((rtp_fec_enc->qos_block_interval * 7 + interval) / 8);
+		}
+		rtp_fec_enc->qos_last_block_time = now;
+		rtp_fec_enc->qos_block_start = gst_util_get_timestamp();
+	}
+
+	switch (rtp_fec_enc->qos_level)
+	{
+		case GST_RTP_FEC_ENC_QOS_LEVEL_REDUCED:
+			num_fec_packets = (requested_num_fec_packets + 1) / 2;
+			break;
+		case GST_RTP_FEC_ENC_QOS_LEVEL_XOR:
+			/* Per-SSRC encoders request their single XOR packet anyway; this limits joint blocks to one RS symbol */
+			num_fec_packets = MIN(requested_num_fec_packets, 1);
+			break;
+		case GST_RTP_FEC_ENC_QOS_LEVEL_SKIP:
+			num_fec_packets = 0;
+			break;
+		default:
+			num_fec_packets = requested_num_fec_packets;
+			break;
+	}
+
+	/* Measure the FEC bitrate over windows of FEC_BITRATE_WINDOW */
+	if (!GST_CLOCK_TIME_IS_VALID(rtp_fec_enc->bitrate_window_start) || (now < rtp_fec_enc->bitrate_window_start))
+	{
+		rtp_fec_enc->bitrate_window_start = now;
+		rtp_fec_enc->bitrate_window_bytes = 0;
+	}
+	else if ((now - rtp_fec_enc->bitrate_window_start) >= FEC_BITRATE_WINDOW)
+	{
+		rtp_fec_enc->fec_bitrate = (guint)MIN(gst_util_uint64_scale(rtp_fec_enc->bitrate_window_bytes * 8, GST_SECOND, now - rtp_fec_enc->bitrate_window_start), G_MAXUINT);
+		rtp_fec_enc->bitrate_window_start = now;
+		rtp_fec_enc->bitrate_window_bytes = 0;
+	}
+
+	if (rtp_fec_enc->max_fec_bitrate == 0)
+	{
+		rtp_fec_enc->bitrate_window_bytes += (guint64)num_fec_packets * fec_packet_size;
+		return num_fec_packets;
+	}
+
+	/* Refill the bucket; the capacity is at least one FEC packet, otherwise low limits would skip every block */
+	{
+		guint64 bytes_per_second = rtp_fec_enc->max_fec_bitrate / 8;
+		guint64 capacity = MAX(gst_util_uint64_scale(bytes_per_second, FEC_BUCKET_DURATION, GST_SECOND), fec_packet_size);
+
+		if (GST_CLOCK_TIME_IS_VALID(rtp_fec_enc->last_refill_time) && (now > rtp_fec_enc->last_refill_time))
+		{
+			GstClockTime elapsed = MIN(now - rtp_fec_enc->last_refill_time, 10 * GST_SECOND);
+			rtp_fec_enc->fec_tokens += gst_util_uint64_scale(bytes_per_second, elapsed, GST_SECOND);
+		}
+		if (!GST_CLOCK_TIME_IS_VALID(rtp_fec_enc->last_refill_time) || (now > rtp_fec_enc->last_refill_time))
+			rtp_fec_enc->last_refill_time = now;
+
+		rtp_fec_enc->fec_tokens = MIN(rtp_fec_enc->fec_tokens, capacity);
+	}
+
+	/* The encoder drops the repair symbols with the highest indices, which are those of the last fec_%d layers */
+	allowed_num_fec_packets = MIN(num_fec_packets, rtp_fec_enc->fec_tokens / fec_packet_size);
+	rtp_fec_enc->fec_tokens -= (guint64)allowed_num_fec_packets * fec_packet_size;
+	rtp_fec_enc->bitrate_window_bytes += (guint64)allowed_num_fec_packets * fec_packet_size;
+
+	if (allowed_num_fec_packets < num_fec_packets)
+	{
+		rtp_fec_enc->skipped_repairs += num_fec_packets - allowed_num_fec_packets;
+		GST_LOG_OBJECT(rtp_fec_enc, "FEC bitrate limit reached - generating %u of %u FEC packets", allowed_num_fec_packets, num_fec_packets);
+	}
+
+	return allowed_num_fec_packets;
+}
+
+
+static gboolean gst_rtp_fec_enc_src_event(GstPad *pad, GstEvent *event)
+{
+	GstRtpFECEnc *rtp_fec_enc;
+	gboolean ret;
+
+	rtp_fec_enc = GST_RTP_FEC_ENC(gst_pad_get_parent(pad));
+
+	if (GST_EVENT_TYPE(event) == GST_EVENT_QOS)
+	{
+		gdouble proportion;
+		GstClockTimeDiff diff;
+		GstClockTime timestamp;
+		GstRtpFECEncQoSLevel old_qos_level, new_qos_level;
+
+		gst_event_parse_qos(event, &proportion, &diff, &timestamp);
+		GST_LOG_OBJECT(rtp_fec_enc, "QoS event on %s: proportion %f diff %" G_GINT64_FORMAT, GST_PAD_NAME(pad), proportion, diff);
+
+		/* Buffers arriving late downstream mean the pipeline cannot keep up */
+		g_mutex_lock(rtp_fec_enc->mutex);
+		old_qos_level = rtp_fec_enc->qos_level;
+		rtp_fec_enc->qos_late = (diff > 0) || (proportion > 1.0);
+		gst_rtp_fec_enc_update_qos_level(rtp_fec_enc);
+		new_qos_level = rtp_fec_enc->qos_level;
+		g_mutex_unlock(rtp_fec_enc->mutex);
+
+		gst_rtp_fec_enc_post_qos_message(rtp_fec_enc, old_qos_level, new_qos_level);
+	}
+	else if ((GST_EVENT_TYPE(event) == GST_EVENT_CUSTOM_UPSTREAM) && (pad == rtp_fec_enc->srcpad) && gst_rtp_fec_enc_handle_retransmission_request(rtp_fec_enc, event))
+	{
+		/* The request has been answered here, so there is no need to pass it on upstream */
+		gst_event_unref(event);
+		gst_object_unref(rtp_fec_enc);
+		return TRUE;
+	}
+
+	/* QoS events are forwarded upstream as well, so upstream elements can react too */
+	ret = gst_pad_event_default(pad, event);
+
+	gst_object_unref(rtp_fec_enc);
+
+	return ret;
+}
+
+
+static void gst_rtp_fec_enc_finish_qos_measurement(GstRtpFECEnc *rtp_fec_enc)
+{
+	GstClockTime encode_time;
+
+	if (!GST_CLOCK_TIME_IS_VALID(rtp_fec_enc->qos_block_start))
+		return;
+
+	encode_time = gst_util_get_timestamp() - rtp_fec_enc->qos_block_start;
+	rtp_fec_enc->qos_block_start = GST_CLOCK_TIME_NONE;
+	rtp_fec_enc->qos_encode_time = (rtp_fec_enc->qos_encode_time == 0) ? encode_time : ((rtp_fec_enc->qos_encode_time * 7 + encode_time) / 8);
+
+	GST_LOG_OBJECT(rtp_fec_enc, "block encode time %" GST_TIME_FORMAT ", average %" GST_TIME_FORMAT ", block interval %" GST_TIME_FORMAT, GST_TIME_ARGS(encode_time), GST_TIME_ARGS(rtp_fec_enc->qos_encode_time), GST_TIME_ARGS(rtp_fec_enc->qos_block_interval));
+
+	gst_rtp_fec_enc_update_qos_level(rtp_fec_enc);
+}
+
+
+static void gst_rtp_fec_enc_update_qos_level(GstRtpFECEnc *rtp_fec_enc)
+{
+	GstClockTime now;
+	gboolean pressure, headroom;
+	GstRtpFECEncQoSLevel level;
+
+	if (!rtp_fec_enc->qos)
+		return;
+
+	/* Without a known block interval, only the QoS events are taken into account */
+	now = gst_util_get_timestamp();
+	pressure = rtp_fec_enc->qos_late || ((rtp_fec_enc->qos_block_interval > 0) && ((rtp_fec_enc->qos_encode_time * QOS_PRESSURE_DIVISOR) > rtp_fec_enc->qos_block_interval));
+	headroom = !rtp_fec_enc->qos_late && ((rtp_fec_enc->qos_block_interval == 0) || ((rtp_fec_enc->qos_encode_time * QOS_HEADROOM_DIVISOR) < rtp_fec_enc->qos_block_interval));
+
+	if (!headroom)
+		rtp_fec_enc->qos_headroom_since = GST_CLOCK_TIME_NONE;
+	else if (!GST_CLOCK_TIME_IS_VALID(rtp_fec_enc->qos_headroom_since))
+		rtp_fec_enc->qos_headroom_since = now;
+
+	level = rtp_fec_enc->qos_level;
+	if (pressure && (level < GST_RTP_FEC_ENC_QOS_LEVEL_SKIP) && (!GST_CLOCK_TIME_IS_VALID(rtp_fec_enc->qos_last_change) || ((now - rtp_fec_enc->qos_last_change) >= QOS_DEGRADE_INTERVAL)))
+		++level;
+	else if (headroom && (level > GST_RTP_FEC_ENC_QOS_LEVEL_FULL) && ((now - rtp_fec_enc->qos_headroom_since) >= QOS_RESTORE_INTERVAL) && ((now - rtp_fec_enc->qos_last_change) >= QOS_RESTORE_INTERVAL))
+	{
+		--level;
+		/* Each restored level needs its own period of headroom */
+		rtp_fec_enc->qos_headroom_since = now;
+	}
+
+	if (level == rtp_fec_enc->qos_level)
+		return;
+
+	GST_INFO_OBJECT(rtp_fec_enc, "QoS level changed from %d to %d (average encode time %" GST_TIME_FORMAT ", block interval %" GST_TIME_FORMAT ", late: %d)", rtp_fec_enc->qos_level, level, GST_TIME_ARGS(rtp_fec_enc->qos_encode_time), GST_TIME_ARGS(rtp_fec_enc->qos_block_interval), rtp_fec_enc->qos_late);
+
+	rtp_fec_enc->qos_level = level;
+	rtp_fec_enc->qos_last_change = now;
+	/* The encode time of the previous level says little about the new one */
+	rtp_fec_enc->qos_encode_time = 0;
+	fec_ssrc_table_foreach(rtp_fec_enc->encoders, gst_rtp_fec_enc_configure_encoder, rtp_fec_enc);
+}
+
+
+static void gst_rtp_fec_enc_reset_qos_state(GstRtpFECEnc *rtp_fec_enc)
+{
+	rtp_fec_enc->qos_level = GST_RTP_FEC_ENC_QOS_LEVEL_FULL;
+	rtp_fec_enc->qos_late = FALSE;
+	rtp_fec_enc->qos_encode_time = 0;
+	rtp_fec_enc->qos_block_interval = 0;
+	rtp_fec_enc->qos_block_start = GST_CLOCK_TIME_NONE;
+	rtp_fec_enc->qos_last_block_time = GST_CLOCK_TIME_NONE;
+	rtp_fec_enc->qos_last_change = GST_CLOCK_TIME_NONE;
+	rtp_fec_enc->qos_headroom_since = GST_CLOCK_TIME_NONE;
+
+	/* Called from init before the encoder table exists */
+	if (rtp_fec_enc->encoders != NULL)
+		fec_ssrc_table_foreach(rtp_fec_enc->encoders, gst_rtp_fec_enc_configure_encoder, rtp_fec_enc);
+}
+
+
+static void gst_rtp_fec_enc_post_qos_message(GstRtpFECEnc *rtp_fec_enc, GstRtpFECEncQoSLevel const old_level, GstRtpFECEncQoSLevel const new_level)
+{
+	GstStructure *structure;
+
+	if (old_level == new_level)
+		return;
+
+	structure = gst_structure_new(
+		"GstRtpFECEncQoS",
+		"level", GST_TYPE_RTP_FEC_ENC_QOS_LEVEL, new_level,
+		"previous-level", GST_TYPE_RTP_FEC_ENC_QOS_LEVEL, old_level,
+		NULL
+	);
+
+	gst_element_post_message(GST_ELEMENT(rtp_fec_enc), gst_message_new_element(GST_OBJECT(rtp_fec_enc), structure));
+}
+
+
+static void gst_rtp_fec_enc_store_rtx_packet(GstRtpFECEnc *rtp_fec_enc, GstBuffer *packet)
+{
+	if (rtp_fec_enc->rtx_history == 0)
+		return;
+
+	gst_rtp_fec_enc_trim_rtx_packets(rtp_fec_enc, rtp_fec_enc->rtx_history - 1);
+	g_queue_push_tail(rtp_fec_enc->rtx_packets, gst_buffer_ref(packet));
+}
+
+
+static void gst_rtp_fec_enc_trim_rtx_packets(GstRtpFECEnc *rtp_fec_enc, guint const max_num_packets)
+{
+	while (g_queue_get_length(rtp_fec_enc->rtx_packets) > max_num_packets)
+		gst_buffer_unref(g_queue_pop_head(rtp_fec_enc->rtx_packets));
+}
+
+
+static gboolean gst_rtp_fec_enc_handle_retransmission_request(GstRtpFECEnc *rtp_fec_enc, GstEvent *event)
+{
+	GstStructure const *structure;
+	GstBuffer *packet;
+	GList *link;
+	guint seqnum, ssrc;
+	GstFlowReturn ret;
+
+	structure = gst_event_get_structure(event);
+	if ((structure == NULL) || !gst_structure_has_name(structure, "GstRTPRetransmissionRequest"))
+		return FALSE;
+	if (!gst_structure_get_uint(structure, "seqnum", &seqnum) || !gst_structure_get_uint(structure, "ssrc", &ssrc))
+		return FALSE;
+
+	/* Requests usually ask for recent packets, so search from the newest one backwards */
+	packet = NULL;
+	g_mutex_lock(rtp_fec_enc->mutex);
+	for (link = rtp_fec_enc->rtx_packets->tail; link != NULL; link = link->prev)
+	{
+		GstBuffer *candidate = link->data;
+		if ((gst_rtp_buffer_get_seq(candidate) == seqnum) && (gst_rtp_buffer_get_ssrc(candidate) == ssrc))
+		{
+			packet = gst_buffer_ref(candidate);
+			break;
+		}
+	}
+	g_mutex_unlock(rtp_fec_enc->mutex);
+
+	if (packet == NULL)
+	{
+		GST_DEBUG_OBJECT(rtp_fec_enc, "retransmission of seqnum %u of SSRC %08x requested, but the packet is not in the history", seqnum, ssrc);
+		return FALSE;
+	}
+
+	GST_DEBUG_OBJECT(rtp_fec_enc, "retransmitting seqnum %u of SSRC %08x", seqnum, ssrc);
+	ret = gst_pad_push(rtp_fec_enc->srcpad, packet);
+	if (ret != GST_FLOW_OK)
+	{
+		GST_WARNING_OBJECT(rtp_fec_enc, "could not retransmit seqnum %u of SSRC %08x: %s", seqnum, ssrc, gst_flow_get_name(ret));
+		return FALSE;
+	}
+
+	g_mutex_lock(rtp_fec_enc->mutex);
+	++rtp_fec_enc->retransmitted_packets;
+	g_mutex_unlock(rtp_fec_enc->mutex);
+
+	return TRUE;
+}
+
+
+static void gst_rtp_fec_enc_post_stats_message(GstRtpFECEnc *rtp_fec_enc)
+{
+	GstStructure *structure;
+	GstClockTime now;
+	gboolean due;
+
+	/* Cheap check first, so disabled messages cost nothing */
+	if (rtp_fec_enc->stats_interval == 0)
+		return;
+
+	now = gst_util_get_timestamp();
+
+	GST_OBJECT_LOCK(rtp_fec_enc);
+	due = (rtp_fec_enc->stats_interval > 0) && (!GST_CLOCK_TIME_IS_VALID(rtp_fec_enc->last_stats_time) || ((now - rtp_fec_enc->last_stats_time) >= rtp_fec_enc->stats_interval));
+	if (due)
+		rtp_fec_enc->last_stats_time = now;
+	GST_OBJECT_UNLOCK(rtp_fec_enc);
+
+	if (!due)
+		return;
+
+	structure = fec_enc_stats_get_structure(&(rtp_fec_enc->stats));
+	gst_structure_set_name(structure, "GstRtpFECEncStats");
+	gst_element_post_message(GST_ELEMENT(rtp_fec_enc), gst_message_new_element(GST_OBJECT(rtp_fec_enc), structure));
+}
+
+
+static gboolean gst_rtp_fec_enc_src_query(GstPad *pad, GstQuery *query)
+{
+	GstRtpFECEnc *rtp_fec_enc;
+	gboolean ret;
+
+	rtp_fec_enc = GST_RTP_FEC_ENC(gst_pad_get_parent(pad));
+
+	/* Without mux mode, the src pad only carries media packets, which pass through right away */
+	if ((GST_QUERY_TYPE(query) == GST_QUERY_LATENCY) && ((pad == rtp_fec_enc->fecpad) || ((pad == rtp_fec_enc->srcpad) && rtp_fec_enc->mux)))
+	{
+		gboolean live;
+		GstClockTime min_latency, max_latency, own_latency;
+
+		ret = gst_pad_peer_query(rtp_fec_enc->sinkpad, query);
+		if (ret)
+		{
+			gst_query_parse_latency(query, &live, &min_latency, &max_latency);
+
+			g_mutex_lock(rtp_fec_enc->mutex);
+			own_latency = gst_rtp_fec_enc_get_own_latency(rtp_fec_enc);
+			rtp_fec_enc->reported_latency = own_latency;
+			g_mutex_unlock(rtp_fec_enc->mutex);
+
+			min_latency += own_latency;
+			if (GST_CLOCK_TIME_IS_VALID(max_latency))
+				max_latency += own_latency;
+
+			GST_DEBUG_OBJECT(rtp_fec_enc, "latency query on %s: own latency %" GST_TIME_FORMAT ", reporting min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT, GST_PAD_NAME(pad), GST_TIME_ARGS(own_latency), GST_TIME_ARGS(min_latency), GST_TIME_ARGS(max_latency));
+
+			gst_query_set_latency(query, live, min_latency, max_latency);
+		}
+	}
+	else
+		ret = gst_pad_query_default(pad, query);
+
+	gst_object_unref(rtp_fec_enc);
+
+	return ret;
+}
+
+
+static GstClockTime gst_rtp_fec_enc_get_own_latency(GstRtpFECEnc *rtp_fec_enc)
+{
+	GstClockTime block_duration = fec_latency_estimator_get_block_duration(&(rtp_fec_enc->latency_estimator), rtp_fec_enc->num_media_packets);
+
+	/* Paced FEC packets are spread over the following block interval, but at most over max_pacing_delay */
+	if (rtp_fec_enc->pacing)
+		return block_duration + MIN(block_duration, rtp_fec_enc->max_pacing_delay);
+	else
+		return block_duration;
+}
+
+
+static void gst_rtp_fec_enc_update_latency(GstRtpFECEnc *rtp_fec_enc)
+{
+	GstClockTime latency = gst_rtp_fec_enc_get_own_latency(rtp_fec_enc);
+
+	if (!fec_latency_has_changed(rtp_fec_enc->reported_latency, latency))
+		return;
+
+	GST_DEBUG_OBJECT(rtp_fec_enc, "latency changed from %" GST_TIME_FORMAT " to %" GST_TIME_FORMAT, GST_TIME_ARGS(rtp_fec_enc->reported_latency), GST_TIME_ARGS(latency));
+
+	/* The pipeline re-queries the latency after the message, which updates reported_latency again */
+	rtp_fec_enc->reported_latency = latency;
+	g_atomic_int_set(&(rtp_fec_enc->latency_changed), TRUE);
+}
+
+
+static void gst_rtp_fec_enc_post_latency_message(GstRtpFECEnc *rtp_fec_enc)
+{
+	if (g_atomic_int_compare_and_exchange(&(rtp_fec_enc->latency_changed), TRUE, FALSE))
+		gst_element_post_message(GST_ELEMENT(rtp_fec_enc), gst_message_new_latency(GST_OBJECT(rtp_fec_enc)));
+}
+
+
+static void gst_rtp_fec_enc_reset_bitrate_state(GstRtpFECEnc *rtp_fec_enc)
+{
+	rtp_fec_enc->fec_tokens = gst_util_uint64_scale(rtp_fec_enc->max_fec_bitrate / 8, FEC_BUCKET_DURATION, GST_SECOND);
+	rtp_fec_enc->fec_bitrate = 0;
+	rtp_fec_enc->bitrate_window_bytes = 0;
+	rtp_fec_enc->cur_time = GST_CLOCK_TIME_NONE;
+	rtp_fec_enc->last_refill_time = GST_CLOCK_TIME_NONE;
+	rtp_fec_enc->bitrate_window_start = GST_CLOCK_TIME_NONE;
+}
+
+
 static GstStateChangeReturn gst_rtp_fec_enc_change_state(GstElement *element, GstStateChange transition)
 {
 	GstStateChangeReturn ret;
 	GstRtpFECEnc *rtp_fec_enc;
 	
 	rtp_fec_enc = GST_RTP_FEC_ENC(element);
+
+	switch (transition)
+	{
+		case GST_STATE_CHANGE_NULL_TO_READY:
+			/*
+			Preallocate enough FEC packets for two blocks: one which is still in flight downstream,
+			and one which is being generated. The pool grows if downstream holds on to more packets.
+			*/
+			GST_OBJECT_LOCK(rtp_fec_enc);
+			{
+				/* FEC packets of joint blocks additionally carry the member table */
+				guint member_table_size = (rtp_fec_enc->num_joint_pads > 0) ? (rtp_fec_enc->num_media_packets * FEC_JOINT_MEMBER_SIZE) : 0;
+				rtp_fec_enc->pool = fec_buffer_pool_create(FEC_PACKET_OVERHEAD + member_table_size + rtp_fec_enc->max_packet_size, rtp_fec_enc->total_num_fec_packets * 2);
+			}
+			GST_OBJECT_UNLOCK(rtp_fec_enc);
+			/* max-packet-size takes effect now; this lets the encoders preallocate their padding memory */
+			g_mutex_lock(rtp_fec_enc->mutex);
+			fec_ssrc_table_foreach(rtp_fec_enc->encoders, gst_rtp_fec_enc_configure_encoder, rtp_fec_enc);
+			gst_rtp_fec_enc_configure_encoder(0, rtp_fec_enc->joint_enc, rtp_fec_enc);
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			break;
+		default:
+			break;
+	}
+
 	ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
 
 	switch (transition)
@@ -393,9 +2525,28 @@ static GstStateChangeReturn gst_rtp_fec_enc_change_state(GstElement *element, Gs
 		case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
 			break;
 		case GST_STATE_CHANGE_PAUSED_TO_READY:
-			fec_enc_reset(rtp_fec_enc->enc);
+			/* The next session may carry different streams, so drop all encoders */
+			g_mutex_lock(rtp_fec_enc->mutex);
+			fec_ssrc_table_clear(rtp_fec_enc->encoders);
+			fec_enc_reset(rtp_fec_enc->joint_enc);
+			gst_rtp_fec_enc_clear_paced_packets(rtp_fec_enc);
+			gst_rtp_fec_enc_reset_bitrate_state(rtp_fec_enc);
+			gst_rtp_fec_enc_reset_qos_state(rtp_fec_enc);
+			gst_rtp_fec_enc_trim_rtx_packets(rtp_fec_enc, 0);
+			/* No encoder is running anymore, so the statistics can be reset for the next session */
+			fec_enc_stats_reset(&(rtp_fec_enc->stats));
+			fec_latency_estimator_reset(&(rtp_fec_enc->latency_estimator));
+			rtp_fec_enc->reported_latency = GST_CLOCK_TIME_NONE;
+			g_mutex_unlock(rtp_fec_enc->mutex);
+			GST_OBJECT_LOCK(rtp_fec_enc);
+			rtp_fec_enc->last_stats_time = GST_CLOCK_TIME_NONE;
+			GST_OBJECT_UNLOCK(rtp_fec_enc);
 			break;
 		case GST_STATE_CHANGE_READY_TO_NULL:
+			GST_OBJECT_LOCK(rtp_fec_enc);
+			fec_buffer_pool_destroy(rtp_fec_enc->pool);
+			rtp_fec_enc->pool = NULL;
+			GST_OBJECT_UNLOCK(rtp_fec_enc);
 			break;
 		default:
 			break;
@@ -408,7 +2559,14 @@ static GstStateChangeReturn gst_rtp_fec_enc_change_state(GstElement *element, Gs
 static void gst_rtp_fec_enc_finalize(GObject *object)
 {
 	GstRtpFECEnc *rtp_fec_enc = GST_RTP_FEC_ENC(object);
-	fec_enc_destroy(rtp_fec_enc->enc);
+	fec_ssrc_table_destroy(rtp_fec_enc->encoders);
+	fec_enc_destroy(rtp_fec_enc->joint_enc);
+	g_list_free(rtp_fec_enc->layer_pads);
+	gst_rtp_fec_enc_clear_paced_packets(rtp_fec_enc);
+	g_queue_free(rtp_fec_enc->paced_packets);
+	gst_rtp_fec_enc_trim_rtx_packets(rtp_fec_enc, 0);
+	g_queue_free(rtp_fec_enc->rtx_packets);
+	g_mutex_free(rtp_fec_enc->mutex);
 	GST_DEBUG_OBJECT(rtp_fec_enc, "Cleaned up FEC encoder");
 	G_OBJECT_CLASS(parent_class)->finalize(object);
 }
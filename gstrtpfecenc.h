@@ -25,6 +25,10 @@
 
 #include <gst/gst.h>
 #include "fecenc.h"
+#include "fecstats.h"
+#include "feclatency.h"
+#include "fecbufferpool.h"
+#include "fecssrctable.h"
 
 
 G_BEGIN_DECLS
@@ -32,6 +36,8 @@ G_BEGIN_DECLS
 
 typedef struct _GstRtpFECEnc GstRtpFECEnc;
 typedef struct _GstRtpFECEncClass GstRtpFECEncClass;
+typedef struct _GstRtpFECEncLayerPad GstRtpFECEncLayerPad;
+typedef struct _GstRtpFECEncLayerPadClass GstRtpFECEncLayerPadClass;
 
 /* standard type-casting and type-checking boilerplate... */
 #define GST_TYPE_RTP_FEC_ENC             (gst_rtp_fec_enc_get_type())
@@ -40,6 +46,31 @@ typedef struct _GstRtpFECEncClass GstRtpFECEncClass;
 #define GST_IS_RTP_FEC_ENC(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_RTP_FEC_ENC))
 #define GST_IS_RTP_FEC_ENC_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass), GST_TYPE_RTP_FEC_ENC))
 
+#define GST_TYPE_RTP_FEC_ENC_LAYER_PAD             (gst_rtp_fec_enc_layer_pad_get_type())
+#define GST_RTP_FEC_ENC_LAYER_PAD(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_RTP_FEC_ENC_LAYER_PAD, GstRtpFECEncLayerPad))
+#define GST_RTP_FEC_ENC_LAYER_PAD_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass), GST_TYPE_RTP_FEC_ENC_LAYER_PAD, GstRtpFECEncLayerPadClass))
+#define GST_IS_RTP_FEC_ENC_LAYER_PAD(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_RTP_FEC_ENC_LAYER_PAD))
+#define GST_IS_RTP_FEC_ENC_LAYER_PAD_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass), GST_TYPE_RTP_FEC_ENC_LAYER_PAD))
+
+typedef enum
+{
+	GST_RTP_FEC_ENC_UEP_MODE_NONE,
+	GST_RTP_FEC_ENC_UEP_MODE_DELTA_UNIT,
+	GST_RTP_FEC_ENC_UEP_MODE_MARKER,
+	GST_RTP_FEC_ENC_UEP_MODE_HEADER_EXTENSION
+}
+GstRtpFECEncUEPMode;
+
+/* QoS levels, from full protection to no protection at all; each level is cheaper than the previous one */
+typedef enum
+{
+	GST_RTP_FEC_ENC_QOS_LEVEL_FULL,
+	GST_RTP_FEC_ENC_QOS_LEVEL_REDUCED,
+	GST_RTP_FEC_ENC_QOS_LEVEL_XOR,
+	GST_RTP_FEC_ENC_QOS_LEVEL_SKIP
+}
+GstRtpFECEncQoSLevel;
+
 struct _GstRtpFECEnc
 {
 	GstElement element;
@@ -49,8 +80,110 @@ struct _GstRtpFECEnc
 		*srcpad,
 		*fecpad;
 
-	/* Actual FEC encoder */
-	fec_enc *enc;
+	/* Actual FEC encoders, one per SSRC, created when the first packet of a stream arrives */
+	fec_ssrc_table *encoders;
+	guint max_ssrcs;
+
+	/* Settings for the encoders */
+	guint num_media_packets, num_fec_packets, payload_type;
+
+	/*
+	Unequal error protection; the UEP mode selects how packets are identified as keyframe packets,
+	which are then protected with their own block geometry
+	*/
+	GstRtpFECEncUEPMode uep_mode;
+	guint uep_extension_id;
+	guint keyframe_num_media_packets, keyframe_num_fec_packets;
+
+	/* Pool for FEC packets; exists between the READY and NULL states */
+	fec_buffer_pool *pool;
+	guint max_packet_size;
+
+	/* If TRUE, FEC packets are interleaved into the src pad instead of going out through the fec pad */
+	gboolean mux;
+
+	/*
+	Pacing: instead of sending the FEC packets of a block in one burst, they are timestamped
+	and spread evenly over the following block interval (at most max_pacing_delay). Paced
+	packets wait in paced_packets until a media packet with a later timestamp arrives.
+	Each stream is paced by its own block interval (see fec_enc_get_block_interval()).
+	*/
+	gboolean pacing;
+	GstClockTime max_pacing_delay;
+	GQueue *paced_packets;
+
+	/*
+	FEC bitrate cap: a token bucket shared by all encoders, refilled with max_fec_bitrate bits
+	per second (0 = unlimited); blocks get fewer FEC packets, or none at all, if the bucket does
+	not hold enough tokens for them. cur_time is the timestamp of the media packet being encoded.
+	fec_bitrate is the measured FEC bitrate of the last full measurement window.
+	*/
+	guint max_fec_bitrate, fec_bitrate;
+	guint64 fec_tokens, skipped_repairs, bitrate_window_bytes;
+	GstClockTime cur_time, last_refill_time, bitrate_window_start;
+
+	/*
+	CPU-aware QoS: if enabled, the encode time of each block (measured with the system clock) is
+	compared against the interval between blocks, and downstream QoS events report lateness. Under
+	pressure, the QoS level is lowered one step at a time; it is raised again once there has been
+	headroom for a while. qos_block_start is the system time at which the current block's encode
+	started, or GST_CLOCK_TIME_NONE if no block is being encoded.
+	*/
+	gboolean qos, qos_late;
+	GstRtpFECEncQoSLevel qos_level;
+	GstClockTime qos_encode_time, qos_block_interval;
+	GstClockTime qos_block_start, qos_last_block_time, qos_last_change, qos_headroom_since;
+
+	/*
+	Latency of the FEC stream: the FEC packets of a block are generated once its last media packet arrived,
+	so they trail the first media packet by one block duration, plus the pacing delay if pacing is enabled.
+	latency_estimator measures the block duration from the media packets of the sink pad. reported_latency is
+	the latency last reported in a latency query (GST_CLOCK_TIME_NONE if there was none yet); if the latency
+	drifts too far from it, latency_changed is set, and a latency message is posted once the mutex is released.
+	*/
+	fec_latency_estimator latency_estimator;
+	GstClockTime reported_latency;
+	volatile gint latency_changed;
+
+	/*
+	Statistics shared by all encoders; they are updated atomically by the encoders, and can be read
+	without locking. If stats_interval is nonzero, they are posted as element messages at least
+	stats_interval apart (measured in system time); last_stats_time is protected by the object lock.
+	*/
+	fec_enc_stats stats;
+	GstClockTime stats_interval, last_stats_time;
+
+	/*
+	Retransmission history: the last rtx_history media packets of the sink pad, oldest first, kept to answer
+	GstRTPRetransmissionRequest events arriving at the src pad (for example from an rtpfecdec with
+	do-retransmission enabled); 0 disables the history
+	*/
+	guint rtx_history;
+	GQueue *rtx_packets;
+	guint64 retransmitted_packets;
+
+	/*
+	Encoder for joint blocks, shared by all sink_%d request pads; the media packets of these
+	pads (for example audio and video) fill the same blocks, whose FEC packets go out through
+	the fec pad. Each sink_%d pad has a src_%d pad with the same number, stored in the sink
+	pad's element_private field.
+	*/
+	fec_enc *joint_enc;
+	guint num_joint_pads;
+
+	/*
+	Additional FEC layers, as fec_%d request pads sorted by pad number. The encoders generate
+	num_fec_packets repair symbols for the fec pad, followed by the symbols of each layer, so
+	all layers share one encoding. total_num_fec_packets is the sum over the fec pad and all layers.
+	*/
+	GList *layer_pads;
+	guint num_layer_pads, total_num_fec_packets;
+
+	/*
+	Mutex used in the chain functions to protect the encoders. The GstObject mutex cannot be used,
+	because it is locked by other functions as well, potentially causing deadlocks.
+	*/
+	GMutex *mutex;
 };
 
 struct _GstRtpFECEncClass
@@ -58,7 +191,25 @@ struct _GstRtpFECEncClass
 	GstElementClass parent_class;
 };
 
+/*
+Request pad carrying one FEC layer; the layer consists of the repair symbols
+[first_index, first_index + num_fec_packets) of each block
+*/
+struct _GstRtpFECEncLayerPad
+{
+	GstPad pad;
+
+	guint layer_nr;
+	guint num_fec_packets, first_index;
+};
+
+struct _GstRtpFECEncLayerPadClass
+{
+	GstPadClass parent_class;
+};
+
 GType gst_rtp_fec_enc_get_type(void);
+GType gst_rtp_fec_enc_layer_pad_get_type(void);
 
 
 G_END_DECLS
@@ -0,0 +1,819 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+#include <string.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include "gstrtpfecimpair.h"
+
+
+
+/**** Debugging ****/
+
+GST_DEBUG_CATEGORY_STATIC(rtpfecimpair_debug);
+#define GST_CAT_DEFAULT rtpfecimpair_debug
+
+
+
+/**** Typedefs ****/
+
+
+/* Output pads, used as indices for the queues of outgoing packets */
+typedef enum
+{
+	OUTPUT_SRC,
+	OUTPUT_FEC_SRC,
+	NUM_OUTPUTS
+}
+output_pads;
+
+
+/* A packet held back for reordering; it is released once remaining more packets of its stream have passed */
+typedef struct
+{
+	GstBuffer *packet;
+	output_pads output;
+	guint remaining;
+}
+held_packet;
+
+
+
+/**** Constants ****/
+
+
+enum
+{
+	PROP_0 = 0, /* GStreamer disallows properties with id 0 -> using dummy enum to prevent 0 */
+	PROP_SEED,
+	PROP_PAYLOAD_TYPE,
+	PROP_STATS,
+	/* The properties of the streams follow, NUM_STREAM_PROPS per stream */
+	PROP_FIRST_STREAM_PROP
+};
+
+
+enum
+{
+	STREAM_PROP_LOSS_MODEL,
+	STREAM_PROP_LOSS_PROBABILITY,
+	STREAM_PROP_BURST_LENGTH,
+	STREAM_PROP_GE_P,
+	STREAM_PROP_GE_R,
+	STREAM_PROP_GE_LOSS_GOOD,
+	STREAM_PROP_GE_LOSS_BAD,
+	STREAM_PROP_REORDER_PROBABILITY,
+	STREAM_PROP_REORDER_DISTANCE,
+	STREAM_PROP_DUPLICATE_PROBABILITY,
+	NUM_STREAM_PROPS
+};
+
+
+enum
+{
+	DEFAULT_SEED = 0,
+	DEFAULT_PT = -1,
+	DEFAULT_BURST_LENGTH = 1,
+	DEFAULT_REORDER_DISTANCE = 1
+};
+
+
+#define DEFAULT_LOSS_MODEL FEC_IMPAIR_LOSS_MODEL_NONE
+#define DEFAULT_PROBABILITY 0.0
+
+
+static gchar const *stream_names[GST_RTP_FEC_IMPAIR_NUM_STREAMS] = { "media", "fec" };
+
+
+
+/**** Function declarations ****/
+
+/* Impairs one packet, and queues it (and the held packets it releases) for output; must be called with the mutex locked */
+static void gst_rtp_fec_impair_process_packet(GstRtpFECImpair *rtp_fec_impair, GstPad *pad, GstBuffer *packet, GQueue *outgoing);
+/* Pushes the queued packets into their output pads; must be called without the mutex locked */
+static GstFlowReturn gst_rtp_fec_impair_push_packets(GstRtpFECImpair *rtp_fec_impair, GQueue *outgoing);
+/* Moves (or drops, if outgoing is NULL) all held packets destined for the given output; must be called with the mutex locked */
+static void gst_rtp_fec_impair_release_held_packets(GstRtpFECImpair *rtp_fec_impair, output_pads const output, GQueue *outgoing);
+
+/* These functions are invoked when the sink or fec_sink pad receive data */
+static GstFlowReturn gst_rtp_fec_impair_chain(GstPad *pad, GstBuffer *packet);
+static GstFlowReturn gst_rtp_fec_impair_chain_list(GstPad *pad, GstBufferList *list);
+
+/* Events only travel between paired pads, so the media and FEC paths each get their own EOS, segments, and flushes */
+static gboolean gst_rtp_fec_impair_sink_event(GstPad *pad, GstEvent *event);
+static gboolean gst_rtp_fec_impair_src_event(GstPad *pad, GstEvent *event);
+
+/* Property accessors */
+static void gst_rtp_fec_impair_install_stream_properties(GObjectClass *object_class, GstRtpFECImpairStream const stream);
+static void gst_rtp_fec_impair_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec);
+static void gst_rtp_fec_impair_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+static GstStructure* gst_rtp_fec_impair_get_stats(GstRtpFECImpair *rtp_fec_impair);
+
+/* Restarts the random sequences of all streams from the seed; must be called with the mutex locked */
+static void gst_rtp_fec_impair_reset(GstRtpFECImpair *rtp_fec_impair);
+
+/* Called when the pipeline state changes */
+static GstStateChangeReturn gst_rtp_fec_impair_change_state(GstElement *element, GstStateChange transition);
+
+/* Finalizer; cleans up states */
+static void gst_rtp_fec_impair_finalize(GObject *object);
+
+
+
+/**** GStreamer boilerplate ****/
+
+GST_BOILERPLATE(GstRtpFECImpair, gst_rtp_fec_impair, GstElement, GST_TYPE_ELEMENT)
+
+
+#define GST_TYPE_RTP_FEC_IMPAIR_LOSS_MODEL (gst_rtp_fec_impair_loss_model_get_type())
+static GType gst_rtp_fec_impair_loss_model_get_type(void)
+{
+	static GType loss_model_type = 0;
+
+	if (!loss_model_type)
+	{
+		static GEnumValue const loss_model_values[] =
+		{
+			{ FEC_IMPAIR_LOSS_MODEL_NONE, "No packets are lost", "none" },
+			{ FEC_IMPAIR_LOSS_MODEL_BERNOULLI, "Every packet is lost with the loss probability", "bernoulli" },
+			{ FEC_IMPAIR_LOSS_MODEL_GILBERT_ELLIOTT, "Two-state Markov chain with a loss probability per state", "gilbert-elliott" },
+			{ FEC_IMPAIR_LOSS_MODEL_BURST, "Bursts of burst-length packets are lost, with the loss probability as average loss rate", "burst" },
+			{ 0, NULL, NULL }
+		};
+
+		loss_model_type = g_enum_register_static("GstRtpFECImpairLossModel", loss_model_values);
+	}
+
+	return loss_model_type;
+}
+
+
+
+/**** Pads ****/
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+	"sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS("application/x-rtp")
+);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+	"src",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS("application/x-rtp")
+);
+
+static GstStaticPadTemplate fec_sink_template = GST_STATIC_PAD_TEMPLATE(
+	"fec_sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS("application/x-rtp")
+);
+
+static GstStaticPadTemplate fec_src_template = GST_STATIC_PAD_TEMPLATE(
+	"fec_src",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS("application/x-rtp")
+);
+
+
+
+/**** Function definition ****/
+
+static void gst_rtp_fec_impair_base_init(gpointer klass)
+{
+	GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+
+	gst_element_class_set_details_simple(
+		element_class,
+		"RTP FEC network impairment",
+		"Filter/Network/RTP",
+		"Drops, reorders and duplicates RTP media and FEC packets reproducibly, for evaluating FEC settings",
+		"Carlos Rafael Giani <dv@pseudoterminal.org>"
+	);
+
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&sink_template));
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&src_template));
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&fec_sink_template));
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&fec_src_template));
+}
+
+
+static void gst_rtp_fec_impair_class_init(GstRtpFECImpairClass *klass)
+{
+	GObjectClass *object_class;
+	GstElementClass *element_class;
+	guint i;
+
+	GST_DEBUG_CATEGORY_INIT(rtpfecimpair_debug, "rtpfecimpair", 0, "RTP FEC network impairment");
+
+	object_class = G_OBJECT_CLASS(klass);
+	element_class = GST_ELEMENT_CLASS(klass);
+
+	/* Set functions */
+	object_class->finalize = GST_DEBUG_FUNCPTR(gst_rtp_fec_impair_finalize);
+	element_class->change_state = GST_DEBUG_FUNCPTR(gst_rtp_fec_impair_change_state);
+	object_class->set_property = GST_DEBUG_FUNCPTR(gst_rtp_fec_impair_set_property);
+	object_class->get_property = GST_DEBUG_FUNCPTR(gst_rtp_fec_impair_get_property);
+
+	/* Install properties */
+	g_object_class_install_property(
+		object_class,
+		PROP_SEED,
+		g_param_spec_uint(
+			"seed",
+			"Seed",
+			"Seed of the random sequences; the media stream uses the seed, the FEC stream the seed plus 1",
+			0, G_MAXUINT,
+			DEFAULT_SEED,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_PAYLOAD_TYPE,
+		g_param_spec_int(
+			"pt",
+			"FEC payload type",
+			"Payload type of FEC packets multiplexed into the sink pad, which are impaired as part of the FEC stream (-1 = none)",
+			-1, 127,
+			DEFAULT_PT,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_STATS,
+		g_param_spec_boxed(
+			"stats",
+			"Statistics",
+			"Number of packets seen, dropped, duplicated and reordered, per stream",
+			GST_TYPE_STRUCTURE,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+
+	for (i = 0; i < GST_RTP_FEC_IMPAIR_NUM_STREAMS; ++i)
+		gst_rtp_fec_impair_install_stream_properties(object_class, i);
+}
+
+
+static void gst_rtp_fec_impair_install_stream_properties(GObjectClass *object_class, GstRtpFECImpairStream const stream)
+{
+	/* The properties of both streams only differ in their prefix, so their names are built at runtime */
+	guint first_prop_id = PROP_FIRST_STREAM_PROP + stream * NUM_STREAM_PROPS;
+	gchar const *name = stream_names[stream];
+	gchar *prop_name;
+
+#define INSTALL_STREAM_PROPERTY(prop, suffix, pspec_call) \
+	do \
+	{ \
+		prop_name = g_strdup_printf("%s-%s", name, suffix); \
+		g_object_class_install_property(object_class, first_prop_id + (prop), pspec_call); \
+		g_free(prop_name); \
+	} \
+	while (0)
+
+	INSTALL_STREAM_PROPERTY(STREAM_PROP_LOSS_MODEL, "loss-model", g_param_spec_enum(
+		prop_name, "Loss model", "Loss model of the stream",
+		GST_TYPE_RTP_FEC_IMPAIR_LOSS_MODEL, DEFAULT_LOSS_MODEL, G_PARAM_READWRITE
+	));
+	INSTALL_STREAM_PROPERTY(STREAM_PROP_LOSS_PROBABILITY, "loss-probability", g_param_spec_double(
+		prop_name, "Loss probability", "Loss probability of the bernoulli model, and average loss rate of the burst model",
+		0.0, 1.0, DEFAULT_PROBABILITY, G_PARAM_READWRITE
+	));
+	INSTALL_STREAM_PROPERTY(STREAM_PROP_BURST_LENGTH, "burst-length", g_param_spec_uint(
+		prop_name, "Burst length", "Number of consecutive packets lost in a burst (burst model)",
+		1, G_MAXUINT, DEFAULT_BURST_LENGTH, G_PARAM_READWRITE
+	));
+	INSTALL_STREAM_PROPERTY(STREAM_PROP_GE_P, "ge-p", g_param_spec_double(
+		prop_name, "Gilbert-Elliott p", "Probability of going from the good to the bad state (gilbert-elliott model)",
+		0.0, 1.0, DEFAULT_PROBABILITY, G_PARAM_READWRITE
+	));
+	INSTALL_STREAM_PROPERTY(STREAM_PROP_GE_R, "ge-r", g_param_spec_double(
+		prop_name, "Gilbert-Elliott r", "Probability of going from the bad to the good state (gilbert-elliott model)",
+		0.0, 1.0, DEFAULT_PROBABILITY, G_PARAM_READWRITE
+	));
+	INSTALL_STREAM_PROPERTY(STREAM_PROP_GE_LOSS_GOOD, "ge-loss-good", g_param_spec_double(
+		prop_name, "Gilbert-Elliott good state loss", "Loss probability in the good state (gilbert-elliott model)",
+		0.0, 1.0, DEFAULT_PROBABILITY, G_PARAM_READWRITE
+	));
+	INSTALL_STREAM_PROPERTY(STREAM_PROP_GE_LOSS_BAD, "ge-loss-bad", g_param_spec_double(
+		prop_name, "Gilbert-Elliott bad state loss", "Loss probability in the bad state (gilbert-elliott model)",
+		0.0, 1.0, DEFAULT_PROBABILITY, G_PARAM_READWRITE
+	));
+	INSTALL_STREAM_PROPERTY(STREAM_PROP_REORDER_PROBABILITY, "reorder-probability", g_param_spec_double(
+		prop_name, "Reorder probability", "Probability that a packet is held back until reorder-distance later packets have passed",
+		0.0, 1.0, DEFAULT_PROBABILITY, G_PARAM_READWRITE
+	));
+	INSTALL_STREAM_PROPERTY(STREAM_PROP_REORDER_DISTANCE, "reorder-distance", g_param_spec_uint(
+		prop_name, "Reorder distance", "Number of later packets which overtake a reordered packet",
+		1, G_MAXUINT, DEFAULT_REORDER_DISTANCE, G_PARAM_READWRITE
+	));
+	INSTALL_STREAM_PROPERTY(STREAM_PROP_DUPLICATE_PROBABILITY, "duplicate-probability", g_param_spec_double(
+		prop_name, "Duplicate probability", "Probability that a packet is sent twice",
+		0.0, 1.0, DEFAULT_PROBABILITY, G_PARAM_READWRITE
+	));
+
+#undef INSTALL_STREAM_PROPERTY
+}
+
+
+static void gst_rtp_fec_impair_init(GstRtpFECImpair *rtp_fec_impair, GstRtpFECImpairClass *klass)
+{
+	GstElement *element;
+	guint i;
+
+	klass = klass;
+
+	element = GST_ELEMENT(rtp_fec_impair);
+
+	/* Create pads out of the templates defined earlier */
+	rtp_fec_impair->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+	rtp_fec_impair->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+	rtp_fec_impair->fec_sinkpad = gst_pad_new_from_static_template(&fec_sink_template, "fec_sink");
+	rtp_fec_impair->fec_srcpad = gst_pad_new_from_static_template(&fec_src_template, "fec_src");
+
+	gst_pad_set_element_private(rtp_fec_impair->sinkpad, rtp_fec_impair->srcpad);
+	gst_pad_set_element_private(rtp_fec_impair->srcpad, rtp_fec_impair->sinkpad);
+	gst_pad_set_element_private(rtp_fec_impair->fec_sinkpad, rtp_fec_impair->fec_srcpad);
+	gst_pad_set_element_private(rtp_fec_impair->fec_srcpad, rtp_fec_impair->fec_sinkpad);
+
+	/* Set chain and event functions */
+	gst_pad_set_chain_function(rtp_fec_impair->sinkpad, gst_rtp_fec_impair_chain);
+	gst_pad_set_chain_function(rtp_fec_impair->fec_sinkpad, gst_rtp_fec_impair_chain);
+	gst_pad_set_chain_list_function(rtp_fec_impair->sinkpad, gst_rtp_fec_impair_chain_list);
+	gst_pad_set_chain_list_function(rtp_fec_impair->fec_sinkpad, gst_rtp_fec_impair_chain_list);
+	gst_pad_set_event_function(rtp_fec_impair->sinkpad, gst_rtp_fec_impair_sink_event);
+	gst_pad_set_event_function(rtp_fec_impair->fec_sinkpad, gst_rtp_fec_impair_sink_event);
+	gst_pad_set_event_function(rtp_fec_impair->srcpad, gst_rtp_fec_impair_src_event);
+	gst_pad_set_event_function(rtp_fec_impair->fec_srcpad, gst_rtp_fec_impair_src_event);
+
+	/* Add the pads to the element */
+	gst_element_add_pad(element, rtp_fec_impair->sinkpad);
+	gst_element_add_pad(element, rtp_fec_impair->srcpad);
+	gst_element_add_pad(element, rtp_fec_impair->fec_sinkpad);
+	gst_element_add_pad(element, rtp_fec_impair->fec_srcpad);
+
+	/* Initialize the mutex */
+	rtp_fec_impair->mutex = g_mutex_new();
+
+	rtp_fec_impair->fec_payload_type = DEFAULT_PT;
+	rtp_fec_impair->seed = DEFAULT_SEED;
+
+	for (i = 0; i < GST_RTP_FEC_IMPAIR_NUM_STREAMS; ++i)
+	{
+		fec_impair_init(&(rtp_fec_impair->impairs[i]), rtp_fec_impair->seed + i);
+		rtp_fec_impair->impairs[i].settings.burst_length = DEFAULT_BURST_LENGTH;
+		rtp_fec_impair->impairs[i].settings.reorder_distance = DEFAULT_REORDER_DISTANCE;
+		rtp_fec_impair->held_packets[i] = g_queue_new();
+	}
+}
+
+
+static void gst_rtp_fec_impair_process_packet(GstRtpFECImpair *rtp_fec_impair, GstPad *pad, GstBuffer *packet, GQueue *outgoing)
+{
+	GstRtpFECImpairStream stream;
+	output_pads output;
+	fec_impair_action action;
+	GQueue *held_packets;
+	GList *link;
+
+	output = (pad == rtp_fec_impair->sinkpad) ? OUTPUT_SRC : OUTPUT_FEC_SRC;
+	if ((output == OUTPUT_FEC_SRC) || ((rtp_fec_impair->fec_payload_type >= 0) && (gst_rtp_buffer_get_payload_type(packet) == rtp_fec_impair->fec_payload_type)))
+		stream = GST_RTP_FEC_IMPAIR_STREAM_FEC;
+	else
+		stream = GST_RTP_FEC_IMPAIR_STREAM_MEDIA;
+
+	action = fec_impair_process_packet(&(rtp_fec_impair->impairs[stream]));
+
+	switch (action)
+	{
+		case FEC_IMPAIR_ACTION_DROP:
+			GST_LOG_OBJECT(rtp_fec_impair, "dropping %s packet with seqnum %u", stream_names[stream], gst_rtp_buffer_get_seq(packet));
+			gst_buffer_unref(packet);
+			/* Lost packets do not overtake held packets */
+			return;
+
+		case FEC_IMPAIR_ACTION_DELAY:
+		{
+			held_packet *held = g_new(held_packet, 1);
+			GST_LOG_OBJECT(rtp_fec_impair, "holding back %s packet with seqnum %u", stream_names[stream], gst_rtp_buffer_get_seq(packet));
+			held->packet = packet;
+			held->output = output;
+			held->remaining = rtp_fec_impair->impairs[stream].settings.reorder_distance;
+			g_queue_push_tail(rtp_fec_impair->held_packets[stream], held);
+			return;
+		}
+
+		case FEC_IMPAIR_ACTION_DUPLICATE:
+			GST_LOG_OBJECT(rtp_fec_impair, "duplicating %s packet with seqnum %u", stream_names[stream], gst_rtp_buffer_get_seq(packet));
+			g_queue_push_tail(&(outgoing[output]), gst_buffer_ref(packet));
+			g_queue_push_tail(&(outgoing[output]), packet);
+			break;
+
+		default:
+			g_queue_push_tail(&(outgoing[output]), packet);
+			break;
+	}
+
+	/* This packet overtook all held packets of its stream; release the ones which have been overtaken often enough */
+	held_packets = rtp_fec_impair->held_packets[stream];
+	link = g_queue_peek_head_link(held_packets);
+	while (link != NULL)
+	{
+		GList *next = link->next;
+		held_packet *held = link->data;
+
+		if (--held->remaining == 0)
+		{
+			g_queue_push_tail(&(outgoing[held->output]), held->packet);
+			g_queue_delete_link(held_packets, link);
+			g_free(held);
+		}
+
+		link = next;
+	}
+}
+
+
+static GstFlowReturn gst_rtp_fec_impair_push_packets(GstRtpFECImpair *rtp_fec_impair, GQueue *outgoing)
+{
+	GstPad *pads[NUM_OUTPUTS];
+	GstFlowReturn ret = GST_FLOW_OK;
+	guint i;
+
+	pads[OUTPUT_SRC] = rtp_fec_impair->srcpad;
+	pads[OUTPUT_FEC_SRC] = rtp_fec_impair->fec_srcpad;
+
+	for (i = 0; i < NUM_OUTPUTS; ++i)
+	{
+		while (!g_queue_is_empty(&(outgoing[i])))
+		{
+			GstFlowReturn push_ret = gst_pad_push(pads[i], g_queue_pop_head(&(outgoing[i])));
+			/* Keep the first error, but push everything; the other path may still be fine */
+			if (ret == GST_FLOW_OK)
+				ret = push_ret;
+		}
+	}
+
+	return ret;
+}
+
+
+static void gst_rtp_fec_impair_release_held_packets(GstRtpFECImpair *rtp_fec_impair, output_pads const output, GQueue *outgoing)
+{
+	guint i;
+
+	for (i = 0; i < GST_RTP_FEC_IMPAIR_NUM_STREAMS; ++i)
+	{
+		GQueue *held_packets = rtp_fec_impair->held_packets[i];
+		GList *link = g_queue_peek_head_link(held_packets);
+
+		while (link != NULL)
+		{
+			GList *next = link->next;
+			held_packet *held = link->data;
+
+			if (held->output == output)
+			{
+				if (outgoing != NULL)
+					g_queue_push_tail(&(outgoing[output]), held->packet);
+				else
+					gst_buffer_unref(held->packet);
+				g_queue_delete_link(held_packets, link);
+				g_free(held);
+			}
+
+			link = next;
+		}
+	}
+}
+
+
+static GstFlowReturn gst_rtp_fec_impair_chain(GstPad *pad, GstBuffer *packet)
+{
+	GstRtpFECImpair *rtp_fec_impair;
+	GQueue outgoing[NUM_OUTPUTS];
+	GstFlowReturn ret;
+
+	rtp_fec_impair = GST_RTP_FEC_IMPAIR(gst_pad_get_parent(pad));
+	g_queue_init(&(outgoing[OUTPUT_SRC]));
+	g_queue_init(&(outgoing[OUTPUT_FEC_SRC]));
+
+	g_mutex_lock(rtp_fec_impair->mutex);
+	gst_rtp_fec_impair_process_packet(rtp_fec_impair, pad, packet, outgoing);
+	g_mutex_unlock(rtp_fec_impair->mutex);
+
+	ret = gst_rtp_fec_impair_push_packets(rtp_fec_impair, outgoing);
+
+	gst_object_unref(rtp_fec_impair);
+
+	return ret;
+}
+
+
+static GstFlowReturn gst_rtp_fec_impair_chain_list(GstPad *pad, GstBufferList *list)
+{
+	GstRtpFECImpair *rtp_fec_impair;
+	GstBufferListIterator *it;
+	GQueue outgoing[NUM_OUTPUTS];
+	GstFlowReturn ret;
+
+	rtp_fec_impair = GST_RTP_FEC_IMPAIR(gst_pad_get_parent(pad));
+	g_queue_init(&(outgoing[OUTPUT_SRC]));
+	g_queue_init(&(outgoing[OUTPUT_FEC_SRC]));
+
+	/* Packets are impaired one by one, and pushed individually, since any of them may be dropped or reordered */
+	g_mutex_lock(rtp_fec_impair->mutex);
+	it = gst_buffer_list_iterate(list);
+	while (gst_buffer_list_iterator_next_group(it))
+	{
+		GstBuffer *packet;
+
+		/* Only groups with several buffers are merged */
+		if (gst_buffer_list_iterator_n_buffers(it) == 1)
+			packet = gst_buffer_ref(gst_buffer_list_iterator_next(it));
+		else
+			packet = gst_buffer_list_iterator_merge_group(it);
+
+		if (packet != NULL)
+			gst_rtp_fec_impair_process_packet(rtp_fec_impair, pad, packet, outgoing);
+	}
+	gst_buffer_list_iterator_free(it);
+	g_mutex_unlock(rtp_fec_impair->mutex);
+
+	gst_buffer_list_unref(list);
+
+	ret = gst_rtp_fec_impair_push_packets(rtp_fec_impair, outgoing);
+
+	gst_object_unref(rtp_fec_impair);
+
+	return ret;
+}
+
+
+static gboolean gst_rtp_fec_impair_sink_event(GstPad *pad, GstEvent *event)
+{
+	GstRtpFECImpair *rtp_fec_impair;
+	GQueue outgoing[NUM_OUTPUTS];
+	output_pads output;
+	gboolean ret;
+
+	rtp_fec_impair = GST_RTP_FEC_IMPAIR(gst_pad_get_parent(pad));
+	output = (pad == rtp_fec_impair->sinkpad) ? OUTPUT_SRC : OUTPUT_FEC_SRC;
+	g_queue_init(&(outgoing[OUTPUT_SRC]));
+	g_queue_init(&(outgoing[OUTPUT_FEC_SRC]));
+
+	switch (GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_EOS:
+			/* Held packets are not lost at the end of the stream, they just arrive last */
+			g_mutex_lock(rtp_fec_impair->mutex);
+			gst_rtp_fec_impair_release_held_packets(rtp_fec_impair, output, outgoing);
+			g_mutex_unlock(rtp_fec_impair->mutex);
+			gst_rtp_fec_impair_push_packets(rtp_fec_impair, outgoing);
+			break;
+		case GST_EVENT_FLUSH_STOP:
+			g_mutex_lock(rtp_fec_impair->mutex);
+			gst_rtp_fec_impair_release_held_packets(rtp_fec_impair, output, NULL);
+			g_mutex_unlock(rtp_fec_impair->mutex);
+			break;
+		default:
+			break;
+	}
+
+	ret = gst_pad_push_event(gst_pad_get_element_private(pad), event);
+
+	gst_object_unref(rtp_fec_impair);
+
+	return ret;
+}
+
+
+static gboolean gst_rtp_fec_impair_src_event(GstPad *pad, GstEvent *event)
+{
+	return gst_pad_push_event(gst_pad_get_element_private(pad), event);
+}
+
+
+static void gst_rtp_fec_impair_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec)
+{
+	GstRtpFECImpair *rtp_fec_impair;
+
+	GST_OBJECT_LOCK(object);
+
+	rtp_fec_impair = GST_RTP_FEC_IMPAIR(object);
+
+	g_mutex_lock(rtp_fec_impair->mutex);
+
+	switch (prop_id)
+	{
+		case PROP_SEED:
+			rtp_fec_impair->seed = g_value_get_uint(value);
+			GST_DEBUG_OBJECT(rtp_fec_impair, "Set seed to %u", rtp_fec_impair->seed);
+			gst_rtp_fec_impair_reset(rtp_fec_impair);
+			break;
+		case PROP_PAYLOAD_TYPE:
+			rtp_fec_impair->fec_payload_type = g_value_get_int(value);
+			GST_DEBUG_OBJECT(rtp_fec_impair, "Set FEC payload type to %d", rtp_fec_impair->fec_payload_type);
+			break;
+		default:
+		{
+			fec_impair_settings *settings;
+
+			if ((prop_id < PROP_FIRST_STREAM_PROP) || (prop_id >= (PROP_FIRST_STREAM_PROP + GST_RTP_FEC_IMPAIR_NUM_STREAMS * NUM_STREAM_PROPS)))
+			{
+				G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+				break;
+			}
+
+			/* Changed settings take effect with the next packet; model state is kept */
+			settings = &(rtp_fec_impair->impairs[(prop_id - PROP_FIRST_STREAM_PROP) / NUM_STREAM_PROPS].settings);
+			switch ((prop_id - PROP_FIRST_STREAM_PROP) % NUM_STREAM_PROPS)
+			{
+				case STREAM_PROP_LOSS_MODEL: settings->loss_model = g_value_get_enum(value); break;
+				case STREAM_PROP_LOSS_PROBABILITY: settings->loss_probability = g_value_get_double(value); break;
+				case STREAM_PROP_BURST_LENGTH: settings->burst_length = g_value_get_uint(value); break;
+				case STREAM_PROP_GE_P: settings->ge_p = g_value_get_double(value); break;
+				case STREAM_PROP_GE_R: settings->ge_r = g_value_get_double(value); break;
+				case STREAM_PROP_GE_LOSS_GOOD: settings->ge_loss_good = g_value_get_double(value); break;
+				case STREAM_PROP_GE_LOSS_BAD: settings->ge_loss_bad = g_value_get_double(value); break;
+				case STREAM_PROP_REORDER_PROBABILITY: settings->reorder_probability = g_value_get_double(value); break;
+				case STREAM_PROP_REORDER_DISTANCE: settings->reorder_distance = g_value_get_uint(value); break;
+				case STREAM_PROP_DUPLICATE_PROBABILITY: settings->duplicate_probability = g_value_get_double(value); break;
+				default: break;
+			}
+			GST_DEBUG_OBJECT(rtp_fec_impair, "Set %s", g_param_spec_get_name(pspec));
+			break;
+		}
+	}
+
+	g_mutex_unlock(rtp_fec_impair->mutex);
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+static void gst_rtp_fec_impair_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+	GstRtpFECImpair *rtp_fec_impair;
+
+	GST_OBJECT_LOCK(object);
+
+	rtp_fec_impair = GST_RTP_FEC_IMPAIR(object);
+
+	g_mutex_lock(rtp_fec_impair->mutex);
+
+	switch (prop_id)
+	{
+		case PROP_SEED:
+			g_value_set_uint(value, rtp_fec_impair->seed);
+			break;
+		case PROP_PAYLOAD_TYPE:
+			g_value_set_int(value, rtp_fec_impair->fec_payload_type);
+			break;
+		case PROP_STATS:
+			g_value_take_boxed(value, gst_rtp_fec_impair_get_stats(rtp_fec_impair));
+			break;
+		default:
+		{
+			fec_impair_settings *settings;
+
+			if ((prop_id < PROP_FIRST_STREAM_PROP) || (prop_id >= (PROP_FIRST_STREAM_PROP + GST_RTP_FEC_IMPAIR_NUM_STREAMS * NUM_STREAM_PROPS)))
+			{
+				G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+				break;
+			}
+
+			settings = &(rtp_fec_impair->impairs[(prop_id - PROP_FIRST_STREAM_PROP) / NUM_STREAM_PROPS].settings);
+			switch ((prop_id - PROP_FIRST_STREAM_PROP) % NUM_STREAM_PROPS)
+			{
+				case STREAM_PROP_LOSS_MODEL: g_value_set_enum(value, settings->loss_model); break;
+				case STREAM_PROP_LOSS_PROBABILITY: g_value_set_double(value, settings->loss_probability); break;
+				case STREAM_PROP_BURST_LENGTH: g_value_set_uint(value, settings->burst_length); break;
+				case STREAM_PROP_GE_P: g_value_set_double(value, settings->ge_p); break;
+				case STREAM_PROP_GE_R: g_value_set_double(value, settings->ge_r); break;
+				case STREAM_PROP_GE_LOSS_GOOD: g_value_set_double(value, settings->ge_loss_good); break;
+				case STREAM_PROP_GE_LOSS_BAD: g_value_set_double(value, settings->ge_loss_bad); break;
+				case STREAM_PROP_REORDER_PROBABILITY: g_value_set_double(value, settings->reorder_probability); break;
+				case STREAM_PROP_REORDER_DISTANCE: g_value_set_uint(value, settings->reorder_distance); break;
+				case STREAM_PROP_DUPLICATE_PROBABILITY: g_value_set_double(value, settings->duplicate_probability); break;
+				default: break;
+			}
+			break;
+		}
+	}
+
+	g_mutex_unlock(rtp_fec_impair->mutex);
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+static GstStructure* gst_rtp_fec_impair_get_stats(GstRtpFECImpair *rtp_fec_impair)
+{
+	fec_impair *media = &(rtp_fec_impair->impairs[GST_RTP_FEC_IMPAIR_STREAM_MEDIA]);
+	fec_impair *fec = &(rtp_fec_impair->impairs[GST_RTP_FEC_IMPAIR_STREAM_FEC]);
+
+	return gst_structure_new(
+		"fec-impair-stats",
+		"media-packets", G_TYPE_UINT64, media->num_packets,
+		"media-dropped", G_TYPE_UINT64, media->num_dropped,
+		"media-duplicated", G_TYPE_UINT64, media->num_duplicated,
+		"media-reordered", G_TYPE_UINT64, media->num_reordered,
+		"fec-packets", G_TYPE_UINT64, fec->num_packets,
+		"fec-dropped", G_TYPE_UINT64, fec->num_dropped,
+		"fec-duplicated", G_TYPE_UINT64, fec->num_duplicated,
+		"fec-reordered", G_TYPE_UINT64, fec->num_reordered,
+		NULL
+	);
+}
+
+
+static void gst_rtp_fec_impair_reset(GstRtpFECImpair *rtp_fec_impair)
+{
+	guint i;
+
+	for (i = 0; i < GST_RTP_FEC_IMPAIR_NUM_STREAMS; ++i)
+		fec_impair_reset(&(rtp_fec_impair->impairs[i]), rtp_fec_impair->seed + i);
+}
+
+
+static GstStateChangeReturn gst_rtp_fec_impair_change_state(GstElement *element, GstStateChange transition)
+{
+	GstStateChangeReturn ret;
+	GstRtpFECImpair *rtp_fec_impair;
+
+	rtp_fec_impair = GST_RTP_FEC_IMPAIR(element);
+
+	switch (transition)
+	{
+		case GST_STATE_CHANGE_READY_TO_PAUSED:
+			/* Every session is impaired the same way */
+			g_mutex_lock(rtp_fec_impair->mutex);
+			gst_rtp_fec_impair_reset(rtp_fec_impair);
+			g_mutex_unlock(rtp_fec_impair->mutex);
+			break;
+		default:
+			break;
+	}
+
+	ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+	switch (transition)
+	{
+		case GST_STATE_CHANGE_PAUSED_TO_READY:
+			g_mutex_lock(rtp_fec_impair->mutex);
+			gst_rtp_fec_impair_release_held_packets(rtp_fec_impair, OUTPUT_SRC, NULL);
+			gst_rtp_fec_impair_release_held_packets(rtp_fec_impair, OUTPUT_FEC_SRC, NULL);
+			g_mutex_unlock(rtp_fec_impair->mutex);
+			break;
+		default:
+			break;
+	}
+
+	return ret;
+}
+
+
+static void gst_rtp_fec_impair_finalize(GObject *object)
+{
+	GstRtpFECImpair *rtp_fec_impair = GST_RTP_FEC_IMPAIR(object);
+	guint i;
+
+	gst_rtp_fec_impair_release_held_packets(rtp_fec_impair, OUTPUT_SRC, NULL);
+	gst_rtp_fec_impair_release_held_packets(rtp_fec_impair, OUTPUT_FEC_SRC, NULL);
+	for (i = 0; i < GST_RTP_FEC_IMPAIR_NUM_STREAMS; ++i)
+	{
+		fec_impair_cleanup(&(rtp_fec_impair->impairs[i]));
+		g_queue_free(rtp_fec_impair->held_packets[i]);
+	}
+	g_mutex_free(rtp_fec_impair->mutex);
+	GST_DEBUG_OBJECT(rtp_fec_impair, "Cleaned up FEC impairment");
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
@@ -0,0 +1,105 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+#ifndef GSTRTPFECIMPAIR_H
+#define GSTRTPFECIMPAIR_H
+
+#include <gst/gst.h>
+#include "fecimpair.h"
+
+
+G_BEGIN_DECLS
+
+
+typedef struct _GstRtpFECImpair GstRtpFECImpair;
+typedef struct _GstRtpFECImpairClass GstRtpFECImpairClass;
+
+/* standard type-casting and type-checking boilerplate... */
+#define GST_TYPE_RTP_FEC_IMPAIR             (gst_rtp_fec_impair_get_type())
+#define GST_RTP_FEC_IMPAIR(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_RTP_FEC_IMPAIR, GstRtpFECImpair))
+#define GST_RTP_FEC_IMPAIR_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass), GST_TYPE_RTP_FEC_IMPAIR, GstRtpFECImpairClass))
+#define GST_IS_RTP_FEC_IMPAIR(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_RTP_FEC_IMPAIR))
+#define GST_IS_RTP_FEC_IMPAIR_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass), GST_TYPE_RTP_FEC_IMPAIR))
+#define GST_RTP_FEC_IMPAIR_CAST(obj)        ((GstRtpFECImpair*)(obj))
+
+
+/* The media and the FEC stream are impaired independently, each with its own settings and random sequence */
+typedef enum
+{
+	GST_RTP_FEC_IMPAIR_STREAM_MEDIA,
+	GST_RTP_FEC_IMPAIR_STREAM_FEC,
+	GST_RTP_FEC_IMPAIR_NUM_STREAMS
+}
+GstRtpFECImpairStream;
+
+
+struct _GstRtpFECImpair
+{
+	GstElement element;
+
+	/*
+	Media packets pass from sinkpad to srcpad, FEC packets from fec_sinkpad to fec_srcpad.
+	Each pad's element_private field points to the pad it is paired with.
+	*/
+	GstPad
+		*sinkpad,
+		*srcpad,
+		*fec_sinkpad,
+		*fec_srcpad;
+
+	/*
+	Payload type of FEC packets multiplexed into the sink pad (mux mode); such packets are impaired
+	as part of the FEC stream, but still leave through the src pad. -1 if there are none.
+	*/
+	gint fec_payload_type;
+
+	/*
+	The random sequence of stream i starts from seed + i when the element goes from READY to PAUSED,
+	or when the seed is set. held_packets contains the packets held back for reordering, per stream.
+	*/
+	guint seed;
+	fec_impair impairs[GST_RTP_FEC_IMPAIR_NUM_STREAMS];
+	GQueue *held_packets[GST_RTP_FEC_IMPAIR_NUM_STREAMS];
+
+	/*
+	Mutex used in the chain functions. The GstObject mutex cannot be used,
+	because it is locked by other functions as well, potentially causing deadlocks.
+	*/
+	GMutex *mutex;
+};
+
+struct _GstRtpFECImpairClass
+{
+	GstElementClass parent_class;
+};
+
+GType gst_rtp_fec_impair_get_type(void);
+
+
+G_END_DECLS
+
+
+#endif
+
@@ -0,0 +1,991 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+/* Needed for sendmmsg() */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include "gstrtpfecudpsink.h"
+
+
+
+/**** Debugging ****/
+
+GST_DEBUG_CATEGORY_STATIC(rtpfecudpsink_debug);
+#define GST_CAT_DEFAULT rtpfecudpsink_debug
+
+
+
+/**** Typedefs ****/
+
+
+/* Control message buffer for the UDP_SEGMENT option; the union ensures proper alignment */
+typedef union
+{
+	struct cmsghdr header;
+	char buf[CMSG_SPACE(sizeof(guint16))];
+}
+gso_control_buffer;
+
+
+
+/**** Constants ****/
+
+
+enum
+{
+	PROP_0 = 0, /* GStreamer disallows properties with id 0 -> using dummy enum to prevent 0 */
+	PROP_HOST,
+	PROP_PORT,
+	PROP_FEC_PORT,
+	PROP_INTERLEAVE,
+	PROP_MAX_BATCH_SIZE,
+	PROP_GSO,
+	PROP_PACKETS_SENT,
+	PROP_SYSCALLS,
+	PROP_BLOCKS_SENT
+};
+
+
+enum
+{
+	DEFAULT_PORT = 5004,
+	DEFAULT_FEC_PORT = 5006,
+	DEFAULT_MAX_BATCH_SIZE = 64,
+	DEFAULT_GSO = FALSE
+};
+
+
+#define DEFAULT_HOST "localhost"
+#define DEFAULT_INTERLEAVE GST_RTP_FEC_UDP_SINK_INTERLEAVE_MEDIA_FIRST
+
+/* Kernel limits for one UDP GSO send */
+#define GSO_MAX_SEGMENTS 64
+#define GSO_MAX_PAYLOAD_SIZE 65507
+
+
+
+/**** Function declarations ****/
+
+/* These functions are invoked when the sink and fec pads receive data */
+static GstFlowReturn gst_rtp_fec_udp_sink_chain_media(GstPad *pad, GstBuffer *packet);
+static GstFlowReturn gst_rtp_fec_udp_sink_chain_fec(GstPad *pad, GstBuffer *packet);
+static GstFlowReturn gst_rtp_fec_udp_sink_chain_list_media(GstPad *pad, GstBufferList *list);
+static GstFlowReturn gst_rtp_fec_udp_sink_chain_list_fec(GstPad *pad, GstBufferList *list);
+/* Handles EOS and flushing on both sink pads */
+static gboolean gst_rtp_fec_udp_sink_event(GstPad *pad, GstEvent *event);
+
+/* Queues a packet for the current block; must be called with the mutex locked */
+static void gst_rtp_fec_udp_sink_queue_packet(GstRtpFECUdpSink *rtp_fec_udp_sink, GstBuffer *packet, gboolean const is_fec);
+/* Sends all queued packets with as few syscalls as possible; must be called with the mutex locked */
+static void gst_rtp_fec_udp_sink_send_block(GstRtpFECUdpSink *rtp_fec_udp_sink);
+/* Drops all queued packets; must be called with the mutex locked */
+static void gst_rtp_fec_udp_sink_drop_block(GstRtpFECUdpSink *rtp_fec_udp_sink);
+
+/* Socket setup and teardown */
+static gboolean gst_rtp_fec_udp_sink_open(GstRtpFECUdpSink *rtp_fec_udp_sink);
+static void gst_rtp_fec_udp_sink_close(GstRtpFECUdpSink *rtp_fec_udp_sink);
+
+/* Property accessors */
+static void gst_rtp_fec_udp_sink_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec);
+static void gst_rtp_fec_udp_sink_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+
+/* Called when the pipeline state changes */
+static GstStateChangeReturn gst_rtp_fec_udp_sink_change_state(GstElement *element, GstStateChange transition);
+
+/* Finalizer; cleans up states */
+static void gst_rtp_fec_udp_sink_finalize(GObject *object);
+
+
+
+/**** GStreamer boilerplate ****/
+
+GST_BOILERPLATE(GstRtpFECUdpSink, gst_rtp_fec_udp_sink, GstElement, GST_TYPE_ELEMENT)
+
+
+#define GST_TYPE_RTP_FEC_UDP_SINK_INTERLEAVE (gst_rtp_fec_udp_sink_interleave_get_type())
+static GType gst_rtp_fec_udp_sink_interleave_get_type(void)
+{
+	static GType interleave_type = 0;
+
+	if (!interleave_type)
+	{
+		static GEnumValue const interleave_values[] =
+		{
+			{ GST_RTP_FEC_UDP_SINK_INTERLEAVE_MEDIA_FIRST, "All media packets of a block first, then its FEC packets", "media-first" },
+			{ GST_RTP_FEC_UDP_SINK_INTERLEAVE_SPREAD, "FEC packets spread evenly between the media packets of the block", "spread" },
+			{ 0, NULL, NULL }
+		};
+
+		interleave_type = g_enum_register_static("GstRtpFECUdpSinkInterleave", interleave_values);
+	}
+
+	return interleave_type;
+}
+
+
+
+/**** Pads ****/
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+	"sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS("application/x-rtp")
+);
+
+static GstStaticPadTemplate fec_template = GST_STATIC_PAD_TEMPLATE(
+	"fec",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS(
+		"application/x-rtp,"
+		"media = (string) { \"video\", \"audio\", \"application\" }, "
+		"payload = (int) [ 96, 127 ], "
+		"clock-rate = (int) [ 1, MAX ], "
+		"encoding-name = (string) \"parityfec\""
+	)
+);
+
+
+
+/**** Function definition ****/
+
+static void gst_rtp_fec_udp_sink_base_init(gpointer klass)
+{
+	GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+
+	gst_element_class_set_details_simple(
+		element_class,
+		"RTP forward error correction UDP sink",
+		"Sink/Network/RTP",
+		"Sends RTP media and FEC packets over UDP, one batched syscall per block",
+		"Carlos Rafael Giani <dv@pseudoterminal.org>"
+	);
+
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&sink_template));
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&fec_template));
+}
+
+
+static void gst_rtp_fec_udp_sink_class_init(GstRtpFECUdpSinkClass *klass)
+{
+	GObjectClass *object_class;
+	GstElementClass *element_class;
+
+	GST_DEBUG_CATEGORY_INIT(rtpfecudpsink_debug, "rtpfecudpsink", 0, "RTP FEC UDP sink");
+
+	object_class = G_OBJECT_CLASS(klass);
+	element_class = GST_ELEMENT_CLASS(klass);
+
+	/* Set functions */
+	object_class->finalize = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_sink_finalize);
+	element_class->change_state = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_sink_change_state);
+	object_class->set_property = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_sink_set_property);
+	object_class->get_property = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_sink_get_property);
+
+	/* Install properties */
+	g_object_class_install_property(
+		object_class,
+		PROP_HOST,
+		g_param_spec_string(
+			"host",
+			"Host",
+			"Host or IP address to send the packets to",
+			DEFAULT_HOST,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_PORT,
+		g_param_spec_uint(
+			"port",
+			"Port",
+			"UDP port to send the media packets to",
+		        1, 65535,
+			DEFAULT_PORT,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_FEC_PORT,
+		g_param_spec_uint(
+			"fec-port",
+			"FEC port",
+			"UDP port to send the FEC packets to",
+		        1, 65535,
+			DEFAULT_FEC_PORT,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_INTERLEAVE,
+		g_param_spec_enum(
+			"interleave",
+			"Interleave",
+			"How FEC packets are placed between the media packets of a block",
+			GST_TYPE_RTP_FEC_UDP_SINK_INTERLEAVE,
+			DEFAULT_INTERLEAVE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_MAX_BATCH_SIZE,
+		g_param_spec_uint(
+			"max-batch-size",
+			"Maximum batch size",
+			"Maximum number of media packets held back while waiting for the end of a block (can only be changed in the NULL state)",
+		        1, 512,
+			DEFAULT_MAX_BATCH_SIZE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_GSO,
+		g_param_spec_boolean(
+			"gso",
+			"GSO",
+			"Use UDP generic segmentation offload to send runs of equally sized packets to the same port in one message",
+			DEFAULT_GSO,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_PACKETS_SENT,
+		g_param_spec_uint64(
+			"packets-sent",
+			"Packets sent",
+			"Number of packets sent so far",
+			0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_SYSCALLS,
+		g_param_spec_uint64(
+			"syscalls",
+			"Syscalls",
+			"Number of send syscalls made so far",
+			0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_BLOCKS_SENT,
+		g_param_spec_uint64(
+			"blocks-sent",
+			"Blocks sent",
+			"Number of blocks (batches) sent so far",
+			0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+}
+
+
+static void gst_rtp_fec_udp_sink_init(GstRtpFECUdpSink *rtp_fec_udp_sink, GstRtpFECUdpSinkClass *klass)
+{
+	GstElement *element;
+
+	klass = klass;
+
+	element = GST_ELEMENT(rtp_fec_udp_sink);
+
+	/* Create pads out of the templates defined earlier */
+	rtp_fec_udp_sink->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+	rtp_fec_udp_sink->fecpad = gst_pad_new_from_static_template(&fec_template, "fec");
+
+	/* Set chain and event functions for sink and fec pads */
+	gst_pad_set_chain_function(rtp_fec_udp_sink->sinkpad, gst_rtp_fec_udp_sink_chain_media);
+	gst_pad_set_chain_function(rtp_fec_udp_sink->fecpad, gst_rtp_fec_udp_sink_chain_fec);
+	gst_pad_set_chain_list_function(rtp_fec_udp_sink->sinkpad, gst_rtp_fec_udp_sink_chain_list_media);
+	gst_pad_set_chain_list_function(rtp_fec_udp_sink->fecpad, gst_rtp_fec_udp_sink_chain_list_fec);
+	gst_pad_set_event_function(rtp_fec_udp_sink->sinkpad, gst_rtp_fec_udp_sink_event);
+	gst_pad_set_event_function(rtp_fec_udp_sink->fecpad, gst_rtp_fec_udp_sink_event);
+
+	/* Add the pads to the element */
+	gst_element_add_pad(element, rtp_fec_udp_sink->sinkpad);
+	gst_element_add_pad(element, rtp_fec_udp_sink->fecpad);
+
+	/* This element has no src pads; let the bin know it needs to wait for its EOS */
+	GST_OBJECT_FLAG_SET(rtp_fec_udp_sink, GST_ELEMENT_IS_SINK);
+
+	rtp_fec_udp_sink->host = g_strdup(DEFAULT_HOST);
+	rtp_fec_udp_sink->port = DEFAULT_PORT;
+	rtp_fec_udp_sink->fec_port = DEFAULT_FEC_PORT;
+	rtp_fec_udp_sink->interleave = DEFAULT_INTERLEAVE;
+	rtp_fec_udp_sink->max_batch_size = DEFAULT_MAX_BATCH_SIZE;
+	rtp_fec_udp_sink->use_gso = DEFAULT_GSO;
+
+	rtp_fec_udp_sink->sock = -1;
+	rtp_fec_udp_sink->media_packets = NULL;
+	rtp_fec_udp_sink->fec_packets = NULL;
+	rtp_fec_udp_sink->num_media_packets = 0;
+	rtp_fec_udp_sink->num_fec_packets = 0;
+	rtp_fec_udp_sink->ordered_packets = NULL;
+	rtp_fec_udp_sink->ordered_is_fec = NULL;
+	rtp_fec_udp_sink->iovecs = NULL;
+	rtp_fec_udp_sink->messages = NULL;
+	rtp_fec_udp_sink->control_buffers = NULL;
+	rtp_fec_udp_sink->media_eos = FALSE;
+	rtp_fec_udp_sink->fec_eos = FALSE;
+
+	rtp_fec_udp_sink->packets_sent = 0;
+	rtp_fec_udp_sink->syscalls = 0;
+	rtp_fec_udp_sink->blocks_sent = 0;
+
+	/* Initialize the mutex */
+	rtp_fec_udp_sink->mutex = g_mutex_new();
+}
+
+
+static void gst_rtp_fec_udp_sink_queue_packet(GstRtpFECUdpSink *rtp_fec_udp_sink, GstBuffer *packet, gboolean const is_fec)
+{
+	if (rtp_fec_udp_sink->sock < 0)
+	{
+		gst_buffer_unref(packet);
+		return;
+	}
+
+	if (is_fec)
+	{
+		/* FEC packets arriving without pending media packets still have to fit */
+		if (rtp_fec_udp_sink->num_fec_packets >= rtp_fec_udp_sink->max_batch_size)
+			gst_rtp_fec_udp_sink_send_block(rtp_fec_udp_sink);
+
+		rtp_fec_udp_sink->fec_packets[rtp_fec_udp_sink->num_fec_packets++] = packet;
+	}
+	else
+	{
+		rtp_fec_udp_sink->media_packets[rtp_fec_udp_sink->num_media_packets++] = packet;
+
+		/*
+		rtpfecenc pushes the FEC packets of a block right before the last media packet of that block.
+		Therefore, a media packet arriving while FEC packets are pending completes the block.
+		The batch size limit bounds the added latency if no FEC packets arrive at all.
+		*/
+		if ((rtp_fec_udp_sink->num_fec_packets > 0) || (rtp_fec_udp_sink->num_media_packets >= rtp_fec_udp_sink->max_batch_size))
+			gst_rtp_fec_udp_sink_send_block(rtp_fec_udp_sink);
+	}
+}
+
+
+static void gst_rtp_fec_udp_sink_order_packets(GstRtpFECUdpSink *rtp_fec_udp_sink, guint *num_packets)
+{
+	guint i, media_index, fec_index, n;
+	guint num_media_packets = rtp_fec_udp_sink->num_media_packets;
+	guint num_fec_packets = rtp_fec_udp_sink->num_fec_packets;
+
+	n = 0;
+	fec_index = 0;
+
+	for (media_index = 0; media_index < num_media_packets; ++media_index)
+	{
+		rtp_fec_udp_sink->ordered_packets[n] = rtp_fec_udp_sink->media_packets[media_index];
+		rtp_fec_udp_sink->ordered_is_fec[n] = FALSE;
+		++n;
+
+		if (rtp_fec_udp_sink->interleave == GST_RTP_FEC_UDP_SINK_INTERLEAVE_SPREAD)
+		{
+			/*
+			Place FEC packet j after media packet i once (j+1)/num_fec >= (i+1)/num_media,
+			which spreads them evenly and puts the last one after the last media packet
+			*/
+			while ((fec_index < num_fec_packets) && ((fec_index + 1) * num_media_packets <= (media_index + 1) * num_fec_packets))
+			{
+				rtp_fec_udp_sink->ordered_packets[n] = rtp_fec_udp_sink->fec_packets[fec_index++];
+				rtp_fec_udp_sink->ordered_is_fec[n] = TRUE;
+				++n;
+			}
+		}
+	}
+
+	for (i = fec_index; i < num_fec_packets; ++i)
+	{
+		rtp_fec_udp_sink->ordered_packets[n] = rtp_fec_udp_sink->fec_packets[i];
+		rtp_fec_udp_sink->ordered_is_fec[n] = TRUE;
+		++n;
+	}
+
+	*num_packets = n;
+}
+
+
+static guint gst_rtp_fec_udp_sink_build_messages(GstRtpFECUdpSink *rtp_fec_udp_sink, guint const num_packets)
+{
+	guint i, num_messages;
+	gso_control_buffer *control_buffers = rtp_fec_udp_sink->control_buffers;
+
+	num_messages = 0;
+	i = 0;
+
+	while (i < num_packets)
+	{
+		struct msghdr *msg;
+		gboolean is_fec;
+		guint segment_size, run_length, run_size;
+
+		is_fec = rtp_fec_udp_sink->ordered_is_fec[i];
+		segment_size = GST_BUFFER_SIZE(rtp_fec_udp_sink->ordered_packets[i]);
+		run_length = 1;
+		run_size = segment_size;
+
+		rtp_fec_udp_sink->iovecs[i].iov_base = GST_BUFFER_DATA(rtp_fec_udp_sink->ordered_packets[i]);
+		rtp_fec_udp_sink->iovecs[i].iov_len = segment_size;
+
+		/*
+		With GSO, consecutive packets to the same port are coalesced into one message
+		as long as they have the same size; only the last one of a run may be shorter
+		*/
+		if (rtp_fec_udp_sink->use_gso)
+		{
+			while ((i + run_length) < num_packets)
+			{
+				GstBuffer *next = rtp_fec_udp_sink->ordered_packets[i + run_length];
+				guint next_size = GST_BUFFER_SIZE(next);
+
+				if ((rtp_fec_udp_sink->ordered_is_fec[i + run_length] != is_fec) || (next_size > segment_size) || (run_length >= GSO_MAX_SEGMENTS) || ((run_size + next_size) > GSO_MAX_PAYLOAD_SIZE))
+					break;
+
+				rtp_fec_udp_sink->iovecs[i + run_length].iov_base = GST_BUFFER_DATA(next);
+				rtp_fec_udp_sink->iovecs[i + run_length].iov_len = next_size;
+				++run_length;
+				run_size += next_size;
+
+				if (next_size < segment_size)
+					break;
+			}
+		}
+
+		msg = &(rtp_fec_udp_sink->messages[num_messages].msg_hdr);
+		memset(msg, 0, sizeof(struct msghdr));
+		msg->msg_name = is_fec ? &(rtp_fec_udp_sink->fec_addr) : &(rtp_fec_udp_sink->media_addr);
+		msg->msg_namelen = is_fec ? rtp_fec_udp_sink->fec_addr_len : rtp_fec_udp_sink->media_addr_len;
+		msg->msg_iov = &(rtp_fec_udp_sink->iovecs[i]);
+		msg->msg_iovlen = run_length;
+
+#ifdef UDP_SEGMENT
+		if (run_length > 1)
+		{
+			struct cmsghdr *cmsg;
+			guint16 gso_size = segment_size;
+
+			msg->msg_control = control_buffers[num_messages].buf;
+			msg->msg_controllen = sizeof(control_buffers[num_messages].buf);
+			cmsg = CMSG_FIRSTHDR(msg);
+			cmsg->cmsg_level = SOL_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(guint16));
+			memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(guint16));
+		}
+#else
+		control_buffers = control_buffers;
+#endif
+
+		++num_messages;
+		i += run_length;
+	}
+
+	return num_messages;
+}
+
+
+static void gst_rtp_fec_udp_sink_send_block(GstRtpFECUdpSink *rtp_fec_udp_sink)
+{
+	guint i, num_packets, num_messages, num_sent, num_packets_sent;
+
+	gst_rtp_fec_udp_sink_order_packets(rtp_fec_udp_sink, &num_packets);
+	if (num_packets == 0)
+		return;
+
+	num_messages = gst_rtp_fec_udp_sink_build_messages(rtp_fec_udp_sink, num_packets);
+
+	num_sent = 0;
+	while (num_sent < num_messages)
+	{
+		int ret = sendmmsg(rtp_fec_udp_sink->sock, rtp_fec_udp_sink->messages + num_sent, num_messages - num_sent, 0);
+		++rtp_fec_udp_sink->syscalls;
+
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			if (rtp_fec_udp_sink->use_gso && (num_sent == 0) && ((errno == EINVAL) || (errno == EIO) || (errno == ENOPROTOOPT)))
+			{
+				/* The kernel or the NIC does not support GSO; rebuild the messages without it and retry */
+				GST_WARNING_OBJECT(rtp_fec_udp_sink, "sending with GSO failed (%s) - disabling GSO", strerror(errno));
+				rtp_fec_udp_sink->use_gso = FALSE;
+				num_messages = gst_rtp_fec_udp_sink_build_messages(rtp_fec_udp_sink, num_packets);
+				continue;
+			}
+
+			/* Like udpsink, do not error out on send failures (ICMP errors on unconnected sockets etc.) */
+			GST_WARNING_OBJECT(rtp_fec_udp_sink, "sendmmsg failed: %s - dropping %u messages", strerror(errno), num_messages - num_sent);
+			break;
+		}
+
+		num_sent += ret;
+	}
+
+	/* With GSO, one message can carry several packets */
+	num_packets_sent = 0;
+	for (i = 0; i < num_sent; ++i)
+		num_packets_sent += rtp_fec_udp_sink->messages[i].msg_hdr.msg_iovlen;
+
+	rtp_fec_udp_sink->packets_sent += num_packets_sent;
+	++rtp_fec_udp_sink->blocks_sent;
+	GST_LOG_OBJECT(rtp_fec_udp_sink, "sent block of %u media and %u FEC packets in %u messages", rtp_fec_udp_sink->num_media_packets, rtp_fec_udp_sink->num_fec_packets, num_messages);
+
+	for (i = 0; i < num_packets; ++i)
+		gst_buffer_unref(rtp_fec_udp_sink->ordered_packets[i]);
+
+	rtp_fec_udp_sink->num_media_packets = 0;
+	rtp_fec_udp_sink->num_fec_packets = 0;
+}
+
+
+static void gst_rtp_fec_udp_sink_drop_block(GstRtpFECUdpSink *rtp_fec_udp_sink)
+{
+	guint i;
+
+	for (i = 0; i < rtp_fec_udp_sink->num_media_packets; ++i)
+		gst_buffer_unref(rtp_fec_udp_sink->media_packets[i]);
+	for (i = 0; i < rtp_fec_udp_sink->num_fec_packets; ++i)
+		gst_buffer_unref(rtp_fec_udp_sink->fec_packets[i]);
+
+	rtp_fec_udp_sink->num_media_packets = 0;
+	rtp_fec_udp_sink->num_fec_packets = 0;
+}
+
+
+static GstFlowReturn gst_rtp_fec_udp_sink_chain_media(GstPad *pad, GstBuffer *packet)
+{
+	GstRtpFECUdpSink *rtp_fec_udp_sink;
+
+	rtp_fec_udp_sink = GST_RTP_FEC_UDP_SINK(gst_pad_get_parent(pad));
+	g_mutex_lock(rtp_fec_udp_sink->mutex);
+
+	gst_rtp_fec_udp_sink_queue_packet(rtp_fec_udp_sink, packet, FALSE);
+
+	g_mutex_unlock(rtp_fec_udp_sink->mutex);
+	gst_object_unref(rtp_fec_udp_sink);
+
+	return GST_FLOW_OK;
+}
+
+
+static GstFlowReturn gst_rtp_fec_udp_sink_chain_fec(GstPad *pad, GstBuffer *packet)
+{
+	GstRtpFECUdpSink *rtp_fec_udp_sink;
+
+	rtp_fec_udp_sink = GST_RTP_FEC_UDP_SINK(gst_pad_get_parent(pad));
+	g_mutex_lock(rtp_fec_udp_sink->mutex);
+
+	gst_rtp_fec_udp_sink_queue_packet(rtp_fec_udp_sink, packet, TRUE);
+
+	g_mutex_unlock(rtp_fec_udp_sink->mutex);
+	gst_object_unref(rtp_fec_udp_sink);
+
+	return GST_FLOW_OK;
+}
+
+
+static void gst_rtp_fec_udp_sink_queue_list(GstRtpFECUdpSink *rtp_fec_udp_sink, GstBufferList *list, gboolean const is_fec)
+{
+	GstBufferListIterator *it;
+
+	it = gst_buffer_list_iterate(list);
+	while (gst_buffer_list_iterator_next_group(it))
+	{
+		GstBuffer *packet;
+
+		/* Each packet has to be in one piece for the iovec */
+		if (gst_buffer_list_iterator_n_buffers(it) == 1)
+			packet = gst_buffer_ref(gst_buffer_list_iterator_next(it));
+		else
+			packet = gst_buffer_list_iterator_merge_group(it);
+
+		if (packet != NULL)
+			gst_rtp_fec_udp_sink_queue_packet(rtp_fec_udp_sink, packet, is_fec);
+	}
+	gst_buffer_list_iterator_free(it);
+
+	gst_buffer_list_unref(list);
+}
+
+
+static GstFlowReturn gst_rtp_fec_udp_sink_chain_list_media(GstPad *pad, GstBufferList *list)
+{
+	GstRtpFECUdpSink *rtp_fec_udp_sink;
+
+	rtp_fec_udp_sink = GST_RTP_FEC_UDP_SINK(gst_pad_get_parent(pad));
+	g_mutex_lock(rtp_fec_udp_sink->mutex);
+
+	gst_rtp_fec_udp_sink_queue_list(rtp_fec_udp_sink, list, FALSE);
+
+	g_mutex_unlock(rtp_fec_udp_sink->mutex);
+	gst_object_unref(rtp_fec_udp_sink);
+
+	return GST_FLOW_OK;
+}
+
+
+static GstFlowReturn gst_rtp_fec_udp_sink_chain_list_fec(GstPad *pad, GstBufferList *list)
+{
+	GstRtpFECUdpSink *rtp_fec_udp_sink;
+
+	rtp_fec_udp_sink = GST_RTP_FEC_UDP_SINK(gst_pad_get_parent(pad));
+	g_mutex_lock(rtp_fec_udp_sink->mutex);
+
+	gst_rtp_fec_udp_sink_queue_list(rtp_fec_udp_sink, list, TRUE);
+
+	g_mutex_unlock(rtp_fec_udp_sink->mutex);
+	gst_object_unref(rtp_fec_udp_sink);
+
+	return GST_FLOW_OK;
+}
+
+
+static gboolean gst_rtp_fec_udp_sink_event(GstPad *pad, GstEvent *event)
+{
+	GstRtpFECUdpSink *rtp_fec_udp_sink;
+	gboolean post_eos = FALSE;
+
+	rtp_fec_udp_sink = GST_RTP_FEC_UDP_SINK(gst_pad_get_parent(pad));
+
+	switch (GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_EOS:
+			g_mutex_lock(rtp_fec_udp_sink->mutex);
+
+			if (pad == rtp_fec_udp_sink->sinkpad)
+				rtp_fec_udp_sink->media_eos = TRUE;
+			else
+				rtp_fec_udp_sink->fec_eos = TRUE;
+
+			/* Send whatever is left once both streams are done (or if FEC is not linked at all) */
+			if (rtp_fec_udp_sink->media_eos && (rtp_fec_udp_sink->fec_eos || !gst_pad_is_linked(rtp_fec_udp_sink->fecpad)))
+			{
+				gst_rtp_fec_udp_sink_send_block(rtp_fec_udp_sink);
+				post_eos = TRUE;
+			}
+
+			g_mutex_unlock(rtp_fec_udp_sink->mutex);
+			break;
+
+		case GST_EVENT_FLUSH_STOP:
+			g_mutex_lock(rtp_fec_udp_sink->mutex);
+			gst_rtp_fec_udp_sink_drop_block(rtp_fec_udp_sink);
+			rtp_fec_udp_sink->media_eos = FALSE;
+			rtp_fec_udp_sink->fec_eos = FALSE;
+			g_mutex_unlock(rtp_fec_udp_sink->mutex);
+			break;
+
+		default:
+			break;
+	}
+
+	if (post_eos)
+		gst_element_post_message(GST_ELEMENT(rtp_fec_udp_sink), gst_message_new_eos(GST_OBJECT(rtp_fec_udp_sink)));
+
+	/* This is a sink; events end here */
+	gst_event_unref(event);
+	gst_object_unref(rtp_fec_udp_sink);
+
+	return TRUE;
+}
+
+
+static gboolean gst_rtp_fec_udp_sink_resolve(GstRtpFECUdpSink *rtp_fec_udp_sink, guint const port, struct sockaddr_storage *addr, socklen_t *addr_len)
+{
+	struct addrinfo hints, *result;
+	gchar service[16];
+	int ret;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	g_snprintf(service, sizeof(service), "%u", port);
+
+	ret = getaddrinfo(rtp_fec_udp_sink->host, service, &hints, &result);
+	if (ret != 0)
+	{
+		GST_ERROR_OBJECT(rtp_fec_udp_sink, "could not resolve %s: %s", rtp_fec_udp_sink->host, gai_strerror(ret));
+		return FALSE;
+	}
+
+	memcpy(addr, result->ai_addr, result->ai_addrlen);
+	*addr_len = result->ai_addrlen;
+	freeaddrinfo(result);
+
+	return TRUE;
+}
+
+
+static gboolean gst_rtp_fec_udp_sink_open(GstRtpFECUdpSink *rtp_fec_udp_sink)
+{
+	guint max_packets;
+
+	if (!gst_rtp_fec_udp_sink_resolve(rtp_fec_udp_sink, rtp_fec_udp_sink->port, &(rtp_fec_udp_sink->media_addr), &(rtp_fec_udp_sink->media_addr_len)))
+		return FALSE;
+	if (!gst_rtp_fec_udp_sink_resolve(rtp_fec_udp_sink, rtp_fec_udp_sink->fec_port, &(rtp_fec_udp_sink->fec_addr), &(rtp_fec_udp_sink->fec_addr_len)))
+		return FALSE;
+
+	rtp_fec_udp_sink->sock = socket(rtp_fec_udp_sink->media_addr.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (rtp_fec_udp_sink->sock < 0)
+	{
+		GST_ERROR_OBJECT(rtp_fec_udp_sink, "could not create socket: %s", strerror(errno));
+		return FALSE;
+	}
+
+	/* Media and FEC packets of one block are sent together, so there can be twice as many packets as the batch size */
+	max_packets = rtp_fec_udp_sink->max_batch_size * 2;
+	rtp_fec_udp_sink->media_packets = g_new(GstBuffer*, rtp_fec_udp_sink->max_batch_size);
+	rtp_fec_udp_sink->fec_packets = g_new(GstBuffer*, rtp_fec_udp_sink->max_batch_size);
+	rtp_fec_udp_sink->ordered_packets = g_new(GstBuffer*, max_packets);
+	rtp_fec_udp_sink->ordered_is_fec = g_new(gboolean, max_packets);
+	rtp_fec_udp_sink->iovecs = g_new(struct iovec, max_packets);
+	rtp_fec_udp_sink->messages = g_new0(struct mmsghdr, max_packets);
+	rtp_fec_udp_sink->control_buffers = g_new0(gso_control_buffer, max_packets);
+	rtp_fec_udp_sink->num_media_packets = 0;
+	rtp_fec_udp_sink->num_fec_packets = 0;
+
+	GST_DEBUG_OBJECT(rtp_fec_udp_sink, "sending to %s, port %u (media) and %u (FEC)", rtp_fec_udp_sink->host, rtp_fec_udp_sink->port, rtp_fec_udp_sink->fec_port);
+
+	return TRUE;
+}
+
+
+static void gst_rtp_fec_udp_sink_close(GstRtpFECUdpSink *rtp_fec_udp_sink)
+{
+	if (rtp_fec_udp_sink->media_packets != NULL)
+		gst_rtp_fec_udp_sink_drop_block(rtp_fec_udp_sink);
+
+	if (rtp_fec_udp_sink->sock >= 0)
+		close(rtp_fec_udp_sink->sock);
+	rtp_fec_udp_sink->sock = -1;
+
+	g_free(rtp_fec_udp_sink->media_packets);
+	g_free(rtp_fec_udp_sink->fec_packets);
+	g_free(rtp_fec_udp_sink->ordered_packets);
+	g_free(rtp_fec_udp_sink->ordered_is_fec);
+	g_free(rtp_fec_udp_sink->iovecs);
+	g_free(rtp_fec_udp_sink->messages);
+	g_free(rtp_fec_udp_sink->control_buffers);
+
+	rtp_fec_udp_sink->media_packets = NULL;
+	rtp_fec_udp_sink->fec_packets = NULL;
+	rtp_fec_udp_sink->ordered_packets = NULL;
+	rtp_fec_udp_sink->ordered_is_fec = NULL;
+	rtp_fec_udp_sink->iovecs = NULL;
+	rtp_fec_udp_sink->messages = NULL;
+	rtp_fec_udp_sink->control_buffers = NULL;
+}
+
+
+static void gst_rtp_fec_udp_sink_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec)
+{
+	GstRtpFECUdpSink *rtp_fec_udp_sink;
+
+	GST_OBJECT_LOCK(object);
+
+	rtp_fec_udp_sink = GST_RTP_FEC_UDP_SINK(object);
+
+	switch (prop_id)
+	{
+		case PROP_HOST:
+			g_free(rtp_fec_udp_sink->host);
+			rtp_fec_udp_sink->host = g_strdup(g_value_get_string(value));
+			break;
+		case PROP_PORT:
+			rtp_fec_udp_sink->port = g_value_get_uint(value);
+			break;
+		case PROP_FEC_PORT:
+			rtp_fec_udp_sink->fec_port = g_value_get_uint(value);
+			break;
+		case PROP_INTERLEAVE:
+			g_mutex_lock(rtp_fec_udp_sink->mutex);
+			rtp_fec_udp_sink->interleave = g_value_get_enum(value);
+			g_mutex_unlock(rtp_fec_udp_sink->mutex);
+			break;
+		case PROP_MAX_BATCH_SIZE:
+			/* The packet and message arrays are sized in open(), so the batch size cannot change while they exist */
+			g_mutex_lock(rtp_fec_udp_sink->mutex);
+			if (rtp_fec_udp_sink->media_packets == NULL)
+				rtp_fec_udp_sink->max_batch_size = g_value_get_uint(value);
+			else
+				GST_WARNING_OBJECT(rtp_fec_udp_sink, "cannot change the maximum batch size while running");
+			g_mutex_unlock(rtp_fec_udp_sink->mutex);
+			break;
+		case PROP_GSO:
+			g_mutex_lock(rtp_fec_udp_sink->mutex);
+			rtp_fec_udp_sink->use_gso = g_value_get_boolean(value);
+			g_mutex_unlock(rtp_fec_udp_sink->mutex);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+static void gst_rtp_fec_udp_sink_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+	GstRtpFECUdpSink *rtp_fec_udp_sink;
+
+	GST_OBJECT_LOCK(object);
+
+	rtp_fec_udp_sink = GST_RTP_FEC_UDP_SINK(object);
+
+	switch (prop_id)
+	{
+		case PROP_HOST:
+			g_value_set_string(value, rtp_fec_udp_sink->host);
+			break;
+		case PROP_PORT:
+			g_value_set_uint(value, rtp_fec_udp_sink->port);
+			break;
+		case PROP_FEC_PORT:
+			g_value_set_uint(value, rtp_fec_udp_sink->fec_port);
+			break;
+		case PROP_INTERLEAVE:
+			g_value_set_enum(value, rtp_fec_udp_sink->interleave);
+			break;
+		case PROP_MAX_BATCH_SIZE:
+			g_value_set_uint(value, rtp_fec_udp_sink->max_batch_size);
+			break;
+		case PROP_GSO:
+			g_value_set_boolean(value, rtp_fec_udp_sink->use_gso);
+			break;
+		case PROP_PACKETS_SENT:
+			g_mutex_lock(rtp_fec_udp_sink->mutex);
+			g_value_set_uint64(value, rtp_fec_udp_sink->packets_sent);
+			g_mutex_unlock(rtp_fec_udp_sink->mutex);
+			break;
+		case PROP_SYSCALLS:
+			g_mutex_lock(rtp_fec_udp_sink->mutex);
+			g_value_set_uint64(value, rtp_fec_udp_sink->syscalls);
+			g_mutex_unlock(rtp_fec_udp_sink->mutex);
+			break;
+		case PROP_BLOCKS_SENT:
+			g_mutex_lock(rtp_fec_udp_sink->mutex);
+			g_value_set_uint64(value, rtp_fec_udp_sink->blocks_sent);
+			g_mutex_unlock(rtp_fec_udp_sink->mutex);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+static GstStateChangeReturn gst_rtp_fec_udp_sink_change_state(GstElement *element, GstStateChange transition)
+{
+	GstStateChangeReturn ret;
+	GstRtpFECUdpSink *rtp_fec_udp_sink;
+
+	rtp_fec_udp_sink = GST_RTP_FEC_UDP_SINK(element);
+
+	switch (transition)
+	{
+		case GST_STATE_CHANGE_NULL_TO_READY:
+		{
+			gboolean opened;
+
+			GST_OBJECT_LOCK(rtp_fec_udp_sink);
+			g_mutex_lock(rtp_fec_udp_sink->mutex);
+			opened = gst_rtp_fec_udp_sink_open(rtp_fec_udp_sink);
+			if (!opened)
+				gst_rtp_fec_udp_sink_close(rtp_fec_udp_sink);
+			g_mutex_unlock(rtp_fec_udp_sink->mutex);
+			GST_OBJECT_UNLOCK(rtp_fec_udp_sink);
+
+			if (!opened)
+			{
+				GST_ELEMENT_ERROR(rtp_fec_udp_sink, RESOURCE, OPEN_READ_WRITE, (NULL), ("could not set up UDP socket"));
+				return GST_STATE_CHANGE_FAILURE;
+			}
+
+			break;
+		}
+		case GST_STATE_CHANGE_READY_TO_PAUSED:
+			g_mutex_lock(rtp_fec_udp_sink->mutex);
+			rtp_fec_udp_sink->media_eos = FALSE;
+			rtp_fec_udp_sink->fec_eos = FALSE;
+			g_mutex_unlock(rtp_fec_udp_sink->mutex);
+			break;
+		default:
+			break;
+	}
+
+	ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+	switch (transition)
+	{
+		case GST_STATE_CHANGE_PAUSED_TO_READY:
+			g_mutex_lock(rtp_fec_udp_sink->mutex);
+			gst_rtp_fec_udp_sink_drop_block(rtp_fec_udp_sink);
+			g_mutex_unlock(rtp_fec_udp_sink->mutex);
+			break;
+		case GST_STATE_CHANGE_READY_TO_NULL:
+			g_mutex_lock(rtp_fec_udp_sink->mutex);
+			gst_rtp_fec_udp_sink_close(rtp_fec_udp_sink);
+			g_mutex_unlock(rtp_fec_udp_sink->mutex);
+			break;
+		default:
+			break;
+	}
+
+	return ret;
+}
+
+
+static void gst_rtp_fec_udp_sink_finalize(GObject *object)
+{
+	GstRtpFECUdpSink *rtp_fec_udp_sink = GST_RTP_FEC_UDP_SINK(object);
+	g_mutex_free(rtp_fec_udp_sink->mutex);
+	g_free(rtp_fec_udp_sink->host);
+	GST_DEBUG_OBJECT(rtp_fec_udp_sink, "Cleaned up FEC UDP sink");
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
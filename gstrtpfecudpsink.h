@@ -0,0 +1,106 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+#ifndef GSTRTPFECUDPSINK_H
+#define GSTRTPFECUDPSINK_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <gst/gst.h>
+
+
+G_BEGIN_DECLS
+
+
+typedef struct _GstRtpFECUdpSink GstRtpFECUdpSink;
+typedef struct _GstRtpFECUdpSinkClass GstRtpFECUdpSinkClass;
+
+/* standard type-casting and type-checking boilerplate... */
+#define GST_TYPE_RTP_FEC_UDP_SINK             (gst_rtp_fec_udp_sink_get_type())
+#define GST_RTP_FEC_UDP_SINK(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_RTP_FEC_UDP_SINK, GstRtpFECUdpSink))
+#define GST_RTP_FEC_UDP_SINK_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass), GST_TYPE_RTP_FEC_UDP_SINK, GstRtpFECUdpSinkClass))
+#define GST_IS_RTP_FEC_UDP_SINK(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_RTP_FEC_UDP_SINK))
+#define GST_IS_RTP_FEC_UDP_SINK_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass), GST_TYPE_RTP_FEC_UDP_SINK))
+
+typedef enum
+{
+	GST_RTP_FEC_UDP_SINK_INTERLEAVE_MEDIA_FIRST,
+	GST_RTP_FEC_UDP_SINK_INTERLEAVE_SPREAD
+}
+GstRtpFECUdpSinkInterleave;
+
+struct _GstRtpFECUdpSink
+{
+	GstElement element;
+
+	GstPad
+		*sinkpad,
+		*fecpad;
+
+	/* Destination */
+	gchar *host;
+	guint port, fec_port;
+
+	GstRtpFECUdpSinkInterleave interleave;
+	guint max_batch_size;
+	gboolean use_gso;
+
+	int sock;
+	struct sockaddr_storage media_addr, fec_addr;
+	socklen_t media_addr_len, fec_addr_len;
+
+	/* Packets of the current block, waiting to be sent */
+	GstBuffer **media_packets, **fec_packets;
+	guint num_media_packets, num_fec_packets;
+
+	/* Send state; sized for 2 * max_batch_size packets and allocated in the READY state */
+	GstBuffer **ordered_packets;
+	gboolean *ordered_is_fec;
+	struct iovec *iovecs;
+	struct mmsghdr *messages;
+	gpointer control_buffers;
+
+	gboolean media_eos, fec_eos;
+
+	/* Statistics */
+	guint64 packets_sent, syscalls, blocks_sent;
+
+	/*
+	Mutex used in the chain functions, since media and FEC packets may arrive in
+	different streaming threads
+	*/
+	GMutex *mutex;
+};
+
+struct _GstRtpFECUdpSinkClass
+{
+	GstElementClass parent_class;
+};
+
+GType gst_rtp_fec_udp_sink_get_type(void);
+
+
+G_END_DECLS
+
+
+#endif
+
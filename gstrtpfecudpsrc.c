@@ -0,0 +1,1001 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+/* Needed for recvmmsg() */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include "feccore.h"
+#include "gstrtpfecudpsrc.h"
+
+
+
+/**** Debugging ****/
+
+GST_DEBUG_CATEGORY_STATIC(rtpfecudpsrc_debug);
+#define GST_CAT_DEFAULT rtpfecudpsrc_debug
+
+
+
+/**** Typedefs ****/
+
+
+/* Control message buffer for the UDP_GRO option; the union ensures proper alignment */
+typedef union
+{
+	struct cmsghdr header;
+	char buf[CMSG_SPACE(sizeof(int))];
+}
+gro_control_buffer;
+
+
+
+/**** Constants ****/
+
+
+enum
+{
+	PROP_0 = 0, /* GStreamer disallows properties with id 0 -> using dummy enum to prevent 0 */
+	PROP_ADDRESS,
+	PROP_PORT,
+	PROP_FEC_PORT,
+	PROP_FEC_PAYLOAD_TYPE,
+	PROP_CAPS,
+	PROP_BATCH_SIZE,
+	PROP_GRO,
+	PROP_NUM_MEDIA_PACKETS,
+	PROP_NUM_FEC_PACKETS,
+	PROP_USE_SYMBOL_ARENA,
+	PROP_MAX_PACKET_SIZE,
+	PROP_PACKETS_RECEIVED,
+	PROP_PACKETS_TRUNCATED,
+	PROP_SYSCALLS
+};
+
+
+enum
+{
+	DEFAULT_PORT = 5004,
+	DEFAULT_FEC_PORT = 5006,
+	DEFAULT_FEC_PAYLOAD_TYPE = -1,
+	DEFAULT_BATCH_SIZE = 32,
+	DEFAULT_GRO = FALSE,
+	DEFAULT_NUM_MEDIA_PACKETS = 9,
+	DEFAULT_NUM_FEC_PACKETS = 3,
+	DEFAULT_USE_SYMBOL_ARENA = FALSE,
+	DEFAULT_MAX_PACKET_SIZE = FEC_DEC_DEFAULT_MAX_SYMBOL_SIZE
+};
+
+
+#define DEFAULT_ADDRESS "0.0.0.0"
+#define DEFAULT_CAPS "application/x-rtp"
+
+/* With GRO, one datagram can contain many coalesced packets */
+#define GRO_RECEIVE_BUFFER_SIZE 65535
+
+
+
+/**** Function declarations ****/
+
+/* GstBaseSrc and GstPushSrc vfuncs */
+static gboolean gst_rtp_fec_udp_src_start(GstBaseSrc *basesrc);
+static gboolean gst_rtp_fec_udp_src_stop(GstBaseSrc *basesrc);
+static gboolean gst_rtp_fec_udp_src_unlock(GstBaseSrc *basesrc);
+static gboolean gst_rtp_fec_udp_src_unlock_stop(GstBaseSrc *basesrc);
+static GstCaps* gst_rtp_fec_udp_src_get_caps(GstBaseSrc *basesrc);
+static GstFlowReturn gst_rtp_fec_udp_src_create(GstPushSrc *pushsrc, GstBuffer **buf);
+
+/* Receives one batch of datagrams from the given socket and passes them to the decoder */
+static gboolean gst_rtp_fec_udp_src_receive(GstRtpFECUdpSrc *rtp_fec_udp_src, int const sock, gboolean const is_fec_socket);
+/* Classifies one packet, pushes it to the decoder, and queues it and any recovered packets for output */
+static void gst_rtp_fec_udp_src_handle_packet(GstRtpFECUdpSrc *rtp_fec_udp_src, GstBuffer *packet, gboolean const is_fec_socket);
+
+/* Property accessors */
+static void gst_rtp_fec_udp_src_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec);
+static void gst_rtp_fec_udp_src_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+
+/* Callback for creating buffers for recovered packets */
+static GstBuffer* gst_rtp_fec_udp_src_create_recovered_buffer(guint const size_in_bytes, void *data);
+
+/* Finalizer; cleans up states */
+static void gst_rtp_fec_udp_src_finalize(GObject *object);
+
+
+
+/**** GStreamer boilerplate ****/
+
+GST_BOILERPLATE(GstRtpFECUdpSrc, gst_rtp_fec_udp_src, GstPushSrc, GST_TYPE_PUSH_SRC)
+
+
+
+/**** Pads ****/
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+	"src",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS("application/x-rtp")
+);
+
+
+
+/**** Function definition ****/
+
+static void gst_rtp_fec_udp_src_base_init(gpointer klass)
+{
+	GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+
+	gst_element_class_set_details_simple(
+		element_class,
+		"RTP forward error correction UDP source",
+		"Source/Network/RTP",
+		"Receives RTP media and FEC packets over UDP in batches and recovers lost media packets",
+		"Carlos Rafael Giani <dv@pseudoterminal.org>"
+	);
+
+	gst_element_class_add_pad_template(element_class, gst_static_pad_template_get(&src_template));
+}
+
+
+static void gst_rtp_fec_udp_src_class_init(GstRtpFECUdpSrcClass *klass)
+{
+	GObjectClass *object_class;
+	GstBaseSrcClass *basesrc_class;
+	GstPushSrcClass *pushsrc_class;
+
+	GST_DEBUG_CATEGORY_INIT(rtpfecudpsrc_debug, "rtpfecudpsrc", 0, "RTP FEC UDP source");
+
+	object_class = G_OBJECT_CLASS(klass);
+	basesrc_class = GST_BASE_SRC_CLASS(klass);
+	pushsrc_class = GST_PUSH_SRC_CLASS(klass);
+
+	/* Set functions */
+	object_class->finalize = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_src_finalize);
+	object_class->set_property = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_src_set_property);
+	object_class->get_property = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_src_get_property);
+	basesrc_class->start = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_src_start);
+	basesrc_class->stop = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_src_stop);
+	basesrc_class->unlock = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_src_unlock);
+	basesrc_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_src_unlock_stop);
+	basesrc_class->get_caps = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_src_get_caps);
+	pushsrc_class->create = GST_DEBUG_FUNCPTR(gst_rtp_fec_udp_src_create);
+
+	/* Install properties */
+	g_object_class_install_property(
+		object_class,
+		PROP_ADDRESS,
+		g_param_spec_string(
+			"address",
+			"Address",
+			"Local address to bind the sockets to",
+			DEFAULT_ADDRESS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_PORT,
+		g_param_spec_uint(
+			"port",
+			"Port",
+			"UDP port to receive media packets on",
+		        1, 65535,
+			DEFAULT_PORT,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_FEC_PORT,
+		g_param_spec_uint(
+			"fec-port",
+			"FEC port",
+			"UDP port to receive FEC packets on (0 = FEC packets arrive on the media port and are identified by fec-payload-type)",
+		        0, 65535,
+			DEFAULT_FEC_PORT,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_FEC_PAYLOAD_TYPE,
+		g_param_spec_int(
+			"fec-payload-type",
+			"FEC payload type",
+			"Payload type identifying FEC packets received on the media port (-1 = classify by port only)",
+		        -1, 127,
+			DEFAULT_FEC_PAYLOAD_TYPE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_CAPS,
+		g_param_spec_boxed(
+			"caps",
+			"Caps",
+			"Caps of the outgoing media packets",
+			GST_TYPE_CAPS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_BATCH_SIZE,
+		g_param_spec_uint(
+			"batch-size",
+			"Batch size",
+			"Maximum number of datagrams received with one syscall (takes effect when the element starts)",
+		        1, 1024,
+			DEFAULT_BATCH_SIZE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_GRO,
+		g_param_spec_boolean(
+			"gro",
+			"GRO",
+			"Let the kernel coalesce equally sized datagrams with UDP generic receive offload (takes effect when the element starts)",
+			DEFAULT_GRO,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_NUM_MEDIA_PACKETS,
+		g_param_spec_uint(
+			"num-media-packets",
+			"Number of media packets",
+			"Number of media packets to expect for FEC packet generation",
+		        1, 24,
+			DEFAULT_NUM_MEDIA_PACKETS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_NUM_FEC_PACKETS,
+		g_param_spec_uint(
+			"num-fec-packets",
+			"Number of FEC packets",
+			"Number of forward error correction packets to expect (media and FEC packets together are limited to 255)",
+		        1, FEC_CORE_MAX_SYMBOLS - 1,
+			DEFAULT_NUM_FEC_PACKETS,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_USE_SYMBOL_ARENA,
+		g_param_spec_boolean(
+			"use-symbol-arena",
+			"Use symbol arena",
+			"Copy media packets into a preallocated symbol arena instead of keeping references to them (keeps the packets writable downstream)",
+			DEFAULT_USE_SYMBOL_ARENA,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_MAX_PACKET_SIZE,
+		g_param_spec_uint(
+			"max-packet-size",
+			"Maximum packet size",
+			"Maximum size of received packets in bytes; used for the receive buffers, the symbol arena and the recovered packet buffer pool",
+		        1, 65535,
+			DEFAULT_MAX_PACKET_SIZE,
+			G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_PACKETS_RECEIVED,
+		g_param_spec_uint64(
+			"packets-received",
+			"Packets received",
+			"Number of packets received so far",
+			0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_PACKETS_TRUNCATED,
+		g_param_spec_uint64(
+			"packets-truncated",
+			"Packets truncated",
+			"Number of datagrams dropped because they were larger than max-packet-size",
+			0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+	g_object_class_install_property(
+		object_class,
+		PROP_SYSCALLS,
+		g_param_spec_uint64(
+			"syscalls",
+			"Syscalls",
+			"Number of receive syscalls made so far",
+			0, G_MAXUINT64,
+			0,
+			G_PARAM_READABLE | G_PARAM_STATIC_STRINGS
+		)
+	);
+}
+
+
+static void gst_rtp_fec_udp_src_init(GstRtpFECUdpSrc *rtp_fec_udp_src, GstRtpFECUdpSrcClass *klass)
+{
+	klass = klass;
+
+	/* Like udpsrc, this is a live source which timestamps packets when they arrive */
+	gst_base_src_set_live(GST_BASE_SRC(rtp_fec_udp_src), TRUE);
+	gst_base_src_set_format(GST_BASE_SRC(rtp_fec_udp_src), GST_FORMAT_TIME);
+	gst_base_src_set_do_timestamp(GST_BASE_SRC(rtp_fec_udp_src), TRUE);
+
+	rtp_fec_udp_src->address = g_strdup(DEFAULT_ADDRESS);
+	rtp_fec_udp_src->port = DEFAULT_PORT;
+	rtp_fec_udp_src->fec_port = DEFAULT_FEC_PORT;
+	rtp_fec_udp_src->fec_payload_type = DEFAULT_FEC_PAYLOAD_TYPE;
+	rtp_fec_udp_src->caps = gst_caps_from_string(DEFAULT_CAPS);
+	rtp_fec_udp_src->batch_size = DEFAULT_BATCH_SIZE;
+	rtp_fec_udp_src->buffer_size = DEFAULT_MAX_PACKET_SIZE;
+	rtp_fec_udp_src->use_gro = DEFAULT_GRO;
+
+	rtp_fec_udp_src->pool = NULL;
+	rtp_fec_udp_src->media_sock = -1;
+	rtp_fec_udp_src->fec_sock = -1;
+	rtp_fec_udp_src->media_gro = FALSE;
+	rtp_fec_udp_src->fec_gro = FALSE;
+	rtp_fec_udp_src->poll = NULL;
+	rtp_fec_udp_src->receive_buffers = NULL;
+	rtp_fec_udp_src->iovecs = NULL;
+	rtp_fec_udp_src->messages = NULL;
+	rtp_fec_udp_src->control_buffers = NULL;
+	rtp_fec_udp_src->output_packets = g_queue_new();
+
+	rtp_fec_udp_src->packets_received = 0;
+	rtp_fec_udp_src->packets_truncated = 0;
+	rtp_fec_udp_src->syscalls = 0;
+
+	/* Finally, create the FEC decoder */
+	rtp_fec_udp_src->dec = fec_dec_create(DEFAULT_NUM_MEDIA_PACKETS, DEFAULT_NUM_FEC_PACKETS, gst_rtp_fec_udp_src_create_recovered_buffer, rtp_fec_udp_src);
+}
+
+
+static int gst_rtp_fec_udp_src_bind(GstRtpFECUdpSrc *rtp_fec_udp_src, guint const port, gboolean *gro)
+{
+	struct addrinfo hints, *result;
+	gchar service[16];
+	int ret, sock, reuse;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_PASSIVE;
+	g_snprintf(service, sizeof(service), "%u", port);
+
+	ret = getaddrinfo(rtp_fec_udp_src->address, service, &hints, &result);
+	if (ret != 0)
+	{
+		GST_ERROR_OBJECT(rtp_fec_udp_src, "could not resolve %s: %s", rtp_fec_udp_src->address, gai_strerror(ret));
+		return -1;
+	}
+
+	sock = socket(result->ai_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0)
+	{
+		GST_ERROR_OBJECT(rtp_fec_udp_src, "could not create socket: %s", strerror(errno));
+		freeaddrinfo(result);
+		return -1;
+	}
+
+	reuse = 1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	if (bind(sock, result->ai_addr, result->ai_addrlen) < 0)
+	{
+		GST_ERROR_OBJECT(rtp_fec_udp_src, "could not bind to %s port %u: %s", rtp_fec_udp_src->address, port, strerror(errno));
+		close(sock);
+		freeaddrinfo(result);
+		return -1;
+	}
+
+	freeaddrinfo(result);
+
+	/* GRO is tracked per socket, since the receive buffers must be large enough for coalesced datagrams on exactly those sockets that have it */
+	*gro = FALSE;
+	if (rtp_fec_udp_src->use_gro)
+	{
+#ifdef UDP_GRO
+		int enable = 1;
+		if (setsockopt(sock, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) < 0)
+			GST_WARNING_OBJECT(rtp_fec_udp_src, "could not enable GRO on port %u: %s - receiving without it", port, strerror(errno));
+		else
+			*gro = TRUE;
+#else
+		GST_WARNING_OBJECT(rtp_fec_udp_src, "GRO is not supported on this system - receiving without it");
+#endif
+	}
+
+	return sock;
+}
+
+
+static gboolean gst_rtp_fec_udp_src_start(GstBaseSrc *basesrc)
+{
+	GstRtpFECUdpSrc *rtp_fec_udp_src;
+	gboolean ok = TRUE;
+
+	rtp_fec_udp_src = GST_RTP_FEC_UDP_SRC(basesrc);
+
+	GST_OBJECT_LOCK(rtp_fec_udp_src);
+
+	rtp_fec_udp_src->media_sock = gst_rtp_fec_udp_src_bind(rtp_fec_udp_src, rtp_fec_udp_src->port, &(rtp_fec_udp_src->media_gro));
+	if (rtp_fec_udp_src->media_sock < 0)
+		ok = FALSE;
+	else if (rtp_fec_udp_src->fec_port != 0)
+	{
+		rtp_fec_udp_src->fec_sock = gst_rtp_fec_udp_src_bind(rtp_fec_udp_src, rtp_fec_udp_src->fec_port, &(rtp_fec_udp_src->fec_gro));
+		if (rtp_fec_udp_src->fec_sock < 0)
+			ok = FALSE;
+	}
+
+	if (ok)
+	{
+		rtp_fec_udp_src->poll = gst_poll_new(TRUE);
+
+		gst_poll_fd_init(&(rtp_fec_udp_src->media_pollfd));
+		rtp_fec_udp_src->media_pollfd.fd = rtp_fec_udp_src->media_sock;
+		gst_poll_add_fd(rtp_fec_udp_src->poll, &(rtp_fec_udp_src->media_pollfd));
+		gst_poll_fd_ctl_read(rtp_fec_udp_src->poll, &(rtp_fec_udp_src->media_pollfd), TRUE);
+
+		gst_poll_fd_init(&(rtp_fec_udp_src->fec_pollfd));
+		if (rtp_fec_udp_src->fec_sock >= 0)
+		{
+			rtp_fec_udp_src->fec_pollfd.fd = rtp_fec_udp_src->fec_sock;
+			gst_poll_add_fd(rtp_fec_udp_src->poll, &(rtp_fec_udp_src->fec_pollfd));
+			gst_poll_fd_ctl_read(rtp_fec_udp_src->poll, &(rtp_fec_udp_src->fec_pollfd), TRUE);
+		}
+
+		rtp_fec_udp_src->receive_buffers = g_new0(GstBuffer*, rtp_fec_udp_src->batch_size);
+		rtp_fec_udp_src->iovecs = g_new(struct iovec, rtp_fec_udp_src->batch_size);
+		rtp_fec_udp_src->messages = g_new0(struct mmsghdr, rtp_fec_udp_src->batch_size);
+		rtp_fec_udp_src->control_buffers = g_new0(gro_control_buffer, rtp_fec_udp_src->batch_size);
+
+		/* Preallocate enough recovered packets for two blocks */
+		rtp_fec_udp_src->pool = fec_buffer_pool_create(fec_dec_get_max_symbol_size(rtp_fec_udp_src->dec), fec_dec_get_num_fec_packets(rtp_fec_udp_src->dec) * 2);
+
+		GST_DEBUG_OBJECT(rtp_fec_udp_src, "receiving on %s, port %u (media) and %u (FEC)", rtp_fec_udp_src->address, rtp_fec_udp_src->port, rtp_fec_udp_src->fec_port);
+	}
+
+	GST_OBJECT_UNLOCK(rtp_fec_udp_src);
+
+	if (!ok)
+	{
+		gst_rtp_fec_udp_src_stop(basesrc);
+		GST_ELEMENT_ERROR(rtp_fec_udp_src, RESOURCE, OPEN_READ, (NULL), ("could not set up UDP sockets"));
+	}
+
+	return ok;
+}
+
+
+static gboolean gst_rtp_fec_udp_src_stop(GstBaseSrc *basesrc)
+{
+	GstRtpFECUdpSrc *rtp_fec_udp_src;
+	guint i;
+
+	rtp_fec_udp_src = GST_RTP_FEC_UDP_SRC(basesrc);
+
+	GST_OBJECT_LOCK(rtp_fec_udp_src);
+
+	fec_dec_reset(rtp_fec_udp_src->dec);
+	while (!g_queue_is_empty(rtp_fec_udp_src->output_packets))
+		gst_buffer_unref(g_queue_pop_head(rtp_fec_udp_src->output_packets));
+
+	if (rtp_fec_udp_src->receive_buffers != NULL)
+	{
+		for (i = 0; i < rtp_fec_udp_src->batch_size; ++i)
+		{
+			if (rtp_fec_udp_src->receive_buffers[i] != NULL)
+				gst_buffer_unref(rtp_fec_udp_src->receive_buffers[i]);
+		}
+	}
+
+	g_free(rtp_fec_udp_src->receive_buffers);
+	g_free(rtp_fec_udp_src->iovecs);
+	g_free(rtp_fec_udp_src->messages);
+	g_free(rtp_fec_udp_src->control_buffers);
+	rtp_fec_udp_src->receive_buffers = NULL;
+	rtp_fec_udp_src->iovecs = NULL;
+	rtp_fec_udp_src->messages = NULL;
+	rtp_fec_udp_src->control_buffers = NULL;
+
+	if (rtp_fec_udp_src->poll != NULL)
+		gst_poll_free(rtp_fec_udp_src->poll);
+	rtp_fec_udp_src->poll = NULL;
+
+	if (rtp_fec_udp_src->media_sock >= 0)
+		close(rtp_fec_udp_src->media_sock);
+	if (rtp_fec_udp_src->fec_sock >= 0)
+		close(rtp_fec_udp_src->fec_sock);
+	rtp_fec_udp_src->media_sock = -1;
+	rtp_fec_udp_src->fec_sock = -1;
+	rtp_fec_udp_src->media_gro = FALSE;
+	rtp_fec_udp_src->fec_gro = FALSE;
+
+	if (rtp_fec_udp_src->pool != NULL)
+		fec_buffer_pool_destroy(rtp_fec_udp_src->pool);
+	rtp_fec_udp_src->pool = NULL;
+
+	GST_OBJECT_UNLOCK(rtp_fec_udp_src);
+
+	return TRUE;
+}
+
+
+static gboolean gst_rtp_fec_udp_src_unlock(GstBaseSrc *basesrc)
+{
+	GstRtpFECUdpSrc *rtp_fec_udp_src = GST_RTP_FEC_UDP_SRC(basesrc);
+	gst_poll_set_flushing(rtp_fec_udp_src->poll, TRUE);
+	return TRUE;
+}
+
+
+static gboolean gst_rtp_fec_udp_src_unlock_stop(GstBaseSrc *basesrc)
+{
+	GstRtpFECUdpSrc *rtp_fec_udp_src = GST_RTP_FEC_UDP_SRC(basesrc);
+	gst_poll_set_flushing(rtp_fec_udp_src->poll, FALSE);
+	return TRUE;
+}
+
+
+static GstCaps* gst_rtp_fec_udp_src_get_caps(GstBaseSrc *basesrc)
+{
+	GstRtpFECUdpSrc *rtp_fec_udp_src;
+	GstCaps *caps;
+
+	rtp_fec_udp_src = GST_RTP_FEC_UDP_SRC(basesrc);
+
+	GST_OBJECT_LOCK(rtp_fec_udp_src);
+	caps = (rtp_fec_udp_src->caps != NULL) ? gst_caps_ref(rtp_fec_udp_src->caps) : gst_caps_new_any();
+	GST_OBJECT_UNLOCK(rtp_fec_udp_src);
+
+	return caps;
+}
+
+
+static GstFlowReturn gst_rtp_fec_udp_src_create(GstPushSrc *pushsrc, GstBuffer **buf)
+{
+	GstRtpFECUdpSrc *rtp_fec_udp_src;
+
+	rtp_fec_udp_src = GST_RTP_FEC_UDP_SRC(pushsrc);
+
+	/*
+	One recvmmsg() call can yield many packets (plus recovered ones), so they are queued
+	and handed out one at a time; the sockets are only read again once the queue is empty
+	*/
+	while (g_queue_is_empty(rtp_fec_udp_src->output_packets))
+	{
+		gint ret;
+
+		ret = gst_poll_wait(rtp_fec_udp_src->poll, GST_CLOCK_TIME_NONE);
+		if (ret < 0)
+		{
+			if (errno == EBUSY)
+			{
+				GST_DEBUG_OBJECT(rtp_fec_udp_src, "poll is flushing");
+				return GST_FLOW_WRONG_STATE;
+			}
+			if ((errno == EINTR) || (errno == EAGAIN))
+				continue;
+
+			GST_ELEMENT_ERROR(rtp_fec_udp_src, RESOURCE, READ, (NULL), ("poll failed: %s", strerror(errno)));
+			return GST_FLOW_ERROR;
+		}
+
+		if (gst_poll_fd_can_read(rtp_fec_udp_src->poll, &(rtp_fec_udp_src->media_pollfd)))
+		{
+			if (!gst_rtp_fec_udp_src_receive(rtp_fec_udp_src, rtp_fec_udp_src->media_sock, FALSE))
+				return GST_FLOW_ERROR;
+		}
+
+		if ((rtp_fec_udp_src->fec_sock >= 0) && gst_poll_fd_can_read(rtp_fec_udp_src->poll, &(rtp_fec_udp_src->fec_pollfd)))
+		{
+			if (!gst_rtp_fec_udp_src_receive(rtp_fec_udp_src, rtp_fec_udp_src->fec_sock, TRUE))
+				return GST_FLOW_ERROR;
+		}
+	}
+
+	*buf = g_queue_pop_head(rtp_fec_udp_src->output_packets);
+
+	return GST_FLOW_OK;
+}
+
+
+static gboolean gst_rtp_fec_udp_src_receive(GstRtpFECUdpSrc *rtp_fec_udp_src, int const sock, gboolean const is_fec_socket)
+{
+	guint i, receive_size;
+	int num_messages;
+	gboolean use_gro, copy_packets;
+	gro_control_buffer *control_buffers = rtp_fec_udp_src->control_buffers;
+
+	use_gro = is_fec_socket ? rtp_fec_udp_src->fec_gro : rtp_fec_udp_src->media_gro;
+	receive_size = use_gro ? GRO_RECEIVE_BUFFER_SIZE : rtp_fec_udp_src->buffer_size;
+
+	/*
+	Without the symbol arena, the decoder keeps references to the media packets until their block is
+	done; sub-buffers of a coalesced datagram would keep the whole 64 kB buffer alive for that long.
+	The packets are copied out then, and the datagram buffer stays in its slot for the next batch.
+	*/
+	copy_packets = use_gro && !fec_dec_get_use_symbol_arena(rtp_fec_udp_src->dec);
+
+	/* Refill the slots consumed by the previous batch; the other ones are reused */
+	for (i = 0; i < rtp_fec_udp_src->batch_size; ++i)
+	{
+		struct msghdr *msg;
+
+		/* The slots are shared by both sockets, and only one of them may have GRO */
+		if ((rtp_fec_udp_src->receive_buffers[i] != NULL) && (GST_BUFFER_SIZE(rtp_fec_udp_src->receive_buffers[i]) < receive_size))
+		{
+			gst_buffer_unref(rtp_fec_udp_src->receive_buffers[i]);
+			rtp_fec_udp_src->receive_buffers[i] = NULL;
+		}
+
+		if (rtp_fec_udp_src->receive_buffers[i] == NULL)
+			rtp_fec_udp_src->receive_buffers[i] = gst_buffer_new_and_alloc(receive_size);
+
+		rtp_fec_udp_src->iovecs[i].iov_base = GST_BUFFER_DATA(rtp_fec_udp_src->receive_buffers[i]);
+		rtp_fec_udp_src->iovecs[i].iov_len = GST_BUFFER_SIZE(rtp_fec_udp_src->receive_buffers[i]);
+
+		msg = &(rtp_fec_udp_src->messages[i].msg_hdr);
+		memset(msg, 0, sizeof(struct msghdr));
+		msg->msg_iov = &(rtp_fec_udp_src->iovecs[i]);
+		msg->msg_iovlen = 1;
+		if (use_gro)
+		{
+			msg->msg_control = control_buffers[i].buf;
+			msg->msg_controllen = sizeof(control_buffers[i].buf);
+		}
+	}
+
+	num_messages = recvmmsg(sock, rtp_fec_udp_src->messages, rtp_fec_udp_src->batch_size, MSG_DONTWAIT, NULL);
+	++rtp_fec_udp_src->syscalls;
+
+	if (num_messages < 0)
+	{
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+			return TRUE;
+
+		/* ICMP port unreachable errors from earlier sends show up here; they are not fatal */
+		if (errno == ECONNREFUSED)
+			return TRUE;
+
+		GST_ELEMENT_ERROR(rtp_fec_udp_src, RESOURCE, READ, (NULL), ("recvmmsg failed: %s", strerror(errno)));
+		return FALSE;
+	}
+
+	GST_LOG_OBJECT(rtp_fec_udp_src, "received %d datagrams from the %s socket", num_messages, is_fec_socket ? "FEC" : "media");
+
+	GST_OBJECT_LOCK(rtp_fec_udp_src);
+
+	for (i = 0; i < (guint)num_messages; ++i)
+	{
+		GstBuffer *datagram;
+		guint length, segment_size;
+		struct msghdr *msg = &(rtp_fec_udp_src->messages[i].msg_hdr);
+
+		/* The rest of a datagram larger than the receive buffer is lost; a cut-off RTP packet is of no use */
+		if (msg->msg_flags & MSG_TRUNC)
+		{
+			GST_DEBUG_OBJECT(rtp_fec_udp_src, "dropping datagram larger than %u bytes", receive_size);
+			++rtp_fec_udp_src->packets_truncated;
+			continue;
+		}
+
+		datagram = rtp_fec_udp_src->receive_buffers[i];
+		length = rtp_fec_udp_src->messages[i].msg_len;
+		segment_size = length;
+
+#ifdef UDP_GRO
+		if (use_gro)
+		{
+			struct cmsghdr *cmsg;
+
+			for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg))
+			{
+				if ((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO))
+				{
+					int gro_size;
+					memcpy(&gro_size, CMSG_DATA(cmsg), sizeof(int));
+					if (gro_size > 0)
+						segment_size = gro_size;
+				}
+			}
+		}
+#endif
+
+		if (copy_packets)
+		{
+			/* The datagram buffer is not handed out, so it stays in its slot */
+			guint offset;
+
+			for (offset = 0; offset < length; offset += segment_size)
+			{
+				guint packet_size = MIN(segment_size, length - offset);
+				GstBuffer *packet = gst_buffer_new_and_alloc(packet_size);
+				memcpy(GST_BUFFER_DATA(packet), GST_BUFFER_DATA(datagram) + offset, packet_size);
+				gst_rtp_fec_udp_src_handle_packet(rtp_fec_udp_src, packet, is_fec_socket);
+			}
+		}
+		else if (segment_size >= length)
+		{
+			rtp_fec_udp_src->receive_buffers[i] = NULL;
+			GST_BUFFER_SIZE(datagram) = length;
+			gst_rtp_fec_udp_src_handle_packet(rtp_fec_udp_src, datagram, is_fec_socket);
+		}
+		else
+		{
+			/* The kernel coalesced several packets; split them again without copying */
+			guint offset;
+
+			rtp_fec_udp_src->receive_buffers[i] = NULL;
+			for (offset = 0; offset < length; offset += segment_size)
+			{
+				guint packet_size = MIN(segment_size, length - offset);
+				gst_rtp_fec_udp_src_handle_packet(rtp_fec_udp_src, gst_buffer_create_sub(datagram, offset, packet_size), is_fec_socket);
+			}
+
+			gst_buffer_unref(datagram);
+		}
+	}
+
+	GST_OBJECT_UNLOCK(rtp_fec_udp_src);
+
+	return TRUE;
+}
+
+
+static void gst_rtp_fec_udp_src_handle_packet(GstRtpFECUdpSrc *rtp_fec_udp_src, GstBuffer *packet, gboolean const is_fec_socket)
+{
+	gboolean is_fec;
+
+	++rtp_fec_udp_src->packets_received;
+
+	if (!gst_rtp_buffer_validate(packet))
+	{
+		GST_DEBUG_OBJECT(rtp_fec_udp_src, "dropping invalid RTP packet with %u bytes", GST_BUFFER_SIZE(packet));
+		gst_buffer_unref(packet);
+		return;
+	}
+
+	is_fec = is_fec_socket || ((rtp_fec_udp_src->fec_payload_type >= 0) && (gst_rtp_buffer_get_payload_type(packet) == rtp_fec_udp_src->fec_payload_type));
+
+	if (is_fec)
+	{
+		/* fec_dec_push_fec_packet() refs the packet, and nobody else needs it */
+		fec_dec_push_fec_packet(rtp_fec_udp_src->dec, packet);
+		gst_buffer_unref(packet);
+	}
+	else
+	{
+		/* Set the caps now, since the decoder may hold a reference to the packet afterwards */
+		gst_buffer_set_caps(packet, GST_PAD_CAPS(GST_BASE_SRC_PAD(rtp_fec_udp_src)));
+		fec_dec_push_media_packet(rtp_fec_udp_src->dec, packet);
+		g_queue_push_tail(rtp_fec_udp_src->output_packets, packet);
+	}
+
+	while (fec_dec_has_recovered_packets(rtp_fec_udp_src->dec))
+	{
+		GstBuffer *recovered_packet = fec_dec_pop_recovered_packet(rtp_fec_udp_src->dec);
+		GST_DEBUG_OBJECT(rtp_fec_udp_src, "queuing recovered RTP media packet, seqnum %u", gst_rtp_buffer_get_seq(recovered_packet));
+		g_queue_push_tail(rtp_fec_udp_src->output_packets, recovered_packet);
+	}
+}
+
+
+static void gst_rtp_fec_udp_src_set_property(GObject *object, guint prop_id, GValue const *value, GParamSpec *pspec)
+{
+	GstRtpFECUdpSrc *rtp_fec_udp_src;
+
+	GST_OBJECT_LOCK(object);
+
+	rtp_fec_udp_src = GST_RTP_FEC_UDP_SRC(object);
+
+	switch (prop_id)
+	{
+		case PROP_ADDRESS:
+			g_free(rtp_fec_udp_src->address);
+			rtp_fec_udp_src->address = g_strdup(g_value_get_string(value));
+			break;
+		case PROP_PORT:
+			rtp_fec_udp_src->port = g_value_get_uint(value);
+			break;
+		case PROP_FEC_PORT:
+			rtp_fec_udp_src->fec_port = g_value_get_uint(value);
+			break;
+		case PROP_FEC_PAYLOAD_TYPE:
+			rtp_fec_udp_src->fec_payload_type = g_value_get_int(value);
+			break;
+		case PROP_CAPS:
+		{
+			GstCaps const *caps = gst_value_get_caps(value);
+			if (rtp_fec_udp_src->caps != NULL)
+				gst_caps_unref(rtp_fec_udp_src->caps);
+			rtp_fec_udp_src->caps = (caps != NULL) ? gst_caps_copy(caps) : NULL;
+			break;
+		}
+		case PROP_BATCH_SIZE:
+			/* The receive arrays are sized in start(), so the batch size cannot change while running */
+			if (rtp_fec_udp_src->receive_buffers == NULL)
+				rtp_fec_udp_src->batch_size = g_value_get_uint(value);
+			else
+				GST_WARNING_OBJECT(rtp_fec_udp_src, "cannot change the batch size while running");
+			break;
+		case PROP_GRO:
+			rtp_fec_udp_src->use_gro = g_value_get_boolean(value);
+			break;
+		case PROP_NUM_MEDIA_PACKETS:
+		{
+			guint num_media_packets = g_value_get_uint(value);
+			fec_dec_set_num_media_packets(rtp_fec_udp_src->dec, num_media_packets);
+			if ((num_media_packets + fec_dec_get_num_fec_packets(rtp_fec_udp_src->dec)) > FEC_CORE_MAX_SYMBOLS)
+			{
+				GST_WARNING_OBJECT(rtp_fec_udp_src, "%u media and %u FEC packets exceed the maximum of %d symbols per block - limiting FEC packets to %u", num_media_packets, fec_dec_get_num_fec_packets(rtp_fec_udp_src->dec), FEC_CORE_MAX_SYMBOLS, FEC_CORE_MAX_SYMBOLS - num_media_packets);
+				fec_dec_set_num_fec_packets(rtp_fec_udp_src->dec, FEC_CORE_MAX_SYMBOLS - num_media_packets);
+			}
+			break;
+		}
+		case PROP_NUM_FEC_PACKETS:
+		{
+			guint num_fec_packets = g_value_get_uint(value);
+			guint num_media_packets = fec_dec_get_num_media_packets(rtp_fec_udp_src->dec);
+			if ((num_media_packets + num_fec_packets) > FEC_CORE_MAX_SYMBOLS)
+			{
+				GST_WARNING_OBJECT(rtp_fec_udp_src, "%u media and %u FEC packets exceed the maximum of %d symbols per block - limiting FEC packets to %u", num_media_packets, num_fec_packets, FEC_CORE_MAX_SYMBOLS, FEC_CORE_MAX_SYMBOLS - num_media_packets);
+				num_fec_packets = FEC_CORE_MAX_SYMBOLS - num_media_packets;
+			}
+			fec_dec_set_num_fec_packets(rtp_fec_udp_src->dec, num_fec_packets);
+			break;
+		}
+		case PROP_USE_SYMBOL_ARENA:
+			fec_dec_set_use_symbol_arena(rtp_fec_udp_src->dec, g_value_get_boolean(value));
+			break;
+		case PROP_MAX_PACKET_SIZE:
+			rtp_fec_udp_src->buffer_size = g_value_get_uint(value);
+			fec_dec_set_max_symbol_size(rtp_fec_udp_src->dec, rtp_fec_udp_src->buffer_size);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+static void gst_rtp_fec_udp_src_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+	GstRtpFECUdpSrc *rtp_fec_udp_src;
+
+	GST_OBJECT_LOCK(object);
+
+	rtp_fec_udp_src = GST_RTP_FEC_UDP_SRC(object);
+
+	switch (prop_id)
+	{
+		case PROP_ADDRESS:
+			g_value_set_string(value, rtp_fec_udp_src->address);
+			break;
+		case PROP_PORT:
+			g_value_set_uint(value, rtp_fec_udp_src->port);
+			break;
+		case PROP_FEC_PORT:
+			g_value_set_uint(value, rtp_fec_udp_src->fec_port);
+			break;
+		case PROP_FEC_PAYLOAD_TYPE:
+			g_value_set_int(value, rtp_fec_udp_src->fec_payload_type);
+			break;
+		case PROP_CAPS:
+			gst_value_set_caps(value, rtp_fec_udp_src->caps);
+			break;
+		case PROP_BATCH_SIZE:
+			g_value_set_uint(value, rtp_fec_udp_src->batch_size);
+			break;
+		case PROP_GRO:
+			g_value_set_boolean(value, rtp_fec_udp_src->use_gro);
+			break;
+		case PROP_NUM_MEDIA_PACKETS:
+			g_value_set_uint(value, fec_dec_get_num_media_packets(rtp_fec_udp_src->dec));
+			break;
+		case PROP_NUM_FEC_PACKETS:
+			g_value_set_uint(value, fec_dec_get_num_fec_packets(rtp_fec_udp_src->dec));
+			break;
+		case PROP_USE_SYMBOL_ARENA:
+			g_value_set_boolean(value, fec_dec_get_use_symbol_arena(rtp_fec_udp_src->dec));
+			break;
+		case PROP_MAX_PACKET_SIZE:
+			g_value_set_uint(value, fec_dec_get_max_symbol_size(rtp_fec_udp_src->dec));
+			break;
+		case PROP_PACKETS_RECEIVED:
+			g_value_set_uint64(value, rtp_fec_udp_src->packets_received);
+			break;
+		case PROP_PACKETS_TRUNCATED:
+			g_value_set_uint64(value, rtp_fec_udp_src->packets_truncated);
+			break;
+		case PROP_SYSCALLS:
+			g_value_set_uint64(value, rtp_fec_udp_src->syscalls);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+static GstBuffer* gst_rtp_fec_udp_src_create_recovered_buffer(guint const size_in_bytes, void *data)
+{
+	GstRtpFECUdpSrc *rtp_fec_udp_src;
+	GstBuffer *buffer = NULL;
+
+	rtp_fec_udp_src = (GstRtpFECUdpSrc*)data;
+
+	if (rtp_fec_udp_src->pool != NULL)
+		buffer = fec_buffer_pool_acquire(rtp_fec_udp_src->pool, size_in_bytes);
+
+	if (buffer == NULL)
+	{
+		buffer = gst_buffer_new_and_alloc(size_in_bytes);
+		GST_DEBUG_OBJECT(rtp_fec_udp_src, "Created new buffer with %u bytes for recovered packet using gst_buffer_new_and_alloc()", size_in_bytes);
+	}
+
+	gst_buffer_set_caps(buffer, GST_PAD_CAPS(GST_BASE_SRC_PAD(rtp_fec_udp_src)));
+
+	return buffer;
+}
+
+
+static void gst_rtp_fec_udp_src_finalize(GObject *object)
+{
+	GstRtpFECUdpSrc *rtp_fec_udp_src = GST_RTP_FEC_UDP_SRC(object);
+	fec_dec_destroy(rtp_fec_udp_src->dec);
+	g_queue_free(rtp_fec_udp_src->output_packets);
+	if (rtp_fec_udp_src->caps != NULL)
+		gst_caps_unref(rtp_fec_udp_src->caps);
+	g_free(rtp_fec_udp_src->address);
+	GST_DEBUG_OBJECT(rtp_fec_udp_src, "Cleaned up FEC UDP source");
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
@@ -0,0 +1,100 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+#ifndef GSTRTPFECUDPSRC_H
+#define GSTRTPFECUDPSRC_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+#include "fecdec.h"
+#include "fecbufferpool.h"
+
+
+G_BEGIN_DECLS
+
+
+typedef struct _GstRtpFECUdpSrc GstRtpFECUdpSrc;
+typedef struct _GstRtpFECUdpSrcClass GstRtpFECUdpSrcClass;
+
+/* standard type-casting and type-checking boilerplate... */
+#define GST_TYPE_RTP_FEC_UDP_SRC             (gst_rtp_fec_udp_src_get_type())
+#define GST_RTP_FEC_UDP_SRC(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_RTP_FEC_UDP_SRC, GstRtpFECUdpSrc))
+#define GST_RTP_FEC_UDP_SRC_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass), GST_TYPE_RTP_FEC_UDP_SRC, GstRtpFECUdpSrcClass))
+#define GST_IS_RTP_FEC_UDP_SRC(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_RTP_FEC_UDP_SRC))
+#define GST_IS_RTP_FEC_UDP_SRC_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass), GST_TYPE_RTP_FEC_UDP_SRC))
+#define GST_RTP_FEC_UDP_SRC_CAST(obj)        ((GstRtpFECUdpSrc*)(obj))
+
+struct _GstRtpFECUdpSrc
+{
+	GstPushSrc parent;
+
+	/* Receive addresses; a fec_port of 0 means FEC packets arrive on the media port */
+	gchar *address;
+	guint port, fec_port;
+	/* FEC payload type used for classifying packets received on the media port; -1 disables it */
+	gint fec_payload_type;
+	GstCaps *caps;
+
+	guint batch_size;
+	guint buffer_size;
+	gboolean use_gro;
+
+	/* Actual FEC decoder; only accessed from the streaming thread once running */
+	fec_dec *dec;
+	/* Pool for recovered packets; exists between the READY and NULL states */
+	fec_buffer_pool *pool;
+
+	int media_sock, fec_sock;
+	/* Whether UDP_GRO could actually be enabled on each socket */
+	gboolean media_gro, fec_gro;
+	GstPoll *poll;
+	GstPollFD media_pollfd, fec_pollfd;
+
+	/* recvmmsg() state; one preallocated buffer per message */
+	GstBuffer **receive_buffers;
+	struct iovec *iovecs;
+	struct mmsghdr *messages;
+	gpointer control_buffers;
+
+	/* Media and recovered packets waiting to be pushed downstream */
+	GQueue *output_packets;
+
+	/* Statistics */
+	guint64 packets_received, packets_truncated, syscalls;
+};
+
+struct _GstRtpFECUdpSrcClass
+{
+	GstPushSrcClass parent_class;
+};
+
+GType gst_rtp_fec_udp_src_get_type(void);
+
+
+G_END_DECLS
+
+
+#endif
+
+
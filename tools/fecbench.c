@@ -0,0 +1,420 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+/*
+fecbench: microbenchmark for the FEC encoder and decoder
+
+Runs fec_enc and fec_dec over a matrix of block geometries (number of media packets k and FEC packets n),
+packet sizes and loss counts per block, with synthetic RTP packets. For every combination, one line of
+CSV (or one JSON object) is printed with the encode and decode throughput and the percentiles of the
+time spent per block. Packet creation and result verification are not timed.
+
+The lost packets of a block are chosen at random (with a fixed seed, so runs are comparable); the
+remaining media packets are pushed to the decoder first, followed by the FEC packets. Recovered
+packets are compared against the originals, and mismatches are counted.
+
+Example:
+
+  fecbench -k 8,16,24 -n 2,4 -s 188,1316 -l 0,1,2 -b 2000 --format=json
+*/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include "fecenc.h"
+#include "fecdec.h"
+#include "fecstats.h"
+#include "fectoolutil.h"
+
+
+#define FECBENCH_MEDIA_PAYLOAD_TYPE 96
+#define FECBENCH_FEC_PAYLOAD_TYPE 100
+#define FECBENCH_SSRC 0x12345678
+
+
+typedef struct
+{
+	guint num_media_packets;
+	guint num_fec_packets;
+	guint packet_size;
+	guint num_lost_packets;
+}
+fecbench_config;
+
+
+typedef struct
+{
+	fec_tool_timings enc_timings, dec_timings;
+	guint64 packets_recovered;
+	guint64 blocks_unrecoverable;
+	guint64 mismatches;
+}
+fecbench_result;
+
+
+static gchar *media_packets_list = "4,8,16,24";
+static gchar *fec_packets_list = "1,2,4";
+static gchar *packet_sizes_list = "188,512,1316";
+static gchar *losses_list = "0,1,2";
+static gint num_blocks = 1000;
+static gint num_warmup_blocks = 16;
+static gint seed = 1;
+static gboolean use_symbol_arena = FALSE;
+static gchar *output_format = "csv";
+
+
+static GOptionEntry entries[] =
+{
+	{ "media-packets", 'k', 0, G_OPTION_ARG_STRING, &media_packets_list, "Comma-separated list of media packets per block (1-24)", "LIST" },
+	{ "fec-packets", 'n', 0, G_OPTION_ARG_STRING, &fec_packets_list, "Comma-separated list of FEC packets per block", "LIST" },
+	{ "packet-sizes", 's', 0, G_OPTION_ARG_STRING, &packet_sizes_list, "Comma-separated list of media packet sizes in bytes, including the RTP header", "LIST" },
+	{ "losses", 'l', 0, G_OPTION_ARG_STRING, &losses_list, "Comma-separated list of media packets lost per block", "LIST" },
+	{ "blocks", 'b', 0, G_OPTION_ARG_INT, &num_blocks, "Number of timed blocks per combination", "N" },
+	{ "warmup", 'w', 0, G_OPTION_ARG_INT, &num_warmup_blocks, "Number of untimed blocks before the timed ones", "N" },
+	{ "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Seed for packet contents and loss positions", "N" },
+	{ "arena", 'a', 0, G_OPTION_ARG_NONE, &use_symbol_arena, "Let the decoder copy media packets into its symbol arena", NULL },
+	{ "format", 'f', 0, G_OPTION_ARG_STRING, &output_format, "Output format: csv or json", "FORMAT" },
+	{ NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+};
+
+
+
+static void fecbench_create_block(fecbench_config const *config, GRand *rand, guint16 const snbase, GstBuffer **media_packets)
+{
+	guint i, j;
+
+	for (i = 0; i < config->num_media_packets; ++i)
+	{
+		GstBuffer *packet;
+		guint8 *payload;
+		guint payload_size;
+
+		payload_size = config->packet_size - 12;
+		packet = gst_rtp_buffer_new_allocate(payload_size, 0, 0);
+		gst_rtp_buffer_set_ssrc(packet, FECBENCH_SSRC);
+		gst_rtp_buffer_set_seq(packet, (snbase + i) & 0xffff);
+		gst_rtp_buffer_set_timestamp(packet, ((guint32)snbase) * 90);
+		gst_rtp_buffer_set_payload_type(packet, FECBENCH_MEDIA_PAYLOAD_TYPE);
+
+		payload = gst_rtp_buffer_get_payload(packet);
+		for (j = 0; j < payload_size; ++j)
+			payload[j] = g_rand_int(rand) & 0xff;
+
+		media_packets[i] = packet;
+	}
+}
+
+
+/* Picks num_lost_packets distinct positions in [0, num_media_packets) */
+static guint32 fecbench_pick_losses(fecbench_config const *config, GRand *rand)
+{
+	guint32 lost_mask = 0;
+	guint i;
+
+	for (i = 0; i < config->num_lost_packets; ++i)
+	{
+		guint position;
+		do
+		{
+			position = g_rand_int_range(rand, 0, config->num_media_packets);
+		}
+		while (lost_mask & (1ul << position));
+		lost_mask |= (1ul << position);
+	}
+
+	return lost_mask;
+}
+
+
+static void fecbench_run(fecbench_config const *config, fecbench_result *result)
+{
+	fec_enc *enc;
+	fec_dec *dec;
+	fec_dec_stats dec_stats;
+	GRand *rand;
+	GstBuffer **media_packets, **fec_packets;
+	guint block, i, num_fec_packets;
+	guint16 snbase;
+
+	enc = fec_enc_create(config->num_media_packets, config->num_fec_packets, FECBENCH_FEC_PAYLOAD_TYPE, 0, fec_tool_create_buffer, NULL);
+	dec = fec_dec_create(config->num_media_packets, config->num_fec_packets, fec_tool_create_buffer, NULL);
+	fec_dec_set_use_symbol_arena(dec, use_symbol_arena);
+	fec_dec_stats_reset(&dec_stats);
+
+	rand = g_rand_new_with_seed(seed);
+	media_packets = malloc(sizeof(GstBuffer*) * config->num_media_packets);
+	fec_packets = malloc(sizeof(GstBuffer*) * config->num_fec_packets);
+
+	memset(result, 0, sizeof(fecbench_result));
+	fec_tool_timings_init(&(result->enc_timings), num_blocks);
+	fec_tool_timings_init(&(result->dec_timings), num_blocks);
+
+	snbase = g_rand_int(rand) & 0xffff;
+
+	for (block = 0; block < (guint)(num_warmup_blocks + num_blocks); ++block)
+	{
+		GstClockTime start_time, end_time;
+		GstBuffer *packet;
+		guint32 lost_mask;
+		gboolean timed = (block >= (guint)num_warmup_blocks);
+
+		/* Statistics only cover the timed blocks */
+		if (block == (guint)num_warmup_blocks)
+			fec_dec_set_stats(dec, &dec_stats);
+
+		fecbench_create_block(config, rand, snbase, media_packets);
+		lost_mask = fecbench_pick_losses(config, rand);
+
+		/* Encoding */
+
+		start_time = gst_util_get_timestamp();
+		for (i = 0; i < config->num_media_packets; ++i)
+			fec_enc_push_media_packet(enc, media_packets[i]);
+		for (num_fec_packets = 0; (num_fec_packets < config->num_fec_packets) && ((packet = fec_enc_pop_fec_packet(enc)) != NULL); ++num_fec_packets)
+			fec_packets[num_fec_packets] = packet;
+		end_time = gst_util_get_timestamp();
+
+		if (timed)
+			fec_tool_timings_add(&(result->enc_timings), end_time - start_time);
+
+		/* Decoding */
+
+		start_time = gst_util_get_timestamp();
+		for (i = 0; i < config->num_media_packets; ++i)
+		{
+			if ((lost_mask & (1ul << i)) == 0)
+				fec_dec_push_media_packet(dec, media_packets[i]);
+		}
+		for (i = 0; i < num_fec_packets; ++i)
+			fec_dec_push_fec_packet(dec, fec_packets[i]);
+		end_time = gst_util_get_timestamp();
+
+		if (timed)
+			fec_tool_timings_add(&(result->dec_timings), end_time - start_time);
+
+		/* Verification */
+
+		while ((packet = fec_dec_pop_recovered_packet(dec)) != NULL)
+		{
+			guint index = (gst_rtp_buffer_get_seq(packet) - snbase) & 0xffff;
+
+			if ((index >= config->num_media_packets) || (GST_BUFFER_SIZE(packet) < GST_BUFFER_SIZE(media_packets[index])) || (memcmp(GST_BUFFER_DATA(packet), GST_BUFFER_DATA(media_packets[index]), GST_BUFFER_SIZE(media_packets[index])) != 0))
+			{
+				if (timed)
+					++result->mismatches;
+			}
+
+			gst_buffer_unref(packet);
+		}
+
+		for (i = 0; i < config->num_media_packets; ++i)
+			gst_buffer_unref(media_packets[i]);
+		for (i = 0; i < num_fec_packets; ++i)
+			gst_buffer_unref(fec_packets[i]);
+
+		snbase = (snbase + config->num_media_packets) & 0xffff;
+	}
+
+	result->packets_recovered = dec_stats.packets_recovered;
+	result->blocks_unrecoverable = dec_stats.blocks_unrecoverable;
+
+	free(fec_packets);
+	free(media_packets);
+	g_rand_free(rand);
+	fec_dec_destroy(dec);
+	fec_enc_destroy(enc);
+}
+
+
+static void fecbench_get_throughput(fecbench_config const *config, fec_tool_timings *timings, gdouble *megabytes_per_second, gdouble *packets_per_second)
+{
+	gdouble seconds = ((gdouble)(timings->total_duration)) / GST_SECOND;
+	gdouble num_packets = ((gdouble)(timings->num_durations)) * config->num_media_packets;
+
+	if (seconds <= 0.0)
+	{
+		*megabytes_per_second = 0.0;
+		*packets_per_second = 0.0;
+		return;
+	}
+
+	*megabytes_per_second = num_packets * config->packet_size / seconds / 1000000.0;
+	*packets_per_second = num_packets / seconds;
+}
+
+
+static void fecbench_print_header(void)
+{
+	if (g_strcmp0(output_format, "csv") != 0)
+		return;
+
+	printf(
+		"k,n,packet_size,losses,blocks,"
+		"enc_mb_per_s,enc_packets_per_s,enc_p50_us,enc_p90_us,enc_p99_us,enc_max_us,"
+		"dec_mb_per_s,dec_packets_per_s,dec_p50_us,dec_p90_us,dec_p99_us,dec_max_us,"
+		"packets_recovered,blocks_unrecoverable,mismatches\n"
+	);
+}
+
+
+static void fecbench_print_result(fecbench_config const *config, fecbench_result *result)
+{
+	gdouble enc_mbps, enc_pps, dec_mbps, dec_pps;
+	fec_tool_timings *et = &(result->enc_timings), *dt = &(result->dec_timings);
+
+	fecbench_get_throughput(config, et, &enc_mbps, &enc_pps);
+	fecbench_get_throughput(config, dt, &dec_mbps, &dec_pps);
+
+#define US(t) (((gdouble)(t)) / GST_USECOND)
+
+	if (g_strcmp0(output_format, "csv") == 0)
+	{
+		printf(
+			"%u,%u,%u,%u,%u,"
+			"%.3f,%.1f,%.3f,%.3f,%.3f,%.3f,"
+			"%.3f,%.1f,%.3f,%.3f,%.3f,%.3f,"
+			"%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT "\n",
+			config->num_media_packets, config->num_fec_packets, config->packet_size, config->num_lost_packets, et->num_durations,
+			enc_mbps, enc_pps, US(fec_tool_timings_get_percentile(et, 50)), US(fec_tool_timings_get_percentile(et, 90)), US(fec_tool_timings_get_percentile(et, 99)), US(fec_tool_timings_get_percentile(et, 100)),
+			dec_mbps, dec_pps, US(fec_tool_timings_get_percentile(dt, 50)), US(fec_tool_timings_get_percentile(dt, 90)), US(fec_tool_timings_get_percentile(dt, 99)), US(fec_tool_timings_get_percentile(dt, 100)),
+			result->packets_recovered, result->blocks_unrecoverable, result->mismatches
+		);
+	}
+	else
+	{
+		printf(
+			"{\"k\": %u, \"n\": %u, \"packet_size\": %u, \"losses\": %u, \"blocks\": %u, "
+			"\"enc\": {\"mb_per_s\": %.3f, \"packets_per_s\": %.1f, \"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f}, "
+			"\"dec\": {\"mb_per_s\": %.3f, \"packets_per_s\": %.1f, \"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f}, "
+			"\"packets_recovered\": %" G_GUINT64_FORMAT ", \"blocks_unrecoverable\": %" G_GUINT64_FORMAT ", \"mismatches\": %" G_GUINT64_FORMAT "}\n",
+			config->num_media_packets, config->num_fec_packets, config->packet_size, config->num_lost_packets, et->num_durations,
+			enc_mbps, enc_pps, US(fec_tool_timings_get_percentile(et, 50)), US(fec_tool_timings_get_percentile(et, 90)), US(fec_tool_timings_get_percentile(et, 99)), US(fec_tool_timings_get_percentile(et, 100)),
+			dec_mbps, dec_pps, US(fec_tool_timings_get_percentile(dt, 50)), US(fec_tool_timings_get_percentile(dt, 90)), US(fec_tool_timings_get_percentile(dt, 99)), US(fec_tool_timings_get_percentile(dt, 100)),
+			result->packets_recovered, result->blocks_unrecoverable, result->mismatches
+		);
+	}
+
+#undef US
+
+	fflush(stdout);
+}
+
+
+int main(int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GArray *media_packets, *fec_packets, *packet_sizes, *losses;
+	guint ik, in, is, il;
+	int ret = 0;
+
+	context = g_option_context_new("- benchmark the RTP FEC encoder and decoder");
+	g_option_context_add_main_entries(context, entries, NULL);
+	g_option_context_add_group(context, gst_init_get_option_group());
+	if (!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	/* Keep the one-time codec table setup out of the measurements */
+	if (fec_core_init() != FEC_CORE_OK)
+	{
+		fprintf(stderr, "Cannot initialize the FEC codec\n");
+		return 1;
+	}
+
+	if ((g_strcmp0(output_format, "csv") != 0) && (g_strcmp0(output_format, "json") != 0))
+	{
+		fprintf(stderr, "Unknown output format \"%s\"\n", output_format);
+		return 1;
+	}
+	if ((num_blocks <= 0) || (num_warmup_blocks < 0))
+	{
+		fprintf(stderr, "The number of blocks must be positive\n");
+		return 1;
+	}
+
+	/* RS over GF(2^8) supports up to 255 symbols per block; the FEC header mask limits k to 24 */
+	media_packets = fec_tool_parse_list("media packets", media_packets_list, 1, 24);
+	fec_packets = fec_tool_parse_list("FEC packets", fec_packets_list, 1, 255 - 24);
+	packet_sizes = fec_tool_parse_list("packet size", packet_sizes_list, 13, 65535);
+	losses = fec_tool_parse_list("losses", losses_list, 0, 24);
+
+	if ((media_packets == NULL) || (fec_packets == NULL) || (packet_sizes == NULL) || (losses == NULL))
+	{
+		ret = 1;
+		goto cleanup;
+	}
+
+	fecbench_print_header();
+
+	for (ik = 0; ik < media_packets->len; ++ik)
+	{
+		for (in = 0; in < fec_packets->len; ++in)
+		{
+			for (is = 0; is < packet_sizes->len; ++is)
+			{
+				for (il = 0; il < losses->len; ++il)
+				{
+					fecbench_config config;
+					fecbench_result result;
+
+					config.num_media_packets = g_array_index(media_packets, guint, ik);
+					config.num_fec_packets = g_array_index(fec_packets, guint, in);
+					config.packet_size = g_array_index(packet_sizes, guint, is);
+					config.num_lost_packets = g_array_index(losses, guint, il);
+
+					if (config.num_lost_packets > config.num_media_packets)
+						continue;
+
+					fecbench_run(&config, &result);
+					fecbench_print_result(&config, &result);
+
+					fec_tool_timings_free(&(result.enc_timings));
+					fec_tool_timings_free(&(result.dec_timings));
+				}
+			}
+		}
+	}
+
+cleanup:
+	if (media_packets != NULL)
+		g_array_free(media_packets, TRUE);
+	if (fec_packets != NULL)
+		g_array_free(fec_packets, TRUE);
+	if (packet_sizes != NULL)
+		g_array_free(packet_sizes, TRUE);
+	if (losses != NULL)
+		g_array_free(losses, TRUE);
+
+	return ret;
+}
@@ -0,0 +1,756 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+/*
+fecpipebench: end-to-end benchmark of the rtpfecenc and rtpfecdec elements
+
+Builds the pipeline
+
+  appsrc ! rtpfecenc ! (loss) ! rtpfecdec ! appsink
+           rtpfecenc.fec ! (loss) ! rtpfecdec.fec
+
+in process, pushes synthetic RTP packets (or the packets of an rtpdump capture) into it at a
+configurable rate, and reports:
+
+- the sustained throughput in packets/s
+- the latency the elements add per packet, from entering rtpfecenc until reaching appsink, separately
+  for media packets which were passed through and for packets which were recovered
+- the residual loss, that is, the media packets which were dropped and not recovered
+- the thread CPU time spent in rtpfecenc, rtpfecdec and appsink per media packet
+
+The loss model runs in front of the decoder's pads, with independent settings for media and FEC
+packets: outside of bursts, a loss burst starts with probability loss/(loss + burst*(1-loss)), and then
+covers burst packets, so the average loss rate is the given one. Losses are seeded, so runs are comparable.
+
+CPU times and timestamps are measured by wrapping the chain functions of the element pads; time spent
+in downstream elements is subtracted, so each element is charged only for its own work. Since the
+final block of a stream is not protected if it is incomplete, a few residual losses at the end of a
+run are expected.
+
+The encoder must not run in mux mode, since the loss model tells media and FEC packets apart by the pad
+they arrive at. The plugin is looked up in the registry (GST_PLUGIN_PATH), or loaded with --plugin.
+
+Examples:
+
+  fecpipebench --plugin=./libgstrtpfec.so -k 10 -n 2 --packets=200000 --rate=20000 --media-loss=2
+  fecpipebench --rtpdump=capture.rtp --caps="application/x-rtp,media=video,clock-rate=90000,payload=96,encoding-name=H264" --media-loss=5 --burst=3
+*/
+
+
+/* For clock_gettime() and CLOCK_THREAD_CPUTIME_ID */
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include "fectoolutil.h"
+
+
+#define PIPEBENCH_MEDIA_PAYLOAD_TYPE 96
+#define PIPEBENCH_SSRC 0x12345678
+#define PIPEBENCH_DEFAULT_CAPS "application/x-rtp, media=(string)video, payload=(int)96, clock-rate=(int)90000, encoding-name=(string)H264"
+
+/* rtpdump files (as written by rtpdump from rtptools) start with this line, followed by a 16 byte header */
+#define RTPDUMP_MAGIC "#!rtpplay1.0 "
+#define RTPDUMP_FILE_HEADER_SIZE 16
+#define RTPDUMP_PACKET_HEADER_SIZE 8
+
+
+typedef enum
+{
+	PIPEBENCH_PAD_ENCODER_SINK,
+	PIPEBENCH_PAD_DECODER_MEDIA,
+	PIPEBENCH_PAD_DECODER_FEC,
+	PIPEBENCH_PAD_APPSINK,
+	PIPEBENCH_NUM_PADS
+}
+pipebench_pad_role;
+
+
+typedef struct
+{
+	gdouble loss_probability;
+	guint burst_length;
+	guint remaining_burst;
+}
+pipebench_loss_model;
+
+
+typedef struct
+{
+	GstPad *pad;
+	GstPadChainFunction chain;
+	GstPadChainListFunction chain_list;
+	guint64 cpu_time;
+}
+pipebench_pad;
+
+
+typedef struct
+{
+	pipebench_pad pads[PIPEBENCH_NUM_PADS];
+
+	/* Per-seqnum state of the media packets in flight */
+	GstClockTime sent_times[65536];
+	guint8 lost[65536];
+	guint8 received[65536];
+
+	GRand *rand;
+	pipebench_loss_model media_loss, fec_loss;
+
+	guint64 packets_sent;
+	guint64 media_packets_dropped, fec_packets_dropped;
+	guint64 media_packets_received, recovered_packets_received, duplicates_received;
+	GstClockTime first_send_time, last_receive_time;
+
+	fec_tool_timings media_latencies, recovered_latencies;
+}
+pipebench_state;
+
+
+static gchar *plugin_path = NULL;
+static gchar *rtpdump_path = NULL;
+static gchar *caps_string = NULL;
+static gint num_packets = 100000;
+static gint packet_size = 1316;
+static gdouble rate = 0.0;
+static gint num_media_packets = 0;
+static gint num_fec_packets = 0;
+static gdouble media_loss_percentage = 0.0;
+static gdouble fec_loss_percentage = 0.0;
+static gint burst_length = 1;
+static gint seed = 1;
+static gchar **enc_props = NULL;
+static gchar **dec_props = NULL;
+static gchar *output_format = "csv";
+
+static pipebench_state *state;
+
+
+static GOptionEntry entries[] =
+{
+	{ "plugin", 0, 0, G_OPTION_ARG_FILENAME, &plugin_path, "Load the rtpfec plugin from this file", "FILE" },
+	{ "rtpdump", 0, 0, G_OPTION_ARG_FILENAME, &rtpdump_path, "Push the RTP packets of this rtpdump file instead of synthetic ones", "FILE" },
+	{ "caps", 0, 0, G_OPTION_ARG_STRING, &caps_string, "Caps of the pushed RTP packets (default: " PIPEBENCH_DEFAULT_CAPS ")", "CAPS" },
+	{ "packets", 'p', 0, G_OPTION_ARG_INT, &num_packets, "Number of synthetic packets to push", "N" },
+	{ "packet-size", 's', 0, G_OPTION_ARG_INT, &packet_size, "Size of the synthetic packets in bytes, including the RTP header", "BYTES" },
+	{ "rate", 'r', 0, G_OPTION_ARG_DOUBLE, &rate, "Packets per second to push; 0 pushes as fast as the pipeline accepts them", "RATE" },
+	{ "media-packets", 'k', 0, G_OPTION_ARG_INT, &num_media_packets, "Media packets per block (sets num-media-packets on both elements)", "N" },
+	{ "fec-packets", 'n', 0, G_OPTION_ARG_INT, &num_fec_packets, "FEC packets per block (sets num-fec-packets on both elements)", "N" },
+	{ "media-loss", 0, 0, G_OPTION_ARG_DOUBLE, &media_loss_percentage, "Percentage of media packets to drop", "PERCENT" },
+	{ "fec-loss", 0, 0, G_OPTION_ARG_DOUBLE, &fec_loss_percentage, "Percentage of FEC packets to drop", "PERCENT" },
+	{ "burst", 'b', 0, G_OPTION_ARG_INT, &burst_length, "Length of loss bursts in packets", "N" },
+	{ "seed", 0, 0, G_OPTION_ARG_INT, &seed, "Seed for the loss model", "N" },
+	{ "enc-prop", 0, 0, G_OPTION_ARG_STRING_ARRAY, &enc_props, "Set a property of rtpfecenc (may be given several times)", "NAME=VALUE" },
+	{ "dec-prop", 0, 0, G_OPTION_ARG_STRING_ARRAY, &dec_props, "Set a property of rtpfecdec (may be given several times)", "NAME=VALUE" },
+	{ "format", 'f', 0, G_OPTION_ARG_STRING, &output_format, "Output format: csv or json", "FORMAT" },
+	{ NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+};
+
+
+/* CPU time spent in wrapped chain functions which were called from within the current one (in this thread) */
+static __thread guint64 nested_cpu_time = 0;
+
+
+
+static guint64 pipebench_get_thread_cpu_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ((guint64)(ts.tv_sec)) * GST_SECOND + ts.tv_nsec;
+}
+
+
+static void pipebench_init_loss_model(pipebench_loss_model *model, gdouble const percentage)
+{
+	gdouble loss = percentage / 100.0;
+
+	/* Burst starts are only drawn outside of bursts, see the description above */
+	model->burst_length = MAX(burst_length, 1);
+	model->loss_probability = loss / (loss + model->burst_length * (1.0 - loss));
+	model->remaining_burst = 0;
+}
+
+
+static gboolean pipebench_is_lost(pipebench_loss_model *model)
+{
+	if (model->remaining_burst > 0)
+	{
+		--model->remaining_burst;
+		return TRUE;
+	}
+
+	if ((model->loss_probability > 0.0) && (g_rand_double(state->rand) < model->loss_probability))
+	{
+		model->remaining_burst = model->burst_length - 1;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+static pipebench_pad* pipebench_find_pad(GstPad *pad, pipebench_pad_role *role)
+{
+	guint i;
+
+	for (i = 0; i < PIPEBENCH_NUM_PADS; ++i)
+	{
+		if (state->pads[i].pad == pad)
+		{
+			*role = i;
+			return &(state->pads[i]);
+		}
+	}
+
+	g_assert_not_reached();
+	return NULL;
+}
+
+
+/* Returns FALSE if the packet shall be dropped */
+static gboolean pipebench_filter_packet(pipebench_pad_role const role, GstBuffer *packet)
+{
+	guint16 seqnum;
+	GstClockTime now;
+
+	switch (role)
+	{
+		case PIPEBENCH_PAD_ENCODER_SINK:
+			seqnum = gst_rtp_buffer_get_seq(packet);
+			now = gst_util_get_timestamp();
+			if (state->packets_sent == 0)
+				state->first_send_time = now;
+			state->sent_times[seqnum] = now;
+			state->lost[seqnum] = 0;
+			state->received[seqnum] = 0;
+			++state->packets_sent;
+			return TRUE;
+
+		case PIPEBENCH_PAD_DECODER_MEDIA:
+			if (!pipebench_is_lost(&(state->media_loss)))
+				return TRUE;
+			state->lost[gst_rtp_buffer_get_seq(packet)] = 1;
+			++state->media_packets_dropped;
+			return FALSE;
+
+		case PIPEBENCH_PAD_DECODER_FEC:
+			if (!pipebench_is_lost(&(state->fec_loss)))
+				return TRUE;
+			++state->fec_packets_dropped;
+			return FALSE;
+
+		case PIPEBENCH_PAD_APPSINK:
+			seqnum = gst_rtp_buffer_get_seq(packet);
+			now = gst_util_get_timestamp();
+			state->last_receive_time = now;
+			if (state->received[seqnum])
+			{
+				++state->duplicates_received;
+				return TRUE;
+			}
+			state->received[seqnum] = 1;
+			if (state->lost[seqnum])
+			{
+				++state->recovered_packets_received;
+				fec_tool_timings_add(&(state->recovered_latencies), now - state->sent_times[seqnum]);
+			}
+			else
+			{
+				++state->media_packets_received;
+				fec_tool_timings_add(&(state->media_latencies), now - state->sent_times[seqnum]);
+			}
+			return TRUE;
+
+		default:
+			return TRUE;
+	}
+}
+
+
+static guint64 pipebench_begin_cpu_measurement(guint64 *saved_nested_cpu_time)
+{
+	*saved_nested_cpu_time = nested_cpu_time;
+	nested_cpu_time = 0;
+	return pipebench_get_thread_cpu_time();
+}
+
+
+static void pipebench_end_cpu_measurement(pipebench_pad *bpad, guint64 const start_time, guint64 const saved_nested_cpu_time)
+{
+	guint64 elapsed = pipebench_get_thread_cpu_time() - start_time;
+
+	/* The element is charged only for its own work, not for the work of downstream elements */
+	__sync_fetch_and_add(&(bpad->cpu_time), elapsed - MIN(nested_cpu_time, elapsed));
+	nested_cpu_time = saved_nested_cpu_time + elapsed;
+}
+
+
+static GstFlowReturn pipebench_chain(GstPad *pad, GstBuffer *packet)
+{
+	pipebench_pad *bpad;
+	pipebench_pad_role role;
+	guint64 start_time, saved_nested_cpu_time;
+	GstFlowReturn ret;
+
+	bpad = pipebench_find_pad(pad, &role);
+
+	if (!pipebench_filter_packet(role, packet))
+	{
+		gst_buffer_unref(packet);
+		return GST_FLOW_OK;
+	}
+
+	start_time = pipebench_begin_cpu_measurement(&saved_nested_cpu_time);
+	ret = bpad->chain(pad, packet);
+	pipebench_end_cpu_measurement(bpad, start_time, saved_nested_cpu_time);
+
+	return ret;
+}
+
+
+static GstFlowReturn pipebench_chain_list(GstPad *pad, GstBufferList *list)
+{
+	pipebench_pad *bpad;
+	pipebench_pad_role role;
+	GstBufferList *filtered_list;
+	GstBufferListIterator *it, *filtered_it;
+	guint64 start_time, saved_nested_cpu_time;
+	GstFlowReturn ret;
+
+	bpad = pipebench_find_pad(pad, &role);
+
+	/* Each group is one RTP packet; its first buffer contains the RTP header */
+	filtered_list = gst_buffer_list_new();
+	filtered_it = gst_buffer_list_iterate(filtered_list);
+	it = gst_buffer_list_iterate(list);
+	while (gst_buffer_list_iterator_next_group(it))
+	{
+		GstBuffer *buffer = gst_buffer_list_iterator_next(it);
+		if ((buffer == NULL) || !pipebench_filter_packet(role, buffer))
+			continue;
+
+		gst_buffer_list_iterator_add_group(filtered_it);
+		do
+		{
+			gst_buffer_list_iterator_add(filtered_it, gst_buffer_ref(buffer));
+		}
+		while ((buffer = gst_buffer_list_iterator_next(it)) != NULL);
+	}
+	gst_buffer_list_iterator_free(it);
+	gst_buffer_list_iterator_free(filtered_it);
+	gst_buffer_list_unref(list);
+
+	if (gst_buffer_list_n_groups(filtered_list) == 0)
+	{
+		gst_buffer_list_unref(filtered_list);
+		return GST_FLOW_OK;
+	}
+
+	start_time = pipebench_begin_cpu_measurement(&saved_nested_cpu_time);
+	ret = bpad->chain_list(pad, filtered_list);
+	pipebench_end_cpu_measurement(bpad, start_time, saved_nested_cpu_time);
+
+	return ret;
+}
+
+
+static void pipebench_wrap_pad(pipebench_pad_role const role, GstElement *element, gchar const *pad_name)
+{
+	pipebench_pad *bpad = &(state->pads[role]);
+
+	bpad->pad = gst_element_get_static_pad(element, pad_name);
+	bpad->chain = GST_PAD_CHAINFUNC(bpad->pad);
+	bpad->chain_list = GST_PAD_CHAINLISTFUNC(bpad->pad);
+	bpad->cpu_time = 0;
+
+	gst_pad_set_chain_function(bpad->pad, pipebench_chain);
+	/* Without a chain list function, GStreamer pushes the buffers of lists one by one, so they still pass pipebench_chain() */
+	if (bpad->chain_list != NULL)
+		gst_pad_set_chain_list_function(bpad->pad, pipebench_chain_list);
+}
+
+
+static void pipebench_unwrap_pads(void)
+{
+	guint i;
+
+	for (i = 0; i < PIPEBENCH_NUM_PADS; ++i)
+	{
+		if (state->pads[i].pad != NULL)
+			gst_object_unref(state->pads[i].pad);
+	}
+}
+
+
+static GPtrArray* pipebench_read_rtpdump(gchar const *path)
+{
+	gchar *contents;
+	gsize length, offset;
+	GError *error = NULL;
+	GPtrArray *packets;
+	gchar *line_end;
+
+	if (!g_file_get_contents(path, &contents, &length, &error))
+	{
+		fprintf(stderr, "Cannot read %s: %s\n", path, error->message);
+		g_error_free(error);
+		return NULL;
+	}
+
+	line_end = (length > strlen(RTPDUMP_MAGIC)) ? memchr(contents, '\n', length) : NULL;
+	if ((strncmp(contents, RTPDUMP_MAGIC, strlen(RTPDUMP_MAGIC)) != 0) || (line_end == NULL))
+	{
+		fprintf(stderr, "%s is not an rtpdump file\n", path);
+		g_free(contents);
+		return NULL;
+	}
+
+	packets = g_ptr_array_new();
+	offset = (line_end - contents) + 1 + RTPDUMP_FILE_HEADER_SIZE;
+
+	/* Every packet has an 8 byte header: length of header and packet, length of the original packet (0 for RTCP), offset in ms */
+	while ((offset + RTPDUMP_PACKET_HEADER_SIZE) <= length)
+	{
+		guint8 const *header = (guint8 const *)(contents + offset);
+		guint record_length = (((guint)(header[0])) << 8) | header[1];
+		guint packet_length = (((guint)(header[2])) << 8) | header[3];
+
+		if ((record_length < RTPDUMP_PACKET_HEADER_SIZE) || ((offset + record_length) > length))
+			break;
+
+		if ((packet_length > 0) && gst_rtp_buffer_validate_data((guint8 *)(header + RTPDUMP_PACKET_HEADER_SIZE), record_length - RTPDUMP_PACKET_HEADER_SIZE))
+		{
+			GstBuffer *packet = gst_buffer_new_and_alloc(record_length - RTPDUMP_PACKET_HEADER_SIZE);
+			memcpy(GST_BUFFER_DATA(packet), header + RTPDUMP_PACKET_HEADER_SIZE, GST_BUFFER_SIZE(packet));
+			g_ptr_array_add(packets, packet);
+		}
+
+		offset += record_length;
+	}
+
+	g_free(contents);
+	return packets;
+}
+
+
+static GstBuffer* pipebench_create_packet(guint const index)
+{
+	GstBuffer *packet;
+	guint8 *payload;
+	guint payload_size, i;
+
+	payload_size = packet_size - 12;
+	packet = gst_rtp_buffer_new_allocate(payload_size, 0, 0);
+	gst_rtp_buffer_set_ssrc(packet, PIPEBENCH_SSRC);
+	gst_rtp_buffer_set_seq(packet, index & 0xffff);
+	/* Timestamps advance in real time if a rate is given, otherwise by 1 ms per packet */
+	gst_rtp_buffer_set_timestamp(packet, (rate > 0.0) ? (guint32)(index * 90000.0 / rate) : (index * 90));
+	gst_rtp_buffer_set_payload_type(packet, PIPEBENCH_MEDIA_PAYLOAD_TYPE);
+
+	payload = gst_rtp_buffer_get_payload(packet);
+	for (i = 0; i < payload_size; ++i)
+		payload[i] = (index + i) & 0xff;
+
+	return packet;
+}
+
+
+static void pipebench_print_result(void)
+{
+	gdouble seconds, packets_per_second, residual_loss_rate;
+	guint64 residual_losses, received;
+	fec_tool_timings *ml = &(state->media_latencies), *rl = &(state->recovered_latencies);
+	gdouble cpu_per_packet[PIPEBENCH_NUM_PADS];
+	guint i;
+
+	seconds = (state->last_receive_time > state->first_send_time) ? (((gdouble)(state->last_receive_time - state->first_send_time)) / GST_SECOND) : 0.0;
+	packets_per_second = (seconds > 0.0) ? (state->packets_sent / seconds) : 0.0;
+	received = state->media_packets_received + state->recovered_packets_received;
+	residual_losses = (state->packets_sent > received) ? (state->packets_sent - received) : 0;
+	residual_loss_rate = (state->packets_sent > 0) ? (((gdouble)residual_losses) / state->packets_sent) : 0.0;
+
+	for (i = 0; i < PIPEBENCH_NUM_PADS; ++i)
+		cpu_per_packet[i] = (state->packets_sent > 0) ? (((gdouble)(state->pads[i].cpu_time)) / state->packets_sent) : 0.0;
+	/* The decoder has two sink pads */
+	cpu_per_packet[PIPEBENCH_PAD_DECODER_MEDIA] += cpu_per_packet[PIPEBENCH_PAD_DECODER_FEC];
+
+#define US(t) (((gdouble)(t)) / GST_USECOND)
+
+	if (g_strcmp0(output_format, "csv") == 0)
+	{
+		printf(
+			"packets_sent,seconds,packets_per_s,media_dropped,fec_dropped,recovered,residual_losses,residual_loss_rate,duplicates,"
+			"media_p50_us,media_p90_us,media_p99_us,media_max_us,"
+			"recovered_p50_us,recovered_p90_us,recovered_p99_us,recovered_max_us,"
+			"enc_cpu_ns_per_packet,dec_cpu_ns_per_packet,sink_cpu_ns_per_packet\n"
+		);
+		printf(
+			"%" G_GUINT64_FORMAT ",%.6f,%.1f,%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%.6f,%" G_GUINT64_FORMAT ","
+			"%.3f,%.3f,%.3f,%.3f,"
+			"%.3f,%.3f,%.3f,%.3f,"
+			"%.1f,%.1f,%.1f\n",
+			state->packets_sent, seconds, packets_per_second, state->media_packets_dropped, state->fec_packets_dropped, state->recovered_packets_received, residual_losses, residual_loss_rate, state->duplicates_received,
+			US(fec_tool_timings_get_percentile(ml, 50)), US(fec_tool_timings_get_percentile(ml, 90)), US(fec_tool_timings_get_percentile(ml, 99)), US(fec_tool_timings_get_percentile(ml, 100)),
+			US(fec_tool_timings_get_percentile(rl, 50)), US(fec_tool_timings_get_percentile(rl, 90)), US(fec_tool_timings_get_percentile(rl, 99)), US(fec_tool_timings_get_percentile(rl, 100)),
+			cpu_per_packet[PIPEBENCH_PAD_ENCODER_SINK], cpu_per_packet[PIPEBENCH_PAD_DECODER_MEDIA], cpu_per_packet[PIPEBENCH_PAD_APPSINK]
+		);
+	}
+	else
+	{
+		printf(
+			"{\"packets_sent\": %" G_GUINT64_FORMAT ", \"seconds\": %.6f, \"packets_per_s\": %.1f, "
+			"\"media_dropped\": %" G_GUINT64_FORMAT ", \"fec_dropped\": %" G_GUINT64_FORMAT ", \"recovered\": %" G_GUINT64_FORMAT ", "
+			"\"residual_losses\": %" G_GUINT64_FORMAT ", \"residual_loss_rate\": %.6f, \"duplicates\": %" G_GUINT64_FORMAT ", "
+			"\"media_latency\": {\"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f}, "
+			"\"recovered_latency\": {\"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f}, "
+			"\"cpu_ns_per_packet\": {\"rtpfecenc\": %.1f, \"rtpfecdec\": %.1f, \"appsink\": %.1f}}\n",
+			state->packets_sent, seconds, packets_per_second,
+			state->media_packets_dropped, state->fec_packets_dropped, state->recovered_packets_received,
+			residual_losses, residual_loss_rate, state->duplicates_received,
+			US(fec_tool_timings_get_percentile(ml, 50)), US(fec_tool_timings_get_percentile(ml, 90)), US(fec_tool_timings_get_percentile(ml, 99)), US(fec_tool_timings_get_percentile(ml, 100)),
+			US(fec_tool_timings_get_percentile(rl, 50)), US(fec_tool_timings_get_percentile(rl, 90)), US(fec_tool_timings_get_percentile(rl, 99)), US(fec_tool_timings_get_percentile(rl, 100)),
+			cpu_per_packet[PIPEBENCH_PAD_ENCODER_SINK], cpu_per_packet[PIPEBENCH_PAD_DECODER_MEDIA], cpu_per_packet[PIPEBENCH_PAD_APPSINK]
+		);
+	}
+
+#undef US
+}
+
+
+static gboolean pipebench_push_packets(GstElement *appsrc, GPtrArray *captured_packets, GstBus *bus)
+{
+	GstClockTime start_time;
+	guint i, total_num_packets;
+	GstFlowReturn flow_ret;
+
+	total_num_packets = (captured_packets != NULL) ? captured_packets->len : (guint)num_packets;
+	start_time = gst_util_get_timestamp();
+
+	for (i = 0; i < total_num_packets; ++i)
+	{
+		GstBuffer *packet;
+
+		if (rate > 0.0)
+		{
+			GstClockTime target_time = start_time + (GstClockTime)(i * (GST_SECOND / rate));
+			GstClockTime now = gst_util_get_timestamp();
+			if (now < target_time)
+				g_usleep((target_time - now) / GST_USECOND);
+		}
+
+		packet = (captured_packets != NULL) ? gst_buffer_ref(g_ptr_array_index(captured_packets, i)) : pipebench_create_packet(i);
+		/* The push-buffer action signal does not take ownership of the buffer */
+		g_signal_emit_by_name(appsrc, "push-buffer", packet, &flow_ret);
+		gst_buffer_unref(packet);
+
+		if (flow_ret != GST_FLOW_OK)
+		{
+			fprintf(stderr, "Pushing packet %u failed: %s\n", i, gst_flow_get_name(flow_ret));
+			return FALSE;
+		}
+
+		/* Errors would otherwise only be noticed after all packets were pushed */
+		if ((i & 1023) == 0)
+		{
+			GstMessage *msg = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+			if (msg != NULL)
+			{
+				gst_bus_post(bus, msg);
+				break;
+			}
+		}
+	}
+
+	g_signal_emit_by_name(appsrc, "end-of-stream", &flow_ret);
+	return TRUE;
+}
+
+
+int main(int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GstElement *pipeline, *appsrc, *enc, *dec, *appsink;
+	GstCaps *caps;
+	GstBus *bus;
+	GstMessage *msg;
+	GPtrArray *captured_packets = NULL;
+	int ret = 1;
+
+	context = g_option_context_new("- end-to-end benchmark of rtpfecenc and rtpfecdec");
+	g_option_context_add_main_entries(context, entries, NULL);
+	g_option_context_add_group(context, gst_init_get_option_group());
+	if (!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	if ((g_strcmp0(output_format, "csv") != 0) && (g_strcmp0(output_format, "json") != 0))
+	{
+		fprintf(stderr, "Unknown output format \"%s\"\n", output_format);
+		return 1;
+	}
+	if ((num_packets <= 0) || (packet_size <= 12) || (packet_size > 65535) || (rate < 0.0))
+	{
+		fprintf(stderr, "Invalid number of packets, packet size or rate\n");
+		return 1;
+	}
+
+	if (plugin_path != NULL)
+	{
+		GstPlugin *plugin = gst_plugin_load_file(plugin_path, &error);
+		if (plugin == NULL)
+		{
+			fprintf(stderr, "Cannot load plugin %s: %s\n", plugin_path, error->message);
+			g_error_free(error);
+			return 1;
+		}
+		gst_object_unref(plugin);
+	}
+
+	if (rtpdump_path != NULL)
+	{
+		captured_packets = pipebench_read_rtpdump(rtpdump_path);
+		if (captured_packets == NULL)
+			return 1;
+	}
+
+	state = g_new0(pipebench_state, 1);
+	state->rand = g_rand_new_with_seed(seed);
+	pipebench_init_loss_model(&(state->media_loss), media_loss_percentage);
+	pipebench_init_loss_model(&(state->fec_loss), fec_loss_percentage);
+	fec_tool_timings_init(&(state->media_latencies), (captured_packets != NULL) ? captured_packets->len : (guint)num_packets);
+	fec_tool_timings_init(&(state->recovered_latencies), (captured_packets != NULL) ? captured_packets->len : (guint)num_packets);
+
+	pipeline = gst_pipeline_new("pipeline");
+	appsrc = gst_element_factory_make("appsrc", "src");
+	enc = gst_element_factory_make("rtpfecenc", "enc");
+	dec = gst_element_factory_make("rtpfecdec", "dec");
+	appsink = gst_element_factory_make("appsink", "sink");
+	if ((appsrc == NULL) || (enc == NULL) || (dec == NULL) || (appsink == NULL))
+	{
+		fprintf(stderr, "Cannot create the elements; is the rtpfec plugin in GST_PLUGIN_PATH (or given with --plugin)?\n");
+		goto cleanup;
+	}
+
+	caps = gst_caps_from_string((caps_string != NULL) ? caps_string : PIPEBENCH_DEFAULT_CAPS);
+	if (caps == NULL)
+	{
+		fprintf(stderr, "Invalid caps\n");
+		goto cleanup;
+	}
+	/* block keeps the queue of appsrc small if packets are pushed as fast as possible */
+	g_object_set(G_OBJECT(appsrc), "caps", caps, "format", GST_FORMAT_TIME, "block", TRUE, "max-bytes", (guint64)(256 * 1024), NULL);
+	gst_caps_unref(caps);
+	g_object_set(G_OBJECT(appsink), "sync", FALSE, "max-buffers", 1, "drop", TRUE, NULL);
+
+	if (num_media_packets > 0)
+	{
+		g_object_set(G_OBJECT(enc), "num-media-packets", (guint)num_media_packets, NULL);
+		g_object_set(G_OBJECT(dec), "num-media-packets", (guint)num_media_packets, NULL);
+	}
+	if (num_fec_packets > 0)
+	{
+		g_object_set(G_OBJECT(enc), "num-fec-packets", (guint)num_fec_packets, NULL);
+		g_object_set(G_OBJECT(dec), "num-fec-packets", (guint)num_fec_packets, NULL);
+	}
+	if (!fec_tool_set_properties(enc, enc_props) || !fec_tool_set_properties(dec, dec_props))
+		goto cleanup;
+
+	gst_bin_add_many(GST_BIN(pipeline), appsrc, enc, dec, appsink, NULL);
+	if (!gst_element_link(appsrc, enc) || !gst_element_link_pads(enc, "src", dec, "sink") || !gst_element_link_pads(enc, "fec", dec, "fec") || !gst_element_link_pads(dec, "src", appsink, "sink"))
+	{
+		fprintf(stderr, "Cannot link the elements\n");
+		/* The elements belong to the pipeline now */
+		appsrc = enc = dec = appsink = NULL;
+		goto cleanup;
+	}
+
+	pipebench_wrap_pad(PIPEBENCH_PAD_ENCODER_SINK, enc, "sink");
+	pipebench_wrap_pad(PIPEBENCH_PAD_DECODER_MEDIA, dec, "sink");
+	pipebench_wrap_pad(PIPEBENCH_PAD_DECODER_FEC, dec, "fec");
+	pipebench_wrap_pad(PIPEBENCH_PAD_APPSINK, appsink, "sink");
+
+	bus = gst_element_get_bus(pipeline);
+	gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+	if (pipebench_push_packets(appsrc, captured_packets, bus))
+	{
+		msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+		if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+		{
+			gchar *debug;
+			gst_message_parse_error(msg, &error, &debug);
+			fprintf(stderr, "Error from %s: %s\n%s\n", GST_OBJECT_NAME(GST_MESSAGE_SRC(msg)), error->message, (debug != NULL) ? debug : "");
+			g_error_free(error);
+			g_free(debug);
+		}
+		else
+		{
+			pipebench_print_result();
+			ret = 0;
+		}
+		gst_message_unref(msg);
+	}
+
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(bus);
+	pipebench_unwrap_pads();
+	appsrc = enc = dec = appsink = NULL;
+
+cleanup:
+	if (appsrc != NULL)
+		gst_object_unref(appsrc);
+	if (enc != NULL)
+		gst_object_unref(enc);
+	if (dec != NULL)
+		gst_object_unref(dec);
+	if (appsink != NULL)
+		gst_object_unref(appsink);
+	gst_object_unref(pipeline);
+
+	if (captured_packets != NULL)
+	{
+		guint i;
+		for (i = 0; i < captured_packets->len; ++i)
+			gst_buffer_unref(g_ptr_array_index(captured_packets, i));
+		g_ptr_array_free(captured_packets, TRUE);
+	}
+
+	fec_tool_timings_free(&(state->media_latencies));
+	fec_tool_timings_free(&(state->recovered_latencies));
+	g_rand_free(state->rand);
+	g_free(state);
+
+	return ret;
+}
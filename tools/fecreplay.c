@@ -0,0 +1,943 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+
+
+
+/*
+fecreplay: replays a packet capture through the FEC decoder (and optionally the encoder)
+
+The capture file (pcap or pcapng) is memory-mapped, and the RTP media and FEC flows are extracted from
+it by UDP destination port and/or RTP payload type. The packets are then fed through fec_dec in
+capture order, as fast as possible, and the number of recovered packets, complete, recovered and
+unrecoverable blocks, and the decoding throughput are printed as CSV (or JSON). Parsing and buffer
+setup are not timed; the packets reference the mapped file directly.
+
+With --encode, the captured FEC flow is ignored. Instead, the media flow is run through fec_enc with
+the given geometry, and the decoder gets the generated FEC packets. Media packets which are missing
+in the capture are replaced by zero-filled placeholders for the encoder, and withheld from the
+decoder, so other geometries can be evaluated against the loss pattern of the capture.
+
+The decoder handles one stream; if the media flow contains several SSRCs and none is selected with
+--ssrc, the first one seen is used, and packets of the others are skipped.
+
+Examples:
+
+  fecreplay -k 9 -n 3 --media-port 5000 --fec-port 5002 capture.pcapng
+  fecreplay -k 9 -n 3 --fec-pt 100 --loops 20 --format=json capture.pcap
+  fecreplay -k 16 -n 4 --media-port 5000 --encode capture.pcap
+*/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include "fecenc.h"
+#include "fecdec.h"
+#include "fecstats.h"
+#include "fectoolutil.h"
+
+
+#define FECREPLAY_FEC_PAYLOAD_TYPE 100
+
+/* Gaps in the media flow larger than this are treated as a discontinuity in --encode mode, not as losses */
+#define FECREPLAY_MAX_GAP 1000
+
+/* Linktypes, see http://www.tcpdump.org/linktypes.html */
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW_BSD 12
+#define LINKTYPE_RAW_OPENBSD 14
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_IPV6 229
+#define LINKTYPE_LINUX_SLL2 276
+
+#define PCAPNG_MAX_INTERFACES 64
+
+
+typedef enum
+{
+	FECREPLAY_MEDIA,
+	FECREPLAY_FEC,
+	/* Only pushed to the encoder; stands in for a media packet missing in the capture */
+	FECREPLAY_PLACEHOLDER,
+	/* Only pushed to the decoder; a media packet which arrived after its successors */
+	FECREPLAY_LATE_MEDIA
+}
+fecreplay_packet_type;
+
+
+typedef struct
+{
+	GstBuffer *buffer;
+	fecreplay_packet_type type;
+}
+fecreplay_packet;
+
+
+typedef struct
+{
+	/* Packets of the capture, in capture order */
+	GArray *packets;
+	guint num_media_packets, num_fec_packets;
+	guint64 media_bytes;
+	guint num_media_lost;
+	/* Non-RTP, fragmented and unmatched UDP packets, and media packets of other SSRCs */
+	guint num_skipped;
+	gboolean has_ssrc;
+	guint32 ssrc;
+	guint8 media_payload_type;
+}
+fecreplay_capture;
+
+
+typedef struct
+{
+	GstClockTime enc_duration, dec_duration;
+	guint64 num_enc_packets, num_dec_packets, num_dec_bytes;
+	guint64 num_generated_fec_packets;
+	fec_dec_stats dec_stats;
+}
+fecreplay_result;
+
+
+static gint num_media_packets = 9;
+static gint num_fec_packets = 3;
+static gint media_port = 0;
+static gint fec_port = 0;
+static gint media_pt = -1;
+static gint fec_pt = -1;
+static gchar *ssrc_string = NULL;
+static gboolean encode = FALSE;
+static gint num_loops = 1;
+static gboolean use_symbol_arena = FALSE;
+static gchar *output_format = "csv";
+
+
+static GOptionEntry entries[] =
+{
+	{ "media-packets", 'k', 0, G_OPTION_ARG_INT, &num_media_packets, "Number of media packets per block (1-24)", "N" },
+	{ "fec-packets", 'n', 0, G_OPTION_ARG_INT, &num_fec_packets, "Number of FEC packets per block", "N" },
+	{ "media-port", 0, 0, G_OPTION_ARG_INT, &media_port, "UDP destination port of the media flow", "PORT" },
+	{ "fec-port", 0, 0, G_OPTION_ARG_INT, &fec_port, "UDP destination port of the FEC flow", "PORT" },
+	{ "media-pt", 0, 0, G_OPTION_ARG_INT, &media_pt, "RTP payload type of the media flow", "PT" },
+	{ "fec-pt", 0, 0, G_OPTION_ARG_INT, &fec_pt, "RTP payload type of the FEC flow", "PT" },
+	{ "ssrc", 0, 0, G_OPTION_ARG_STRING, &ssrc_string, "SSRC of the media flow (decimal or 0x-prefixed hexadecimal)", "SSRC" },
+	{ "encode", 'e', 0, G_OPTION_ARG_NONE, &encode, "Generate the FEC packets with fec_enc instead of using the captured ones", NULL },
+	{ "loops", 'L', 0, G_OPTION_ARG_INT, &num_loops, "Number of times the capture is replayed; statistics cover the first replay", "N" },
+	{ "arena", 'a', 0, G_OPTION_ARG_NONE, &use_symbol_arena, "Let the decoder copy media packets into its symbol arena", NULL },
+	{ "format", 'f', 0, G_OPTION_ARG_STRING, &output_format, "Output format: csv or json", "FORMAT" },
+	{ NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+};
+
+
+
+/**** Capture parsing ****/
+
+
+static guint16 fecreplay_read16(guint8 const *data, gboolean const big_endian)
+{
+	return big_endian ? GST_READ_UINT16_BE(data) : GST_READ_UINT16_LE(data);
+}
+
+
+static guint32 fecreplay_read32(guint8 const *data, gboolean const big_endian)
+{
+	return big_endian ? GST_READ_UINT32_BE(data) : GST_READ_UINT32_LE(data);
+}
+
+
+/* Wraps a packet of the mapped file in a buffer without copying it */
+static GstBuffer* fecreplay_wrap_packet(guint8 const *data, guint const size)
+{
+	GstBuffer *buffer = gst_buffer_new();
+	GST_BUFFER_DATA(buffer) = (guint8 *)data;
+	GST_BUFFER_SIZE(buffer) = size;
+	GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_READONLY);
+	return buffer;
+}
+
+
+static void fecreplay_add_rtp_packet(fecreplay_capture *capture, guint8 const *data, guint const size, guint16 const dest_port)
+{
+	fecreplay_packet packet;
+	guint pt;
+	gboolean is_fec, is_media;
+
+	if ((size < 12) || ((data[0] >> 6) != 2))
+	{
+		++capture->num_skipped;
+		return;
+	}
+
+	pt = data[1] & 0x7f;
+
+	is_fec = ((fec_port != 0) && (dest_port == fec_port)) || ((fec_pt >= 0) && (pt == (guint)fec_pt));
+	if (media_pt >= 0)
+		is_media = (pt == (guint)media_pt);
+	else
+		is_media = (pt < 64) || (pt > 95); /* payload types 64-95 collide with RTCP packet types */
+	if (media_port != 0)
+		is_media = is_media && (dest_port == media_port);
+
+	if (is_fec)
+	{
+		if (encode)
+			return;
+		packet.type = FECREPLAY_FEC;
+		++capture->num_fec_packets;
+	}
+	else if (is_media)
+	{
+		guint32 ssrc = GST_READ_UINT32_BE(data + 8);
+
+		if (!capture->has_ssrc)
+		{
+			capture->has_ssrc = TRUE;
+			capture->ssrc = ssrc;
+			capture->media_payload_type = pt;
+		}
+		else if (ssrc != capture->ssrc)
+		{
+			++capture->num_skipped;
+			return;
+		}
+
+		packet.type = FECREPLAY_MEDIA;
+		++capture->num_media_packets;
+		capture->media_bytes += size;
+	}
+	else
+	{
+		++capture->num_skipped;
+		return;
+	}
+
+	packet.buffer = fecreplay_wrap_packet(data, size);
+	g_array_append_val(capture->packets, packet);
+}
+
+
+static void fecreplay_add_ip_packet(fecreplay_capture *capture, guint8 const *data, guint size)
+{
+	guint8 const *udp;
+	guint udp_size, udp_length;
+
+	if (size < 1)
+	{
+		++capture->num_skipped;
+		return;
+	}
+
+	switch (data[0] >> 4)
+	{
+		case 4:
+		{
+			guint header_size = (data[0] & 0x0f) * 4;
+			guint total_length;
+
+			if ((size < 20) || (header_size < 20) || (size < header_size))
+				goto skip;
+			/* Fragments cannot be reassembled from a single packet */
+			if ((GST_READ_UINT16_BE(data + 6) & 0x3fff) != 0)
+				goto skip;
+			if (data[9] != 17)
+				goto skip;
+
+			total_length = GST_READ_UINT16_BE(data + 2);
+			if ((total_length >= header_size) && (total_length < size))
+				size = total_length;
+
+			udp = data + header_size;
+			udp_size = size - header_size;
+			break;
+		}
+
+		case 6:
+		{
+			guint next_header, offset, payload_length;
+
+			if (size < 40)
+				goto skip;
+
+			payload_length = GST_READ_UINT16_BE(data + 4);
+			if ((payload_length + 40) < size)
+				size = payload_length + 40;
+
+			/* Skip hop-by-hop, routing and destination options headers */
+			next_header = data[6];
+			offset = 40;
+			while ((next_header == 0) || (next_header == 43) || (next_header == 60))
+			{
+				if ((offset + 8) > size)
+					goto skip;
+				next_header = data[offset];
+				offset += (data[offset + 1] + 1) * 8;
+			}
+			if ((next_header != 17) || (offset > size))
+				goto skip;
+
+			udp = data + offset;
+			udp_size = size - offset;
+			break;
+		}
+
+		default:
+			goto skip;
+	}
+
+	if (udp_size < 8)
+		goto skip;
+
+	udp_length = GST_READ_UINT16_BE(udp + 4);
+	if ((udp_length >= 8) && (udp_length < udp_size))
+		udp_size = udp_length;
+
+	fecreplay_add_rtp_packet(capture, udp + 8, udp_size - 8, GST_READ_UINT16_BE(udp + 2));
+	return;
+
+skip:
+	++capture->num_skipped;
+}
+
+
+static void fecreplay_add_frame(fecreplay_capture *capture, guint const linktype, guint8 const *data, guint const size)
+{
+	guint offset, ethertype;
+
+	switch (linktype)
+	{
+		case LINKTYPE_NULL:
+			/* The address family is in the byte order of the capturing machine, and IPv6 has several values; the IP version nibble is used instead */
+			if (size < 4)
+				goto skip;
+			fecreplay_add_ip_packet(capture, data + 4, size - 4);
+			return;
+
+		case LINKTYPE_RAW_BSD:
+		case LINKTYPE_RAW_OPENBSD:
+		case LINKTYPE_RAW:
+		case LINKTYPE_IPV4:
+		case LINKTYPE_IPV6:
+			fecreplay_add_ip_packet(capture, data, size);
+			return;
+
+		case LINKTYPE_ETHERNET:
+			if (size < 14)
+				goto skip;
+			ethertype = GST_READ_UINT16_BE(data + 12);
+			offset = 14;
+			/* VLAN tags */
+			while (((ethertype == 0x8100) || (ethertype == 0x88a8)) && ((offset + 4) <= size))
+			{
+				ethertype = GST_READ_UINT16_BE(data + offset + 2);
+				offset += 4;
+			}
+			break;
+
+		case LINKTYPE_LINUX_SLL:
+			if (size < 16)
+				goto skip;
+			ethertype = GST_READ_UINT16_BE(data + 14);
+			offset = 16;
+			break;
+
+		case LINKTYPE_LINUX_SLL2:
+			if (size < 20)
+				goto skip;
+			ethertype = GST_READ_UINT16_BE(data);
+			offset = 20;
+			break;
+
+		default:
+			goto skip;
+	}
+
+	if (((ethertype != 0x0800) && (ethertype != 0x86dd)) || (offset > size))
+		goto skip;
+
+	fecreplay_add_ip_packet(capture, data + offset, size - offset);
+	return;
+
+skip:
+	++capture->num_skipped;
+}
+
+
+static gboolean fecreplay_parse_pcap(fecreplay_capture *capture, guint8 const *data, gsize const size)
+{
+	guint32 magic = GST_READ_UINT32_LE(data);
+	gboolean big_endian = (magic != 0xa1b2c3d4) && (magic != 0xa1b23c4d);
+	guint linktype;
+	gsize offset;
+
+	if (size < 24)
+	{
+		fprintf(stderr, "Truncated pcap header\n");
+		return FALSE;
+	}
+
+	linktype = fecreplay_read32(data + 20, big_endian) & 0xffff;
+
+	for (offset = 24; (offset + 16) <= size;)
+	{
+		guint captured_length = fecreplay_read32(data + offset + 8, big_endian);
+
+		offset += 16;
+		if (captured_length > (size - offset))
+		{
+			fprintf(stderr, "Warning: capture is truncated\n");
+			break;
+		}
+
+		fecreplay_add_frame(capture, linktype, data + offset, captured_length);
+		offset += captured_length;
+	}
+
+	return TRUE;
+}
+
+
+static gboolean fecreplay_parse_pcapng(fecreplay_capture *capture, guint8 const *data, gsize const size)
+{
+	guint linktypes[PCAPNG_MAX_INTERFACES];
+	guint num_interfaces = 0;
+	gboolean big_endian = FALSE;
+	gsize offset;
+
+	for (offset = 0; (offset + 12) <= size;)
+	{
+		guint8 const *block = data + offset;
+		guint32 block_type, block_length;
+
+		/* The section header block determines the byte order of all blocks in its section */
+		if (GST_READ_UINT32_LE(block) == 0x0a0d0d0a)
+		{
+			if (size - offset < 28)
+				break;
+			big_endian = (GST_READ_UINT32_LE(block + 8) != 0x1a2b3c4d);
+			num_interfaces = 0;
+		}
+
+		block_type = fecreplay_read32(block, big_endian);
+		block_length = fecreplay_read32(block + 4, big_endian);
+		if ((block_length < 12) || (block_length > (size - offset)))
+		{
+			fprintf(stderr, "Warning: capture is truncated\n");
+			break;
+		}
+
+		switch (block_type)
+		{
+			case 1: /* interface description block */
+				if ((block_length >= 20) && (num_interfaces < PCAPNG_MAX_INTERFACES))
+					linktypes[num_interfaces++] = fecreplay_read16(block + 8, big_endian);
+				break;
+
+			case 6: /* enhanced packet block */
+			{
+				guint interface_id, captured_length;
+
+				if (block_length < 32)
+					break;
+				interface_id = fecreplay_read32(block + 8, big_endian);
+				captured_length = fecreplay_read32(block + 20, big_endian);
+				if ((interface_id >= num_interfaces) || (captured_length > (block_length - 32)))
+				{
+					++capture->num_skipped;
+					break;
+				}
+				fecreplay_add_frame(capture, linktypes[interface_id], block + 28, captured_length);
+				break;
+			}
+
+			case 3: /* simple packet block; always from the first interface */
+			{
+				guint captured_length;
+
+				if ((block_length < 16) || (num_interfaces == 0))
+					break;
+				captured_length = MIN(fecreplay_read32(block + 8, big_endian), block_length - 16);
+				fecreplay_add_frame(capture, linktypes[0], block + 12, captured_length);
+				break;
+			}
+
+			default:
+				break;
+		}
+
+		offset += block_length;
+	}
+
+	return TRUE;
+}
+
+
+static gboolean fecreplay_parse_capture(fecreplay_capture *capture, guint8 const *data, gsize const size)
+{
+	guint32 magic;
+
+	if (size < 4)
+	{
+		fprintf(stderr, "File is too small to be a capture\n");
+		return FALSE;
+	}
+
+	magic = GST_READ_UINT32_LE(data);
+	switch (magic)
+	{
+		case 0xa1b2c3d4:
+		case 0xd4c3b2a1:
+		case 0xa1b23c4d: /* nanosecond timestamps */
+		case 0x4d3cb2a1:
+			return fecreplay_parse_pcap(capture, data, size);
+		case 0x0a0d0d0a:
+			return fecreplay_parse_pcapng(capture, data, size);
+		default:
+			fprintf(stderr, "Unknown capture format (magic 0x%08x); only pcap and pcapng are supported\n", magic);
+			return FALSE;
+	}
+}
+
+
+
+/**** Replay ****/
+
+
+/* Extends a 16-bit seqnum to 32 bits, relative to the previous extended seqnum */
+static guint32 fecreplay_extend_seqnum(guint32 const previous, guint16 const seqnum)
+{
+	return previous + (gint16)(seqnum - (previous & 0xffff));
+}
+
+
+/* Counts the media packets missing in the capture */
+static void fecreplay_count_losses(fecreplay_capture *capture)
+{
+	GHashTable *received;
+	guint32 ext_seqnum = 0, min_ext_seqnum = 0, max_ext_seqnum = 0;
+	gboolean first = TRUE;
+	guint i;
+
+	received = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	for (i = 0; i < capture->packets->len; ++i)
+	{
+		fecreplay_packet *packet = &g_array_index(capture->packets, fecreplay_packet, i);
+		guint16 seqnum;
+
+		if (packet->type != FECREPLAY_MEDIA)
+			continue;
+
+		seqnum = gst_rtp_buffer_get_seq(packet->buffer);
+		/* Extended seqnums start at 0x80000000, so they do not wrap around for earlier packets */
+		ext_seqnum = first ? (0x80000000u | seqnum) : fecreplay_extend_seqnum(ext_seqnum, seqnum);
+		if (first || (ext_seqnum < min_ext_seqnum))
+			min_ext_seqnum = ext_seqnum;
+		if (first || (ext_seqnum > max_ext_seqnum))
+			max_ext_seqnum = ext_seqnum;
+		first = FALSE;
+
+		g_hash_table_replace(received, GUINT_TO_POINTER(ext_seqnum), GUINT_TO_POINTER(1));
+	}
+
+	capture->num_media_lost = first ? 0 : ((max_ext_seqnum - min_ext_seqnum + 1) - g_hash_table_size(received));
+
+	g_hash_table_destroy(received);
+}
+
+
+/*
+Builds the encoder input for --encode: the captured media packets, with placeholders for missing ones,
+and late packets marked as decoder-only. Returns the array; the placeholders are owned by it.
+*/
+static GArray* fecreplay_create_encoder_input(fecreplay_capture *capture)
+{
+	GArray *input;
+	guint32 next_ext_seqnum = 0;
+	gboolean first = TRUE;
+	guint i;
+
+	input = g_array_new(FALSE, FALSE, sizeof(fecreplay_packet));
+
+	for (i = 0; i < capture->packets->len; ++i)
+	{
+		fecreplay_packet packet = g_array_index(capture->packets, fecreplay_packet, i);
+		guint32 ext_seqnum;
+
+		if (first)
+			ext_seqnum = 0x80000000u | gst_rtp_buffer_get_seq(packet.buffer);
+		else
+			ext_seqnum = fecreplay_extend_seqnum(next_ext_seqnum, gst_rtp_buffer_get_seq(packet.buffer));
+
+		if (!first && (ext_seqnum < next_ext_seqnum))
+		{
+			packet.type = FECREPLAY_LATE_MEDIA;
+			g_array_append_val(input, packet);
+			continue;
+		}
+
+		if (!first && ((ext_seqnum - next_ext_seqnum) <= FECREPLAY_MAX_GAP))
+		{
+			/* The placeholders get the size and RTP timestamp of the packet following the gap */
+			for (; next_ext_seqnum != ext_seqnum; ++next_ext_seqnum)
+			{
+				fecreplay_packet placeholder;
+				guint size = GST_BUFFER_SIZE(packet.buffer);
+
+				placeholder.type = FECREPLAY_PLACEHOLDER;
+				placeholder.buffer = gst_rtp_buffer_new_allocate(size - 12, 0, 0);
+				memset(gst_rtp_buffer_get_payload(placeholder.buffer), 0, size - 12);
+				gst_rtp_buffer_set_ssrc(placeholder.buffer, capture->ssrc);
+				gst_rtp_buffer_set_seq(placeholder.buffer, next_ext_seqnum & 0xffff);
+				gst_rtp_buffer_set_timestamp(placeholder.buffer, gst_rtp_buffer_get_timestamp(packet.buffer));
+				gst_rtp_buffer_set_payload_type(placeholder.buffer, capture->media_payload_type);
+				g_array_append_val(input, placeholder);
+			}
+		}
+
+		first = FALSE;
+		next_ext_seqnum = ext_seqnum + 1;
+		g_array_append_val(input, packet);
+	}
+
+	return input;
+}
+
+
+static void fecreplay_free_encoder_input(GArray *input)
+{
+	guint i;
+
+	for (i = 0; i < input->len; ++i)
+	{
+		fecreplay_packet *packet = &g_array_index(input, fecreplay_packet, i);
+		if (packet->type == FECREPLAY_PLACEHOLDER)
+			gst_buffer_unref(packet->buffer);
+	}
+
+	g_array_free(input, TRUE);
+}
+
+
+/* Runs the encoder over the input, and fills the decoder input with the media packets and generated FEC packets */
+static void fecreplay_encode(fec_enc *enc, GArray *enc_input, GArray *dec_input, fecreplay_result *result)
+{
+	GstClockTime start_time;
+	guint i;
+
+	start_time = gst_util_get_timestamp();
+
+	for (i = 0; i < enc_input->len; ++i)
+	{
+		fecreplay_packet packet = g_array_index(enc_input, fecreplay_packet, i);
+		GstBuffer *fec_packet;
+
+		if (packet.type != FECREPLAY_LATE_MEDIA)
+		{
+			fec_enc_push_media_packet(enc, packet.buffer);
+			++result->num_enc_packets;
+		}
+
+		if (packet.type != FECREPLAY_PLACEHOLDER)
+		{
+			packet.type = FECREPLAY_MEDIA;
+			g_array_append_val(dec_input, packet);
+		}
+
+		while ((fec_packet = fec_enc_pop_fec_packet(enc)) != NULL)
+		{
+			packet.buffer = fec_packet;
+			packet.type = FECREPLAY_FEC;
+			g_array_append_val(dec_input, packet);
+			++result->num_generated_fec_packets;
+		}
+	}
+
+	result->enc_duration += gst_util_get_timestamp() - start_time;
+}
+
+
+static void fecreplay_decode(fec_dec *dec, GArray *dec_input, fecreplay_result *result)
+{
+	GstClockTime start_time;
+	GstBuffer *recovered;
+	guint i;
+
+	start_time = gst_util_get_timestamp();
+
+	for (i = 0; i < dec_input->len; ++i)
+	{
+		fecreplay_packet *packet = &g_array_index(dec_input, fecreplay_packet, i);
+
+		if (packet->type == FECREPLAY_FEC)
+			fec_dec_push_fec_packet(dec, packet->buffer);
+		else
+			fec_dec_push_media_packet(dec, packet->buffer);
+
+		while ((recovered = fec_dec_pop_recovered_packet(dec)) != NULL)
+			gst_buffer_unref(recovered);
+	}
+
+	result->dec_duration += gst_util_get_timestamp() - start_time;
+	result->num_dec_packets += dec_input->len;
+}
+
+
+static void fecreplay_run(fecreplay_capture *capture, fecreplay_result *result)
+{
+	fec_enc *enc = NULL;
+	fec_dec *dec;
+	GArray *enc_input = NULL, *dec_input;
+	gint loop;
+	guint i;
+
+	memset(result, 0, sizeof(fecreplay_result));
+	fec_dec_stats_reset(&(result->dec_stats));
+
+	dec = fec_dec_create(num_media_packets, num_fec_packets, fec_tool_create_buffer, NULL);
+	fec_dec_set_use_symbol_arena(dec, use_symbol_arena);
+
+	if (encode)
+	{
+		enc = fec_enc_create(num_media_packets, num_fec_packets, (fec_pt >= 0) ? (guint)fec_pt : FECREPLAY_FEC_PAYLOAD_TYPE, 0, fec_tool_create_buffer, NULL);
+		enc_input = fecreplay_create_encoder_input(capture);
+		dec_input = g_array_new(FALSE, FALSE, sizeof(fecreplay_packet));
+	}
+	else
+		dec_input = capture->packets;
+
+	for (loop = 0; loop < num_loops; ++loop)
+	{
+		fec_dec_set_stats(dec, (loop == 0) ? &(result->dec_stats) : NULL);
+
+		if (encode)
+		{
+			fec_enc_reset(enc);
+			fecreplay_encode(enc, enc_input, dec_input, result);
+		}
+
+		fecreplay_decode(dec, dec_input, result);
+
+		/* Blocks still open at the end of the capture are not counted */
+		fec_dec_reset(dec);
+
+		if (encode)
+		{
+			for (i = 0; i < dec_input->len; ++i)
+			{
+				fecreplay_packet *packet = &g_array_index(dec_input, fecreplay_packet, i);
+				if (packet->type == FECREPLAY_FEC)
+					gst_buffer_unref(packet->buffer);
+			}
+			g_array_set_size(dec_input, 0);
+		}
+	}
+
+	for (i = 0; i < capture->packets->len; ++i)
+	{
+		fecreplay_packet *packet = &g_array_index(capture->packets, fecreplay_packet, i);
+		result->num_dec_bytes += GST_BUFFER_SIZE(packet->buffer);
+	}
+	result->num_dec_bytes *= num_loops;
+
+	fec_dec_destroy(dec);
+	if (encode)
+	{
+		g_array_free(dec_input, TRUE);
+		fecreplay_free_encoder_input(enc_input);
+		fec_enc_destroy(enc);
+	}
+}
+
+
+static gdouble fecreplay_per_second(gdouble const value, GstClockTime const duration)
+{
+	return (duration > 0) ? (value * GST_SECOND / duration) : 0.0;
+}
+
+
+static void fecreplay_print_result(fecreplay_capture *capture, fecreplay_result *result)
+{
+	fec_dec_stats *stats = &(result->dec_stats);
+	gdouble dec_mbps, dec_pps, enc_mbps, enc_pps;
+	guint64 residual_lost;
+
+	dec_mbps = fecreplay_per_second(result->num_dec_bytes, result->dec_duration) / 1000000.0;
+	dec_pps = fecreplay_per_second(result->num_dec_packets, result->dec_duration);
+	enc_mbps = fecreplay_per_second(((gdouble)(capture->media_bytes)) * num_loops, result->enc_duration) / 1000000.0;
+	enc_pps = fecreplay_per_second(result->num_enc_packets, result->enc_duration);
+	residual_lost = (stats->packets_recovered < capture->num_media_lost) ? (capture->num_media_lost - stats->packets_recovered) : 0;
+
+	if (g_strcmp0(output_format, "csv") == 0)
+	{
+		printf(
+			"k,n,ssrc,media_packets,fec_packets,skipped_packets,media_lost,loops,"
+			"dec_mb_per_s,dec_packets_per_s,enc_mb_per_s,enc_packets_per_s,generated_fec_packets,"
+			"blocks_complete,blocks_recovered,blocks_unrecoverable,packets_recovered,residual_lost,duplicates_dropped\n"
+		);
+		printf(
+			"%d,%d,0x%08x,%u,%u,%u,%u,%d,"
+			"%.3f,%.1f,%.3f,%.1f,%" G_GUINT64_FORMAT ","
+			"%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT "\n",
+			num_media_packets, num_fec_packets, capture->ssrc, capture->num_media_packets, capture->num_fec_packets, capture->num_skipped, capture->num_media_lost, num_loops,
+			dec_mbps, dec_pps, enc_mbps, enc_pps, result->num_generated_fec_packets / num_loops,
+			stats->blocks_complete, stats->blocks_recovered, stats->blocks_unrecoverable, stats->packets_recovered, residual_lost, stats->duplicates_dropped
+		);
+	}
+	else
+	{
+		printf(
+			"{\"k\": %d, \"n\": %d, \"ssrc\": %u, \"media_packets\": %u, \"fec_packets\": %u, \"skipped_packets\": %u, \"media_lost\": %u, \"loops\": %d, "
+			"\"dec\": {\"mb_per_s\": %.3f, \"packets_per_s\": %.1f}, "
+			"\"enc\": {\"mb_per_s\": %.3f, \"packets_per_s\": %.1f, \"generated_fec_packets\": %" G_GUINT64_FORMAT "}, "
+			"\"blocks_complete\": %" G_GUINT64_FORMAT ", \"blocks_recovered\": %" G_GUINT64_FORMAT ", \"blocks_unrecoverable\": %" G_GUINT64_FORMAT ", "
+			"\"packets_recovered\": %" G_GUINT64_FORMAT ", \"residual_lost\": %" G_GUINT64_FORMAT ", \"duplicates_dropped\": %" G_GUINT64_FORMAT "}\n",
+			num_media_packets, num_fec_packets, capture->ssrc, capture->num_media_packets, capture->num_fec_packets, capture->num_skipped, capture->num_media_lost, num_loops,
+			dec_mbps, dec_pps,
+			enc_mbps, enc_pps, result->num_generated_fec_packets / num_loops,
+			stats->blocks_complete, stats->blocks_recovered, stats->blocks_unrecoverable,
+			stats->packets_recovered, residual_lost, stats->duplicates_dropped
+		);
+	}
+
+	fflush(stdout);
+}
+
+
+int main(int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GMappedFile *mapped_file;
+	fecreplay_capture capture;
+	fecreplay_result result;
+	guint i;
+	int ret = 0;
+
+	context = g_option_context_new("FILE - replay a pcap or pcapng capture through the RTP FEC decoder");
+	g_option_context_add_main_entries(context, entries, NULL);
+	g_option_context_add_group(context, gst_init_get_option_group());
+	if (!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	/* Keep the one-time codec table setup out of the measurements */
+	if (fec_core_init() != FEC_CORE_OK)
+	{
+		fprintf(stderr, "Cannot initialize the FEC codec\n");
+		return 1;
+	}
+
+	if (argc != 2)
+	{
+		fprintf(stderr, "Expected exactly one capture file\n");
+		return 1;
+	}
+	if ((g_strcmp0(output_format, "csv") != 0) && (g_strcmp0(output_format, "json") != 0))
+	{
+		fprintf(stderr, "Unknown output format \"%s\"\n", output_format);
+		return 1;
+	}
+	/* RS over GF(2^8) supports up to 255 symbols per block; the FEC header mask limits k to 24 */
+	if ((num_media_packets < 1) || (num_media_packets > 24) || (num_fec_packets < 1) || ((num_media_packets + num_fec_packets) > 255))
+	{
+		fprintf(stderr, "Invalid block geometry k=%d n=%d\n", num_media_packets, num_fec_packets);
+		return 1;
+	}
+	if ((media_port < 0) || (media_port > 65535) || (fec_port < 0) || (fec_port > 65535) || (media_pt > 127) || (fec_pt > 127))
+	{
+		fprintf(stderr, "Invalid port or payload type\n");
+		return 1;
+	}
+	if (!encode && (fec_port == 0) && (fec_pt < 0))
+	{
+		fprintf(stderr, "The FEC flow must be selected with --fec-port or --fec-pt (or use --encode)\n");
+		return 1;
+	}
+	if (num_loops < 1)
+	{
+		fprintf(stderr, "The number of loops must be positive\n");
+		return 1;
+	}
+
+	memset(&capture, 0, sizeof(capture));
+	if (ssrc_string != NULL)
+	{
+		gchar *end;
+		capture.ssrc = (guint32)g_ascii_strtoull(ssrc_string, &end, 0);
+		if ((*ssrc_string == '\0') || (*end != '\0'))
+		{
+			fprintf(stderr, "Invalid SSRC \"%s\"\n", ssrc_string);
+			return 1;
+		}
+		capture.has_ssrc = TRUE;
+	}
+
+	mapped_file = g_mapped_file_new(argv[1], FALSE, &error);
+	if (mapped_file == NULL)
+	{
+		fprintf(stderr, "Could not map %s: %s\n", argv[1], error->message);
+		g_error_free(error);
+		return 1;
+	}
+
+	capture.packets = g_array_new(FALSE, FALSE, sizeof(fecreplay_packet));
+
+	if (!fecreplay_parse_capture(&capture, (guint8 const *)g_mapped_file_get_contents(mapped_file), g_mapped_file_get_length(mapped_file)))
+	{
+		ret = 1;
+		goto cleanup;
+	}
+
+	if (capture.num_media_packets == 0)
+	{
+		fprintf(stderr, "No media packets found in %s\n", argv[1]);
+		ret = 1;
+		goto cleanup;
+	}
+
+	fecreplay_count_losses(&capture);
+	fecreplay_run(&capture, &result);
+	fecreplay_print_result(&capture, &result);
+
+cleanup:
+	/* The buffers reference the mapped file, so they must be gone before it is unmapped */
+	for (i = 0; i < capture.packets->len; ++i)
+		gst_buffer_unref(g_array_index(capture.packets, fecreplay_packet, i).buffer);
+	g_array_free(capture.packets, TRUE);
+	g_mapped_file_unref(mapped_file);
+
+	return ret;
+}
@@ -0,0 +1,541 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+
+
+
+/*
+fecscalebench: scale benchmark for many concurrent rtpfecenc/rtpfecdec instances
+
+For each instance count N, builds one pipeline with N independent branches
+
+  appsrc ! rtpfecenc ! (rtpfecimpair) ! rtpfecdec ! fakesink
+           rtpfecenc.fec ! (rtpfecimpair.fec_sink) ... rtpfecdec.fec
+
+and pushes the same number of synthetic RTP packets into every branch, round-robin, as fast as the
+pipeline accepts them. There is no network involved. One line of CSV (or one JSON object) is
+printed per N with:
+
+- the time to create, add and link the elements, per instance
+- the time of the state change to PLAYING
+- the RSS growth per instance after creating the elements, after going to PLAYING, and after the
+  traffic (the latter includes the blocks and queues the elements keep)
+- the aggregate throughput over all branches, and the process CPU time per packet
+
+The branches include their appsrc and fakesink (and their streaming threads), so the RSS per instance
+is an upper bound for the FEC elements alone; running with --no-fec gives the baseline to subtract.
+Every N is measured in a forked child process, so memory freed by earlier runs does not hide the
+growth of later ones. With large N, the limits for threads and memory maps (ulimit -u,
+vm.max_map_count) may have to be raised, since every appsrc has its own streaming thread.
+
+Examples:
+
+  fecscalebench --plugin=./libgstrtpfec.so -N 1,10,100,1000,4000 --packets=2000
+  fecscalebench -N 100,1000 -k 20 -n 5 --loss=5 --format=json
+*/
+
+
+/* For fork() and waitpid() */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include "fectoolutil.h"
+
+
+#define SCALEBENCH_MEDIA_PAYLOAD_TYPE 96
+#define SCALEBENCH_SSRC 0x12345678
+#define SCALEBENCH_CAPS "application/x-rtp, media=(string)video, payload=(int)96, clock-rate=(int)90000, encoding-name=(string)H264"
+
+
+typedef struct
+{
+	guint num_instances;
+
+	GstClockTime create_time, start_time, run_time;
+	glong rss_base, rss_created, rss_playing, rss_traffic; /* in kB */
+	gdouble cpu_seconds;
+
+	guint64 packets_sent, packets_received;
+}
+scalebench_result;
+
+
+static gchar *plugin_path = NULL;
+static gchar *instances_list = "1,10,100,1000";
+static gint num_packets = 1000;
+static gint packet_size = 1316;
+static gint num_media_packets = 0;
+static gint num_fec_packets = 0;
+static gdouble loss_percentage = 0.0;
+static gboolean no_fec = FALSE;
+static gboolean no_fork = FALSE;
+static gchar **enc_props = NULL;
+static gchar **dec_props = NULL;
+static gchar *output_format = "csv";
+
+/* Packets received by all fakesinks; updated from their streaming threads */
+static volatile gint packets_received = 0;
+
+
+static GOptionEntry entries[] =
+{
+	{ "plugin", 0, 0, G_OPTION_ARG_FILENAME, &plugin_path, "Load the rtpfec plugin from this file", "FILE" },
+	{ "instances", 'N', 0, G_OPTION_ARG_STRING, &instances_list, "Comma-separated list of instance counts", "LIST" },
+	{ "packets", 'p', 0, G_OPTION_ARG_INT, &num_packets, "Number of packets pushed into every instance", "N" },
+	{ "packet-size", 's', 0, G_OPTION_ARG_INT, &packet_size, "Size of the packets in bytes, including the RTP header", "BYTES" },
+	{ "media-packets", 'k', 0, G_OPTION_ARG_INT, &num_media_packets, "Media packets per block (sets num-media-packets on both elements)", "N" },
+	{ "fec-packets", 'n', 0, G_OPTION_ARG_INT, &num_fec_packets, "FEC packets per block (sets num-fec-packets on both elements)", "N" },
+	{ "loss", 'l', 0, G_OPTION_ARG_DOUBLE, &loss_percentage, "Percentage of media packets dropped by an rtpfecimpair element in every instance", "PERCENT" },
+	{ "no-fec", 0, 0, G_OPTION_ARG_NONE, &no_fec, "Leave out the FEC elements, to measure the appsrc/fakesink baseline", NULL },
+	{ "no-fork", 0, 0, G_OPTION_ARG_NONE, &no_fork, "Measure all instance counts in this process", NULL },
+	{ "enc-prop", 0, 0, G_OPTION_ARG_STRING_ARRAY, &enc_props, "Set a property of rtpfecenc (may be given several times)", "NAME=VALUE" },
+	{ "dec-prop", 0, 0, G_OPTION_ARG_STRING_ARRAY, &dec_props, "Set a property of rtpfecdec (may be given several times)", "NAME=VALUE" },
+	{ "format", 'f', 0, G_OPTION_ARG_STRING, &output_format, "Output format: csv or json", "FORMAT" },
+	{ NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+};
+
+
+
+/* Returns the resident set size of the process in kB, or 0 if it is unknown */
+static glong scalebench_get_rss(void)
+{
+	FILE *file;
+	long size, resident;
+	glong rss = 0;
+
+	file = fopen("/proc/self/statm", "r");
+	if (file == NULL)
+		return 0;
+
+	if (fscanf(file, "%ld %ld", &size, &resident) == 2)
+		rss = resident * (sysconf(_SC_PAGESIZE) / 1024);
+
+	fclose(file);
+	return rss;
+}
+
+
+static gdouble scalebench_get_cpu_seconds(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+
+static void scalebench_handoff(GstElement *fakesink, GstBuffer *buffer, GstPad *pad, gpointer user_data)
+{
+	fakesink = fakesink;
+	buffer = buffer;
+	pad = pad;
+	user_data = user_data;
+
+	g_atomic_int_inc(&packets_received);
+}
+
+
+static GstBuffer* scalebench_create_packet(guint const index)
+{
+	GstBuffer *packet;
+	guint8 *payload;
+	guint payload_size, i;
+
+	payload_size = packet_size - 12;
+	packet = gst_rtp_buffer_new_allocate(payload_size, 0, 0);
+	gst_rtp_buffer_set_ssrc(packet, SCALEBENCH_SSRC);
+	gst_rtp_buffer_set_seq(packet, index & 0xffff);
+	gst_rtp_buffer_set_timestamp(packet, index * 90);
+	gst_rtp_buffer_set_payload_type(packet, SCALEBENCH_MEDIA_PAYLOAD_TYPE);
+
+	payload = gst_rtp_buffer_get_payload(packet);
+	for (i = 0; i < payload_size; ++i)
+		payload[i] = (index + i) & 0xff;
+
+	return packet;
+}
+
+
+/* Creates one branch, adds it to the pipeline, and returns its appsrc; returns NULL on error */
+static GstElement* scalebench_add_instance(GstElement *pipeline, GstCaps *caps, guint const index)
+{
+	GstElement *appsrc, *enc = NULL, *impair = NULL, *dec = NULL, *fakesink;
+	gchar name[32];
+	gboolean linked;
+
+#define SCALEBENCH_MAKE(element, factory, prefix) \
+	do \
+	{ \
+		g_snprintf(name, sizeof(name), prefix "%u", index); \
+		element = gst_element_factory_make(factory, name); \
+		if (element == NULL) \
+		{ \
+			fprintf(stderr, "Cannot create %s; is the rtpfec plugin in GST_PLUGIN_PATH (or given with --plugin)?\n", factory); \
+			return NULL; \
+		} \
+		gst_bin_add(GST_BIN(pipeline), element); \
+	} \
+	while (0)
+
+	SCALEBENCH_MAKE(appsrc, "appsrc", "src");
+	SCALEBENCH_MAKE(fakesink, "fakesink", "sink");
+
+	/* block keeps the queues small, since the packets are pushed as fast as possible */
+	g_object_set(G_OBJECT(appsrc), "caps", caps, "format", GST_FORMAT_TIME, "block", TRUE, "max-bytes", (guint64)(64 * 1024), NULL);
+	g_object_set(G_OBJECT(fakesink), "sync", FALSE, "signal-handoffs", TRUE, NULL);
+	g_signal_connect(fakesink, "handoff", G_CALLBACK(scalebench_handoff), NULL);
+
+	if (no_fec)
+		return gst_element_link(appsrc, fakesink) ? appsrc : NULL;
+
+	SCALEBENCH_MAKE(enc, "rtpfecenc", "enc");
+	SCALEBENCH_MAKE(dec, "rtpfecdec", "dec");
+	if (loss_percentage > 0.0)
+		SCALEBENCH_MAKE(impair, "rtpfecimpair", "impair");
+
+#undef SCALEBENCH_MAKE
+
+	if (num_media_packets > 0)
+	{
+		g_object_set(G_OBJECT(enc), "num-media-packets", (guint)num_media_packets, NULL);
+		g_object_set(G_OBJECT(dec), "num-media-packets", (guint)num_media_packets, NULL);
+	}
+	if (num_fec_packets > 0)
+	{
+		g_object_set(G_OBJECT(enc), "num-fec-packets", (guint)num_fec_packets, NULL);
+		g_object_set(G_OBJECT(dec), "num-fec-packets", (guint)num_fec_packets, NULL);
+	}
+	if (!fec_tool_set_properties(enc, enc_props) || !fec_tool_set_properties(dec, dec_props))
+		return NULL;
+
+	if (impair != NULL)
+	{
+		/* Every instance gets its own loss pattern */
+		gst_util_set_object_arg(G_OBJECT(impair), "media-loss-model", "bernoulli");
+		g_object_set(G_OBJECT(impair), "media-loss-probability", loss_percentage / 100.0, "seed", index * 2, NULL);
+
+		linked = gst_element_link_pads(enc, "src", impair, "sink") && gst_element_link_pads(enc, "fec", impair, "fec_sink")
+		      && gst_element_link_pads(impair, "src", dec, "sink") && gst_element_link_pads(impair, "fec_src", dec, "fec");
+	}
+	else
+		linked = gst_element_link_pads(enc, "src", dec, "sink") && gst_element_link_pads(enc, "fec", dec, "fec");
+
+	if (!linked || !gst_element_link(appsrc, enc) || !gst_element_link_pads(dec, "src", fakesink, "sink"))
+	{
+		fprintf(stderr, "Cannot link instance %u\n", index);
+		return NULL;
+	}
+
+	return appsrc;
+}
+
+
+static gboolean scalebench_wait(GstBus *bus, GstMessageType const type)
+{
+	GstMessage *msg;
+	gboolean ret = TRUE;
+
+	msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, type | GST_MESSAGE_ERROR);
+	if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+	{
+		GError *error;
+		gchar *debug;
+		gst_message_parse_error(msg, &error, &debug);
+		fprintf(stderr, "Error from %s: %s\n%s\n", GST_OBJECT_NAME(GST_MESSAGE_SRC(msg)), error->message, (debug != NULL) ? debug : "");
+		g_error_free(error);
+		g_free(debug);
+		ret = FALSE;
+	}
+	gst_message_unref(msg);
+
+	return ret;
+}
+
+
+static gboolean scalebench_run(guint const num_instances, GstBuffer **packets, scalebench_result *result)
+{
+	GstElement *pipeline;
+	GstElement **appsrcs;
+	GstCaps *caps;
+	GstBus *bus;
+	GstClockTime start_time;
+	gdouble start_cpu_seconds;
+	GstFlowReturn flow_ret;
+	guint i, j;
+	gboolean ret = FALSE;
+
+	memset(result, 0, sizeof(scalebench_result));
+	result->num_instances = num_instances;
+	g_atomic_int_set(&packets_received, 0);
+
+	appsrcs = g_new0(GstElement*, num_instances);
+	caps = gst_caps_from_string(SCALEBENCH_CAPS);
+
+	result->rss_base = scalebench_get_rss();
+
+	/* Instantiation */
+
+	start_time = gst_util_get_timestamp();
+	pipeline = gst_pipeline_new("pipeline");
+	for (i = 0; i < num_instances; ++i)
+	{
+		appsrcs[i] = scalebench_add_instance(pipeline, caps, i);
+		if (appsrcs[i] == NULL)
+			goto cleanup;
+	}
+	result->create_time = gst_util_get_timestamp() - start_time;
+	result->rss_created = scalebench_get_rss();
+
+	/* Startup */
+
+	bus = gst_element_get_bus(pipeline);
+	start_time = gst_util_get_timestamp();
+	if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+	{
+		fprintf(stderr, "Cannot start the pipeline with %u instances\n", num_instances);
+		gst_object_unref(bus);
+		goto cleanup;
+	}
+	gst_element_get_state(pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+	result->start_time = gst_util_get_timestamp() - start_time;
+	result->rss_playing = scalebench_get_rss();
+
+	/* Traffic; the packets are shared by all instances, since they only read them */
+
+	start_cpu_seconds = scalebench_get_cpu_seconds();
+	start_time = gst_util_get_timestamp();
+	for (j = 0; j < (guint)num_packets; ++j)
+	{
+		for (i = 0; i < num_instances; ++i)
+		{
+			/* The push-buffer action signal does not take ownership of the buffer */
+			g_signal_emit_by_name(appsrcs[i], "push-buffer", packets[j], &flow_ret);
+			if (flow_ret != GST_FLOW_OK)
+			{
+				fprintf(stderr, "Pushing packet %u into instance %u failed: %s\n", j, i, gst_flow_get_name(flow_ret));
+				break;
+			}
+			++result->packets_sent;
+		}
+
+		if (flow_ret != GST_FLOW_OK)
+			break;
+	}
+	for (i = 0; i < num_instances; ++i)
+		g_signal_emit_by_name(appsrcs[i], "end-of-stream", &flow_ret);
+
+	ret = scalebench_wait(bus, GST_MESSAGE_EOS);
+	result->run_time = gst_util_get_timestamp() - start_time;
+	result->cpu_seconds = scalebench_get_cpu_seconds() - start_cpu_seconds;
+	result->rss_traffic = scalebench_get_rss();
+	result->packets_received = g_atomic_int_get(&packets_received);
+
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(bus);
+
+cleanup:
+	/* The elements belong to the pipeline */
+	gst_object_unref(pipeline);
+	gst_caps_unref(caps);
+	g_free(appsrcs);
+
+	return ret;
+}
+
+
+static void scalebench_print_header(void)
+{
+	if (g_strcmp0(output_format, "csv") != 0)
+		return;
+
+	printf(
+		"instances,create_us_per_instance,start_ms,"
+		"rss_base_kb,rss_created_kb_per_instance,rss_playing_kb_per_instance,rss_traffic_kb_per_instance,"
+		"packets_sent,packets_received,seconds,packets_per_s,mb_per_s,cpu_us_per_packet\n"
+	);
+	fflush(stdout);
+}
+
+
+static void scalebench_print_result(scalebench_result *result)
+{
+	gdouble n = result->num_instances;
+	gdouble seconds = ((gdouble)(result->run_time)) / GST_SECOND;
+	gdouble packets_per_second = (seconds > 0.0) ? (result->packets_sent / seconds) : 0.0;
+	gdouble megabytes_per_second = packets_per_second * packet_size / 1000000.0;
+	gdouble cpu_per_packet = (result->packets_sent > 0) ? (result->cpu_seconds * 1000000.0 / result->packets_sent) : 0.0;
+	gdouble create_per_instance = ((gdouble)(result->create_time)) / GST_USECOND / n;
+	gdouble start_ms = ((gdouble)(result->start_time)) / GST_MSECOND;
+	gdouble rss_created = (result->rss_created - result->rss_base) / n;
+	gdouble rss_playing = (result->rss_playing - result->rss_base) / n;
+	gdouble rss_traffic = (result->rss_traffic - result->rss_base) / n;
+
+	if (g_strcmp0(output_format, "csv") == 0)
+	{
+		printf(
+			"%u,%.3f,%.3f,"
+			"%ld,%.2f,%.2f,%.2f,"
+			"%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%.6f,%.1f,%.3f,%.3f\n",
+			result->num_instances, create_per_instance, start_ms,
+			result->rss_base, rss_created, rss_playing, rss_traffic,
+			result->packets_sent, result->packets_received, seconds, packets_per_second, megabytes_per_second, cpu_per_packet
+		);
+	}
+	else
+	{
+		printf(
+			"{\"instances\": %u, \"create_us_per_instance\": %.3f, \"start_ms\": %.3f, "
+			"\"rss_base_kb\": %ld, \"rss_kb_per_instance\": {\"created\": %.2f, \"playing\": %.2f, \"traffic\": %.2f}, "
+			"\"packets_sent\": %" G_GUINT64_FORMAT ", \"packets_received\": %" G_GUINT64_FORMAT ", \"seconds\": %.6f, "
+			"\"packets_per_s\": %.1f, \"mb_per_s\": %.3f, \"cpu_us_per_packet\": %.3f}\n",
+			result->num_instances, create_per_instance, start_ms,
+			result->rss_base, rss_created, rss_playing, rss_traffic,
+			result->packets_sent, result->packets_received, seconds,
+			packets_per_second, megabytes_per_second, cpu_per_packet
+		);
+	}
+
+	fflush(stdout);
+}
+
+
+static gboolean scalebench_measure(guint const num_instances, GstBuffer **packets)
+{
+	scalebench_result result;
+	pid_t pid;
+	int status;
+
+	if (no_fork)
+	{
+		if (!scalebench_run(num_instances, packets, &result))
+			return FALSE;
+		scalebench_print_result(&result);
+		return TRUE;
+	}
+
+	/* Nothing but the main thread runs at this point, so the child can safely use GLib and GStreamer */
+	pid = fork();
+	if (pid < 0)
+	{
+		perror("fork");
+		return FALSE;
+	}
+	else if (pid == 0)
+	{
+		if (!scalebench_run(num_instances, packets, &result))
+			_exit(1);
+		scalebench_print_result(&result);
+		_exit(0);
+	}
+
+	if ((waitpid(pid, &status, 0) < 0) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+	{
+		fprintf(stderr, "Measurement with %u instances failed\n", num_instances);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+int main(int argc, char *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GArray *instances;
+	GstBuffer **packets;
+	guint i;
+	int ret = 0;
+
+	context = g_option_context_new("- scale benchmark for many rtpfecenc/rtpfecdec instances");
+	g_option_context_add_main_entries(context, entries, NULL);
+	g_option_context_add_group(context, gst_init_get_option_group());
+	if (!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	if ((g_strcmp0(output_format, "csv") != 0) && (g_strcmp0(output_format, "json") != 0))
+	{
+		fprintf(stderr, "Unknown output format \"%s\"\n", output_format);
+		return 1;
+	}
+	if ((num_packets <= 0) || (packet_size <= 12) || (packet_size > 65535) || (loss_percentage < 0.0) || (loss_percentage > 100.0))
+	{
+		fprintf(stderr, "Invalid number of packets, packet size or loss\n");
+		return 1;
+	}
+
+	instances = fec_tool_parse_list("instances", instances_list, 1, 1000000);
+	if (instances == NULL)
+		return 1;
+
+	if (plugin_path != NULL)
+	{
+		GstPlugin *plugin = gst_plugin_load_file(plugin_path, &error);
+		if (plugin == NULL)
+		{
+			fprintf(stderr, "Cannot load plugin %s: %s\n", plugin_path, error->message);
+			g_error_free(error);
+			g_array_free(instances, TRUE);
+			return 1;
+		}
+		gst_object_unref(plugin);
+	}
+
+	packets = g_new(GstBuffer*, num_packets);
+	for (i = 0; i < (guint)num_packets; ++i)
+		packets[i] = scalebench_create_packet(i);
+
+	scalebench_print_header();
+
+	for (i = 0; i < instances->len; ++i)
+	{
+		if (!scalebench_measure(g_array_index(instances, guint, i), packets))
+		{
+			ret = 1;
+			break;
+		}
+	}
+
+	for (i = 0; i < (guint)num_packets; ++i)
+		gst_buffer_unref(packets[i]);
+	g_free(packets);
+	g_array_free(instances, TRUE);
+
+	return ret;
+}
@@ -0,0 +1,144 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "fectoolutil.h"
+
+
+
+void fec_tool_timings_init(fec_tool_timings *timings, guint const capacity)
+{
+	timings->durations = malloc(sizeof(GstClockTime) * MAX(capacity, 1));
+	timings->num_durations = 0;
+	timings->capacity = capacity;
+	timings->total_duration = 0;
+	timings->sorted = TRUE;
+}
+
+
+void fec_tool_timings_free(fec_tool_timings *timings)
+{
+	free(timings->durations);
+	timings->durations = NULL;
+	timings->num_durations = 0;
+	timings->capacity = 0;
+}
+
+
+void fec_tool_timings_add(fec_tool_timings *timings, GstClockTime const duration)
+{
+	timings->total_duration += duration;
+	if (timings->num_durations < timings->capacity)
+	{
+		timings->durations[timings->num_durations++] = duration;
+		timings->sorted = FALSE;
+	}
+}
+
+
+static int fec_tool_compare_durations(void const *a, void const *b)
+{
+	GstClockTime da = *((GstClockTime const *)a), db = *((GstClockTime const *)b);
+	return (da < db) ? -1 : ((da > db) ? 1 : 0);
+}
+
+
+GstClockTime fec_tool_timings_get_percentile(fec_tool_timings *timings, guint const percentile)
+{
+	if (timings->num_durations == 0)
+		return 0;
+
+	if (!timings->sorted)
+	{
+		qsort(timings->durations, timings->num_durations, sizeof(GstClockTime), fec_tool_compare_durations);
+		timings->sorted = TRUE;
+	}
+
+	return timings->durations[((guint64)(timings->num_durations - 1)) * MIN(percentile, 100) / 100];
+}
+
+
+GArray* fec_tool_parse_list(gchar const *name, gchar const *list, guint const min_value, guint const max_value)
+{
+	GArray *values;
+	gchar **tokens;
+	guint i;
+
+	values = g_array_new(FALSE, FALSE, sizeof(guint));
+	tokens = g_strsplit(list, ",", 0);
+
+	for (i = 0; tokens[i] != NULL; ++i)
+	{
+		gchar *end;
+		guint64 value;
+		guint v;
+
+		value = g_ascii_strtoull(tokens[i], &end, 10);
+		if ((end == tokens[i]) || (*end != '\0') || (value < min_value) || (value > max_value))
+		{
+			fprintf(stderr, "Invalid %s value \"%s\" (must be in range %u-%u)\n", name, tokens[i], min_value, max_value);
+			g_strfreev(tokens);
+			g_array_free(values, TRUE);
+			return NULL;
+		}
+
+		v = value;
+		g_array_append_val(values, v);
+	}
+
+	g_strfreev(tokens);
+	return values;
+}
+
+
+gboolean fec_tool_set_properties(GstElement *element, gchar **props)
+{
+	guint i;
+
+	if (props == NULL)
+		return TRUE;
+
+	for (i = 0; props[i] != NULL; ++i)
+	{
+		gchar **name_value = g_strsplit(props[i], "=", 2);
+		if ((name_value[0] == NULL) || (name_value[1] == NULL) || !gst_util_set_object_arg(G_OBJECT(element), name_value[0], name_value[1]))
+		{
+			fprintf(stderr, "Cannot set property \"%s\" on %s\n", props[i], GST_ELEMENT_NAME(element));
+			g_strfreev(name_value);
+			return FALSE;
+		}
+		g_strfreev(name_value);
+	}
+
+	return TRUE;
+}
+
+
+GstBuffer* fec_tool_create_buffer(guint const size_in_bytes, void *data)
+{
+	data = data; /* shut up compiler warning about unused arguments */
+	return gst_buffer_new_and_alloc(size_in_bytes);
+}
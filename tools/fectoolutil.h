@@ -0,0 +1,68 @@
+/*
+ *  RTP forward error correction encoding plugin for GStreamer
+ *
+ *  Copyright (C) 2012 Carlos Rafael Giani <dv@pseudoterminal.org>
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+
+
+
+
+#ifndef FECTOOLUTIL_H
+#define FECTOOLUTIL_H
+
+
+#include <gst/gst.h>
+
+
+/* Helpers shared by the benchmark tools */
+
+
+/* A set of measured durations, for percentiles; the capacity is fixed at init time */
+typedef struct
+{
+	GstClockTime *durations;
+	guint num_durations, capacity;
+	GstClockTime total_duration;
+	gboolean sorted;
+}
+fec_tool_timings;
+
+
+void fec_tool_timings_init(fec_tool_timings *timings, guint const capacity);
+void fec_tool_timings_free(fec_tool_timings *timings);
+/* Durations beyond the capacity are not stored, but still count towards the total duration */
+void fec_tool_timings_add(fec_tool_timings *timings, GstClockTime const duration);
+/* Percentile in [0, 100]; returns 0 if there are no durations */
+GstClockTime fec_tool_timings_get_percentile(fec_tool_timings *timings, guint const percentile);
+
+/*
+Parses a comma-separated list of unsigned integers in [min_value, max_value] into a GArray of guint;
+prints an error and returns NULL if the list is invalid
+*/
+GArray* fec_tool_parse_list(gchar const *name, gchar const *list, guint const min_value, guint const max_value);
+
+/* Sets properties given as NAME=VALUE strings (a NULL-terminated array, or NULL); prints an error and returns FALSE if one cannot be set */
+gboolean fec_tool_set_properties(GstElement *element, gchar **props);
+
+/* Allocates buffers with gst_buffer_new_and_alloc(); usable as create_buffer function for fec_enc and fec_dec */
+GstBuffer* fec_tool_create_buffer(guint const size_in_bytes, void *data);
+
+
+#endif
+